@@ -59,7 +59,7 @@ class CExampleTest(BrokerTestCase):
             try:
                 return self.proc(args).wait_out()
             except ProcError, e:
-                if "connection refused" in e.args[0] and max > 0:
+                if "connection refused" in e.args[0].lower() and max > 0:
                     max -= 1
                     continue
                 raise
@@ -130,6 +130,17 @@ class decoder : public internal::data {
     template <class T> static sequence_ref<T> sequence(T& x) { return sequence_ref<T>(x); }
     template <class T> static associative_ref<T> associative(T& x) { return associative_ref<T>(x); }
     template <class T> static pair_sequence_ref<T> pair_sequence(T& x) { return pair_sequence_ref<T>(x); }
+
+    template <class T> struct packed_array_ref { T& ref; packed_array_ref(T& r) : ref(r) {} };
+    template <class T> static packed_array_ref<T> packed_array(T& x) { return packed_array_ref<T>(x); }
+
+    /// If the next value is an undescribed ARRAY of element, set count
+    /// to its size and return true. Does not move the decoder.
+    PN_CPP_EXTERN bool peek_array_elements(type_id element, size_t& count);
+
+    /// Copy the elements of the ARRAY checked by peek_array_elements
+    /// in host byte order and move past it.
+    PN_CPP_EXTERN decoder& get_array_elements(void* elements, size_t count);
     /// @endcond
 
     /// Extract any AMQP sequence (ARRAY, LIST or MAP) to a C++
@@ -145,6 +156,18 @@ class decoder : public internal::data {
         return *this;
     }
 
+    /// Extract an ARRAY of the exact element type to a contiguous
+    /// container of internal::is_packable values in one copy, and
+    /// anything else like sequence().
+    template <class T> decoder& operator>>(packed_array_ref<T> r)  {
+        typedef typename T::value_type value_type;
+        size_t count;
+        if (!peek_array_elements(internal::type_id_of<value_type>::value, count))
+            return *this >> sequence(r.ref);
+        r.ref.resize(count);
+        return get_array_elements(count ? &r.ref[0] : 0, count);
+    }
+
     /// Extract an AMQP MAP to a C++ associative container
     template <class T> decoder& operator>>(associative_ref<T> r)  {
         using namespace internal;
@@ -0,0 +1,491 @@
+#ifndef PROTON_CODEC_DESCRIBED_LIST_HPP
+#define PROTON_CODEC_DESCRIBED_LIST_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "../binary.hpp"
+#include "../decimal.hpp"
+#include "../error.hpp"
+#include "../message.hpp"
+#include "../symbol.hpp"
+#include "../timestamp.hpp"
+#include "../uuid.hpp"
+#include "../internal/export.hpp"
+#include "../internal/type_traits.hpp"
+
+#include <proton/type_compat.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace proton {
+class value;
+
+namespace codec {
+
+/// **Experimental** - The descriptor of an AMQP described list, either
+/// a ulong code or a symbol.
+struct list_descriptor {
+    /// A ulong descriptor.
+    list_descriptor(uint64_t code) : code(code), symbol(0) {}
+
+    /// A symbolic descriptor.
+    list_descriptor(const char* symbol) : code(0), symbol(symbol) {}
+
+    /// @cond INTERNAL
+    uint64_t code;
+    const char* symbol;
+    /// @endcond
+};
+
+/// **Experimental** - Traits that describe a struct as an AMQP
+/// described list.
+///
+/// Specialize it for T to give the descriptor and the members of T in
+/// list order. The encoder and decoder for T are generated at compile
+/// time from the member types and read and write AMQP bytes directly,
+/// without building a proton::value.
+///
+///     struct point { int32_t x, y; std::string label; };
+///
+///     namespace proton { namespace codec {
+///     template <> struct described_list<point> {
+///         static list_descriptor descriptor() { return uint64_t(0x1234); }
+///         template <class F> static void fields(F& f) {
+///             f(&point::x)(&point::y)(&point::label);
+///         }
+///     };
+///     }}
+///
+/// or at global scope, with the same result:
+///
+///     PN_CPP_DESCRIBED_LIST(point, uint64_t(0x1234), (&point::x)(&point::y)(&point::label))
+///
+/// Members can be bool, any integer type, wchar_t, float, double,
+/// proton::timestamp, the decimal types, proton::uuid, std::string,
+/// proton::symbol, proton::binary, std::vector of fixed width numbers
+/// (encoded as an AMQP array), proton::value, or another struct with a
+/// described_list specialization.
+///
+/// When decoding, null or missing trailing fields leave the member
+/// unchanged and extra fields are skipped, so a schema can grow at the
+/// end of the list.
+template <class T> struct described_list;
+
+} // codec
+
+namespace internal {
+
+/// @cond INTERNAL
+
+// Full width AMQP type codes of the fixed width types.
+template <class T> struct fixed_code;
+template<> struct fixed_code<uint8_t> { static const uint8_t value = 0x50; };
+template<> struct fixed_code<int8_t> { static const uint8_t value = 0x51; };
+template<> struct fixed_code<uint16_t> { static const uint8_t value = 0x60; };
+template<> struct fixed_code<int16_t> { static const uint8_t value = 0x61; };
+template<> struct fixed_code<uint32_t> { static const uint8_t value = 0x70; };
+template<> struct fixed_code<int32_t> { static const uint8_t value = 0x71; };
+template<> struct fixed_code<uint64_t> { static const uint8_t value = 0x80; };
+template<> struct fixed_code<int64_t> { static const uint8_t value = 0x81; };
+template<> struct fixed_code<float> { static const uint8_t value = 0x72; };
+template<> struct fixed_code<double> { static const uint8_t value = 0x82; };
+
+// Writes described lists as AMQP bytes, using the same encodings as
+// the proton::value encoder.
+class described_writer {
+  public:
+    explicit described_writer(std::string& out) : out_(out) {}
+
+    void put(bool x) { code(x ? 0x41 : 0x42); }
+    void put(uint8_t x) { code(0x50); fixed(x); }
+    void put(int8_t x) { code(0x51); fixed(x); }
+    void put(uint16_t x) { code(0x60); fixed(x); }
+    void put(int16_t x) { code(0x61); fixed(x); }
+    void put(wchar_t x) { code(0x73); fixed(uint32_t(x)); }
+    void put(float x) { code(0x72); fixed(x); }
+    void put(double x) { code(0x82); fixed(x); }
+    void put(timestamp x) { code(0x83); fixed(int64_t(x.milliseconds())); }
+
+    void put(uint32_t x) {
+        if (x < 256) { code(0x52); fixed(uint8_t(x)); }
+        else { code(0x70); fixed(x); }
+    }
+
+    void put(int32_t x) {
+        if (x >= -128 && x <= 127) { code(0x54); fixed(int8_t(x)); }
+        else { code(0x71); fixed(x); }
+    }
+
+    void put(uint64_t x) {
+        if (x < 256) { code(0x53); fixed(uint8_t(x)); }
+        else { code(0x80); fixed(x); }
+    }
+
+    void put(int64_t x) {
+        if (x >= -128 && x <= 127) { code(0x55); fixed(int8_t(x)); }
+        else { code(0x81); fixed(x); }
+    }
+
+    void put(const decimal32& x) { code(0x74); fixed(as<uint32_t>(x.begin())); }
+    void put(const decimal64& x) { code(0x84); fixed(as<uint64_t>(x.begin())); }
+    void put(const decimal128& x) { code(0x94); raw(x.begin(), x.size()); }
+    void put(const uuid& x) { code(0x98); raw(x.begin(), x.size()); }
+
+    void put(const std::string& x) { variable(0xa1, 0xb1, x.data(), x.size()); }
+    void put(const symbol& x) { variable(0xa3, 0xb3, x.data(), x.size()); }
+    void put(const binary& x) { variable(0xa0, 0xb0, x.empty() ? 0 : &x[0], x.size()); }
+
+    PN_CPP_EXTERN void put(const value& x);
+
+    template <class T> typename enable_if<is_unknown_integer<T>::value>::type put(T x) {
+        put(static_cast<typename known_integer<T>::type>(x));
+    }
+
+    // Fixed width numbers as an ARRAY32
+    template <class T, class A>
+    typename enable_if<is_packable<T>::value>::type put(const std::vector<T, A>& x) {
+        code(0xf0);
+        size_t start = begin_compound();
+        code(fixed_code<T>::value);
+        for (typename std::vector<T, A>::const_iterator i = x.begin(); i != x.end(); ++i)
+            fixed(*i);
+        end_compound(start, x.size());
+    }
+
+    // Any other type must be a described list
+    template <class T> typename enable_if<!is_unknown_integer<T>::value>::type put(const T& x) {
+        code(0x00);
+        codec::list_descriptor d = codec::described_list<T>::descriptor();
+        if (d.symbol) variable(0xa3, 0xb3, d.symbol, std::strlen(d.symbol));
+        else put(d.code);
+        code(0xd0);
+        size_t start = begin_compound();
+        field_writer<T> f(*this, x);
+        codec::described_list<T>::fields(f);
+        end_compound(start, f.count);
+    }
+
+  private:
+    template <class T> struct field_writer {
+        field_writer(described_writer& w, const T& x) : writer(w), object(x), count(0) {}
+
+        template <class M, class C> field_writer& operator()(M C::* member) {
+            writer.put(object.*member);
+            ++count;
+            return *this;
+        }
+
+        described_writer& writer;
+        const T& object;
+        size_t count;
+    };
+
+    template <class U> static U as(const void* p) { U u; std::memcpy(&u, p, sizeof(U)); return u; }
+
+    void code(uint8_t c) { out_ += char(c); }
+
+    // Big endian bytes of a fixed width value
+    template <class T> void fixed(T x) {
+        typedef typename integer_type<sizeof(T), false>::type U;
+        U u = as<U>(&x);
+        for (size_t i = sizeof(T); i > 0; --i)
+            out_ += char(uint8_t(u >> (8 * (i - 1))));
+    }
+
+    void raw(const void* p, size_t n) { out_.append(static_cast<const char*>(p), n); }
+
+    void variable(uint8_t small, uint8_t large, const void* p, size_t n) {
+        if (n < 256) { code(small); fixed(uint8_t(n)); }
+        else { code(large); fixed(uint32_t(n)); }
+        raw(p, n);
+    }
+
+    // Reserve the 32 bit size and count, filled in by end_compound
+    size_t begin_compound() { size_t start = out_.size(); out_.append(8, '\0'); return start; }
+
+    void end_compound(size_t start, size_t count) {
+        backfill(start, uint32_t(out_.size() - start - 4));
+        backfill(start + 4, uint32_t(count));
+    }
+
+    void backfill(size_t at, uint32_t x) {
+        for (size_t i = 0; i < 4; ++i)
+            out_[at + i] = char(uint8_t(x >> (8 * (3 - i))));
+    }
+
+    std::string& out_;
+};
+
+// Reads described lists from AMQP bytes. Accepts the compact encodings
+// other AMQP implementations may use as well as those written by
+// described_writer.
+class described_reader {
+  public:
+    described_reader(const char* bytes, size_t size) : pos_(bytes), end_(bytes + size) {}
+
+    const char* position() const { return pos_; }
+
+    PN_CPP_EXTERN void get(value& x);
+
+    template <class T> void get(T& x) { get(code(), x); }
+
+    void get(uint8_t c, bool& x) {
+        if (c == 0x41) x = true;
+        else if (c == 0x42) x = false;
+        else { expect(c, 0x56); x = fixed<uint8_t>() != 0; }
+    }
+
+    void get(uint8_t c, uint8_t& x) { expect(c, 0x50); x = fixed<uint8_t>(); }
+    void get(uint8_t c, int8_t& x) { expect(c, 0x51); x = fixed<int8_t>(); }
+    void get(uint8_t c, uint16_t& x) { expect(c, 0x60); x = fixed<uint16_t>(); }
+    void get(uint8_t c, int16_t& x) { expect(c, 0x61); x = fixed<int16_t>(); }
+    void get(uint8_t c, wchar_t& x) { expect(c, 0x73); x = wchar_t(fixed<uint32_t>()); }
+    void get(uint8_t c, float& x) { expect(c, 0x72); x = fixed<float>(); }
+    void get(uint8_t c, double& x) { expect(c, 0x82); x = fixed<double>(); }
+    void get(uint8_t c, timestamp& x) { expect(c, 0x83); x = timestamp(fixed<int64_t>()); }
+
+    void get(uint8_t c, uint32_t& x) {
+        if (c == 0x43) x = 0;
+        else if (c == 0x52) x = fixed<uint8_t>();
+        else { expect(c, 0x70); x = fixed<uint32_t>(); }
+    }
+
+    void get(uint8_t c, int32_t& x) {
+        if (c == 0x54) x = fixed<int8_t>();
+        else { expect(c, 0x71); x = fixed<int32_t>(); }
+    }
+
+    void get(uint8_t c, uint64_t& x) {
+        if (c == 0x44) x = 0;
+        else if (c == 0x53) x = fixed<uint8_t>();
+        else { expect(c, 0x80); x = fixed<uint64_t>(); }
+    }
+
+    void get(uint8_t c, int64_t& x) {
+        if (c == 0x55) x = fixed<int8_t>();
+        else { expect(c, 0x81); x = fixed<int64_t>(); }
+    }
+
+    void get(uint8_t c, decimal32& x) { expect(c, 0x74); store(fixed<uint32_t>(), x.begin()); }
+    void get(uint8_t c, decimal64& x) { expect(c, 0x84); store(fixed<uint64_t>(), x.begin()); }
+    void get(uint8_t c, decimal128& x) { expect(c, 0x94); raw(x.begin(), x.size()); }
+    void get(uint8_t c, uuid& x) { expect(c, 0x98); raw(x.begin(), x.size()); }
+
+    void get(uint8_t c, std::string& x) { size_t n = variable(c, 0xa1, 0xb1); x.assign(pos_, n); pos_ += n; }
+    void get(uint8_t c, symbol& x) { size_t n = variable(c, 0xa3, 0xb3); x.assign(pos_, n); pos_ += n; }
+    void get(uint8_t c, binary& x) { size_t n = variable(c, 0xa0, 0xb0); x.assign(pos_, pos_ + n); pos_ += n; }
+
+    template <class T> typename enable_if<is_unknown_integer<T>::value>::type get(uint8_t c, T& x) {
+        typename known_integer<T>::type y;
+        get(c, y);
+        x = static_cast<T>(y);
+    }
+
+    // Fixed width numbers from an ARRAY8 or ARRAY32
+    template <class T, class A>
+    typename enable_if<is_packable<T>::value>::type get(uint8_t c, std::vector<T, A>& x) {
+        size_t count;
+        const char* end = begin_compound(c, 0xe0, 0xf0, count);
+        uint8_t element = code();
+        x.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            get(element, x[i]);
+        check_end(end);
+    }
+
+    // Any other type must be a described list
+    template <class T> typename enable_if<!is_unknown_integer<T>::value>::type get(uint8_t c, T& x) {
+        expect(c, 0x00);
+        codec::list_descriptor d = codec::described_list<T>::descriptor();
+        uint8_t dc = code();
+        if (d.symbol) {
+            size_t n = variable(dc, 0xa3, 0xb3);
+            if (n != std::strlen(d.symbol) || std::memcmp(pos_, d.symbol, n) != 0)
+                throw conversion_error("unexpected descriptor");
+            pos_ += n;
+        } else {
+            uint64_t id;
+            get(dc, id);
+            if (id != d.code) throw conversion_error("unexpected descriptor");
+        }
+        size_t count = 0;
+        c = code();
+        const char* end = (c == 0x45) ? pos_ : begin_compound(c, 0xc0, 0xd0, count);
+        field_reader<T> f(*this, x, count);
+        codec::described_list<T>::fields(f);
+        check_end(end);
+        pos_ = end;             // Skip any fields added by a later schema
+    }
+
+  private:
+    template <class T> struct field_reader {
+        field_reader(described_reader& r, T& x, size_t n) : reader(r), object(x), count(n), index(0) {}
+
+        template <class M, class C> field_reader& operator()(M C::* member) {
+            if (index++ < count) {
+                if (reader.peek() == 0x40) reader.skip(1);
+                else reader.get(object.*member);
+            }
+            return *this;
+        }
+
+        described_reader& reader;
+        T& object;
+        size_t count;
+        size_t index;
+    };
+
+    void need(size_t n) {
+        if (size_t(end_ - pos_) < n) throw conversion_error("not enough data to decode");
+    }
+
+    uint8_t peek() { need(1); return uint8_t(*pos_); }
+    void skip(size_t n) { need(n); pos_ += n; }
+    uint8_t code() { uint8_t c = peek(); ++pos_; return c; }
+
+    static void expect(uint8_t c, uint8_t expected) {
+        if (c != expected) throw conversion_error("unexpected AMQP type code");
+    }
+
+    template <class U> static void store(U u, void* p) { std::memcpy(p, &u, sizeof(U)); }
+
+    // A fixed width value from big endian bytes
+    template <class T> T fixed() {
+        typedef typename integer_type<sizeof(T), false>::type U;
+        need(sizeof(T));
+        U u = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+            u = U((u << 8) | uint8_t(*pos_++));
+        T x;
+        store(u, &x);
+        return x;
+    }
+
+    void raw(void* p, size_t n) { need(n); std::memcpy(p, pos_, n); pos_ += n; }
+
+    // Size of a variable width value, checked against the bytes left
+    size_t variable(uint8_t c, uint8_t small, uint8_t large) {
+        size_t n;
+        if (c == small) n = fixed<uint8_t>();
+        else { expect(c, large); n = fixed<uint32_t>(); }
+        need(n);
+        return n;
+    }
+
+    // Read the size and count of a list or array, return where it ends
+    const char* begin_compound(uint8_t c, uint8_t small, uint8_t large, size_t& count) {
+        size_t size;
+        if (c == small) {
+            size = fixed<uint8_t>();
+            need(size);
+            if (size < 1) throw conversion_error("invalid compound size");
+            count = fixed<uint8_t>();
+        } else {
+            expect(c, large);
+            size = fixed<uint32_t>();
+            need(size);
+            if (size < 4) throw conversion_error("invalid compound size");
+            count = fixed<uint32_t>();
+        }
+        return pos_ + size - (c == small ? 1 : 4);
+    }
+
+    void check_end(const char* end) {
+        if (pos_ > end) throw conversion_error("compound value overruns its size");
+    }
+
+    const char* pos_;
+    const char* end_;
+};
+
+/// @endcond
+
+} // internal
+
+namespace codec {
+
+/// **Experimental** - Encode x as an AMQP described list into bytes,
+/// replacing their contents. T must have a described_list
+/// specialization.
+template <class T> void encode_described(std::string& bytes, const T& x) {
+    bytes.clear();
+    internal::described_writer w(bytes);
+    w.put(x);
+}
+
+/// **Experimental** - Encode x as an AMQP described list.
+template <class T> std::string encode_described(const T& x) {
+    std::string bytes;
+    encode_described(bytes, x);
+    return bytes;
+}
+
+/// **Experimental** - Decode x from an AMQP described list at the start
+/// of bytes.
+///
+/// @return the number of bytes used.
+/// @throw conversion_error if the bytes are not a described list with
+/// the descriptor and field types of T.
+template <class T> size_t decode_described(const char* bytes, size_t size, T& x) {
+    internal::described_reader r(bytes, size);
+    r.get(x);
+    return size_t(r.position() - bytes);
+}
+
+/// **Experimental** - Decode x from an AMQP described list at the start
+/// of bytes.
+template <class T> size_t decode_described(const std::string& bytes, T& x) {
+    return decode_described(bytes.data(), bytes.size(), x);
+}
+
+/// **Experimental** - Set the body of m to x encoded as an AMQP
+/// described list. The bytes are sent as they are, without a
+/// proton::value in between.
+template <class T> void encode_body(message& m, const T& x) {
+    m.encoded_body(encode_described(x));
+}
+
+/// **Experimental** - Decode the body of m, set by encode_body() or
+/// received from a peer, into x.
+template <class T> void decode_body(const message& m, T& x) {
+    decode_described(m.encoded_body(), x);
+}
+
+} // codec
+} // proton
+
+/// **Experimental** - Specialize proton::codec::described_list for TYPE.
+///
+/// DESCRIPTOR is a ulong or a symbol. FIELDS are the member pointers of
+/// TYPE in list order, each in parentheses: (&point::x)(&point::y).
+/// Use at global scope.
+#define PN_CPP_DESCRIBED_LIST(TYPE, DESCRIPTOR, FIELDS)                 \
+    namespace proton { namespace codec {                                \
+    template <> struct described_list<TYPE> {                           \
+        static list_descriptor descriptor() { return list_descriptor(DESCRIPTOR); } \
+        template <class F> static void fields(F& f) { f FIELDS; }      \
+    };                                                                  \
+    } }
+
+#endif // PROTON_CODEC_DESCRIBED_LIST_HPP
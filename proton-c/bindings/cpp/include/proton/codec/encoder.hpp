@@ -154,6 +154,22 @@ class encoder : public internal::data {
         *this << finish();
         return *this;
     }
+
+    template <class T> struct packed_array_cref { T& ref; packed_array_cref(T& r) : ref(r) {} };
+
+    /// Encode a contiguous container of internal::is_packable values
+    /// as an ARRAY in one copy.
+    template <class T> static packed_array_cref<T> packed_array(T& x) { return packed_array_cref<T>(x); }
+
+    template <class T> encoder& operator<<(const packed_array_cref<T>& x) {
+        typedef typename T::value_type value_type;
+        return put_array_elements(internal::type_id_of<value_type>::value,
+                                  x.ref.empty() ? 0 : &x.ref[0], x.ref.size());
+    }
+
+    /// Put an ARRAY of count elements of a fixed width type, given in
+    /// host byte order.
+    PN_CPP_EXTERN encoder& put_array_elements(type_id element, const void* elements, size_t count);
     /// @endcond
 
   private:
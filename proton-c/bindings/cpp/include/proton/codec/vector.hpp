@@ -32,10 +32,19 @@ namespace proton {
 namespace codec {
 
 /// Encode std::vector<T> as amqp::ARRAY (same type elements)
-template <class T, class A> encoder& operator<<(encoder& e, const std::vector<T, A>& x) {
+template <class T, class A>
+typename internal::enable_if<!internal::is_packable<T>::value, encoder&>::type
+operator<<(encoder& e, const std::vector<T, A>& x) {
     return e << encoder::array(x, internal::type_id_of<T>::value);
 }
 
+/// Encode std::vector<T> of fixed width numbers as amqp::ARRAY in one copy
+template <class T, class A>
+typename internal::enable_if<internal::is_packable<T>::value, encoder&>::type
+operator<<(encoder& e, const std::vector<T, A>& x) {
+    return e << encoder::packed_array(x);
+}
+
 /// Encode std::vector<value> encode as amqp::LIST (mixed type elements)
 template <class A> encoder& operator<<(encoder& e, const std::vector<value, A>& x) { return e << encoder::list(x); }
 
@@ -47,7 +56,15 @@ template <class A, class K, class T>
 encoder& operator<<(encoder& e, const std::vector<std::pair<K,T>, A>& x) { return e << encoder::map(x); }
 
 /// Decode to std::vector<T> from an amqp::LIST or amqp::ARRAY.
-template <class T, class A> decoder& operator>>(decoder& d, std::vector<T, A>& x) { return d >> decoder::sequence(x); }
+template <class T, class A>
+typename internal::enable_if<!internal::is_packable<T>::value, decoder&>::type
+operator>>(decoder& d, std::vector<T, A>& x) { return d >> decoder::sequence(x); }
+
+/// Decode to std::vector<T> of fixed width numbers, in one copy from an
+/// amqp::ARRAY of the same type.
+template <class T, class A>
+typename internal::enable_if<internal::is_packable<T>::value, decoder&>::type
+operator>>(decoder& d, std::vector<T, A>& x) { return d >> decoder::packed_array(x); }
 
 /// Decode to std::vector<std::pair<K, T> from an amqp::MAP.
 template <class A, class K, class T> decoder& operator>>(decoder& d, std::vector<std::pair<K, T> , A>& x) { return d >> decoder::pair_sequence(x); }
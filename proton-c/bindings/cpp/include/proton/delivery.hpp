@@ -59,6 +59,10 @@ class delivery : public transfer {
     /// Settle with MODIFIED state.
     PN_CPP_EXTERN void modify();
 
+    /// **Experimental** - True if more of the message is still to
+    /// arrive.
+    PN_CPP_EXTERN bool partial() const;
+
     /// @cond INTERNAL
   friend class internal::factory<delivery>;
     /// @endcond
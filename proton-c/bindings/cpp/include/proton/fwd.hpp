@@ -59,6 +59,7 @@ class void_function0;
 namespace io {
 
 class connection_driver;
+struct const_buffer;
 
 }
 
@@ -119,6 +119,21 @@ template<> struct type_id_of<binary> : public type_id_constant<BINARY, binary> {
 template <class T, class Enable=void> struct has_type_id : public false_type {};
 template <class T> struct has_type_id<T, typename type_id_of<T>::type>  : public true_type {};
 
+/// Metafunction to test if T is laid out like the AMQP encoding of its
+/// type_id, apart from byte order, so a sequence of T can be encoded as
+/// an ARRAY in one copy.
+template <class T> struct is_packable : public false_type {};
+template<> struct is_packable<uint8_t> : public true_type {};
+template<> struct is_packable<int8_t> : public true_type {};
+template<> struct is_packable<uint16_t> : public true_type {};
+template<> struct is_packable<int16_t> : public true_type {};
+template<> struct is_packable<uint32_t> : public true_type {};
+template<> struct is_packable<int32_t> : public true_type {};
+template<> struct is_packable<uint64_t> : public true_type {};
+template<> struct is_packable<int64_t> : public true_type {};
+template<> struct is_packable<float> : public true_type {};
+template<> struct is_packable<double> : public true_type {};
+
 // The known/unknown integer type magic is required because the C++ standard is
 // vague a about the equivalence of integral types for overloading. E.g. char is
 // sometimes equivalent to signed char, sometimes unsigned char, sometimes
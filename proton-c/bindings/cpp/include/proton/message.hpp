@@ -37,6 +37,7 @@
 #include <vector>
 
 struct pn_message_t;
+struct pn_link_t;
 
 namespace proton {
 
@@ -151,6 +152,19 @@ class message {
     /// Get a reference to the body that can be modified in place.
     PN_CPP_EXTERN value& body();
 
+    /// Set the body to an AMQP value that is already encoded. The
+    /// bytes are sent as they are and only decoded if body() is
+    /// called.
+    ///
+    /// @throw error if bytes is not exactly one encoded value
+    PN_CPP_EXTERN void encoded_body(const std::string& bytes);
+
+    /// Get the body as an encoded AMQP value. A body that is still
+    /// encoded, because the message was received or set by
+    /// encoded_body() and body() has not been called since, is copied
+    /// without being decoded. Empty if there is no body.
+    PN_CPP_EXTERN std::string encoded_body() const;
+
     /// Set the subject.
     PN_CPP_EXTERN void subject(const std::string &s);
 
@@ -329,11 +343,18 @@ class message {
     mutable annotation_map message_annotations_;
     mutable annotation_map delivery_annotations_;
 
+    /// Decode sections only when they are first used.
+    void decode_lazy(const std::vector<char> &bytes);
+
     /// Decode the message corresponding to a delivery from a link.
     void decode(proton::delivery);
 
+    /// Encode the message directly into the current delivery of a sender link.
+    void encode_to(pn_link_t *sender) const;
+
   PN_CPP_EXTERN friend void swap(message&, message&);
   friend class messaging_adapter;
+  friend class sender;
     /// @endcond
 };
 
@@ -153,6 +153,16 @@ PN_CPP_CLASS_EXTERN messaging_handler {
 
     /// Fallback error handling.
     PN_CPP_EXTERN virtual void on_error(const error_condition &c);
+
+    /// **Experimental** - More of a message has arrived on a receiver
+    /// opened with receiver_options::stream_messages.
+    ///
+    /// The chunk holds the next bytes of the AMQP encoded message and
+    /// is only valid during the call. delivery::partial() is false for
+    /// the last chunk of the message, after which the delivery is
+    /// accepted as it would be after on_message. on_message is not
+    /// called for messages on such a receiver.
+    PN_CPP_EXTERN virtual void on_message_chunk(delivery &d, const io::const_buffer &chunk);
 };
 
 } // proton
@@ -90,6 +90,14 @@ class receiver_options {
     /// replenishing.
     PN_CPP_EXTERN receiver_options& credit_window(int);
 
+    /// **Experimental** - Pass each message to
+    /// messaging_handler::on_message_chunk as it arrives, instead of
+    /// waiting for all of it and calling messaging_handler::on_message
+    /// (default is false). The memory used for a message is then
+    /// bounded by the data that arrives between events rather than by
+    /// the size of the message.
+    PN_CPP_EXTERN receiver_options& stream_messages(bool);
+
     /// @cond INTERNAL
   private:
     void apply(receiver &) const;
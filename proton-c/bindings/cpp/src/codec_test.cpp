@@ -19,12 +19,69 @@
 
 #include "test_bits.hpp"
 
+#include "proton/codec/described_list.hpp"
 #include "proton/internal/data.hpp"
 #include "proton/internal/config.hpp"
+#include "proton/message.hpp"
 #include "proton/types.hpp"
 
 namespace {
 
+struct point {
+    point() : x(0), y(0) {}
+    int32_t x, y;
+};
+
+// Same descriptor as point with a field added at the end
+struct point3 {
+    point3() : x(0), y(0), z(-1) {}
+    int32_t x, y, z;
+};
+
+// A struct followed by another field
+struct segment {
+    segment() : n(0) {}
+    point start;
+    int32_t n;
+};
+
+struct record {
+    bool flag;
+    uint8_t ub;
+    int16_t s;
+    uint32_t small_uint, big_uint;
+    int32_t i;
+    int64_t l;
+    uint64_t ul;
+    char c;
+    wchar_t ch;
+    float f;
+    double d;
+    proton::timestamp t;
+    proton::decimal64 d64;
+    proton::uuid id;
+    std::string str;
+    proton::symbol sym;
+    proton::binary bin;
+    std::vector<int32_t> ints;
+    point where;
+    proton::value any;
+};
+
+}
+
+PN_CPP_DESCRIBED_LIST(point, uint64_t(0x1234), (&point::x)(&point::y))
+PN_CPP_DESCRIBED_LIST(point3, uint64_t(0x1234), (&point3::x)(&point3::y)(&point3::z))
+PN_CPP_DESCRIBED_LIST(segment, uint64_t(0x1236), (&segment::start)(&segment::n))
+PN_CPP_DESCRIBED_LIST(record, "example:record",
+                      (&record::flag)(&record::ub)(&record::s)(&record::small_uint)
+                      (&record::big_uint)(&record::i)(&record::l)(&record::ul)(&record::c)
+                      (&record::ch)(&record::f)(&record::d)(&record::t)(&record::d64)
+                      (&record::id)(&record::str)(&record::sym)(&record::bin)(&record::ints)
+                      (&record::where)(&record::any))
+
+namespace {
+
 using namespace proton;
 
 template <class T> void  simple_type_test(const T& x) {
@@ -43,6 +100,183 @@ template <class T> T make_fill(const char c) {
     return x;
 }
 
+// A packable std::vector encodes to the same bytes as an array built
+// element by element, and decodes back from either an ARRAY or a LIST.
+template <class T> void packed_vector_test(const std::vector<T>& x) {
+    value packed, nodes, list;
+    codec::encoder ep(packed), en(nodes), el(list);
+    ep << x;
+    en << codec::encoder::array(x, internal::type_id_of<T>::value);
+    el << codec::encoder::list(x);
+
+    value* sources[] = { &packed, &nodes, &list };
+    for (size_t i = 0; i < sizeof(sources)/sizeof(sources[0]); ++i) {
+        std::vector<T> y;
+        codec::decoder d(*sources[i]);
+        d >> y;
+        ASSERT_EQUAL(x, y);
+    }
+
+    std::string bytes = en.encode();
+    ASSERT_EQUAL(bytes, ep.encode());
+    value decoded;
+    codec::decoder dd(decoded);
+    dd.decode(bytes);
+    std::vector<T> y;
+    dd >> y;
+    ASSERT_EQUAL(x, y);
+}
+
+// An ARRAY of a narrower type converts element by element
+void widening_vector_test() {
+    value v(std::vector<int32_t>(3, -42));
+    std::vector<int64_t> y;
+    codec::decoder d(v);
+    d >> y;
+    ASSERT_EQUAL(std::vector<int64_t>(3, -42), y);
+}
+
+record make_record() {
+    record r;
+    r.flag = true;
+    r.ub = 200;
+    r.s = -4242;
+    r.small_uint = 42;
+    r.big_uint = 42424242;
+    r.i = -42;
+    r.l = -42424242424242LL;
+    r.ul = 300;
+    r.c = 42;
+    r.ch = 'X';
+    r.f = 1.5;
+    r.d = -11.2233;
+    r.t = timestamp(1234);
+    r.d64 = make_fill<decimal64>(7);
+    r.id = uuid::copy("\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\xcc\xdd\xee\xff");
+    r.str = std::string(300, 'x');
+    r.sym = symbol("sym");
+    r.bin = binary("bin");
+    r.ints = std::vector<int32_t>(3, -4242);
+    r.where.x = 1;
+    r.where.y = -1000;
+    r.any = std::vector<std::string>(2, "any");
+    return r;
+}
+
+// A described list is encoded to the same bytes as the value encoder
+// would build from the same fields, and decodes back from them.
+void described_bytes_test() {
+    record r = make_record();
+    value v;
+    codec::encoder e(v);
+    e << codec::start::described() << symbol("example:record") << codec::start::list()
+      << r.flag << r.ub << r.s << r.small_uint << r.big_uint << r.i << r.l << r.ul << r.c
+      << r.ch << r.f << r.d << r.t << r.d64 << r.id << r.str << r.sym << r.bin << r.ints
+      << codec::start::described() << uint64_t(0x1234) << codec::start::list()
+      << r.where.x << r.where.y << codec::finish() << codec::finish()
+      << r.any << codec::finish() << codec::finish();
+    std::string expect = e.encode();
+
+    std::string bytes = codec::encode_described(r);
+    ASSERT_EQUAL(expect, bytes);
+
+    record y;
+    ASSERT_EQUAL(bytes.size(), codec::decode_described(bytes, y));
+    ASSERT_EQUAL(bytes, codec::encode_described(y));
+    ASSERT_EQUAL(r.str, y.str);
+    ASSERT_EQUAL(r.ints, y.ints);
+    ASSERT_EQUAL(r.where.y, y.where.y);
+    ASSERT_EQUAL(r.any, y.any);
+}
+
+// Fields can be added at the end of a list: missing or null ones keep
+// their defaults and extra ones are skipped.
+void described_schema_test() {
+    point3 p3;
+    p3.x = 1; p3.y = 2; p3.z = 3;
+    point p;
+    codec::decode_described(codec::encode_described(p3), p);
+    ASSERT_EQUAL(2, p.y);
+
+    point3 q;
+    codec::decode_described(codec::encode_described(p), q);
+    ASSERT_EQUAL(2, q.y);
+    ASSERT_EQUAL(-1, q.z);
+
+    value v;
+    codec::encoder e(v);
+    e << codec::start::described() << uint64_t(0x1234) << codec::start::list()
+      << value() << int32_t(5) << codec::finish() << codec::finish();
+    point n;
+    n.x = 7;
+    codec::decode_described(e.encode(), n);
+    ASSERT_EQUAL(7, n.x);
+    ASSERT_EQUAL(5, n.y);
+
+    // An empty list is written as list0, with no size or count
+    std::string list0("\x00\x80\x00\x00\x00\x00\x00\x00\x12\x34\x45", 11);
+    point empty;
+    empty.x = 7;
+    ASSERT_EQUAL(list0.size(), codec::decode_described(list0, empty));
+    ASSERT_EQUAL(7, empty.x);
+    ASSERT_EQUAL(0, empty.y);
+
+    std::string nested("\x00\x80\x00\x00\x00\x00\x00\x00\x12\x36\xc0\x0e\x02", 13);
+    nested += list0;
+    nested += std::string("\x54\x05", 2);
+    segment seg;
+    ASSERT_EQUAL(nested.size(), codec::decode_described(nested, seg));
+    ASSERT_EQUAL(0, seg.start.x);
+    ASSERT_EQUAL(5, seg.n);
+}
+
+void described_error_test() {
+    std::string bytes = codec::encode_described(make_record());
+    point p;
+    try {
+        codec::decode_described(bytes, p);
+        FAIL("expected conversion_error");
+    } catch (const conversion_error&) {}
+    record r;
+    try {
+        codec::decode_described(bytes.data(), bytes.size() - 1, r);
+        FAIL("expected conversion_error");
+    } catch (const conversion_error&) {}
+}
+
+// A message body is set and read as bytes, and is the same described
+// value seen through body()
+void described_body_test() {
+    record r = make_record();
+    message m;
+    codec::encode_body(m, r);
+    std::vector<char> bytes;
+    m.encode(bytes);
+
+    message received;
+    received.decode(bytes);
+    record y;
+    codec::decode_body(received, y);
+    ASSERT_EQUAL(r.str, y.str);
+    ASSERT_EQUAL(r.where.x, y.where.x);
+
+    ASSERT_EQUAL(DESCRIBED, received.body().type());
+    point p;
+    p.x = 3;
+    received.body() = value();
+    codec::encode_body(received, p);
+    point q;
+    codec::decode_body(received, q);
+    ASSERT_EQUAL(3, q.x);
+
+    // A body set as a value is encoded on demand
+    message valued;
+    valued.body() = m.body();
+    record z;
+    codec::decode_body(valued, z);
+    ASSERT_EQUAL(r.l, z.l);
+}
+
 template <class T> void  uncodable_type_test() {
     ASSERT(!codec::is_encodable<T>::value);
 }
@@ -103,6 +337,22 @@ int main(int, char**) {
     RUN_TEST(failed, simple_type_test(annotation_key(42)));
     RUN_TEST(failed, simple_type_test(message_id(42)));
 
+    // std::vector of fixed width types go as one packed ARRAY
+    RUN_TEST(failed, packed_vector_test(std::vector<uint8_t>(3, 200)));
+    RUN_TEST(failed, packed_vector_test(std::vector<int16_t>(3, -4242)));
+    RUN_TEST(failed, packed_vector_test(std::vector<uint32_t>(1000, 42424242)));
+    RUN_TEST(failed, packed_vector_test(std::vector<int64_t>(5, -42424242424242LL)));
+    RUN_TEST(failed, packed_vector_test(std::vector<float>(2, 1.5)));
+    RUN_TEST(failed, packed_vector_test(std::vector<double>(4, -11.2233)));
+    RUN_TEST(failed, packed_vector_test(std::vector<int32_t>()));
+    RUN_TEST(failed, widening_vector_test());
+
+    // Structs with a described_list specialization
+    RUN_TEST(failed, described_bytes_test());
+    RUN_TEST(failed, described_schema_test());
+    RUN_TEST(failed, described_error_test());
+    RUN_TEST(failed, described_body_test());
+
     // Make sure we reject uncodable types
     RUN_TEST(failed, (uncodable_type_test<std::pair<int, float> >()));
     RUN_TEST(failed, (uncodable_type_test<std::pair<scalar, value> >()));
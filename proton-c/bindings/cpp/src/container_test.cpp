@@ -23,7 +23,13 @@
 #include "proton/connection_options.hpp"
 #include "proton/container.hpp"
 #include "proton/default_container.hpp"
+#include "proton/delivery.hpp"
+#include "proton/io/connection_driver.hpp"
+#include "proton/message.hpp"
 #include "proton/messaging_handler.hpp"
+#include "proton/receiver_options.hpp"
+#include "proton/sender.hpp"
+#include "proton/tracker.hpp"
 #include "proton/listener.hpp"
 #include "proton/listen_handler.hpp"
 #include "proton/thread_safe.hpp"
@@ -33,6 +39,7 @@
 #include <string>
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 namespace {
 
@@ -192,6 +199,82 @@ int test_container_stop() {
     return 0;
 }
 
+// A streaming receiver gets a large message in chunks no bigger than what
+// arrives at a time, which together make up the encoded message. A sender
+// settling before the end is reported once while the message streams.
+class stream_tester : public proton::messaging_handler {
+    proton::listener listener;
+    bool presettle, sent, done;
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        int port = listen_on_random_port(c, listener);
+        proton::connection conn = c.connect("127.0.0.1:" + int2string(port),
+                                            proton::connection_options().max_frame_size(4096));
+        conn.open_receiver("x", proton::receiver_options().stream_messages(true));
+    }
+
+    void on_sendable(proton::sender &s) PN_CPP_OVERRIDE {
+        if (sent) return;
+        proton::message m(std::string(200000, 'x'));
+        m.subject("big");
+        proton::tracker t = s.send(m);
+        if (presettle) t.settle();
+        sent = true;
+    }
+
+    void on_message(proton::delivery &, proton::message &) PN_CPP_OVERRIDE {
+        ++messages;
+    }
+
+    void on_delivery_settle(proton::delivery &d) PN_CPP_OVERRIDE {
+        if (d.partial()) ++settles;
+    }
+
+    void on_message_chunk(proton::delivery &d, const proton::io::const_buffer &chunk) PN_CPP_OVERRIDE {
+        bytes.insert(bytes.end(), chunk.data, chunk.data + chunk.size);
+        ++chunks;
+        if (chunk.size > largest) largest = chunk.size;
+        if (!d.partial()) {
+            ++streamed;
+            d.connection().close();
+        }
+    }
+
+    void on_connection_close(proton::connection &) PN_CPP_OVERRIDE {
+        if (!done) listener.stop();
+        done = true;
+    }
+
+  public:
+    stream_tester(bool presettle_) : presettle(presettle_), sent(false), done(false),
+                                     chunks(0), largest(0), streamed(0), messages(0), settles(0) {}
+
+    std::vector<char> bytes;
+    size_t chunks, largest;
+    int streamed, messages, settles;
+};
+
+int test_container_stream_messages() {
+    stream_tester t(false);
+    proton::default_container(t).run();
+    ASSERT_EQUAL(1, t.streamed);
+    ASSERT_EQUAL(0, t.messages);
+    ASSERT_EQUAL(0, t.settles);
+    ASSERT(t.chunks > 1);
+    ASSERT(t.largest < t.bytes.size());
+    proton::message m;
+    m.decode(t.bytes);
+    ASSERT_EQUAL(std::string("big"), m.subject());
+    ASSERT_EQUAL(std::string(200000, 'x'), proton::get<std::string>(m.body()));
+
+    stream_tester p(true);
+    proton::default_container(p).run();
+    ASSERT_EQUAL(1, p.streamed);
+    ASSERT_EQUAL(1, p.settles);
+    ASSERT_EQUAL(t.bytes.size(), p.bytes.size());
+    return 0;
+}
+
 }
 
 int main(int, char**) {
@@ -201,6 +284,7 @@ int main(int, char**) {
     RUN_TEST(failed, test_container_no_vhost());
     RUN_TEST(failed, test_container_bad_address());
     RUN_TEST(failed, test_container_stop());
+    RUN_TEST(failed, test_container_stream_messages());
     return failed;
 }
 
@@ -47,11 +47,12 @@ void cpp_context_finalize(void* v) { reinterpret_cast<context*>(v)->~context();
 #define cpp_context_inspect NULL
 pn_class_t cpp_context_class = PN_CLASS(cpp_context);
 
-// Handles
-PN_HANDLE(CONNECTION_CONTEXT)
-PN_HANDLE(CONTAINER_CONTEXT)
-PN_HANDLE(LISTENER_CONTEXT)
-PN_HANDLE(LINK_CONTEXT)
+// Handles. Each of these objects has only the one C++ context, so they all
+// use the record slot reserved for bindings and are found without a search.
+const pn_handle_t CONNECTION_CONTEXT = PN_BINDINGCTX;
+const pn_handle_t CONTAINER_CONTEXT = PN_BINDINGCTX;
+const pn_handle_t LISTENER_CONTEXT = PN_BINDINGCTX;
+const pn_handle_t LINK_CONTEXT = PN_BINDINGCTX;
 
 void set_context(pn_record_t* record, pn_handle_t handle, const pn_class_t *clazz, void* value)
 {
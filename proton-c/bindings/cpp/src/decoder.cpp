@@ -135,6 +135,24 @@ decoder& decoder::operator>>(const finish&) {
     return *this;
 }
 
+bool decoder::peek_array_elements(type_id element, size_t& count) {
+    internal::state_guard sg(*this);
+    pn_data_t* d = pn_object();
+    if (!next() || pn_data_type(d) != PN_ARRAY || pn_data_is_array_described(d) ||
+        type_id(pn_data_get_array_type(d)) != element)
+        return false;
+    count = pn_data_get_array(d);
+    return true;
+}
+
+decoder& decoder::get_array_elements(void* elements, size_t count) {
+    internal::state_guard sg(*this);
+    assert_type_equal(ARRAY, pre_get());
+    check(pn_data_get_array_elements(pn_object(), elements, count));
+    sg.cancel();
+    return *this;
+}
+
 decoder& decoder::operator>>(null&) {
     internal::state_guard sg(*this);
     assert_type_equal(NULL_TYPE, pre_get());
@@ -44,5 +44,6 @@ void delivery::accept() { settle_delivery(pn_object(), ACCEPTED); }
 void delivery::reject() { settle_delivery(pn_object(), REJECTED); }
 void delivery::release() { settle_delivery(pn_object(), RELEASED); }
 void delivery::modify() { settle_delivery(pn_object(), MODIFIED); }
+bool delivery::partial() const { return pn_delivery_partial(pn_object()); }
 
 }
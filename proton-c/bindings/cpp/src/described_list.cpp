@@ -0,0 +1,57 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton_bits.hpp"
+
+#include "proton/codec/described_list.hpp"
+#include "proton/codec/decoder.hpp"
+#include "proton/codec/encoder.hpp"
+#include "proton/value.hpp"
+
+#include <proton/codec.h>
+
+namespace proton {
+namespace internal {
+
+// proton::value fields are the only ones that go through pn_data_t.
+
+void described_writer::put(const value& x) {
+    if (x.empty()) {
+        code(0x40);
+        return;
+    }
+    codec::encoder e(data::create());
+    e << x;
+    out_ += e.encode();
+}
+
+void described_reader::get(value& x) {
+    data d = data::create();
+    ssize_t size = pn_data_decode(unwrap(d), pos_, size_t(end_ - pos_));
+    if (size < 0) throw conversion_error(error_str(size));
+    pos_ += size;
+    codec::decoder dec(d);
+    dec.rewind();
+    dec >> x;
+}
+
+} // internal
+} // proton
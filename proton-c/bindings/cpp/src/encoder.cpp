@@ -76,6 +76,7 @@ void encoder::encode(std::string& s) {
         assert(!s.empty());
         encode(&s[0], size);
     }
+    s.resize(size);
 }
 
 std::string encoder::encode() {
@@ -102,6 +103,13 @@ encoder& encoder::operator<<(const finish&) {
     return *this;
 }
 
+encoder& encoder::put_array_elements(type_id element, const void* elements, size_t count) {
+    internal::state_guard sg(*this);
+    check(pn_data_put_array_elements(pn_object(), pn_type_t(element), elements, count));
+    sg.cancel();
+    return *this;
+}
+
 namespace {
 
 template <class T, class U> T coerce(const U &x) { return x; }
@@ -70,5 +70,6 @@ void messaging_handler::on_sender_drain_start(sender &) {}
 void messaging_handler::on_receiver_drain_finish(receiver &) {}
 
 void messaging_handler::on_error(const error_condition& c) { throw proton::error(c.what()); }
+void messaging_handler::on_message_chunk(delivery &, const io::const_buffer &) {}
 
 }
@@ -90,6 +90,7 @@ class connection_context : public context {
     class container* container;
     pn_session_t *default_session; // Owned by connection.
     message event_message;      // re-used by messaging_adapter for performance.
+    std::vector<char> event_chunk; // re-used by messaging_adapter for streamed messages.
     io::link_namer* link_gen;      // Link name generator.
 
     internal::pn_unique_ptr<proton_handler> handler;
@@ -121,12 +122,14 @@ class listener_context : public context {
 class link_context : public context {
   public:
     static link_context& get(pn_link_t* l);
-    link_context() : credit_window(10), auto_accept(true), auto_settle(true), draining(false), pending_credit(0) {}
+    link_context() : credit_window(10), auto_accept(true), auto_settle(true), stream_messages(false), draining(false), pending_credit(0), tag_counter(0) {}
     int credit_window;
     bool auto_accept;
     bool auto_settle;
+    bool stream_messages;
     bool draining;
     uint32_t pending_credit;
+    uint64_t tag_counter;
 };
 
 }
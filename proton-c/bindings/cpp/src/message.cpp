@@ -71,7 +71,6 @@ void swap(message& x, message& y) {
 
 pn_message_t *message::pn_msg() const {
     if (!pn_msg_) pn_msg_ = pn_message();
-    body_.refer(pn_message_body(pn_msg_));
     return pn_msg_;
 }
 
@@ -80,7 +79,7 @@ message& message::operator=(const message& m) {
         // TODO aconway 2015-08-10: more efficient pn_message_copy function
         std::vector<char> data;
         m.encode(data);
-        decode(data);
+        decode_lazy(data);
     }
     return *this;
 }
@@ -91,12 +90,25 @@ namespace {
 void check(int err) {
     if (err) throw error(error_str(err));
 }
+
+// Sections decoded lazily report errors in the message, throw them
+template <class T> T get_checked(T (*get)(pn_message_t*), pn_message_t* msg) {
+    T x = get(msg);
+    if (pn_message_errno(msg))
+        throw error(MSG("message decode: " << pn_error_text(pn_message_error(msg))));
+    return x;
+}
+
+std::string get_string(const char* (*get)(pn_message_t*), pn_message_t* msg) {
+    const char* s = get_checked(get, msg);
+    return s ? std::string(s) : std::string();
+}
 } // namespace
 
 void message::id(const message_id& id) { pn_message_set_id(pn_msg(), id.atom_); }
 
 message_id message::id() const {
-    return pn_message_get_id(pn_msg());
+    return get_checked(pn_message_get_id, pn_msg());
 }
 
 void message::user(const std::string &id) {
@@ -104,7 +116,7 @@ void message::user(const std::string &id) {
 }
 
 std::string message::user() const {
-    return str(pn_message_get_user_id(pn_msg()));
+    return str(get_checked(pn_message_get_user_id, pn_msg()));
 }
 
 void message::to(const std::string &addr) {
@@ -112,8 +124,7 @@ void message::to(const std::string &addr) {
 }
 
 std::string message::to() const {
-    const char* addr = pn_message_get_address(pn_msg());
-    return addr ? std::string(addr) : std::string();
+    return get_string(pn_message_get_address, pn_msg());
 }
 
 void message::address(const std::string &addr) {
@@ -121,8 +132,7 @@ void message::address(const std::string &addr) {
 }
 
 std::string message::address() const {
-  const char* addr = pn_message_get_address(pn_msg());
-  return addr ? std::string(addr) : std::string();
+  return get_string(pn_message_get_address, pn_msg());
 }
 
 void message::subject(const std::string &s) {
@@ -130,8 +140,7 @@ void message::subject(const std::string &s) {
 }
 
 std::string message::subject() const {
-    const char* s = pn_message_get_subject(pn_msg());
-    return s ? std::string(s) : std::string();
+    return get_string(pn_message_get_subject, pn_msg());
 }
 
 void message::reply_to(const std::string &s) {
@@ -139,8 +148,7 @@ void message::reply_to(const std::string &s) {
 }
 
 std::string message::reply_to() const {
-    const char* s = pn_message_get_reply_to(pn_msg());
-    return s ? std::string(s) : std::string();
+    return get_string(pn_message_get_reply_to, pn_msg());
 }
 
 void message::correlation_id(const message_id& id) {
@@ -148,7 +156,7 @@ void message::correlation_id(const message_id& id) {
 }
 
 message_id message::correlation_id() const {
-    return pn_message_get_correlation_id(pn_msg());
+    return get_checked(pn_message_get_correlation_id, pn_msg());
 }
 
 void message::content_type(const std::string &s) {
@@ -156,8 +164,7 @@ void message::content_type(const std::string &s) {
 }
 
 std::string message::content_type() const {
-    const char* s = pn_message_get_content_type(pn_msg());
-    return s ? std::string(s) : std::string();
+    return get_string(pn_message_get_content_type, pn_msg());
 }
 
 void message::content_encoding(const std::string &s) {
@@ -165,22 +172,21 @@ void message::content_encoding(const std::string &s) {
 }
 
 std::string message::content_encoding() const {
-    const char* s = pn_message_get_content_encoding(pn_msg());
-    return s ? std::string(s) : std::string();
+    return get_string(pn_message_get_content_encoding, pn_msg());
 }
 
 void message::expiry_time(timestamp t) {
     pn_message_set_expiry_time(pn_msg(), t.milliseconds());
 }
 timestamp message::expiry_time() const {
-    return timestamp(pn_message_get_expiry_time(pn_msg()));
+    return timestamp(get_checked(pn_message_get_expiry_time, pn_msg()));
 }
 
 void message::creation_time(timestamp t) {
     pn_message_set_creation_time(pn_msg(), t.milliseconds());
 }
 timestamp message::creation_time() const {
-    return timestamp(pn_message_get_creation_time(pn_msg()));
+    return timestamp(get_checked(pn_message_get_creation_time, pn_msg()));
 }
 
 void message::group_id(const std::string &s) {
@@ -188,8 +194,7 @@ void message::group_id(const std::string &s) {
 }
 
 std::string message::group_id() const {
-    const char* s = pn_message_get_group_id(pn_msg());
-    return s ? std::string(s) : std::string();
+    return get_string(pn_message_get_group_id, pn_msg());
 }
 
 void message::reply_to_group_id(const std::string &s) {
@@ -197,8 +202,7 @@ void message::reply_to_group_id(const std::string &s) {
 }
 
 std::string message::reply_to_group_id() const {
-    const char* s = pn_message_get_reply_to_group_id(pn_msg());
-    return s ? std::string(s) : std::string();
+    return get_string(pn_message_get_reply_to_group_id, pn_msg());
 }
 
 bool message::inferred() const { return pn_message_is_inferred(pn_msg()); }
@@ -207,8 +211,25 @@ void message::inferred(bool b) { pn_message_set_inferred(pn_msg(), b); }
 
 void message::body(const value& x) { body() = x; }
 
-const value& message::body() const { pn_msg(); return body_; }
-value& message::body() { pn_msg(); return body_; }
+// pn_message_body() decodes the body if it hasn't been already
+const value& message::body() const { body_.refer(get_checked(pn_message_body, pn_msg())); return body_; }
+value& message::body() { body_.refer(get_checked(pn_message_body, pn_msg())); return body_; }
+
+void message::encoded_body(const std::string& bytes) {
+    check(pn_message_set_encoded_body(pn_msg(), bytes.data(), bytes.size()));
+}
+
+std::string message::encoded_body() const {
+    pn_bytes_t encoded = pn_message_get_encoded_body(pn_msg());
+    if (encoded.size) return std::string(encoded.start, encoded.size);
+    pn_data_t* data = get_checked(pn_message_body, pn_msg());
+    if (!pn_data_size(data)) return std::string();
+    std::string bytes(size_t(pn_data_encoded_size(data)), '\0');
+    pn_data_rewind(data);
+    ssize_t size = pn_data_encode(data, &bytes[0], bytes.size());
+    if (size < 0) check(int(size));
+    return bytes;
+}
 
 // MAP CACHING: the properties and annotations maps can either be encoded in the
 // pn_message pn_data_t structures OR decoded as C++ map members of the message
@@ -217,7 +238,7 @@ value& message::body() { pn_msg(); return body_; }
 
 // Decode a map on demand
 template<class M, class F> M& get_map(pn_message_t* msg, F get, M& map) {
-    codec::decoder d(make_wrapper(get(msg)));
+    codec::decoder d(make_wrapper(get_checked(get, msg)));
     if (map.empty() && !d.empty()) {
         d.rewind();
         d >> map;
@@ -228,10 +249,12 @@ template<class M, class F> M& get_map(pn_message_t* msg, F get, M& map) {
 
 // Encode a map if necessary.
 template<class M, class F> M& put_map(pn_message_t* msg, F get, M& map) {
-    codec::encoder e(make_wrapper(get(msg)));
-    if (e.empty() && !map.empty()) {
-        e << map;
-        map.clear();            // The encoded pn_data_t  is now the authority.
+    if (!map.empty()) {         // Don't call get() needlessly, it decodes the section
+        codec::encoder e(make_wrapper(get(msg)));
+        if (e.empty()) {
+            e << map;
+            map.clear();        // The encoded pn_data_t  is now the authority.
+        }
     }
     return map;
 }
@@ -267,19 +290,23 @@ void message::encode(std::vector<char> &s) const {
     put_map(pn_msg(), pn_message_annotations, message_annotations_);
     put_map(pn_msg(), pn_message_instructions, delivery_annotations_);
     size_t sz = std::max(s.capacity(), size_t(512));
-    while (true) {
+    s.resize(sz);
+    int err = pn_message_encode(pn_msg(), const_cast<char*>(&s[0]), &sz);
+    if (err == PN_OVERFLOW) {
+        // sz is now the exact size needed
         s.resize(sz);
-        assert(!s.empty());
-        int err = pn_message_encode(pn_msg(), const_cast<char*>(&s[0]), &sz);
-        if (err) {
-            if (err != PN_OVERFLOW)
-                check(err);
-        } else {
-            s.resize(sz);
-            return;
-        }
-        sz *= 2;
+        err = pn_message_encode(pn_msg(), const_cast<char*>(&s[0]), &sz);
     }
+    check(err);
+    s.resize(sz);
+}
+
+void message::encode_to(pn_link_t *sender) const {
+    put_map(pn_msg(), pn_message_properties, application_properties_);
+    put_map(pn_msg(), pn_message_annotations, message_annotations_);
+    put_map(pn_msg(), pn_message_instructions, delivery_annotations_);
+    ssize_t n = pn_message_send(pn_msg(), sender);
+    if (n < 0) check(int(n));
 }
 
 std::vector<char> message::encode() const {
@@ -298,6 +325,15 @@ void message::decode(const std::vector<char> &s) {
     check(pn_message_decode(pn_msg(), &s[0], s.size()));
 }
 
+void message::decode_lazy(const std::vector<char> &s) {
+    if (s.empty())
+        throw error("message decode: no data");
+    application_properties_.clear();
+    message_annotations_.clear();
+    delivery_annotations_.clear();
+    check(pn_message_decode_lazy(pn_msg(), &s[0], s.size()));
+}
+
 void message::decode(proton::delivery delivery) {
     std::vector<char> buf;
     buf.resize(pn_delivery_pending(unwrap(delivery)));
@@ -308,26 +344,26 @@ void message::decode(proton::delivery delivery) {
     ssize_t n = pn_link_recv(unwrap(link), const_cast<char *>(&buf[0]), buf.size());
     if (n != ssize_t(buf.size())) throw error(MSG("receiver read failure"));
     clear();
-    decode(buf);
+    decode_lazy(buf);
     pn_link_advance(unwrap(link));
 }
 
-bool message::durable() const { return pn_message_is_durable(pn_msg()); }
+bool message::durable() const { return get_checked(pn_message_is_durable, pn_msg()); }
 void message::durable(bool b) { pn_message_set_durable(pn_msg(), b); }
 
-duration message::ttl() const { return duration(pn_message_get_ttl(pn_msg())); }
+duration message::ttl() const { return duration(get_checked(pn_message_get_ttl, pn_msg())); }
 void message::ttl(duration d) { pn_message_set_ttl(pn_msg(), d.milliseconds()); }
 
-uint8_t message::priority() const { return pn_message_get_priority(pn_msg()); }
+uint8_t message::priority() const { return get_checked(pn_message_get_priority, pn_msg()); }
 void message::priority(uint8_t d) { pn_message_set_priority(pn_msg(), d); }
 
-bool message::first_acquirer() const { return pn_message_is_first_acquirer(pn_msg()); }
+bool message::first_acquirer() const { return get_checked(pn_message_is_first_acquirer, pn_msg()); }
 void message::first_acquirer(bool b) { pn_message_set_first_acquirer(pn_msg(), b); }
 
-uint32_t message::delivery_count() const { return pn_message_get_delivery_count(pn_msg()); }
+uint32_t message::delivery_count() const { return get_checked(pn_message_get_delivery_count, pn_msg()); }
 void message::delivery_count(uint32_t d) { pn_message_set_delivery_count(pn_msg(), d); }
 
-int32_t message::group_sequence() const { return pn_message_get_group_sequence(pn_msg()); }
+int32_t message::group_sequence() const { return get_checked(pn_message_get_group_sequence, pn_msg()); }
 void message::group_sequence(int32_t d) { pn_message_set_group_sequence(pn_msg(), d); }
 
 const uint8_t message::default_priority = PN_DEFAULT_PRIORITY;
@@ -164,6 +164,25 @@ void test_message_maps() {
     ASSERT(m2.message_annotations().empty());
 }
 
+void test_message_decode_error() {
+    // Not checked until the body is used: a list holding a bad type code
+    message m;
+    m.encoded_body(std::string("\xc0\x02\x01\xff", 4));
+    try {
+        m.body();
+        FAIL("expected error");
+    } catch (const proton::error&) {}
+
+    // Nor in a copy, which decodes lazily
+    message m2;
+    m2.encoded_body(std::string("\xc0\x02\x01\xff", 4));
+    message m3(m2);
+    try {
+        m3.body();
+        FAIL("expected error");
+    } catch (const proton::error&) {}
+}
+
 }
 
 int main(int, char**) {
@@ -172,5 +191,6 @@ int main(int, char**) {
     RUN_TEST(failed, test_message_defaults());
     RUN_TEST(failed, test_message_body());
     RUN_TEST(failed, test_message_maps());
+    RUN_TEST(failed, test_message_decode_error());
     return failed;
 }
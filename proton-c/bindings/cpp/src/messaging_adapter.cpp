@@ -23,6 +23,7 @@
 
 #include "proton/delivery.hpp"
 #include "proton/error.hpp"
+#include "proton/io/connection_driver.hpp"
 #include "proton/receiver_options.hpp"
 #include "proton/sender.hpp"
 #include "proton/sender_options.hpp"
@@ -108,7 +109,34 @@ void messaging_adapter::on_delivery(proton_event &pe) {
 
     if (pn_link_is_receiver(lnk)) {
         delivery d(make_wrapper<delivery>(dlv));
-        if (!pn_delivery_partial(dlv) && pn_delivery_readable(dlv)) {
+        if (lctx.stream_messages && pn_delivery_readable(dlv)) {
+            // Hand over whatever has arrived so the message is never
+            // buffered whole, neither here nor in the engine
+            size_t pending = pn_delivery_pending(dlv);
+            bool last = !pn_delivery_partial(dlv);
+            if (pending || last) {
+                pn_connection_t *pnc = pn_session_connection(pn_link_session(lnk));
+                std::vector<char> &buf = connection_context::get(pnc).event_chunk;
+                buf.resize(pending);
+                if (pending && pn_link_recv(lnk, &buf[0], pending) != ssize_t(pending))
+                    throw error(MSG("receiver read failure"));
+                if (last) pn_link_advance(lnk);
+                if (pn_link_state(lnk) & PN_LOCAL_CLOSED) {
+                    if (last && lctx.auto_accept)
+                        d.release();
+                } else {
+                    delegate_.on_message_chunk(d, io::const_buffer(pending ? &buf[0] : 0, pending));
+                    if (last && lctx.auto_accept && !d.settled())
+                        d.accept();
+                }
+            }
+            // The sender may settle before the last chunk, report that once
+            if (!last && pn_delivery_updated(dlv) && d.settled()) {
+                pn_delivery_clear(dlv);
+                delegate_.on_delivery_settle(d);
+            }
+        }
+        else if (!pn_delivery_partial(dlv) && pn_delivery_readable(dlv)) {
             // generate on_message
             pn_connection_t *pnc = pn_session_connection(pn_link_session(lnk));
             connection_context& ctx = connection_context::get(pnc);
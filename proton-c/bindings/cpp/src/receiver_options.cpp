@@ -67,6 +67,7 @@ class receiver_options::impl {
     option<bool> auto_accept;
     option<bool> auto_settle;
     option<int> credit_window;
+    option<bool> stream_messages;
     option<bool> dynamic_address;
     option<source_options> source;
     option<target_options> target;
@@ -79,6 +80,7 @@ class receiver_options::impl {
             if (auto_settle.set) get_context(r).auto_settle = auto_settle.value;
             if (auto_accept.set) get_context(r).auto_accept = auto_accept.value;
             if (credit_window.set) get_context(r).credit_window = credit_window.value;
+            if (stream_messages.set) get_context(r).stream_messages = stream_messages.value;
 
             if (source.set) {
                 proton::source local_s(make_wrapper<proton::source>(pn_link_source(unwrap(r))));
@@ -97,6 +99,7 @@ class receiver_options::impl {
         auto_accept.update(x.auto_accept);
         auto_settle.update(x.auto_settle);
         credit_window.update(x.credit_window);
+        stream_messages.update(x.stream_messages);
         dynamic_address.update(x.dynamic_address);
         source.update(x.source);
         target.update(x.target);
@@ -122,6 +125,7 @@ receiver_options& receiver_options::delivery_mode(proton::delivery_mode m) {impl
 receiver_options& receiver_options::auto_accept(bool b) {impl_->auto_accept = b; return *this; }
 receiver_options& receiver_options::auto_settle(bool b) {impl_->auto_settle = b; return *this; }
 receiver_options& receiver_options::credit_window(int w) {impl_->credit_window = w; return *this; }
+receiver_options& receiver_options::stream_messages(bool b) {impl_->stream_messages = b; return *this; }
 receiver_options& receiver_options::source(source_options &s) {impl_->source = s; return *this; }
 receiver_options& receiver_options::target(target_options &s) {impl_->target = s; return *this; }
 
@@ -34,8 +34,6 @@
 #include "proton_bits.hpp"
 #include "contexts.hpp"
 
-#include <assert.h>
-
 namespace proton {
 
 sender::sender(pn_link_t *l): link(make_wrapper(l)) {}
@@ -57,24 +55,21 @@ class target sender::target() const {
     return proton::target(*this);
 }
 
-namespace {
-// TODO: revisit if thread safety required
-uint64_t tag_counter = 0;
-}
-
 tracker sender::send(const message &message) {
-    uint64_t id = ++tag_counter;
+    // Tags only need to be unique on the link, so each link counts its own
+    // and sends on different connections share nothing.
+    link_context &lctx = link_context::get(pn_object());
+    uint64_t id = ++lctx.tag_counter;
     pn_delivery_t *dlv =
         pn_delivery(pn_object(), pn_dtag(reinterpret_cast<const char*>(&id), sizeof(id)));
-    std::vector<char> buf;
-    message.encode(buf);
-    assert(!buf.empty());
-    pn_link_send(pn_object(), &buf[0], buf.size());
+    // Encodes in place into the delivery buffer, which is recycled with the
+    // delivery, so a steady stream of sends does not allocate.
+    message.encode_to(pn_object());
     pn_link_advance(pn_object());
     if (pn_link_snd_settle_mode(pn_object()) == PN_SND_SETTLED)
         pn_delivery_settle(dlv);
     if (!pn_link_credit(pn_object()))
-        link_context::get(pn_object()).draining = false;
+        lctx.draining = false;
     return make_wrapper<tracker>(dlv);
 }
 
@@ -642,6 +642,30 @@ PN_EXTERN int pn_data_put_map(pn_data_t *data);
  */
 PN_EXTERN int pn_data_put_array(pn_data_t *data, bool described, pn_type_t type);
 
+/**
+ * Puts an undescribed array of count fixed width elements into a
+ * pn_data_t in one step. The elements are given as a C array in host
+ * byte order and are stored already encoded, without a node per
+ * element, so this is much cheaper than putting them one by one. The
+ * array may still be entered and read element by element.
+ *
+ * The type may be PN_BYTE, PN_UBYTE, PN_SHORT, PN_USHORT, PN_INT,
+ * PN_UINT, PN_CHAR, PN_FLOAT, PN_DECIMAL32, PN_LONG, PN_ULONG,
+ * PN_TIMESTAMP, PN_DOUBLE or PN_DECIMAL64.
+ *
+ * @code
+ *   int32_t values[] = {1, 2, 3};
+ *   pn_data_put_array_elements(data, PN_INT, values, 3);
+ * @endcode
+ *
+ * @param data a pn_data_t object
+ * @param type the type of the elements
+ * @param elements the element values
+ * @param count the number of elements
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_data_put_array_elements(pn_data_t *data, pn_type_t type, const void *elements, size_t count);
+
 /**
  * Puts a described value into a pn_data_t object. A described node
  * has two children, the descriptor and the value. These are specified
@@ -984,6 +1008,21 @@ PN_EXTERN bool pn_data_is_array_described(pn_data_t *data);
  */
 PN_EXTERN pn_type_t pn_data_get_array_type(pn_data_t *data);
 
+/**
+ * If the current node is an undescribed array of one of the fixed
+ * width types accepted by ::pn_data_put_array_elements, copy its
+ * elements into a C array in host byte order without entering it.
+ *
+ * @param data a pn_data_t object
+ * @param elements where to copy the elements, with room for count of
+ * the array type
+ * @param count the room in elements
+ * @return the number of elements copied, PN_OVERFLOW if count is
+ * smaller than the array or PN_ARG_ERR if the current node is not
+ * such an array
+ */
+PN_EXTERN ssize_t pn_data_get_array_elements(pn_data_t *data, void *elements, size_t count);
+
 /**
  * Checks if the current node is a described value. The descriptor and
  * value may be accessed by entering the described value node.
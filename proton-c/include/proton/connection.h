@@ -494,6 +494,50 @@ PN_EXTERN pn_data_t *pn_connection_remote_properties(pn_connection_t *connection
  */
 PN_EXTERN pn_transport_t *pn_connection_transport(pn_connection_t *connection);
 
+/**
+ * Get the incoming capacity of a connection in bytes.
+ *
+ * @param[in] connection the connection object
+ * @return the incoming capacity of the connection, or 0 if it has none
+ */
+PN_EXTERN size_t pn_connection_get_incoming_capacity(pn_connection_t *connection);
+
+/**
+ * Limit the incoming message data buffered by all the sessions of a
+ * connection together.
+ *
+ * Each session's incoming window is shrunk as the connection's
+ * buffered bytes, and the windows already granted to its other
+ * sessions, approach the capacity, and is opened again as the
+ * application reads the data. This is in addition to the capacity
+ * of each session, see ::pn_session_set_incoming_capacity. Like the
+ * session capacity it is counted in frames of the transport's
+ * maximum frame size, so it has no effect unless one is set with
+ * ::pn_transport_set_max_frame.
+ *
+ * @param[in] connection the connection object
+ * @param[in] capacity the incoming capacity in bytes, 0 for no limit
+ */
+PN_EXTERN void pn_connection_set_incoming_capacity(pn_connection_t *connection, size_t capacity);
+
+/**
+ * Get the number of incoming bytes currently buffered by all the
+ * sessions of a connection.
+ *
+ * @param[in] connection the connection object
+ * @return the number of incoming bytes currently buffered
+ */
+PN_EXTERN size_t pn_connection_incoming_bytes(pn_connection_t *connection);
+
+/**
+ * Get the number of outgoing bytes currently buffered by all the
+ * sessions of a connection.
+ *
+ * @param[in] connection the connection object
+ * @return the number of outgoing bytes currently buffered
+ */
+PN_EXTERN size_t pn_connection_outgoing_bytes(pn_connection_t *connection);
+
 /**
  * @}
  */
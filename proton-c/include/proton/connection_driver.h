@@ -161,8 +161,23 @@ PN_EXTERN bool pn_connection_driver_read_closed(pn_connection_driver_t *);
  PN_EXTERN pn_bytes_t pn_connection_driver_write_buffer(pn_connection_driver_t *);
 
 /**
- * Call when the first n bytes of pn_connection_driver_write_buffer() have been
- * written to IO. Reclaims the buffer space and reset the write buffer.
+ * Get the pending output as a list of buffers, for use with a gathering
+ * write such as writev() or sendmsg().
+ *
+ * Fills in up to iovcnt entries of iov and returns the number used, 0 means
+ * there is nothing to write. Where no security layer has to transform the
+ * output, frames are returned from where the transport queued them without
+ * first being copied into a single write buffer.
+ *
+ * Write the buffers in order and call pn_connection_driver_write_done() with
+ * the total number of bytes written. The buffers are valid until then.
+ */
+PN_EXTERN size_t pn_connection_driver_write_iov(pn_connection_driver_t *, pn_bytes_t *iov, size_t iovcnt);
+
+/**
+ * Call when the first n bytes of pn_connection_driver_write_buffer() or
+ * pn_connection_driver_write_iov() have been written to IO. Reclaims the
+ * buffer space and reset the write buffer.
  */
 PN_EXTERN void pn_connection_driver_write_done(pn_connection_driver_t *, size_t n);
 
@@ -710,6 +710,36 @@ PN_EXTERN pn_data_t *pn_message_properties(pn_message_t *msg);
  */
 PN_EXTERN pn_data_t *pn_message_body(pn_message_t *msg);
 
+/**
+ * Set the body of a message to an AMQP value that is already encoded.
+ *
+ * The bytes are copied and sent as an amqp-value body section without
+ * being decoded. They are only decoded if pn_message_body() is called
+ * later.
+ *
+ * @param[in] msg a message object
+ * @param[in] bytes exactly one encoded AMQP value
+ * @param[in] size the size of the encoded value
+ * @return zero on success, PN_ARG_ERR if bytes is not one complete
+ * value, or another error code on failure
+ */
+PN_EXTERN int pn_message_set_encoded_body(pn_message_t *msg, const char *bytes, size_t size);
+
+/**
+ * Get the encoded body of a message without decoding it.
+ *
+ * The body is only available this way if it is an amqp-value section
+ * that is still encoded: either it came from
+ * pn_message_decode_lazy() or pn_message_set_encoded_body(), and
+ * pn_message_body() has not been called since.
+ *
+ * @param[in] msg a message object
+ * @return the encoded AMQP value of the body, valid until the message
+ * is next changed, or an empty pn_bytes_t if the body is not
+ * available encoded
+ */
+PN_EXTERN pn_bytes_t pn_message_get_encoded_body(pn_message_t *msg);
+
 /**
  * Decode/load message content from AMQP formatted binary data.
  *
@@ -724,21 +754,63 @@ PN_EXTERN pn_data_t *pn_message_body(pn_message_t *msg);
  */
 PN_EXTERN int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size);
 
+/**
+ * Like pn_message_decode(), but sections are only decoded when they
+ * are first accessed.
+ *
+ * The encoded data is copied and split into sections, which are not
+ * otherwise examined until a field in them is used. When the message
+ * is encoded again, sections that have not been changed are copied
+ * as they are.  Errors in a section are reported by
+ * pn_message_error() when the section is accessed.
+ *
+ * @param[in] msg a message object
+ * @param[in] bytes the start of the encoded AMQP data
+ * @param[in] size the size of the encoded AMQP data
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_message_decode_lazy(pn_message_t *msg, const char *bytes, size_t size);
+
 /**
  * Encode/save message content as AMQP formatted binary data.
  *
  * If the buffer space provided is insufficient to store the content
  * held in the message, the operation will fail and return a
- * PN_OVERFLOW error code.
+ * PN_OVERFLOW error code, and size is set to the amount of buffer
+ * space needed.
  *
  * @param[in] msg a message object
  * @param[in] bytes the start of empty buffer space
  * @param[in] size the amount of empty buffer space
- * @param[out] size the amount of data written
+ * @param[out] size the amount of data written, or needed on PN_OVERFLOW
  * @return zero on success or an error code on failure
  */
 PN_EXTERN int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size);
 
+/**
+ * Get the exact number of bytes pn_message_encode() will write for
+ * the current message content.
+ *
+ * @param[in] msg a message object
+ * @return the encoded size or an error code on failure
+ */
+PN_EXTERN ssize_t pn_message_encoded_size(pn_message_t *msg);
+
+/**
+ * Encode a message directly into the current delivery of a sender.
+ *
+ * This is equivalent to pn_message_encode() followed by
+ * pn_link_send(), but the message is written in place into the
+ * delivery's buffer so no intermediate buffer is needed. The link is
+ * not advanced, call pn_link_advance() when the delivery is complete.
+ *
+ * @param[in] msg a message object
+ * @param[in] sender a sending link with a current delivery
+ * @return the number of bytes sent, PN_EOS if there is no current
+ * delivery, or an error code on failure
+ */
+PN_EXTERN ssize_t pn_message_send(pn_message_t *msg, pn_link_t *sender);
+
 /**
  * Save message content into a pn_data_t object data. The data object will first be cleared.
  */
@@ -305,6 +305,15 @@ PN_EXTERN void *pn_iterator_start(pn_iterator_t *iterator,
 PN_EXTERN void *pn_iterator_next(pn_iterator_t *iterator);
 
 #define PN_LEGCTX ((pn_handle_t) 0)
+/* The reactor's handler for an object, see pn_record_get_handler() */
+#define PN_HANDLERCTX ((pn_handle_t) 1)
+/* A language binding's own context for an object */
+#define PN_BINDINGCTX ((pn_handle_t) 2)
+
+/* Handles below PN_RESERVED_HANDLES have a fixed slot in every record,
+   so getting and setting them needs no search. Any other handle must be
+   made with PN_HANDLE. */
+#define PN_RESERVED_HANDLES (3)
 
 /**
    PN_HANDLE is a trick to define a unique identifier by using the address of a static variable.
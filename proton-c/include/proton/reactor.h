@@ -163,6 +163,17 @@ PNX_EXTERN pn_task_t *pn_timer_schedule(pn_timer_t *timer, pn_timestamp_t deadli
 PNX_EXTERN int pn_timer_tasks(pn_timer_t *timer);
 
 PNX_EXTERN pn_record_t *pn_task_attachments(pn_task_t *task);
+
+/**
+ * Cancel a scheduled task.
+ *
+ * The task is removed from its timer and released at once, and may be
+ * reused for a later pn_timer_schedule() or pn_reactor_schedule(). The
+ * handle returned by those calls must not be used after the task has
+ * been cancelled or has fired unless the caller holds its own reference
+ * with pn_incref(); cancelling a task the timer no longer holds does
+ * nothing.
+ */
 PNX_EXTERN void pn_task_cancel(pn_task_t *task);
 
 PNX_EXTERN pn_reactor_t *pn_class_reactor(const pn_class_t *clazz, void *object);
@@ -101,6 +101,22 @@ typedef enum {
   PN_SSL_RESUME_REUSED          /**< Session resumed from previous session. */
 } pn_ssl_resume_status_t;
 
+/**
+ * Session resumption counters of an SSL server domain, see
+ * ::pn_ssl_domain_get_resume_stats().
+ */
+typedef struct pn_ssl_resume_stats_t {
+  uint64_t handshakes;        /**< Handshakes completed, full or resumed */
+  uint64_t resumed;           /**< Handshakes that resumed a previous session */
+  uint64_t misses;            /**< Sessions asked for but not in the cache */
+  uint64_t timeouts;          /**< Sessions asked for but expired */
+  uint64_t cache_full;        /**< Sessions dropped because the cache was full */
+  uint64_t cached;            /**< Sessions in the cache now */
+  uint64_t tickets_issued;    /**< Session tickets issued */
+  uint64_t tickets_accepted;  /**< Session tickets presented with a key still in use */
+  uint64_t tickets_rejected;  /**< Session tickets presented with an unknown or retired key */
+} pn_ssl_resume_stats_t;
+
 /**
  * Tests for SSL implementation present
  *
@@ -238,6 +254,72 @@ PN_EXTERN int pn_ssl_domain_set_peer_authentication(pn_ssl_domain_t *domain,
  */
 PN_EXTERN int pn_ssl_domain_allow_unsecured_client(pn_ssl_domain_t *domain);
 
+/**
+ * Let the operating system encrypt the output of connections using this domain.
+ *
+ * Once the TLS handshake has finished, the negotiated keys are installed in
+ * the connection's socket (Linux kernel TLS) and the transport writes
+ * plaintext, which the kernel encrypts as it sends it.  Input is still
+ * decrypted by the SSL library.  Only the proactor knows the socket, so only
+ * its connections can be offloaded.
+ *
+ * Enabling this limits the domain to TLS 1.2 and refuses renegotiation.  A
+ * connection for which the kernel cannot take over (no socket, no kernel
+ * support, or a cipher other than AES-GCM) carries on with the SSL library
+ * doing the encryption, see ::pn_ssl_get_kernel_tls().
+ *
+ * @param[in] domain the ssl domain to configure.
+ * @return 0 on success, else an error code if kernel TLS is not supported
+ * by this build.
+ */
+PN_EXTERN int pn_ssl_domain_enable_kernel_tls(pn_ssl_domain_t *domain);
+
+/**
+ * Configure the session cache of a server.
+ *
+ * A server keeps the sessions of the clients that connected to it, so that a
+ * client reconnecting with the same session (see ::pn_ssl_init) skips the
+ * full handshake.  The cache is shared by all connections of the domain and
+ * may be used from several threads at once.  When it is full the oldest
+ * sessions are dropped.
+ *
+ * @param[in] domain the server domain to configure.
+ * @param[in] size the maximum number of sessions kept, 0 disables the cache.
+ * @param[in] timeout seconds a session can be resumed for, also for session
+ * tickets.  0 keeps the library's default.
+ * @return 0 on success, else an error code.
+ */
+PN_EXTERN int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, uint32_t timeout);
+
+/**
+ * Configure the session tickets (RFC 5077) issued by a server.
+ *
+ * With session tickets the client keeps its session, encrypted by the
+ * server, so resuming costs the server no cache space.  By default tickets
+ * are encrypted with one key made when the domain is created.  Setting a key
+ * lifetime makes a new key every @p key_lifetime seconds: tickets made with
+ * the previous key are still accepted, and replaced, until the next change.
+ *
+ * @param[in] domain the server domain to configure.
+ * @param[in] enable false to stop issuing and accepting tickets.
+ * @param[in] key_lifetime seconds between ticket key changes, 0 for a single key.
+ * @return 0 on success, else an error code.
+ */
+PN_EXTERN int pn_ssl_domain_set_session_tickets(pn_ssl_domain_t *domain, bool enable, uint32_t key_lifetime);
+
+/**
+ * Get the session resumption counters of a server.
+ *
+ * The counters cover all connections of the domain.  The ticket counters
+ * are only kept when a ticket key lifetime is set (see
+ * ::pn_ssl_domain_set_session_tickets).
+ *
+ * @param[in] domain the server domain.
+ * @param[out] stats set to the current counters.
+ * @return 0 on success, else an error code.
+ */
+PN_EXTERN int pn_ssl_domain_get_resume_stats(pn_ssl_domain_t *domain, pn_ssl_resume_stats_t *stats);
+
 /**
  * Create a new SSL session object associated with a transport.
  *
@@ -320,6 +402,15 @@ PN_EXTERN bool pn_ssl_get_protocol_name(pn_ssl_t *ssl, char *buffer, size_t size
  */
 PN_EXTERN pn_ssl_resume_status_t pn_ssl_resume_status(pn_ssl_t *ssl);
 
+/**
+ * Check whether the kernel encrypts the output of the connection.
+ *
+ * @param[in] ssl the ssl session to check
+ * @return true once the keys have been installed in the socket (see
+ * ::pn_ssl_domain_enable_kernel_tls), false otherwise.
+ */
+PN_EXTERN bool pn_ssl_get_kernel_tls(pn_ssl_t *ssl);
+
 /**
  * Set the expected identity of the remote peer.
  *
@@ -23,6 +23,7 @@
 #ifndef __cplusplus
 #include <stdbool.h>
 #endif
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -155,6 +156,9 @@ int pn_buffer_ensure(pn_buffer_t *buf, size_t size)
           memmove(buf->bytes + buf->capacity - n, buf->bytes + old_head, n);
           buf->start = buf->capacity - n;
       }
+    } else {
+      buf->capacity = old_capacity;
+      return PN_OUT_OF_MEMORY;
     }
   }
 
@@ -233,6 +237,25 @@ size_t pn_buffer_get(pn_buffer_t *buf, size_t offset, size_t size, char *dst)
   return sz1 + sz2;
 }
 
+pn_rwbytes_t pn_buffer_reserve(pn_buffer_t *buf, size_t size)
+{
+  if (pni_buffer_tail_space(buf) < size) {
+    if (pn_buffer_ensure(buf, size)) {
+      pn_rwbytes_t r = {0, NULL};
+      return r;
+    }
+    pn_buffer_defrag(buf);
+  }
+  pn_rwbytes_t r = {pni_buffer_tail_space(buf), buf->bytes + pni_buffer_tail(buf)};
+  return r;
+}
+
+void pn_buffer_commit(pn_buffer_t *buf, size_t size)
+{
+  assert(size <= pni_buffer_tail_space(buf));
+  buf->size += size;
+}
+
 int pn_buffer_trim(pn_buffer_t *buf, size_t left, size_t right)
 {
   if (left + right > buf->size) return PN_ARG_ERR;
@@ -300,6 +323,18 @@ pn_rwbytes_t pn_buffer_memory(pn_buffer_t *buf)
   }
 }
 
+size_t pn_buffer_segments(pn_buffer_t *buf, pn_bytes_t *segments, size_t count)
+{
+  size_t n = 0;
+  if (n < count && buf->size) {
+    segments[n++] = pn_bytes(pni_buffer_head_size(buf), buf->bytes + pni_buffer_head(buf));
+  }
+  if (n < count && pni_buffer_tail_size(buf)) {
+    segments[n++] = pn_bytes(pni_buffer_tail_size(buf), buf->bytes);
+  }
+  return n;
+}
+
 int pn_buffer_print(pn_buffer_t *buf)
 {
   printf("pn_buffer(\"");
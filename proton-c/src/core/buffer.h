@@ -40,11 +40,18 @@ int pn_buffer_ensure(pn_buffer_t *buf, size_t size);
 int pn_buffer_append(pn_buffer_t *buf, const char *bytes, size_t size);
 int pn_buffer_prepend(pn_buffer_t *buf, const char *bytes, size_t size);
 size_t pn_buffer_get(pn_buffer_t *buf, size_t offset, size_t size, char *dst);
+// contiguous free space of at least size bytes after the contents, for writing in place,
+// or none if it cannot be allocated
+pn_rwbytes_t pn_buffer_reserve(pn_buffer_t *buf, size_t size);
+// add size bytes written in place after pn_buffer_reserve() to the contents
+void pn_buffer_commit(pn_buffer_t *buf, size_t size);
 int pn_buffer_trim(pn_buffer_t *buf, size_t left, size_t right);
 void pn_buffer_clear(pn_buffer_t *buf);
 int pn_buffer_defrag(pn_buffer_t *buf);
 pn_bytes_t pn_buffer_bytes(pn_buffer_t *buf);
 pn_rwbytes_t pn_buffer_memory(pn_buffer_t *buf);
+// the contents in order as (at most 2) contiguous segments, without defragmenting
+size_t pn_buffer_segments(pn_buffer_t *buf, pn_bytes_t *segments, size_t count);
 int pn_buffer_print(pn_buffer_t *buf);
 
 #ifdef __cplusplus
@@ -73,10 +73,85 @@ const char *pn_type_name(pn_type_t type)
   return "<UNKNOWN>";
 }
 
-static inline void pni_atom_init(pn_atom_t *atom, pn_type_t type)
+// Nodes hold only the scalar part of an atom, rebuild the whole thing
+static pn_atom_t pni_node_atom(pn_data_t *data, pni_node_t *node)
 {
-  memset(atom, 0, sizeof(pn_atom_t));
-  atom->type = type;
+  pn_atom_t atom;
+  memset(&atom, 0, sizeof(pn_atom_t));
+  atom.type = (pn_type_t) node->type;
+  switch (atom.type) {
+  case PN_DECIMAL128:
+    memcpy(atom.u.as_decimal128.bytes, pni_node_bytes(data, node).start, 16);
+    break;
+  case PN_UUID:
+    memcpy(atom.u.as_uuid.bytes, pni_node_bytes(data, node).start, 16);
+    break;
+  case PN_BINARY:
+  case PN_STRING:
+  case PN_SYMBOL:
+    atom.u.as_bytes = pni_node_bytes(data, node);
+    break;
+  case PN_DESCRIBED:
+  case PN_ARRAY:
+  case PN_LIST:
+  case PN_MAP:
+    break;
+  default:
+    memcpy(&atom.u, &node->u, sizeof(node->u.as_ulong));
+    break;
+  }
+  return atom;
+}
+
+// Convert count elements of width bytes between host and encoded (big
+// endian) order. The conversion is its own inverse so dst may be src.
+static void pni_swap_copy(char *dst, const char *src, size_t width, size_t count)
+{
+  static const union { uint16_t u; uint8_t c[2]; } order = {1};
+  if (width == 1 || !order.c[0]) {
+    memmove(dst, src, width * count);
+    return;
+  }
+  switch (width) {
+  case 2:
+    for (size_t i = 0; i < count; i++) {
+      uint16_t v;
+      memcpy(&v, src + 2*i, 2);
+      v = (uint16_t) ((v >> 8) | (v << 8));
+      memcpy(dst + 2*i, &v, 2);
+    }
+    break;
+  case 4:
+    for (size_t i = 0; i < count; i++) {
+      uint32_t v;
+      memcpy(&v, src + 4*i, 4);
+      v = ((v & 0xFF) << 24) | ((v & 0xFF00) << 8) | ((v >> 8) & 0xFF00) | (v >> 24);
+      memcpy(dst + 4*i, &v, 4);
+    }
+    break;
+  case 8:
+    for (size_t i = 0; i < count; i++) {
+      uint64_t v;
+      memcpy(&v, src + 8*i, 8);
+      v = ((v & 0xFFULL) << 56) | ((v & 0xFF00ULL) << 40) |
+          ((v & 0xFF0000ULL) << 24) | ((v & 0xFF000000ULL) << 8) |
+          ((v >> 8) & 0xFF000000ULL) | ((v >> 24) & 0xFF0000ULL) |
+          ((v >> 40) & 0xFF00ULL) | (v >> 56);
+      memcpy(dst + 8*i, &v, 8);
+    }
+    break;
+  }
+}
+
+// Element i of a packed array
+static pn_atom_t pni_packed_atom(pn_data_t *data, pni_node_t *node, size_t i)
+{
+  pn_atom_t atom;
+  memset(&atom, 0, sizeof(pn_atom_t));
+  atom.type = (pn_type_t) node->array_type;
+  size_t width = pni_packed_width(atom.type);
+  pni_swap_copy((char *) &atom.u, pni_node_bytes(data, node).start + i*width, width, 1);
+  return atom;
 }
 
 // data
@@ -95,16 +170,16 @@ static void pn_data_finalize(void *object)
 static const pn_fields_t *pni_node_fields(pn_data_t *data, pni_node_t *node)
 {
   if (!node) return NULL;
-  if (node->atom.type != PN_DESCRIBED) return NULL;
+  if (node->type != PN_DESCRIBED) return NULL;
 
   pni_node_t *descriptor = pn_data_node(data, node->down);
 
-  if (!descriptor || descriptor->atom.type != PN_ULONG) {
+  if (!descriptor || descriptor->type != PN_ULONG) {
     return NULL;
   }
 
-  if (descriptor->atom.u.as_ulong >= FIELD_MIN && descriptor->atom.u.as_ulong <= FIELD_MAX) {
-    const pn_fields_t *f = &FIELDS[descriptor->atom.u.as_ulong-FIELD_MIN];
+  if (descriptor->u.as_ulong >= FIELD_MIN && descriptor->u.as_ulong <= FIELD_MAX) {
+    const pn_fields_t *f = &FIELDS[descriptor->u.as_ulong-FIELD_MIN];
     return (f->name_index!=0) ? f : NULL;
   } else {
     return NULL;
@@ -250,7 +325,7 @@ int pni_inspect_atom(pn_atom_t *atom, pn_string_t *str)
 int pni_inspect_enter(void *ctx, pn_data_t *data, pni_node_t *node)
 {
   pn_string_t *str = (pn_string_t *) ctx;
-  pn_atom_t *atom = (pn_atom_t *) &node->atom;
+  pn_atom_t atom = pni_node_atom(data, node);
 
   pni_node_t *parent = pn_data_node(data, node->parent);
   const pn_fields_t *fields = pni_node_fields(data, parent);
@@ -261,7 +336,7 @@ int pni_inspect_enter(void *ctx, pn_data_t *data, pni_node_t *node)
   int err;
 
   if (grandfields) {
-    if (atom->type == PN_NULL) {
+    if (atom.type == PN_NULL) {
       return 0;
     }
     const char *name = (index < grandfields->field_count)
@@ -273,12 +348,25 @@ int pni_inspect_enter(void *ctx, pn_data_t *data, pni_node_t *node)
     }
   }
 
-  switch (atom->type) {
+  switch (atom.type) {
   case PN_DESCRIBED:
     return pn_string_addf(str, "@");
   case PN_ARRAY:
     // XXX: need to fix for described arrays
-    return pn_string_addf(str, "@%s[", pn_type_name(node->type));
+    err = pn_string_addf(str, "@%s[", pn_type_name((pn_type_t) node->array_type));
+    if (err) return err;
+    if (node->packed) {
+      for (size_t i = 0; i < node->children; i++) {
+        if (i) {
+          err = pn_string_addf(str, ", ");
+          if (err) return err;
+        }
+        pn_atom_t element = pni_packed_atom(data, node, i);
+        err = pni_inspect_atom(&element, str);
+        if (err) return err;
+      }
+    }
+    return 0;
   case PN_LIST:
     return pn_string_addf(str, "[");
   case PN_MAP:
@@ -289,11 +377,11 @@ int pni_inspect_enter(void *ctx, pn_data_t *data, pni_node_t *node)
       if (err) return err;
       err = pn_string_addf(str, "(");
       if (err) return err;
-      err = pni_inspect_atom(atom, str);
+      err = pni_inspect_atom(&atom, str);
       if (err) return err;
       return pn_string_addf(str, ")");
     } else {
-      return pni_inspect_atom(atom, str);
+      return pni_inspect_atom(&atom, str);
     }
   }
 }
@@ -302,7 +390,7 @@ pni_node_t *pni_next_nonnull(pn_data_t *data, pni_node_t *node)
 {
   while (node) {
     node = pn_data_node(data, node->next);
-    if (node && node->atom.type != PN_NULL) {
+    if (node && node->type != PN_NULL) {
       return node;
     }
   }
@@ -319,7 +407,7 @@ int pni_inspect_exit(void *ctx, pn_data_t *data, pni_node_t *node)
   pni_node_t *next = pn_data_node(data, node->next);
   int err;
 
-  switch (node->atom.type) {
+  switch (node->type) {
   case PN_ARRAY:
   case PN_LIST:
     err = pn_string_addf(str, "]");
@@ -333,12 +421,12 @@ int pni_inspect_exit(void *ctx, pn_data_t *data, pni_node_t *node)
     break;
   }
 
-  if (!grandfields || node->atom.type != PN_NULL) {
+  if (!grandfields || node->type != PN_NULL) {
     if (next) {
       int index = pni_node_index(data, node);
-      if (parent && parent->atom.type == PN_MAP && (index % 2) == 0) {
+      if (parent && parent->type == PN_MAP && (index % 2) == 0) {
         err = pn_string_addf(str, "=");
-      } else if (parent && parent->atom.type == PN_DESCRIBED && index == 0) {
+      } else if (parent && parent->type == PN_DESCRIBED && index == 0) {
         err = pn_string_addf(str, " ");
         if (err) return err;
       } else {
@@ -371,15 +459,18 @@ pn_data_t *pn_data(size_t capacity)
   data->capacity = capacity;
   data->size = 0;
   data->nodes = capacity ? (pni_node_t *) malloc(capacity * sizeof(pni_node_t)) : NULL;
-  data->buf = pn_buffer(64);
   data->parent = 0;
   data->current = 0;
   data->base_parent = 0;
   data->base_current = 0;
-  data->decoder = pn_decoder();
-  data->encoder = pn_encoder();
-  data->error = pn_error();
-  data->str = pn_string(NULL);
+  data->changes = 0;
+  // Most pn_data_t hold nothing, such as the unused fields of a terminus
+  // or condition, so the rest is only allocated when it is first needed
+  data->buf = NULL;
+  data->decoder = NULL;
+  data->encoder = NULL;
+  data->error = NULL;
+  data->str = NULL;
   return data;
 }
 
@@ -390,14 +481,25 @@ void pn_data_free(pn_data_t *data)
 
 int pn_data_errno(pn_data_t *data)
 {
-  return pn_error_code(data->error);
+  return data->error ? pn_error_code(data->error) : 0;
 }
 
 pn_error_t *pn_data_error(pn_data_t *data)
 {
+  if (!data->error) {
+    data->error = pn_error();
+  }
   return data->error;
 }
 
+static pn_string_t *pni_data_str(pn_data_t *data)
+{
+  if (!data->str) {
+    data->str = pn_string(NULL);
+  }
+  return data->str;
+}
+
 size_t pn_data_size(pn_data_t *data)
 {
   return data ? data->size : 0;
@@ -411,7 +513,8 @@ void pn_data_clear(pn_data_t *data)
     data->current = 0;
     data->base_parent = 0;
     data->base_current = 0;
-    pn_buffer_clear(data->buf);
+    data->changes++;
+    if (data->buf) pn_buffer_clear(data->buf);
   }
 }
 
@@ -429,55 +532,24 @@ static int pni_data_grow(pn_data_t *data)
   return 0;
 }
 
-static ssize_t pni_data_intern(pn_data_t *data, const char *start, size_t size)
+/* Copy a value that doesn't fit in a node to the end of data->buf, with
+   a terminating NUL for bytes types */
+static int pni_data_intern(pn_data_t *data, pni_node_t *node, const char *start, size_t size, bool nul)
 {
+  if (!data->buf) {
+    data->buf = pn_buffer(size < 64 ? 64 : size + 1);
+    if (!data->buf) return PN_OUT_OF_MEMORY;
+  }
   size_t offset = pn_buffer_size(data->buf);
+  if (offset + size + 1 > UINT32_MAX) return PN_OUT_OF_MEMORY;
   int err = pn_buffer_append(data->buf, start, size);
   if (err) return err;
-  err = pn_buffer_append(data->buf, "\0", 1);
-  if (err) return err;
-  return offset;
-}
-
-static pn_bytes_t *pni_data_bytes(pn_data_t *data, pni_node_t *node)
-{
-  switch (node->atom.type) {
-  case PN_BINARY:
-  case PN_STRING:
-  case PN_SYMBOL:
-    return &node->atom.u.as_bytes;
-  default: return NULL;
-  }
-}
-
-static void pni_data_rebase(pn_data_t *data, char *base)
-{
-  for (unsigned i = 0; i < data->size; i++) {
-    pni_node_t *node = &data->nodes[i];
-    if (node->data) {
-      pn_bytes_t *bytes = pni_data_bytes(data, node);
-      bytes->start = base + node->data_offset;
-    }
-  }
-}
-
-static int pni_data_intern_node(pn_data_t *data, pni_node_t *node)
-{
-  pn_bytes_t *bytes = pni_data_bytes(data, node);
-  if (!bytes) return 0;
-  size_t oldcap = pn_buffer_capacity(data->buf);
-  ssize_t offset = pni_data_intern(data, bytes->start, bytes->size);
-  if (offset < 0) return offset;
-  node->data = true;
-  node->data_offset = offset;
-  node->data_size = bytes->size;
-  pn_rwbytes_t buf = pn_buffer_memory(data->buf);
-  bytes->start = buf.start + offset;
-
-  if (pn_buffer_capacity(data->buf) != oldcap) {
-    pni_data_rebase(data, buf.start);
+  if (nul) {
+    err = pn_buffer_append(data->buf, "\0", 1);
+    if (err) return err;
   }
-
+  node->u.as_data.offset = offset;
+  node->u.as_data.size = size;
   return 0;
 }
 
@@ -565,10 +637,10 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
     case 'T':
       {
         pni_node_t *parent = pn_data_node(data, data->parent);
-        if (parent->atom.type == PN_ARRAY) {
-          parent->type = (pn_type_t) va_arg(ap, int);
+        if (parent->type == PN_ARRAY) {
+          parent->array_type = (pn_type_t) va_arg(ap, int);
         } else {
-          return pn_error_format(data->error, PN_ERR, "naked type");
+          return pn_error_format(pn_data_error(data), PN_ERR, "naked type");
         }
       }
       break;
@@ -600,7 +672,7 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
     case '}':
     case ']':
       if (!pn_data_exit(data))
-        return pn_error_format(data->error, PN_ERR, "exit failed");
+        return pn_error_format(pn_data_error(data), PN_ERR, "exit failed");
       break;
     case '?':
       if (!va_arg(ap, int)) {
@@ -656,10 +728,10 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
 
     pni_node_t *parent = pn_data_node(data, data->parent);
     while (parent) {
-      if (parent->atom.type == PN_DESCRIBED && parent->children == 2) {
+      if (parent->type == PN_DESCRIBED && parent->children == 2) {
         pn_data_exit(data);
         parent = pn_data_node(data, data->parent);
-      } else if (parent->atom.type == PN_NULL && parent->children == 1) {
+      } else if (parent->type == PN_NULL && parent->children == 1) {
         pn_data_exit(data);
         pni_node_t *current = pn_data_node(data, data->current);
         current->down = 0;
@@ -693,7 +765,7 @@ static bool pn_scan_next(pn_data_t *data, pn_type_t *type, bool suspend)
     return true;
   } else {
     pni_node_t *parent = pn_data_node(data, data->parent);
-    if (parent && parent->atom.type == PN_DESCRIBED) {
+    if (parent && parent->type == PN_DESCRIBED) {
       pn_data_exit(data);
       return pn_scan_next(data, type, suspend);
     } else {
@@ -1026,7 +1098,7 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
     case '}':
       level--;
       if (!suspend && !pn_data_exit(data))
-        return pn_error_format(data->error, PN_ERR, "exit failed");
+        return pn_error_format(pn_data_error(data), PN_ERR, "exit failed");
       if (resume_count && level == count_level) resume_count--;
       break;
     case '.':
@@ -1036,7 +1108,7 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
       break;
     case '?':
       if (!*fmt || *fmt == '?')
-        return pn_error_format(data->error, PN_ARG_ERR, "codes must follow a ?");
+        return pn_error_format(pn_data_error(data), PN_ARG_ERR, "codes must follow a ?");
       scanarg = va_arg(ap, bool *);
       break;
     case 'C':
@@ -1045,7 +1117,7 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
         if (!suspend) {
           size_t old = pn_data_size(dst);
           pni_node_t *next = pni_data_peek(data);
-          if (next && next->atom.type != PN_NULL) {
+          if (next && next->type != PN_NULL) {
             pn_data_narrow(data);
             int err = pn_data_appendn(dst, data, 1);
             pn_data_widen(data);
@@ -1062,7 +1134,7 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
       if (resume_count && level == count_level) resume_count--;
       break;
     default:
-      return pn_error_format(data->error, PN_ARG_ERR, "unrecognized scan code: 0x%.2X '%c'", code, code);
+      return pn_error_format(pn_data_error(data), PN_ARG_ERR, "unrecognized scan code: 0x%.2X '%c'", code, code);
     }
 
     if (scanarg && code != '?') {
@@ -1085,7 +1157,7 @@ int pn_data_scan(pn_data_t *data, const char *fmt, ...)
 
 static int pni_data_inspectify(pn_data_t *data)
 {
-  int err = pn_string_set(data->str, "");
+  int err = pn_string_set(pni_data_str(data), "");
   if (err) return err;
   return pn_data_inspect(data, data->str);
 }
@@ -1154,7 +1226,7 @@ pn_handle_t pn_data_point(pn_data_t *data)
   if (data->current) {
     return (pn_handle_t)(uintptr_t)data->current;
   } else {
-    return (pn_handle_t)(uintptr_t)-data->parent;
+    return (pn_handle_t)(uintptr_t)-(pn_shandle_t)data->parent;
   }
 }
 
@@ -1269,7 +1341,7 @@ pn_type_t pn_data_type(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
   if (node) {
-    return node->atom.type;
+    return (pn_type_t) node->type;
   } else {
     return PN_INVALID;
   }
@@ -1279,7 +1351,7 @@ pn_type_t pni_data_parent_type(pn_data_t *data)
 {
   pni_node_t *node = pn_data_node(data, data->parent);
   if (node) {
-    return node->atom.type;
+    return (pn_type_t) node->type;
   } else {
     return PN_INVALID;
   }
@@ -1295,9 +1367,38 @@ size_t pn_data_siblings(pn_data_t *data)
   }
 }
 
+// Replace the elements of a packed array by child nodes
+static int pni_data_unpack(pn_data_t *data, pni_nid_t array)
+{
+  pni_node_t *node = pn_data_node(data, array);
+  size_t count = node->children;
+  node->packed = false;
+  node->children = 0;
+  node->down = 0;
+
+  pni_nid_t parent = data->parent;
+  pni_nid_t current = data->current;
+  // the value is the same, only its representation changes
+  uint32_t changes = data->changes;
+  data->parent = array;
+  data->current = 0;
+  int err = 0;
+  for (size_t i = 0; i < count && !err; i++) {
+    // the nodes move if they grow
+    err = pn_data_put_atom(data, pni_packed_atom(data, pn_data_node(data, array), i));
+  }
+  data->parent = parent;
+  data->current = current;
+  data->changes = changes;
+  return err;
+}
+
 bool pn_data_enter(pn_data_t *data)
 {
   if (data->current) {
+    if (pni_data_current(data)->packed && pni_data_unpack(data, data->current)) {
+      return false;
+    }
     data->parent = data->current;
     data->current = 0;
     return true;
@@ -1350,8 +1451,9 @@ void pn_data_dump(pn_data_t *data)
   for (unsigned i = 0; i < data->size; i++)
   {
     pni_node_t *node = &data->nodes[i];
-    pn_string_set(data->str, "");
-    pni_inspect_atom((pn_atom_t *) &node->atom, data->str);
+    pn_string_set(pni_data_str(data), "");
+    pn_atom_t atom = pni_node_atom(data, node);
+    pni_inspect_atom(&atom, data->str);
     printf("Node %i: prev=%" PN_ZI ", next=%" PN_ZI ", parent=%" PN_ZI ", down=%" PN_ZI 
            ", children=%" PN_ZI ", type=%s (%s)\n",
            i + 1, (size_t) node->prev,
@@ -1359,7 +1461,7 @@ void pn_data_dump(pn_data_t *data)
            (size_t) node->parent,
            (size_t) node->down,
            (size_t) node->children,
-           pn_type_name(node->atom.type), pn_string_get(data->str));
+           pn_type_name((pn_type_t) node->type), pn_string_get(data->str));
   }
 }
 
@@ -1415,25 +1517,28 @@ static pni_node_t *pni_data_add(pn_data_t *data)
 
   node->down = 0;
   node->children = 0;
-  node->data = false;
-  node->data_offset = 0;
-  node->data_size = 0;
+  node->packed = false;
+  node->u.as_ulong = 0;
   data->current = pni_data_id(data, node);
+  data->changes++;
   return node;
 }
 
 ssize_t pn_data_encode(pn_data_t *data, char *bytes, size_t size)
 {
+  if (!data->encoder) data->encoder = pn_encoder();
   return pn_encoder_encode(data->encoder, data, bytes, size);
 }
 
 ssize_t pn_data_encoded_size(pn_data_t *data)
 {
+  if (!data->encoder) data->encoder = pn_encoder();
   return pn_encoder_size(data->encoder, data);
 }
 
 ssize_t pn_data_decode(pn_data_t *data, const char *bytes, size_t size)
 {
+  if (!data->decoder) data->decoder = pn_decoder();
   return pn_decoder_decode(data->decoder, bytes, size, data);
 }
 
@@ -1441,7 +1546,7 @@ int pn_data_put_list(pn_data_t *data)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_LIST;
+  node->type = PN_LIST;
   return 0;
 }
 
@@ -1449,7 +1554,7 @@ int pn_data_put_map(pn_data_t *data)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_MAP;
+  node->type = PN_MAP;
   return 0;
 }
 
@@ -1457,23 +1562,48 @@ int pn_data_put_array(pn_data_t *data, bool described, pn_type_t type)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_ARRAY;
+  node->type = PN_ARRAY;
   node->described = described;
-  node->type = type;
+  node->array_type = type;
   return 0;
 }
 
 void pni_data_set_array_type(pn_data_t *data, pn_type_t type)
 {
   pni_node_t *array = pni_data_current(data);
-  if (array) array->type = type;
+  if (array) array->array_type = type;
+}
+
+int pni_data_put_packed_array(pn_data_t *data, pn_type_t type, const char *bytes, size_t count)
+{
+  size_t width = pni_packed_width(type);
+  if (!width) return PN_ARG_ERR;
+  if (count > UINT32_MAX / width) return PN_OVERFLOW;
+  pni_node_t *node = pni_data_add(data);
+  if (node == NULL) return PN_OUT_OF_MEMORY;
+  node->type = PN_ARRAY;
+  node->described = false;
+  node->array_type = type;
+  node->packed = true;
+  node->children = count;
+  return pni_data_intern(data, node, bytes, width * count, false);
+}
+
+int pn_data_put_array_elements(pn_data_t *data, pn_type_t type, const void *elements, size_t count)
+{
+  int err = pni_data_put_packed_array(data, type, (const char *) elements, count);
+  if (err) return err;
+  pni_node_t *node = pni_data_current(data);
+  char *bytes = (char *) pni_node_bytes(data, node).start;
+  pni_swap_copy(bytes, bytes, pni_packed_width(type), count);
+  return 0;
 }
 
 int pn_data_put_described(pn_data_t *data)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_DESCRIBED;
+  node->type = PN_DESCRIBED;
   return 0;
 }
 
@@ -1481,7 +1611,8 @@ int pn_data_put_null(pn_data_t *data)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  pni_atom_init(&node->atom, PN_NULL);
+  node->type = PN_NULL;
+  node->u.as_ulong = 0;
   return 0;
 }
 
@@ -1489,8 +1620,8 @@ int pn_data_put_bool(pn_data_t *data, bool b)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_BOOL;
-  node->atom.u.as_bool = b;
+  node->type = PN_BOOL;
+  node->u.as_bool = b;
   return 0;
 }
 
@@ -1498,8 +1629,8 @@ int pn_data_put_ubyte(pn_data_t *data, uint8_t ub)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_UBYTE;
-  node->atom.u.as_ubyte = ub;
+  node->type = PN_UBYTE;
+  node->u.as_ubyte = ub;
   return 0;
 }
 
@@ -1507,8 +1638,8 @@ int pn_data_put_byte(pn_data_t *data, int8_t b)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_BYTE;
-  node->atom.u.as_byte = b;
+  node->type = PN_BYTE;
+  node->u.as_byte = b;
   return 0;
 }
 
@@ -1516,8 +1647,8 @@ int pn_data_put_ushort(pn_data_t *data, uint16_t us)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_USHORT;
-  node->atom.u.as_ushort = us;
+  node->type = PN_USHORT;
+  node->u.as_ushort = us;
   return 0;
 }
 
@@ -1525,8 +1656,8 @@ int pn_data_put_short(pn_data_t *data, int16_t s)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_SHORT;
-  node->atom.u.as_short = s;
+  node->type = PN_SHORT;
+  node->u.as_short = s;
   return 0;
 }
 
@@ -1534,8 +1665,8 @@ int pn_data_put_uint(pn_data_t *data, uint32_t ui)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_UINT;
-  node->atom.u.as_uint = ui;
+  node->type = PN_UINT;
+  node->u.as_uint = ui;
   return 0;
 }
 
@@ -1543,8 +1674,8 @@ int pn_data_put_int(pn_data_t *data, int32_t i)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_INT;
-  node->atom.u.as_int = i;
+  node->type = PN_INT;
+  node->u.as_int = i;
   return 0;
 }
 
@@ -1552,8 +1683,8 @@ int pn_data_put_char(pn_data_t *data, pn_char_t c)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_CHAR;
-  node->atom.u.as_char = c;
+  node->type = PN_CHAR;
+  node->u.as_char = c;
   return 0;
 }
 
@@ -1561,8 +1692,8 @@ int pn_data_put_ulong(pn_data_t *data, uint64_t ul)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_ULONG;
-  node->atom.u.as_ulong = ul;
+  node->type = PN_ULONG;
+  node->u.as_ulong = ul;
   return 0;
 }
 
@@ -1570,8 +1701,8 @@ int pn_data_put_long(pn_data_t *data, int64_t l)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_LONG;
-  node->atom.u.as_long = l;
+  node->type = PN_LONG;
+  node->u.as_long = l;
   return 0;
 }
 
@@ -1579,8 +1710,8 @@ int pn_data_put_timestamp(pn_data_t *data, pn_timestamp_t t)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_TIMESTAMP;
-  node->atom.u.as_timestamp = t;
+  node->type = PN_TIMESTAMP;
+  node->u.as_timestamp = t;
   return 0;
 }
 
@@ -1588,8 +1719,8 @@ int pn_data_put_float(pn_data_t *data, float f)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_FLOAT;
-  node->atom.u.as_float = f;
+  node->type = PN_FLOAT;
+  node->u.as_float = f;
   return 0;
 }
 
@@ -1597,8 +1728,8 @@ int pn_data_put_double(pn_data_t *data, double d)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_DOUBLE;
-  node->atom.u.as_double = d;
+  node->type = PN_DOUBLE;
+  node->u.as_double = d;
   return 0;
 }
 
@@ -1606,8 +1737,8 @@ int pn_data_put_decimal32(pn_data_t *data, pn_decimal32_t d)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_DECIMAL32;
-  node->atom.u.as_decimal32 = d;
+  node->type = PN_DECIMAL32;
+  node->u.as_decimal32 = d;
   return 0;
 }
 
@@ -1615,8 +1746,8 @@ int pn_data_put_decimal64(pn_data_t *data, pn_decimal64_t d)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_DECIMAL64;
-  node->atom.u.as_decimal64 = d;
+  node->type = PN_DECIMAL64;
+  node->u.as_decimal64 = d;
   return 0;
 }
 
@@ -1624,59 +1755,63 @@ int pn_data_put_decimal128(pn_data_t *data, pn_decimal128_t d)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_DECIMAL128;
-  memmove(node->atom.u.as_decimal128.bytes, d.bytes, 16);
-  return 0;
+  node->type = PN_DECIMAL128;
+  return pni_data_intern(data, node, d.bytes, 16, false);
 }
 
 int pn_data_put_uuid(pn_data_t *data, pn_uuid_t u)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_UUID;
-  memmove(node->atom.u.as_uuid.bytes, u.bytes, 16);
-  return 0;
+  node->type = PN_UUID;
+  return pni_data_intern(data, node, u.bytes, 16, false);
 }
 
 int pn_data_put_binary(pn_data_t *data, pn_bytes_t bytes)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_BINARY;
-  node->atom.u.as_bytes = bytes;
-  return pni_data_intern_node(data, node);
+  node->type = PN_BINARY;
+  return pni_data_intern(data, node, bytes.start, bytes.size, true);
 }
 
 int pn_data_put_string(pn_data_t *data, pn_bytes_t string)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_STRING;
-  node->atom.u.as_bytes = string;
-  return pni_data_intern_node(data, node);
+  node->type = PN_STRING;
+  return pni_data_intern(data, node, string.start, string.size, true);
 }
 
 int pn_data_put_symbol(pn_data_t *data, pn_bytes_t symbol)
 {
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom.type = PN_SYMBOL;
-  node->atom.u.as_bytes = symbol;
-  return pni_data_intern_node(data, node);
+  node->type = PN_SYMBOL;
+  return pni_data_intern(data, node, symbol.start, symbol.size, true);
 }
 
 int pn_data_put_atom(pn_data_t *data, pn_atom_t atom)
 {
+  switch (atom.type) {
+  case PN_DECIMAL128: return pn_data_put_decimal128(data, atom.u.as_decimal128);
+  case PN_UUID: return pn_data_put_uuid(data, atom.u.as_uuid);
+  case PN_BINARY: return pn_data_put_binary(data, atom.u.as_bytes);
+  case PN_STRING: return pn_data_put_string(data, atom.u.as_bytes);
+  case PN_SYMBOL: return pn_data_put_symbol(data, atom.u.as_bytes);
+  default: break;
+  }
   pni_node_t *node = pni_data_add(data);
   if (node == NULL) return PN_OUT_OF_MEMORY;
-  node->atom = atom;
-  return pni_data_intern_node(data, node);
+  node->type = atom.type;
+  memcpy(&node->u, &atom.u, sizeof(node->u.as_ulong));
+  return 0;
 }
 
 size_t pn_data_get_list(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_LIST) {
+  if (node && node->type == PN_LIST) {
     return node->children;
   } else {
     return 0;
@@ -1686,7 +1821,7 @@ size_t pn_data_get_list(pn_data_t *data)
 size_t pn_data_get_map(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_MAP) {
+  if (node && node->type == PN_MAP) {
     return node->children;
   } else {
     return 0;
@@ -1696,7 +1831,7 @@ size_t pn_data_get_map(pn_data_t *data)
 size_t pn_data_get_array(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_ARRAY) {
+  if (node && node->type == PN_ARRAY) {
     if (node->described) {
       return node->children - 1;
     } else {
@@ -1710,7 +1845,7 @@ size_t pn_data_get_array(pn_data_t *data)
 bool pn_data_is_array_described(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_ARRAY) {
+  if (node && node->type == PN_ARRAY) {
     return node->described;
   } else {
     return false;
@@ -1720,30 +1855,52 @@ bool pn_data_is_array_described(pn_data_t *data)
 pn_type_t pn_data_get_array_type(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_ARRAY) {
-    return node->type;
+  if (node && node->type == PN_ARRAY) {
+    return (pn_type_t) node->array_type;
   } else {
     return PN_INVALID;
   }
 }
 
+ssize_t pn_data_get_array_elements(pn_data_t *data, void *elements, size_t count)
+{
+  pni_node_t *node = pni_data_current(data);
+  if (!node || node->type != PN_ARRAY || node->described) return PN_ARG_ERR;
+  size_t width = pni_packed_width((pn_type_t) node->array_type);
+  if (!width) return PN_ARG_ERR;
+  if (count < node->children) return PN_OVERFLOW;
+
+  char *out = (char *) elements;
+  if (node->packed) {
+    pni_swap_copy(out, pni_node_bytes(data, node).start, width, node->children);
+  } else {
+    // every scalar member of the union starts at its first byte
+    for (pni_node_t *child = pn_data_node(data, node->down); child;
+         child = pn_data_node(data, child->next)) {
+      memcpy(out, &child->u, width);
+      out += width;
+    }
+  }
+  return node->children;
+}
+
 bool pn_data_is_described(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  return node && node->atom.type == PN_DESCRIBED;
+  return node && node->type == PN_DESCRIBED;
 }
 
 bool pn_data_is_null(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  return node && node->atom.type == PN_NULL;
+  return node && node->type == PN_NULL;
 }
 
 bool pn_data_get_bool(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_BOOL) {
-    return node->atom.u.as_bool;
+  if (node && node->type == PN_BOOL) {
+    return node->u.as_bool;
   } else {
     return false;
   }
@@ -1752,8 +1909,8 @@ bool pn_data_get_bool(pn_data_t *data)
 uint8_t pn_data_get_ubyte(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_UBYTE) {
-    return node->atom.u.as_ubyte;
+  if (node && node->type == PN_UBYTE) {
+    return node->u.as_ubyte;
   } else {
     return 0;
   }
@@ -1762,8 +1919,8 @@ uint8_t pn_data_get_ubyte(pn_data_t *data)
 int8_t pn_data_get_byte(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_BYTE) {
-    return node->atom.u.as_byte;
+  if (node && node->type == PN_BYTE) {
+    return node->u.as_byte;
   } else {
     return 0;
   }
@@ -1772,8 +1929,8 @@ int8_t pn_data_get_byte(pn_data_t *data)
 uint16_t pn_data_get_ushort(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_USHORT) {
-    return node->atom.u.as_ushort;
+  if (node && node->type == PN_USHORT) {
+    return node->u.as_ushort;
   } else {
     return 0;
   }
@@ -1782,8 +1939,8 @@ uint16_t pn_data_get_ushort(pn_data_t *data)
 int16_t pn_data_get_short(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_SHORT) {
-    return node->atom.u.as_short;
+  if (node && node->type == PN_SHORT) {
+    return node->u.as_short;
   } else {
     return 0;
   }
@@ -1792,8 +1949,8 @@ int16_t pn_data_get_short(pn_data_t *data)
 uint32_t pn_data_get_uint(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_UINT) {
-    return node->atom.u.as_uint;
+  if (node && node->type == PN_UINT) {
+    return node->u.as_uint;
   } else {
     return 0;
   }
@@ -1802,8 +1959,8 @@ uint32_t pn_data_get_uint(pn_data_t *data)
 int32_t pn_data_get_int(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_INT) {
-    return node->atom.u.as_int;
+  if (node && node->type == PN_INT) {
+    return node->u.as_int;
   } else {
     return 0;
   }
@@ -1812,8 +1969,8 @@ int32_t pn_data_get_int(pn_data_t *data)
 pn_char_t pn_data_get_char(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_CHAR) {
-    return node->atom.u.as_char;
+  if (node && node->type == PN_CHAR) {
+    return node->u.as_char;
   } else {
     return 0;
   }
@@ -1822,8 +1979,8 @@ pn_char_t pn_data_get_char(pn_data_t *data)
 uint64_t pn_data_get_ulong(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_ULONG) {
-    return node->atom.u.as_ulong;
+  if (node && node->type == PN_ULONG) {
+    return node->u.as_ulong;
   } else {
     return 0;
   }
@@ -1832,8 +1989,8 @@ uint64_t pn_data_get_ulong(pn_data_t *data)
 int64_t pn_data_get_long(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_LONG) {
-    return node->atom.u.as_long;
+  if (node && node->type == PN_LONG) {
+    return node->u.as_long;
   } else {
     return 0;
   }
@@ -1842,8 +1999,8 @@ int64_t pn_data_get_long(pn_data_t *data)
 pn_timestamp_t pn_data_get_timestamp(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_TIMESTAMP) {
-    return node->atom.u.as_timestamp;
+  if (node && node->type == PN_TIMESTAMP) {
+    return node->u.as_timestamp;
   } else {
     return 0;
   }
@@ -1852,8 +2009,8 @@ pn_timestamp_t pn_data_get_timestamp(pn_data_t *data)
 float pn_data_get_float(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_FLOAT) {
-    return node->atom.u.as_float;
+  if (node && node->type == PN_FLOAT) {
+    return node->u.as_float;
   } else {
     return 0;
   }
@@ -1862,8 +2019,8 @@ float pn_data_get_float(pn_data_t *data)
 double pn_data_get_double(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_DOUBLE) {
-    return node->atom.u.as_double;
+  if (node && node->type == PN_DOUBLE) {
+    return node->u.as_double;
   } else {
     return 0;
   }
@@ -1872,8 +2029,8 @@ double pn_data_get_double(pn_data_t *data)
 pn_decimal32_t pn_data_get_decimal32(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_DECIMAL32) {
-    return node->atom.u.as_decimal32;
+  if (node && node->type == PN_DECIMAL32) {
+    return node->u.as_decimal32;
   } else {
     return 0;
   }
@@ -1882,8 +2039,8 @@ pn_decimal32_t pn_data_get_decimal32(pn_data_t *data)
 pn_decimal64_t pn_data_get_decimal64(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_DECIMAL64) {
-    return node->atom.u.as_decimal64;
+  if (node && node->type == PN_DECIMAL64) {
+    return node->u.as_decimal64;
   } else {
     return 0;
   }
@@ -1892,30 +2049,28 @@ pn_decimal64_t pn_data_get_decimal64(pn_data_t *data)
 pn_decimal128_t pn_data_get_decimal128(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_DECIMAL128) {
-    return node->atom.u.as_decimal128;
-  } else {
-    pn_decimal128_t t = {{0}};
-    return t;
+  pn_decimal128_t t = {{0}};
+  if (node && node->type == PN_DECIMAL128) {
+    memcpy(t.bytes, pni_node_bytes(data, node).start, 16);
   }
+  return t;
 }
 
 pn_uuid_t pn_data_get_uuid(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_UUID) {
-    return node->atom.u.as_uuid;
-  } else {
-    pn_uuid_t t = {{0}};
-    return t;
+  pn_uuid_t t = {{0}};
+  if (node && node->type == PN_UUID) {
+    memcpy(t.bytes, pni_node_bytes(data, node).start, 16);
   }
+  return t;
 }
 
 pn_bytes_t pn_data_get_binary(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_BINARY) {
-    return node->atom.u.as_bytes;
+  if (node && node->type == PN_BINARY) {
+    return pni_node_bytes(data, node);
   } else {
     pn_bytes_t t = {0};
     return t;
@@ -1925,8 +2080,8 @@ pn_bytes_t pn_data_get_binary(pn_data_t *data)
 pn_bytes_t pn_data_get_string(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_STRING) {
-    return node->atom.u.as_bytes;
+  if (node && node->type == PN_STRING) {
+    return pni_node_bytes(data, node);
   } else {
     pn_bytes_t t = {0};
     return t;
@@ -1936,8 +2091,8 @@ pn_bytes_t pn_data_get_string(pn_data_t *data)
 pn_bytes_t pn_data_get_symbol(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && node->atom.type == PN_SYMBOL) {
-    return node->atom.u.as_bytes;
+  if (node && node->type == PN_SYMBOL) {
+    return pni_node_bytes(data, node);
   } else {
     pn_bytes_t t = {0};
     return t;
@@ -1947,10 +2102,10 @@ pn_bytes_t pn_data_get_symbol(pn_data_t *data)
 pn_bytes_t pn_data_get_bytes(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
-  if (node && (node->atom.type == PN_BINARY ||
-               node->atom.type == PN_STRING ||
-               node->atom.type == PN_SYMBOL)) {
-    return node->atom.u.as_bytes;
+  if (node && (node->type == PN_BINARY ||
+               node->type == PN_STRING ||
+               node->type == PN_SYMBOL)) {
+    return pni_node_bytes(data, node);
   } else {
     pn_bytes_t t = {0};
     return t;
@@ -1961,7 +2116,7 @@ pn_atom_t pn_data_get_atom(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
   if (node) {
-    return *((pn_atom_t *) &node->atom);
+    return pni_node_atom(data, node);
   } else {
     pn_atom_t t = {PN_NULL, {0,}};
     return t;
@@ -2104,6 +2259,13 @@ int pn_data_appendn(pn_data_t *data, pn_data_t *src, int limit)
       level++;
       break;
     case PN_ARRAY:
+      if (pni_data_current(src)->packed) {
+        pni_node_t *node = pni_data_current(src);
+        err = pni_data_put_packed_array(data, (pn_type_t) node->array_type,
+                                        pni_node_bytes(src, node).start, node->children);
+        if (level == 0) count++;
+        break;
+      }
       err = pn_data_put_array(data, pn_data_is_array_described(src),
                               pn_data_get_array_type(src));
       if (level == 0) count++;
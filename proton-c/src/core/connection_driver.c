@@ -102,6 +102,10 @@ pn_bytes_t pn_connection_driver_write_buffer(pn_connection_driver_t *d) {
     pn_bytes(pending, pn_transport_head(d->transport)) : pn_bytes_null;
 }
 
+size_t pn_connection_driver_write_iov(pn_connection_driver_t *d, pn_bytes_t *iov, size_t iovcnt) {
+  return pni_transport_head_iov(d->transport, iov, iovcnt);
+}
+
 void pn_connection_driver_write_done(pn_connection_driver_t *d, size_t n) {
   if (n > 0)
     pn_transport_pop(d->transport, n);
@@ -27,24 +27,51 @@
 #include "decoder.h"
 #include "encoder.h"
 
-typedef uint16_t pni_nid_t;
+typedef uint32_t pni_nid_t;
 #define PNI_NID_MAX ((pni_nid_t)-1)
 
+/* A node is 32 bytes: an inline scalar, the tree links and the types.
+   Values that don't fit inline (binary, string, symbol, decimal128 and
+   uuid) live in pn_data_t.buf and the node holds their offset and size.
+   The encoder uses start to backfill the size of a compound node.
+
+   A packed array has no child nodes: its elements, all of a fixed width
+   type, are kept in pn_data_t.buf in encoded (big endian) order, the node
+   holds their offset and size and children is the element count. It is
+   unpacked into child nodes when it is entered. */
 typedef struct {
-  char *start;
-  size_t data_offset;
-  size_t data_size;
-  pn_atom_t atom;
-  pn_type_t type;
+  union {
+    bool as_bool;
+    uint8_t as_ubyte;
+    int8_t as_byte;
+    uint16_t as_ushort;
+    int16_t as_short;
+    uint32_t as_uint;
+    int32_t as_int;
+    pn_char_t as_char;
+    uint64_t as_ulong;
+    int64_t as_long;
+    pn_timestamp_t as_timestamp;
+    float as_float;
+    double as_double;
+    pn_decimal32_t as_decimal32;
+    pn_decimal64_t as_decimal64;
+    struct {
+      uint32_t offset;
+      uint32_t size;
+    } as_data;
+    uint32_t start;
+  } u;
   pni_nid_t next;
   pni_nid_t prev;
   pni_nid_t down;
   pni_nid_t parent;
   pni_nid_t children;
+  int8_t type;
   // for arrays
+  int8_t array_type;
   bool described;
-  bool data;
-  bool small;
+  bool packed;
 } pni_node_t;
 
 struct pn_data_t {
@@ -60,6 +87,8 @@ struct pn_data_t {
   pni_nid_t current;
   pni_nid_t base_parent;
   pni_nid_t base_current;
+  // bumped whenever a node is added or the data is cleared
+  uint32_t changes;
 };
 
 static inline pni_node_t * pn_data_node(pn_data_t *data, pni_nid_t nd) 
@@ -67,6 +96,53 @@ static inline pni_node_t * pn_data_node(pn_data_t *data, pni_nid_t nd)
   return nd ? (data->nodes + nd - 1) : NULL;
 }
 
+/* Compare with an earlier result to tell if data may have been changed
+   since then */
+static inline uint32_t pni_data_changes(pn_data_t *data)
+{
+  return data->changes;
+}
+
+/* The bytes of a binary, string or symbol node, or the 16 bytes of a
+   decimal128 or uuid node */
+static inline pn_bytes_t pni_node_bytes(pn_data_t *data, pni_node_t *node)
+{
+  pn_bytes_t bytes = {node->u.as_data.size,
+                      pn_buffer_memory(data->buf).start + node->u.as_data.offset};
+  return bytes;
+}
+
+/* The encoded width of an element of a packed array of type, or 0 if
+   arrays of type can't be packed */
+static inline size_t pni_packed_width(pn_type_t type)
+{
+  switch (type) {
+  case PN_BYTE:
+  case PN_UBYTE:
+    return 1;
+  case PN_SHORT:
+  case PN_USHORT:
+    return 2;
+  case PN_INT:
+  case PN_UINT:
+  case PN_CHAR:
+  case PN_FLOAT:
+  case PN_DECIMAL32:
+    return 4;
+  case PN_LONG:
+  case PN_ULONG:
+  case PN_TIMESTAMP:
+  case PN_DOUBLE:
+  case PN_DECIMAL64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/* Put a packed array of count elements that are already encoded */
+int pni_data_put_packed_array(pn_data_t *data, pn_type_t type, const char *bytes, size_t count);
+
 int pni_data_traverse(pn_data_t *data,
                       int (*enter)(void *ctx, pn_data_t *data, pni_node_t *node),
                       int (*exit)(void *ctx, pn_data_t *data, pni_node_t *node),
@@ -27,4 +27,57 @@ typedef struct pn_decoder_t pn_decoder_t;
 pn_decoder_t *pn_decoder(void);
 ssize_t pn_decoder_decode(pn_decoder_t *decoder, const char *src, size_t size, pn_data_t *dst);
 
+/* Find the extent of an encoded value without decoding it. Returns the
+   size of the value at src, or PN_UNDERFLOW if it is incomplete. */
+ssize_t pni_value_size(const char *src, size_t size);
+/* True if the value at src is described by a ulong, stored in descriptor */
+bool pni_value_descriptor(const char *src, size_t size, uint64_t *descriptor);
+
+/* The fields of the frequent performatives, as used by the transport */
+typedef struct {
+  uint32_t handle;
+  uint32_t id;
+  pn_bytes_t tag;
+  uint32_t message_format;
+  uint64_t type;
+  bool id_present;
+  bool settled;
+  bool more;
+  bool has_type;
+} pni_transfer_frame_t;
+
+typedef struct {
+  uint32_t next_incoming_id;
+  uint32_t incoming_window;
+  uint32_t next_outgoing_id;
+  uint32_t outgoing_window;
+  uint32_t handle;
+  uint32_t delivery_count;
+  uint32_t link_credit;
+  bool next_incoming_id_present;
+  bool handle_present;
+  bool delivery_count_present;
+  bool drain;
+} pni_flow_frame_t;
+
+typedef struct {
+  uint32_t first;
+  uint32_t last;
+  uint64_t type;
+  bool role;
+  bool last_present;
+  bool settled;
+  bool has_type;
+} pni_disposition_frame_t;
+
+/* Decode a performative straight from the frame body at src. Returns the
+   encoded size of the performative, or a negative value if it is not of
+   the expected kind or uses an encoding these don't handle, in which case
+   the frame must be decoded with pn_data_decode instead. A transfer is
+   only accepted without a delivery state and a disposition only with a
+   state that has no fields, such as accepted or released. */
+ssize_t pni_decode_transfer(const char *src, size_t size, pni_transfer_frame_t *transfer);
+ssize_t pni_decode_flow(const char *src, size_t size, pni_flow_frame_t *flow);
+ssize_t pni_decode_disposition(const char *src, size_t size, pni_disposition_frame_t *disposition);
+
 #endif /* decoder.h */
@@ -23,6 +23,7 @@
  */
 
 #include "dispatcher.h"
+#include "decoder.h"
 
 #define AMQP_FRAME_TYPE (0)
 #define SASL_FRAME_TYPE (1)
@@ -39,6 +40,11 @@ int pn_do_detach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
 int pn_do_end(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
 int pn_do_close(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
 
+/* Actions on already decoded performatives, for the fast path */
+int pni_do_transfer(pn_transport_t *transport, uint16_t channel, const pni_transfer_frame_t *transfer, const pn_bytes_t *payload);
+int pni_do_flow(pn_transport_t *transport, uint16_t channel, const pni_flow_frame_t *flow);
+int pni_do_disposition(pn_transport_t *transport, uint16_t channel, const pni_disposition_frame_t *disposition, bool remote_data);
+
 /* SASL actions */
 int pn_do_init(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
 int pn_do_mechanisms(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
@@ -74,6 +74,44 @@ static inline int pni_dispatch_action(pn_transport_t* transport, uint64_t lcode,
   return action(transport, frame_type, channel, args, payload);
 }
 
+// Decode the frequent performatives straight from the frame into a
+// struct. Returns false if the frame must take the generic path.
+static bool pni_dispatch_fast(pn_transport_t *transport, pn_frame_t frame, int *err)
+{
+  uint64_t lcode;
+  if (!pni_value_descriptor(frame.payload, frame.size, &lcode)) return false;
+
+  ssize_t dsize;
+  pn_bytes_t payload;
+  switch (lcode) {
+  case TRANSFER: {
+    pni_transfer_frame_t transfer;
+    dsize = pni_decode_transfer(frame.payload, frame.size, &transfer);
+    if (dsize < 0) return false;
+    payload.size = frame.size - dsize;
+    payload.start = payload.size ? frame.payload + dsize : NULL;
+    *err = pni_do_transfer(transport, frame.channel, &transfer, &payload);
+    return true;
+  }
+  case FLOW: {
+    pni_flow_frame_t flow;
+    dsize = pni_decode_flow(frame.payload, frame.size, &flow);
+    if (dsize < 0) return false;
+    *err = pni_do_flow(transport, frame.channel, &flow);
+    return true;
+  }
+  case DISPOSITION: {
+    pni_disposition_frame_t disposition;
+    dsize = pni_decode_disposition(frame.payload, frame.size, &disposition);
+    if (dsize < 0) return false;
+    *err = pni_do_disposition(transport, frame.channel, &disposition, false);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
 static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_frame_t frame)
 {
   if (frame.size == 0) { // ignore null frames
@@ -82,6 +120,13 @@ static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_fr
     return 0;
   }
 
+  // Traced frames need the generic decoding to be logged
+  int err;
+  if (frame.type == AMQP_FRAME_TYPE && !(transport->trace & PN_TRACE_FRM) &&
+      pni_dispatch_fast(transport, frame, &err)) {
+    return err;
+  }
+
   ssize_t dsize = pn_data_decode(args, frame.payload, frame.size);
   if (dsize < 0) {
     pn_string_format(transport->scratch,
@@ -113,7 +158,7 @@ static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_fr
 
   pn_do_trace(transport, channel, IN, args, payload_mem, payload_size);
 
-  int err = pni_dispatch_action(transport, lcode, frame_type, channel, args, &payload);
+  err = pni_dispatch_action(transport, lcode, frame_type, channel, args, &payload);
 
   pn_data_clear(args);
 
@@ -149,10 +194,7 @@ ssize_t pn_dispatcher_input(pn_transport_t *transport, const char *bytes, size_t
 
 ssize_t pn_dispatcher_output(pn_transport_t *transport, char *bytes, size_t size)
 {
-    int n = transport->available < size ? transport->available : size;
-    memmove(bytes, transport->output, n);
-    memmove(transport->output, transport->output + n, transport->available - n);
-    transport->available -= n;
-    // XXX: need to check for errors
+    size_t n = pn_buffer_get(transport->output, 0, size, bytes);
+    pn_buffer_trim(transport->output, n, 0);
     return n;
 }
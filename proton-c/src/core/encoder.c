@@ -24,6 +24,7 @@
 #include <proton/codec.h>
 #include "encodings.h"
 #include "encoder.h"
+#include "protocol.h"
 
 #include <string.h>
 
@@ -33,6 +34,7 @@ struct pn_encoder_t {
   char *output;
   size_t size;
   char *position;
+  const char *base; // data->buf of the data being encoded
   pn_error_t *error;
 };
 
@@ -42,6 +44,7 @@ static void pn_encoder_initialize(void *obj)
   encoder->output = NULL;
   encoder->size = 0;
   encoder->position = NULL;
+  encoder->base = NULL;
   encoder->error = pn_error();
 }
 
@@ -96,57 +99,57 @@ static uint8_t pn_type2code(pn_encoder_t *encoder, pn_type_t type)
 
 static uint8_t pn_node2code(pn_encoder_t *encoder, pni_node_t *node)
 {
-  switch (node->atom.type) {
+  switch (node->type) {
   case PN_LONG:
-    if (-128 <= node->atom.u.as_long && node->atom.u.as_long <= 127) {
+    if (-128 <= node->u.as_long && node->u.as_long <= 127) {
       return PNE_SMALLLONG;
     } else {
       return PNE_LONG;
     }
   case PN_INT:
-    if (-128 <= node->atom.u.as_int && node->atom.u.as_int <= 127) {
+    if (-128 <= node->u.as_int && node->u.as_int <= 127) {
       return PNE_SMALLINT;
     } else {
       return PNE_INT;
     }
   case PN_ULONG:
-    if (node->atom.u.as_ulong < 256) {
+    if (node->u.as_ulong < 256) {
       return PNE_SMALLULONG;
     } else {
       return PNE_ULONG;
     }
   case PN_UINT:
-    if (node->atom.u.as_uint < 256) {
+    if (node->u.as_uint < 256) {
       return PNE_SMALLUINT;
     } else {
       return PNE_UINT;
     }
   case PN_BOOL:
-    if (node->atom.u.as_bool) {
+    if (node->u.as_bool) {
       return PNE_TRUE;
     } else {
       return PNE_FALSE;
     }
   case PN_STRING:
-    if (node->atom.u.as_bytes.size < 256) {
+    if (node->u.as_data.size < 256) {
       return PNE_STR8_UTF8;
     } else {
       return PNE_STR32_UTF8;
     }
   case PN_SYMBOL:
-    if (node->atom.u.as_bytes.size < 256) {
+    if (node->u.as_data.size < 256) {
       return PNE_SYM8;
     } else {
       return PNE_SYM32;
     }
   case PN_BINARY:
-    if (node->atom.u.as_bytes.size < 256) {
+    if (node->u.as_data.size < 256) {
       return PNE_VBIN8;
     } else {
       return PNE_VBIN32;
     }
   default:
-    return pn_type2code(encoder, node->atom.type);
+    return pn_type2code(encoder, (pn_type_t) node->type);
   }
 }
 
@@ -200,32 +203,32 @@ static inline void pn_encoder_writef64(pn_encoder_t *encoder, uint64_t value) {
   encoder->position += 8;
 }
 
-static inline void pn_encoder_writef128(pn_encoder_t *encoder, char *value) {
+static inline void pn_encoder_writef128(pn_encoder_t *encoder, const char *value) {
   if (pn_encoder_remaining(encoder) >= 16) {
     memmove(encoder->position, value, 16);
   }
   encoder->position += 16;
 }
 
-static inline void pn_encoder_writev8(pn_encoder_t *encoder, const pn_bytes_t *value)
+static inline void pn_encoder_writev8(pn_encoder_t *encoder, size_t size, const char *start)
 {
-  pn_encoder_writef8(encoder, value->size);
-  if (pn_encoder_remaining(encoder) >= value->size)
-    memmove(encoder->position, value->start, value->size);
-  encoder->position += value->size;
+  pn_encoder_writef8(encoder, size);
+  if (pn_encoder_remaining(encoder) >= size)
+    memmove(encoder->position, start, size);
+  encoder->position += size;
 }
 
-static inline void pn_encoder_writev32(pn_encoder_t *encoder, const pn_bytes_t *value)
+static inline void pn_encoder_writev32(pn_encoder_t *encoder, size_t size, const char *start)
 {
-  pn_encoder_writef32(encoder, value->size);
-  if (pn_encoder_remaining(encoder) >= value->size)
-    memmove(encoder->position, value->start, value->size);
-  encoder->position += value->size;
+  pn_encoder_writef32(encoder, size);
+  if (pn_encoder_remaining(encoder) >= size)
+    memmove(encoder->position, start, size);
+  encoder->position += size;
 }
 
 /* True if node is an element of an array - not the descriptor. */
 static bool pn_is_in_array(pn_data_t *data, pni_node_t *parent, pni_node_t *node) {
-  return (parent && parent->atom.type == PN_ARRAY) /* In array */
+  return (parent && parent->type == PN_ARRAY) /* In array */
     && !(parent->described && !node->prev); /* Not the descriptor */
 }
 
@@ -249,13 +252,12 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
 {
   pn_encoder_t *encoder = (pn_encoder_t *) ctx;
   pni_node_t *parent = pn_data_node(data, node->parent);
-  pn_atom_t *atom = &node->atom;
   uint8_t code;
   conv_t c;
 
   /** In an array we don't write the code before each element, only the first. */
   if (pn_is_in_array(data, parent, node)) {
-    code = pn_type2code(encoder, parent->type);
+    code = pn_type2code(encoder, (pn_type_t) parent->array_type);
     if (pn_is_first_in_array(data, parent, node)) {
       pn_encoder_writef8(encoder, code);
     }
@@ -269,37 +271,54 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
   case PNE_NULL:
   case PNE_TRUE:
   case PNE_FALSE: return 0;
-  case PNE_BOOLEAN: pn_encoder_writef8(encoder, atom->u.as_bool); return 0;
-  case PNE_UBYTE: pn_encoder_writef8(encoder, atom->u.as_ubyte); return 0;
-  case PNE_BYTE: pn_encoder_writef8(encoder, atom->u.as_byte); return 0;
-  case PNE_USHORT: pn_encoder_writef16(encoder, atom->u.as_ushort); return 0;
-  case PNE_SHORT: pn_encoder_writef16(encoder, atom->u.as_short); return 0;
+  case PNE_BOOLEAN: pn_encoder_writef8(encoder, node->u.as_bool); return 0;
+  case PNE_UBYTE: pn_encoder_writef8(encoder, node->u.as_ubyte); return 0;
+  case PNE_BYTE: pn_encoder_writef8(encoder, node->u.as_byte); return 0;
+  case PNE_USHORT: pn_encoder_writef16(encoder, node->u.as_ushort); return 0;
+  case PNE_SHORT: pn_encoder_writef16(encoder, node->u.as_short); return 0;
   case PNE_UINT0: return 0;
-  case PNE_SMALLUINT: pn_encoder_writef8(encoder, atom->u.as_uint); return 0;
-  case PNE_UINT: pn_encoder_writef32(encoder, atom->u.as_uint); return 0;
-  case PNE_SMALLINT: pn_encoder_writef8(encoder, atom->u.as_int); return 0;
-  case PNE_INT: pn_encoder_writef32(encoder, atom->u.as_int); return 0;
-  case PNE_UTF32: pn_encoder_writef32(encoder, atom->u.as_char); return 0;
-  case PNE_ULONG: pn_encoder_writef64(encoder, atom->u.as_ulong); return 0;
-  case PNE_SMALLULONG: pn_encoder_writef8(encoder, atom->u.as_ulong); return 0;
-  case PNE_LONG: pn_encoder_writef64(encoder, atom->u.as_long); return 0;
-  case PNE_SMALLLONG: pn_encoder_writef8(encoder, atom->u.as_long); return 0;
-  case PNE_MS64: pn_encoder_writef64(encoder, atom->u.as_timestamp); return 0;
-  case PNE_FLOAT: c.f = atom->u.as_float; pn_encoder_writef32(encoder, c.i); return 0;
-  case PNE_DOUBLE: c.d = atom->u.as_double; pn_encoder_writef64(encoder, c.l); return 0;
-  case PNE_DECIMAL32: pn_encoder_writef32(encoder, atom->u.as_decimal32); return 0;
-  case PNE_DECIMAL64: pn_encoder_writef64(encoder, atom->u.as_decimal64); return 0;
-  case PNE_DECIMAL128: pn_encoder_writef128(encoder, atom->u.as_decimal128.bytes); return 0;
-  case PNE_UUID: pn_encoder_writef128(encoder, atom->u.as_uuid.bytes); return 0;
-  case PNE_VBIN8: pn_encoder_writev8(encoder, &atom->u.as_bytes); return 0;
-  case PNE_VBIN32: pn_encoder_writev32(encoder, &atom->u.as_bytes); return 0;
-  case PNE_STR8_UTF8: pn_encoder_writev8(encoder, &atom->u.as_bytes); return 0;
-  case PNE_STR32_UTF8: pn_encoder_writev32(encoder, &atom->u.as_bytes); return 0;
-  case PNE_SYM8: pn_encoder_writev8(encoder, &atom->u.as_bytes); return 0;
-  case PNE_SYM32: pn_encoder_writev32(encoder, &atom->u.as_bytes); return 0;
+  case PNE_SMALLUINT: pn_encoder_writef8(encoder, node->u.as_uint); return 0;
+  case PNE_UINT: pn_encoder_writef32(encoder, node->u.as_uint); return 0;
+  case PNE_SMALLINT: pn_encoder_writef8(encoder, node->u.as_int); return 0;
+  case PNE_INT: pn_encoder_writef32(encoder, node->u.as_int); return 0;
+  case PNE_UTF32: pn_encoder_writef32(encoder, node->u.as_char); return 0;
+  case PNE_ULONG: pn_encoder_writef64(encoder, node->u.as_ulong); return 0;
+  case PNE_SMALLULONG: pn_encoder_writef8(encoder, node->u.as_ulong); return 0;
+  case PNE_LONG: pn_encoder_writef64(encoder, node->u.as_long); return 0;
+  case PNE_SMALLLONG: pn_encoder_writef8(encoder, node->u.as_long); return 0;
+  case PNE_MS64: pn_encoder_writef64(encoder, node->u.as_timestamp); return 0;
+  case PNE_FLOAT: c.f = node->u.as_float; pn_encoder_writef32(encoder, c.i); return 0;
+  case PNE_DOUBLE: c.d = node->u.as_double; pn_encoder_writef64(encoder, c.l); return 0;
+  case PNE_DECIMAL32: pn_encoder_writef32(encoder, node->u.as_decimal32); return 0;
+  case PNE_DECIMAL64: pn_encoder_writef64(encoder, node->u.as_decimal64); return 0;
+  case PNE_DECIMAL128:
+  case PNE_UUID:
+    pn_encoder_writef128(encoder, encoder->base + node->u.as_data.offset);
+    return 0;
+  case PNE_VBIN8:
+  case PNE_STR8_UTF8:
+  case PNE_SYM8:
+    pn_encoder_writev8(encoder, node->u.as_data.size, encoder->base + node->u.as_data.offset);
+    return 0;
+  case PNE_VBIN32:
+  case PNE_STR32_UTF8:
+  case PNE_SYM32:
+    pn_encoder_writev32(encoder, node->u.as_data.size, encoder->base + node->u.as_data.offset);
+    return 0;
   case PNE_ARRAY32:
-    node->start = encoder->position;
-    node->small = false;
+    if (node->packed) {
+      // the elements are already encoded, write the whole array now
+      size_t bytes = node->u.as_data.size;
+      pn_encoder_writef32(encoder, 4 + 1 + bytes);
+      pn_encoder_writef32(encoder, node->children);
+      pn_encoder_writef8(encoder, pn_type2code(encoder, (pn_type_t) node->array_type));
+      if (pn_encoder_remaining(encoder) >= bytes)
+        memmove(encoder->position, encoder->base + node->u.as_data.offset, bytes);
+      encoder->position += bytes;
+      return 0;
+    }
+    // offset rather than pointer: in size mode output is NULL
+    node->u.start = encoder->position - encoder->output;
     // we'll backfill the size on exit
     encoder->position += 4;
     pn_encoder_writef32(encoder, node->described ? node->children - 1 : node->children);
@@ -308,14 +327,13 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
     return 0;
   case PNE_LIST32:
   case PNE_MAP32:
-    node->start = encoder->position;
-    node->small = false;
+    node->u.start = encoder->position - encoder->output;
     // we'll backfill the size later
     encoder->position += 4;
     pn_encoder_writef32(encoder, node->children);
     return 0;
   default:
-    return pn_error_format(data->error, PN_ERR, "unrecognized encoding: %u", code);
+    return pn_error_format(pn_data_error(data), PN_ERR, "unrecognized encoding: %u", code);
   }
 }
 
@@ -324,27 +342,23 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
 static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
 {
   pn_encoder_t *encoder = (pn_encoder_t *) ctx;
-  char *pos;
+  char *pos, *start;
+
+  if (node->packed) return 0;
 
-  switch (node->atom.type) {
+  switch (node->type) {
   case PN_ARRAY:
     if ((node->described && node->children == 1) || (!node->described && node->children == 0)) {
-      pn_encoder_writef8(encoder, pn_type2code(encoder, node->type));
+      pn_encoder_writef8(encoder, pn_type2code(encoder, (pn_type_t) node->array_type));
     }
   // Fallthrough
   case PN_LIST:
   case PN_MAP:
+    // backfill size
     pos = encoder->position;
-    encoder->position = node->start;
-    if (node->small) {
-      // backfill size
-      size_t size = pos - node->start - 1;
-      pn_encoder_writef8(encoder, size);
-    } else {
-      // backfill size
-      size_t size = pos - node->start - 4;
-      pn_encoder_writef32(encoder, size);
-    }
+    start = encoder->output + node->u.start;
+    encoder->position = start;
+    pn_encoder_writef32(encoder, pos - start - 4);
     encoder->position = pos;
     return 0;
   default:
@@ -357,6 +371,7 @@ ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size
   encoder->output = dst;
   encoder->position = dst;
   encoder->size = size;
+  encoder->base = src->buf ? pn_buffer_memory(src->buf).start : NULL;
 
   int err = pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
   if (err) return err;
@@ -373,6 +388,7 @@ ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src)
   encoder->output = 0;
   encoder->position = 0;
   encoder->size = 0;
+  encoder->base = src->buf ? pn_buffer_memory(src->buf).start : NULL;
 
   pn_handle_t save = pn_data_point(src);
   int err = pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
@@ -381,3 +397,201 @@ ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src)
   if (err) return err;
   return encoder->position - encoder->output;
 }
+
+void pn_encoder_begin(pn_encoder_t *encoder, char *dst, size_t size)
+{
+  encoder->output = dst;
+  encoder->position = dst;
+  encoder->size = size;
+}
+
+ssize_t pn_encoder_end(pn_encoder_t *encoder)
+{
+  size_t encoded = encoder->position - encoder->output;
+  if (encoder->output && encoded > encoder->size) return PN_OVERFLOW;
+  return (ssize_t)encoded;
+}
+
+size_t pn_encoder_needed(pn_encoder_t *encoder)
+{
+  return encoder->position - encoder->output;
+}
+
+void pn_encoder_put_null(pn_encoder_t *encoder)
+{
+  pn_encoder_writef8(encoder, PNE_NULL);
+}
+
+void pn_encoder_put_described(pn_encoder_t *encoder)
+{
+  pn_encoder_writef8(encoder, PNE_DESCRIPTOR);
+}
+
+void pn_encoder_put_bool(pn_encoder_t *encoder, bool value)
+{
+  pn_encoder_writef8(encoder, value ? PNE_TRUE : PNE_FALSE);
+}
+
+void pn_encoder_put_ubyte(pn_encoder_t *encoder, uint8_t value)
+{
+  pn_encoder_writef8(encoder, PNE_UBYTE);
+  pn_encoder_writef8(encoder, value);
+}
+
+void pn_encoder_put_uint(pn_encoder_t *encoder, uint32_t value)
+{
+  if (value < 256) {
+    pn_encoder_writef8(encoder, PNE_SMALLUINT);
+    pn_encoder_writef8(encoder, value);
+  } else {
+    pn_encoder_writef8(encoder, PNE_UINT);
+    pn_encoder_writef32(encoder, value);
+  }
+}
+
+void pn_encoder_put_ulong(pn_encoder_t *encoder, uint64_t value)
+{
+  if (value < 256) {
+    pn_encoder_writef8(encoder, PNE_SMALLULONG);
+    pn_encoder_writef8(encoder, value);
+  } else {
+    pn_encoder_writef8(encoder, PNE_ULONG);
+    pn_encoder_writef64(encoder, value);
+  }
+}
+
+void pn_encoder_put_timestamp(pn_encoder_t *encoder, pn_timestamp_t value)
+{
+  pn_encoder_writef8(encoder, PNE_MS64);
+  pn_encoder_writef64(encoder, value);
+}
+
+static void pn_encoder_put_variable(pn_encoder_t *encoder, uint8_t code8, uint8_t code32, pn_bytes_t value)
+{
+  if (value.size < 256) {
+    pn_encoder_writef8(encoder, code8);
+    pn_encoder_writev8(encoder, value.size, value.start);
+  } else {
+    pn_encoder_writef8(encoder, code32);
+    pn_encoder_writev32(encoder, value.size, value.start);
+  }
+}
+
+void pn_encoder_put_binary(pn_encoder_t *encoder, pn_bytes_t value)
+{
+  pn_encoder_put_variable(encoder, PNE_VBIN8, PNE_VBIN32, value);
+}
+
+void pn_encoder_put_string(pn_encoder_t *encoder, pn_bytes_t value)
+{
+  pn_encoder_put_variable(encoder, PNE_STR8_UTF8, PNE_STR32_UTF8, value);
+}
+
+void pn_encoder_put_symbol(pn_encoder_t *encoder, pn_bytes_t value)
+{
+  pn_encoder_put_variable(encoder, PNE_SYM8, PNE_SYM32, value);
+}
+
+void pn_encoder_put_raw(pn_encoder_t *encoder, const char *bytes, size_t size)
+{
+  if (pn_encoder_remaining(encoder) >= size)
+    memmove(encoder->position, bytes, size);
+  encoder->position += size;
+}
+
+size_t pn_encoder_begin_list(pn_encoder_t *encoder)
+{
+  pn_encoder_writef8(encoder, PNE_LIST32);
+  size_t start = encoder->position - encoder->output;
+  // we'll backfill the size and count in pn_encoder_end_list
+  encoder->position += 8;
+  return start;
+}
+
+void pn_encoder_end_list(pn_encoder_t *encoder, size_t start, uint32_t count)
+{
+  char *pos = encoder->position;
+  encoder->position = encoder->output + start;
+  pn_encoder_writef32(encoder, pos - encoder->position - 4);
+  pn_encoder_writef32(encoder, count);
+  encoder->position = pos;
+}
+
+int pn_encoder_put_data(pn_encoder_t *encoder, pn_data_t *src)
+{
+  encoder->base = src->buf ? pn_buffer_memory(src->buf).start : NULL;
+  return pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
+}
+
+static void pni_encoder_put_optional_uint(pn_encoder_t *encoder, bool present, uint32_t value)
+{
+  if (present) {
+    pn_encoder_put_uint(encoder, value);
+  } else {
+    pn_encoder_put_null(encoder);
+  }
+}
+
+static void pni_encoder_put_state(pn_encoder_t *encoder, uint64_t type)
+{
+  pn_encoder_put_described(encoder);
+  pn_encoder_put_ulong(encoder, type);
+  pn_encoder_writef8(encoder, PNE_LIST0);
+}
+
+ssize_t pni_encode_transfer(pn_encoder_t *encoder, char *dst, size_t size, const pni_transfer_frame_t *transfer)
+{
+  pn_encoder_begin(encoder, dst, size);
+  pn_encoder_put_described(encoder);
+  pn_encoder_put_ulong(encoder, TRANSFER);
+  size_t list = pn_encoder_begin_list(encoder);
+  pn_encoder_put_uint(encoder, transfer->handle);
+  pni_encoder_put_optional_uint(encoder, transfer->id_present, transfer->id);
+  pn_encoder_put_binary(encoder, transfer->tag);
+  pn_encoder_put_uint(encoder, transfer->message_format);
+  pn_encoder_put_bool(encoder, transfer->settled);
+  pn_encoder_put_bool(encoder, transfer->more);
+  pn_encoder_end_list(encoder, list, 6);
+  return pn_encoder_end(encoder);
+}
+
+ssize_t pni_encode_flow(pn_encoder_t *encoder, char *dst, size_t size, const pni_flow_frame_t *flow)
+{
+  pn_encoder_begin(encoder, dst, size);
+  pn_encoder_put_described(encoder);
+  pn_encoder_put_ulong(encoder, FLOW);
+  size_t list = pn_encoder_begin_list(encoder);
+  pni_encoder_put_optional_uint(encoder, flow->next_incoming_id_present, flow->next_incoming_id);
+  pn_encoder_put_uint(encoder, flow->incoming_window);
+  pn_encoder_put_uint(encoder, flow->next_outgoing_id);
+  pn_encoder_put_uint(encoder, flow->outgoing_window);
+  uint32_t count = 4;
+  // The link's fields are only written with its handle
+  if (flow->handle_present) {
+    pn_encoder_put_uint(encoder, flow->handle);
+    pni_encoder_put_optional_uint(encoder, flow->delivery_count_present, flow->delivery_count);
+    pn_encoder_put_uint(encoder, flow->link_credit);
+    pn_encoder_put_null(encoder);
+    pn_encoder_put_bool(encoder, flow->drain);
+    count = 9;
+  }
+  pn_encoder_end_list(encoder, list, count);
+  return pn_encoder_end(encoder);
+}
+
+ssize_t pni_encode_disposition(pn_encoder_t *encoder, char *dst, size_t size, const pni_disposition_frame_t *disposition)
+{
+  pn_encoder_begin(encoder, dst, size);
+  pn_encoder_put_described(encoder);
+  pn_encoder_put_ulong(encoder, DISPOSITION);
+  size_t list = pn_encoder_begin_list(encoder);
+  pn_encoder_put_bool(encoder, disposition->role);
+  pn_encoder_put_uint(encoder, disposition->first);
+  pni_encoder_put_optional_uint(encoder, disposition->last_present, disposition->last);
+  pn_encoder_put_bool(encoder, disposition->settled);
+  if (disposition->has_type) {
+    pni_encoder_put_state(encoder, disposition->type);
+  }
+  pn_encoder_end_list(encoder, list, disposition->has_type ? 5 : 4);
+  return pn_encoder_end(encoder);
+}
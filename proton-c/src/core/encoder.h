@@ -22,10 +22,46 @@
  *
  */
 
+#include "decoder.h"
+
 typedef struct pn_encoder_t pn_encoder_t;
 
 pn_encoder_t *pn_encoder(void);
 ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size_t size);
 ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src);
 
+/* Write values straight to dst, without building a pn_data_t. If dst is
+   NULL nothing is written but the encoded size is still counted.
+   pn_encoder_end returns the encoded size, or PN_OVERFLOW if it did not
+   fit, in which case pn_encoder_needed gives the size that would. */
+void pn_encoder_begin(pn_encoder_t *encoder, char *dst, size_t size);
+ssize_t pn_encoder_end(pn_encoder_t *encoder);
+size_t pn_encoder_needed(pn_encoder_t *encoder);
+void pn_encoder_put_null(pn_encoder_t *encoder);
+void pn_encoder_put_described(pn_encoder_t *encoder);
+void pn_encoder_put_bool(pn_encoder_t *encoder, bool value);
+void pn_encoder_put_ubyte(pn_encoder_t *encoder, uint8_t value);
+void pn_encoder_put_uint(pn_encoder_t *encoder, uint32_t value);
+void pn_encoder_put_ulong(pn_encoder_t *encoder, uint64_t value);
+void pn_encoder_put_timestamp(pn_encoder_t *encoder, pn_timestamp_t value);
+void pn_encoder_put_binary(pn_encoder_t *encoder, pn_bytes_t value);
+void pn_encoder_put_string(pn_encoder_t *encoder, pn_bytes_t value);
+void pn_encoder_put_symbol(pn_encoder_t *encoder, pn_bytes_t value);
+/* Copy bytes that are already encoded */
+void pn_encoder_put_raw(pn_encoder_t *encoder, const char *bytes, size_t size);
+/* Returns a mark to pass to pn_encoder_end_list with the element count */
+size_t pn_encoder_begin_list(pn_encoder_t *encoder);
+void pn_encoder_end_list(pn_encoder_t *encoder, size_t mark, uint32_t count);
+/* Write every top level value in src */
+int pn_encoder_put_data(pn_encoder_t *encoder, pn_data_t *src);
+
+/* Write the frequent performatives straight to dst, the counterparts of
+   the pni_decode_* functions. A delivery state is written as its
+   descriptor with an empty list; transfers are written without one, their
+   has_type and type are only filled in by decoding. Returns the encoded size, or PN_OVERFLOW
+   with the size needed given by pn_encoder_needed. */
+ssize_t pni_encode_transfer(pn_encoder_t *encoder, char *dst, size_t size, const pni_transfer_frame_t *transfer);
+ssize_t pni_encode_flow(pn_encoder_t *encoder, char *dst, size_t size, const pni_flow_frame_t *flow);
+ssize_t pni_encode_disposition(pn_encoder_t *encoder, char *dst, size_t size, const pni_disposition_frame_t *disposition);
+
 #endif /* encoder.h */
@@ -24,10 +24,12 @@
 
 #include <proton/object.h>
 #include <proton/engine.h>
+#include <proton/selectable.h>
 #include <proton/types.h>
 
 #include "buffer.h"
 #include "dispatcher.h"
+#include "encoder.h"
 #include "util.h"
 
 typedef enum pn_endpoint_type_t {CONNECTION, SESSION, SENDER, RECEIVER} pn_endpoint_type_t;
@@ -58,13 +60,18 @@ struct pn_endpoint_t {
 
 typedef struct {
   pn_sequence_t id;
+  size_t disp;  // where its last batched disposition went in the session's disps
   bool sent;
   bool init;
 } pn_delivery_state_t;
 
+// Deliveries by id, ids are consecutive so this is a ring indexed by id - first
 typedef struct {
+  pn_delivery_t **deliveries;
+  size_t capacity;      // a power of 2
+  size_t head;          // index of first
+  pn_sequence_t first;  // the oldest id that may still be in the map
   pn_sequence_t next;
-  pn_hash_t *deliveries;
 } pn_delivery_map_t;
 
 typedef struct {
@@ -75,6 +82,14 @@ typedef struct {
   pn_sequence_t link_credit;
 } pn_link_state_t;
 
+// a disposition that can be sent as part of a range
+typedef struct {
+  uint64_t code;
+  pn_sequence_t id;
+  bool settled;
+  bool role;
+} pni_disp_t;
+
 typedef struct {
   // XXX: stop using negative numbers
   uint16_t local_channel;
@@ -90,12 +105,10 @@ typedef struct {
   pn_hash_t *local_handles;
   pn_hash_t *remote_handles;
 
-  uint64_t disp_code;
-  bool disp_settled;
-  bool disp_type;
-  pn_sequence_t disp_first;
-  pn_sequence_t disp_last;
-  bool disp;
+  pni_disp_t *disps;    // batchable dispositions waiting for the next flush
+  size_t disp_count;
+  size_t disp_capacity;
+  bool disp_unsorted;
 } pn_session_state_t;
 
 typedef struct pn_io_layer_t {
@@ -126,6 +139,7 @@ struct pn_transport_t {
   pn_tracer_t tracer;
   pni_sasl_t *sasl;
   pni_ssl_t *ssl;
+  pn_socket_t socket;           // set for kernel TLS, see pn_ssl_set_socket()
   pn_connection_t *connection;  // reference counted
   char *remote_container;
   char *remote_hostname;
@@ -162,11 +176,9 @@ struct pn_transport_t {
   pn_string_t *scratch;
   pn_data_t *args;
   pn_data_t *output_args;
+  pn_encoder_t *encoder; // writes the frequent performatives directly
   pn_buffer_t *frame;  // frame under construction
-  // Temporary
-  size_t capacity;
-  size_t available; /* number of raw bytes pending output */
-  char *output;
+  pn_buffer_t *output; // encoded frames not yet handed to the io layers
 
   /* statistics */
   uint64_t bytes_input;
@@ -174,13 +186,15 @@ struct pn_transport_t {
   uint64_t output_frames_ct;
   uint64_t input_frames_ct;
 
-  /* output buffered for send */
+  /* output buffered for send: output_pending bytes from output_start */
   size_t output_size;
+  size_t output_start;
   size_t output_pending;
   char *output_buf;
 
-  /* input from peer */
+  /* input from peer: input_pending bytes from input_start */
   size_t input_size;
+  size_t input_start;
   size_t input_pending;
   char *input_buf;
 
@@ -246,6 +260,11 @@ struct pn_connection_t {
   pn_collector_t *collector;
   pn_record_t *context;
   pn_list_t *delivery_pool;
+  size_t incoming_capacity;  // 0 for no limit beyond the sessions' own
+  size_t incoming_bytes;
+  size_t outgoing_bytes;
+  uint64_t incoming_window;  // frames granted to the peer and not yet used, over all sessions
+  bool incoming_blocked;     // a session may have a zero window for lack of incoming_capacity
 };
 
 struct pn_session_t {
@@ -318,11 +337,16 @@ struct pn_disposition_t {
   bool settled;
 };
 
+// tags up to this size are stored in the delivery itself
+#define PNI_INLINE_TAG 8
+
 struct pn_delivery_t {
   pn_disposition_t local;
   pn_disposition_t remote;
   pn_link_t *link;  // reference counted
-  pn_buffer_t *tag;
+  pn_buffer_t *long_tag;  // only created for a tag longer than PNI_INLINE_TAG
+  size_t tag_size;
+  char tag[PNI_INLINE_TAG];
   pn_delivery_t *unsettled_next;
   pn_delivery_t *unsettled_prev;
   pn_delivery_t *work_next;
@@ -346,6 +370,14 @@ struct pn_delivery_t {
 #define PN_SET_REMOTE(OLD, NEW)                                         \
   (OLD) = ((OLD) & PN_LOCAL_MASK) | (NEW)
 
+static inline pn_bytes_t pni_delivery_tag(pn_delivery_t *delivery)
+{
+  pn_bytes_t tag;
+  tag.size = delivery->tag_size;
+  tag.start = tag.size <= PNI_INLINE_TAG ? delivery->tag : pn_buffer_memory(delivery->long_tag).start;
+  return tag;
+}
+
 void pn_link_dump(pn_link_t *link);
 
 void pn_dump(pn_connection_t *conn);
@@ -368,6 +400,18 @@ void pn_ep_incref(pn_endpoint_t *endpoint);
 void pn_ep_decref(pn_endpoint_t *endpoint);
 
 int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...);
+// write outgoing delivery data in place: pni_link_send_space() returns room for at
+// least n bytes in the current delivery, pni_link_sent() adds what was written
+pn_rwbytes_t pni_link_send_space(pn_link_t *sender, size_t n);
+void pni_link_sent(pn_link_t *sender, size_t n);
+size_t pni_transport_head_iov(pn_transport_t *transport, pn_bytes_t *iov, size_t iovcnt);
+// For a security layer: when only pass-through layers lie between 'layer'
+// and the AMQP layer, run the AMQP layer and point frames at the start of
+// its queued output so it can be read in place, then drop what was used
+// with pni_transport_amqp_output_done(). *result is 0 or PN_EOS from the
+// AMQP layer. Returns false if another layer must see the output first.
+bool pni_transport_amqp_output(pn_transport_t *transport, unsigned int layer, ssize_t *result, pn_bytes_t *frames);
+void pni_transport_amqp_output_done(pn_transport_t *transport, size_t size);
 
 typedef enum {IN, OUT} pn_dir_t;
 
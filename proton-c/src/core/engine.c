@@ -536,6 +536,11 @@ pn_connection_t *pn_connection()
   conn->collector = NULL;
   conn->context = pn_record();
   conn->delivery_pool = pn_list(PN_OBJECT, 0);
+  conn->incoming_capacity = 0;
+  conn->incoming_bytes = 0;
+  conn->outgoing_bytes = 0;
+  conn->incoming_window = 0;
+  conn->incoming_blocked = false;
 
   return conn;
 }
@@ -934,6 +939,32 @@ static bool pni_preserve_child(pn_endpoint_t *endpoint)
   }
 }
 
+// Incoming bytes have been read or discarded. The sessions kept waiting
+// for space in the connection's incoming capacity are looked at again the
+// next time the transport processes the connection.
+static void pni_incoming_consumed(pn_session_t *ssn, size_t size)
+{
+  pn_connection_t *conn = ssn->connection;
+  ssn->incoming_bytes -= size;
+  conn->incoming_bytes -= size;
+  if (conn->incoming_blocked && size && pni_connection_live(conn)) {
+    pn_modified(conn, &conn->endpoint, false);
+  }
+}
+
+// Take a session's buffered bytes and unused incoming window out of its
+// connection's totals
+static void pni_session_release_bytes(pn_session_t *ssn)
+{
+  pn_connection_t *conn = ssn->connection;
+  conn->incoming_bytes -= ssn->incoming_bytes;
+  conn->outgoing_bytes -= ssn->outgoing_bytes;
+  conn->incoming_window -= ssn->state.incoming_window;
+  ssn->incoming_bytes = 0;
+  ssn->outgoing_bytes = 0;
+  ssn->state.incoming_window = 0;
+}
+
 static void pn_session_finalize(void *object)
 {
   pn_session_t *session = (pn_session_t *) object;
@@ -948,8 +979,10 @@ static void pn_session_finalize(void *object)
   pni_endpoint_tini(endpoint);
   pn_delivery_map_free(&session->state.incoming);
   pn_delivery_map_free(&session->state.outgoing);
+  free(session->state.disps);
   pn_free(session->state.local_handles);
   pn_free(session->state.remote_handles);
+  pni_session_release_bytes(session);
   pni_remove_session(session->connection, session);
   pn_list_remove(session->connection->freed, session);
 
@@ -1040,8 +1073,7 @@ void pn_session_unbound(pn_session_t* ssn)
   assert(ssn);
   ssn->state.local_channel = (uint16_t)-1;
   ssn->state.remote_channel = (uint16_t)-1;
-  ssn->incoming_bytes = 0;
-  ssn->outgoing_bytes = 0;
+  pni_session_release_bytes(ssn);
   ssn->incoming_deliveries = 0;
   ssn->outgoing_deliveries = 0;
 }
@@ -1059,6 +1091,33 @@ void pn_session_set_incoming_capacity(pn_session_t *ssn, size_t capacity)
   ssn->incoming_capacity = capacity;
 }
 
+size_t pn_connection_get_incoming_capacity(pn_connection_t *conn)
+{
+  assert(conn);
+  return conn->incoming_capacity;
+}
+
+void pn_connection_set_incoming_capacity(pn_connection_t *conn, size_t capacity)
+{
+  assert(conn);
+  conn->incoming_capacity = capacity;
+  // Let the transport open up any windows the new capacity allows
+  conn->incoming_blocked = true;
+  pn_modified(conn, &conn->endpoint, false);
+}
+
+size_t pn_connection_incoming_bytes(pn_connection_t *conn)
+{
+  assert(conn);
+  return conn->incoming_bytes;
+}
+
+size_t pn_connection_outgoing_bytes(pn_connection_t *conn)
+{
+  assert(conn);
+  return conn->outgoing_bytes;
+}
+
 size_t pn_session_get_outgoing_window(pn_session_t *ssn)
 {
   assert(ssn);
@@ -1457,7 +1516,10 @@ static void pn_delivery_finalize(void *object)
                         ? &link->session->state.outgoing
                         : &link->session->state.incoming,
                         delivery);
-    pn_buffer_clear(delivery->tag);
+    if (pn_link_is_receiver(link)) {
+      // Bytes freed before they were read are no longer buffered
+      pni_incoming_consumed(link->session, pn_buffer_size(delivery->bytes));
+    }
     pn_buffer_clear(delivery->bytes);
     pn_record_clear(delivery->context);
     delivery->settled = true;
@@ -1474,7 +1536,7 @@ static void pn_delivery_finalize(void *object)
 
   if (!pooled) {
     pn_free(delivery->context);
-    pn_buffer_free(delivery->tag);
+    pn_buffer_free(delivery->long_tag);
     pn_buffer_free(delivery->bytes);
     pn_disposition_finalize(&delivery->local);
     pn_disposition_finalize(&delivery->remote);
@@ -1520,6 +1582,21 @@ pn_delivery_tag_t pn_dtag(const char *bytes, size_t size) {
   return dtag;
 }
 
+static int pni_delivery_set_tag(pn_delivery_t *delivery, pn_delivery_tag_t tag)
+{
+  delivery->tag_size = tag.size;
+  if (tag.size <= PNI_INLINE_TAG) {
+    if (tag.size) memcpy(delivery->tag, tag.start, tag.size);
+    return 0;
+  }
+  if (!delivery->long_tag) {
+    delivery->long_tag = pn_buffer(tag.size);
+    if (!delivery->long_tag) return PN_OUT_OF_MEMORY;
+  }
+  pn_buffer_clear(delivery->long_tag);
+  return pn_buffer_append(delivery->long_tag, tag.start, tag.size);
+}
+
 pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
 {
   assert(link);
@@ -1529,7 +1606,7 @@ pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
     static const pn_class_t clazz = PN_METACLASS(pn_delivery);
     delivery = (pn_delivery_t *) pn_class_new(&clazz, sizeof(pn_delivery_t));
     if (!delivery) return NULL;
-    delivery->tag = pn_buffer(16);
+    delivery->long_tag = NULL;
     delivery->bytes = pn_buffer(64);
     pn_disposition_init(&delivery->local);
     pn_disposition_init(&delivery->remote);
@@ -1537,10 +1614,14 @@ pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
   } else {
     assert(!delivery->state.init);
   }
+  if (pni_delivery_set_tag(delivery, tag)) {
+    // not on the link yet, so the finalizer only releases its memory
+    delivery->link = NULL;
+    pn_free(delivery);
+    return NULL;
+  }
   delivery->link = link;
   pn_incref(delivery->link);  // keep link until finalized
-  pn_buffer_clear(delivery->tag);
-  pn_buffer_append(delivery->tag, tag.start, tag.size);
   pn_disposition_clear(&delivery->local);
   pn_disposition_clear(&delivery->remote);
   delivery->updated = false;
@@ -1623,7 +1704,7 @@ bool pn_delivery_current(pn_delivery_t *delivery)
 void pn_delivery_dump(pn_delivery_t *d)
 {
   char tag[1024];
-  pn_bytes_t bytes = pn_buffer_bytes(d->tag);
+  pn_bytes_t bytes = pni_delivery_tag(d);
   pn_quote_data(tag, 1024, bytes.start, bytes.size);
   printf("{tag=%s, local.type=%" PRIu64 ", remote.type=%" PRIu64 ", local.settled=%u, "
          "remote.settled=%u, updated=%u, current=%u, writable=%u, readable=%u, "
@@ -1726,7 +1807,7 @@ pn_condition_t *pn_disposition_condition(pn_disposition_t *disposition)
 pn_delivery_tag_t pn_delivery_tag(pn_delivery_t *delivery)
 {
   if (delivery) {
-    pn_bytes_t tag = pn_buffer_bytes(delivery->tag);
+    pn_bytes_t tag = pni_delivery_tag(delivery);
     return pn_dtag(tag.start, tag.size);
   } else {
     return pn_dtag(0, 0);
@@ -1756,7 +1837,7 @@ static void pni_advance_receiver(pn_link_t *link)
   link->session->incoming_deliveries--;
 
   pn_delivery_t *current = link->current;
-  link->session->incoming_bytes -= pn_buffer_size(current->bytes);
+  pni_incoming_consumed(link->session, pn_buffer_size(current->bytes));
   pn_buffer_clear(current->bytes);
 
   if (!link->session->state.incoming_window) {
@@ -1875,10 +1956,31 @@ ssize_t pn_link_send(pn_link_t *sender, const char *bytes, size_t n)
   if (!bytes || !n) return 0;
   pn_buffer_append(current->bytes, bytes, n);
   sender->session->outgoing_bytes += n;
+  sender->session->connection->outgoing_bytes += n;
   pni_add_tpwork(current);
   return n;
 }
 
+pn_rwbytes_t pni_link_send_space(pn_link_t *sender, size_t n)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) {
+    pn_rwbytes_t r = {0, NULL};
+    return r;
+  }
+  return pn_buffer_reserve(current->bytes, n);
+}
+
+void pni_link_sent(pn_link_t *sender, size_t n)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current || !n) return;
+  pn_buffer_commit(current->bytes, n);
+  sender->session->outgoing_bytes += n;
+  sender->session->connection->outgoing_bytes += n;
+  pni_add_tpwork(current);
+}
+
 int pn_link_drained(pn_link_t *link)
 {
   assert(link);
@@ -1908,7 +2010,7 @@ ssize_t pn_link_recv(pn_link_t *receiver, char *bytes, size_t n)
     size_t size = pn_buffer_get(delivery->bytes, 0, n, bytes);
     pn_buffer_trim(delivery->bytes, size, 0);
     if (size) {
-      receiver->session->incoming_bytes -= size;
+      pni_incoming_consumed(receiver->session, size);
       if (!receiver->session->state.incoming_window) {
         pni_add_tpwork(delivery);
       }
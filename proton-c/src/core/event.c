@@ -23,22 +23,29 @@
 #include <proton/event.h>
 #include <proton/reactor.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 struct pn_collector_t {
   pn_list_t *pool;
   pn_event_t *head;
   pn_event_t *tail;
   pn_event_t *prev;         /* event returned by previous call to pn_collector_next() */
+  /* Open addressed index of the queued events behind the head that
+     later duplicates are folded into, see pni_coalesces() */
+  pn_event_t **pending;
+  size_t pending_capacity;
+  size_t pending_count;
   bool freed;
 };
 
 struct pn_event_t {
-  pn_list_t *pool;
   const pn_class_t *clazz;
   void *context;    // depends on clazz
   pn_record_t *attachments;
   pn_event_t *next;
   pn_event_type_t type;
+  bool pending;     // in the collector's pending index
 };
 
 static void pn_collector_initialize(pn_collector_t *collector)
@@ -47,6 +54,9 @@ static void pn_collector_initialize(pn_collector_t *collector)
   collector->head = NULL;
   collector->tail = NULL;
   collector->prev = NULL;
+  collector->pending = NULL;
+  collector->pending_capacity = 0;
+  collector->pending_count = 0;
   collector->freed = false;
 }
 
@@ -68,6 +78,7 @@ static void pn_collector_shrink(pn_collector_t *collector)
 static void pn_collector_finalize(pn_collector_t *collector)
 {
   pn_collector_drain(collector);
+  free(collector->pending);
   pn_decref(collector->pool);
 }
 
@@ -121,6 +132,80 @@ void pn_collector_release(pn_collector_t *collector)
 
 pn_event_t *pn_event(void);
 
+/* A delivery or flow event only tells the application to look at the
+   current state of its context, so one queued behind the head covers any
+   more of the same kind for the same object. The head is left out as it
+   may be the event being handled. */
+static inline bool pni_coalesces(pn_event_type_t type)
+{
+  return type == PN_DELIVERY || type == PN_LINK_FLOW;
+}
+
+static inline size_t pni_pending_slot(pn_collector_t *collector, void *context, pn_event_type_t type)
+{
+  uintptr_t h = ((uintptr_t) context >> 4) ^ (uintptr_t) type;
+  return (size_t) (h * 0x9E3779B1u) & (collector->pending_capacity - 1);
+}
+
+static pn_event_t *pni_pending_find(pn_collector_t *collector, void *context, pn_event_type_t type)
+{
+  if (!collector->pending_count) return NULL;
+  size_t mask = collector->pending_capacity - 1;
+  for (size_t i = pni_pending_slot(collector, context, type);
+       collector->pending[i]; i = (i + 1) & mask) {
+    pn_event_t *event = collector->pending[i];
+    if (event->context == context && event->type == type) return event;
+  }
+  return NULL;
+}
+
+static void pni_pending_insert(pn_collector_t *collector, pn_event_t *event)
+{
+  size_t mask = collector->pending_capacity - 1;
+  size_t i = pni_pending_slot(collector, event->context, event->type);
+  while (collector->pending[i]) i = (i + 1) & mask;
+  collector->pending[i] = event;
+}
+
+static void pni_pending_add(pn_collector_t *collector, pn_event_t *event)
+{
+  // keep the index at most half full
+  if (2 * (collector->pending_count + 1) > collector->pending_capacity) {
+    pn_event_t **old = collector->pending;
+    size_t old_capacity = collector->pending_capacity;
+    size_t capacity = old_capacity ? 2 * old_capacity : 16;
+    pn_event_t **pending = (pn_event_t **) calloc(capacity, sizeof(pn_event_t *));
+    if (!pending) return;
+    collector->pending = pending;
+    collector->pending_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old[i]) pni_pending_insert(collector, old[i]);
+    }
+    free(old);
+  }
+  pni_pending_insert(collector, event);
+  collector->pending_count++;
+  event->pending = true;
+}
+
+static void pni_pending_remove(pn_collector_t *collector, pn_event_t *event)
+{
+  size_t mask = collector->pending_capacity - 1;
+  size_t i = pni_pending_slot(collector, event->context, event->type);
+  while (collector->pending[i] != event) i = (i + 1) & mask;
+  // shift back any entries that probed past the freed slot
+  for (size_t j = (i + 1) & mask; collector->pending[j]; j = (j + 1) & mask) {
+    size_t k = pni_pending_slot(collector, collector->pending[j]->context, collector->pending[j]->type);
+    if (((j - k) & mask) >= ((j - i) & mask)) {
+      collector->pending[i] = collector->pending[j];
+      i = j;
+    }
+  }
+  collector->pending[i] = NULL;
+  collector->pending_count--;
+  event->pending = false;
+}
+
 pn_event_t *pn_collector_put(pn_collector_t *collector,
                              const pn_class_t *clazz, void *context,
                              pn_event_type_t type)
@@ -140,6 +225,11 @@ pn_event_t *pn_collector_put(pn_collector_t *collector,
     return NULL;
   }
 
+  bool coalesces = pni_coalesces(type);
+  if (coalesces && pni_pending_find(collector, context, type)) {
+    return NULL;
+  }
+
   clazz = clazz->reify(context);
 
   pn_event_t *event = (pn_event_t *) pn_list_pop(collector->pool);
@@ -148,9 +238,6 @@ pn_event_t *pn_collector_put(pn_collector_t *collector,
     event = pn_event();
   }
 
-  event->pool = collector->pool;
-  pn_incref(event->pool);
-
   if (tail) {
     tail->next = event;
     collector->tail = event;
@@ -164,6 +251,10 @@ pn_event_t *pn_collector_put(pn_collector_t *collector,
   event->type = type;
   pn_class_incref(clazz, event->context);
 
+  if (coalesces && tail) {
+    pni_pending_add(collector, event);
+  }
+
   return event;
 }
 
@@ -179,22 +270,40 @@ static pn_event_t *pop_internal(pn_collector_t *collector) {
     collector->head = event->next;
     if (!collector->head) {
       collector->tail = NULL;
+    } else if (collector->head->pending) {
+      pni_pending_remove(collector, collector->head);
     }
   }
   return event;
 }
 
+// Drop the collector's reference to an event it has handed out. Unless
+// the application has kept a reference the event goes straight back to
+// the pool, otherwise it is freed along with the last reference.
+static void pni_event_release(pn_collector_t *collector, pn_event_t *event) {
+  if (pn_refcount(event) == 1 && !collector->freed) {
+    pn_class_decref(event->clazz, event->context);
+    event->type = PN_EVENT_NONE;
+    event->clazz = NULL;
+    event->context = NULL;
+    event->next = NULL;
+    pn_record_clear(event->attachments);
+    pn_list_add(collector->pool, event);
+  }
+  pn_decref(event);
+}
+
 bool pn_collector_pop(pn_collector_t *collector) {
   pn_event_t *event = pop_internal(collector);
   if (event) {
-    pn_decref(event);
+    pni_event_release(collector, event);
   }
   return event;
 }
 
 pn_event_t *pn_collector_next(pn_collector_t *collector) {
   if (collector->prev) {
-    pn_decref(collector->prev);
+    pni_event_release(collector, collector->prev);
   }
   collector->prev = pop_internal(collector);
   return collector->prev;
@@ -212,35 +321,19 @@ bool pn_collector_more(pn_collector_t *collector)
 
 static void pn_event_initialize(pn_event_t *event)
 {
-  event->pool = NULL;
   event->type = PN_EVENT_NONE;
   event->clazz = NULL;
   event->context = NULL;
   event->next = NULL;
+  event->pending = false;
   event->attachments = pn_record();
 }
 
 static void pn_event_finalize(pn_event_t *event) {
-  // decref before adding to the free list
   if (event->clazz && event->context) {
     pn_class_decref(event->clazz, event->context);
   }
-
-  pn_list_t *pool = event->pool;
-
-  if (pool && pn_refcount(pool) > 1) {
-    event->pool = NULL;
-    event->type = PN_EVENT_NONE;
-    event->clazz = NULL;
-    event->context = NULL;
-    event->next = NULL;
-    pn_record_clear(event->attachments);
-    pn_list_add(pool, event);
-  } else {
-    pn_decref(event->attachments);
-  }
-
-  pn_decref(pool);
+  pn_decref(event->attachments);
 }
 
 static int pn_event_inspect(pn_event_t *event, pn_string_t *dst)
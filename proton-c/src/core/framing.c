@@ -101,3 +101,26 @@ size_t pn_write_frame(char *bytes, size_t available, pn_frame_t frame)
     return 0;
   }
 }
+
+ssize_t pn_queue_frame(pn_buffer_t *queue, pn_frame_t frame, pn_bytes_t body)
+{
+  static const char padding[4] = {0};
+  int doff = (frame.ex_size + AMQP_HEADER_SIZE - 1)/4 + 1;
+  size_t pad = 4*doff - AMQP_HEADER_SIZE - frame.ex_size;
+  size_t size = 4*doff + frame.size + body.size;
+
+  char header[AMQP_HEADER_SIZE];
+  pn_i_write32(&header[0], size);
+  header[4] = doff;
+  header[5] = frame.type;
+  pn_i_write16(&header[6], frame.channel);
+
+  int err = pn_buffer_ensure(queue, size);
+  if (err) return err;
+  pn_buffer_append(queue, header, AMQP_HEADER_SIZE);
+  pn_buffer_append(queue, frame.extended, frame.ex_size);
+  pn_buffer_append(queue, padding, pad);
+  pn_buffer_append(queue, frame.payload, frame.size);
+  pn_buffer_append(queue, body.start, body.size);
+  return size;
+}
@@ -25,6 +25,9 @@
 #include <proton/import_export.h>
 #include <proton/type_compat.h>
 #include <proton/error.h>
+#include <proton/types.h>
+
+#include "buffer.h"
 
 #define AMQP_HEADER_SIZE (8)
 #define AMQP_MIN_MAX_FRAME_SIZE ((uint32_t)512) // minimum allowable max-frame
@@ -40,5 +43,7 @@ typedef struct {
 
 ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max);
 size_t pn_write_frame(char *bytes, size_t size, pn_frame_t frame);
+// append a frame to an output queue, the frame body follows frame.payload
+ssize_t pn_queue_frame(pn_buffer_t *queue, pn_frame_t frame, pn_bytes_t body);
 
 #endif /* framing.h */
@@ -33,8 +33,38 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include "buffer.h"
+#include "data.h"
+#include "decoder.h"
+#include "encoder.h"
+#include "encodings.h"
+#include "engine-internal.h"
+
 // message
 
+// The sections pn_message_decode_lazy() keeps encoded, in encoding order
+typedef enum {
+  PNI_HEADER,
+  PNI_DELIVERY_ANNOTATIONS,
+  PNI_MESSAGE_ANNOTATIONS,
+  PNI_PROPERTIES,
+  PNI_APPLICATION_PROPERTIES,
+  PNI_BODY,
+  PNI_SECTIONS
+} pni_section_t;
+
+// A section's bytes in msg->raw. Size is zero if there are none, or they
+// are out of date because the section has been changed since. A section
+// whose pn_data_t has been handed out is lent: its bytes stay good until
+// the data's change count moves on from changes.
+typedef struct {
+  size_t offset;
+  size_t size;
+  uint32_t changes;
+  bool parsed;
+  bool lent;
+} pni_raw_section_t;
+
 struct pn_message_t {
   pn_timestamp_t expiry_time;
   pn_timestamp_t creation_time;
@@ -55,8 +85,12 @@ struct pn_message_t {
   pn_data_t *properties;
   pn_data_t *body;
 
+  pn_encoder_t *encoder;
   pn_error_t *error;
 
+  pn_buffer_t *raw;
+  pni_raw_section_t sections[PNI_SECTIONS];
+
   pn_sequence_t group_sequence;
   pn_millis_t ttl;
   uint32_t delivery_count;
@@ -68,6 +102,57 @@ struct pn_message_t {
   bool inferred;
 };
 
+static void pni_message_parse(pn_message_t *msg, pni_section_t section);
+
+// Make sure a section is decoded and stop using its encoded bytes
+static void pni_message_modify(pn_message_t *msg, pni_section_t section)
+{
+  pni_message_parse(msg, section);
+  msg->sections[section].size = 0;
+}
+
+// The pn_data_t the application can reach a section through, if any
+static pn_data_t *pni_message_section_data(pn_message_t *msg, pni_section_t section)
+{
+  switch (section) {
+  case PNI_DELIVERY_ANNOTATIONS: return msg->instructions;
+  case PNI_MESSAGE_ANNOTATIONS: return msg->annotations;
+  case PNI_APPLICATION_PROPERTIES: return msg->properties;
+  case PNI_BODY: return msg->body;
+  default: return NULL;
+  }
+}
+
+// Make sure a section is decoded and hand out its pn_data_t, keeping the
+// encoded bytes unless the caller changes it
+static pn_data_t *pni_message_lend(pn_message_t *msg, pni_section_t section)
+{
+  pni_message_parse(msg, section);
+  pn_data_t *data = pni_message_section_data(msg, section);
+  msg->sections[section].lent = true;
+  msg->sections[section].changes = pni_data_changes(data);
+  return data;
+}
+
+// The size of a section's bytes, first dropping them if it was lent and
+// has been changed since
+static size_t pni_message_raw_size(pn_message_t *msg, pni_section_t section)
+{
+  pni_raw_section_t *raw = &msg->sections[section];
+  if (raw->lent && raw->changes != pni_data_changes(pni_message_section_data(msg, section))) {
+    raw->size = 0;
+    raw->lent = false;
+  }
+  return raw->size;
+}
+
+static void pni_message_parse_all(pn_message_t *msg)
+{
+  for (int i = 0; i < PNI_SECTIONS; ++i) {
+    pni_message_parse(msg, (pni_section_t) i);
+  }
+}
+
 void pn_message_finalize(void *obj)
 {
   pn_message_t *msg = (pn_message_t *) obj;
@@ -86,12 +171,15 @@ void pn_message_finalize(void *obj)
   pn_data_free(msg->annotations);
   pn_data_free(msg->properties);
   pn_data_free(msg->body);
+  pn_free(msg->encoder);
   pn_error_free(msg->error);
+  pn_buffer_free(msg->raw);
 }
 
 int pn_message_inspect(void *obj, pn_string_t *dst)
 {
   pn_message_t *msg = (pn_message_t *) obj;
+  pni_message_parse_all(msg);
   int err = pn_string_addf(dst, "Message{");
   if (err) return err;
 
@@ -333,7 +421,10 @@ pn_message_t *pn_message()
   msg->properties = pn_data(16);
   msg->body = pn_data(16);
 
+  msg->encoder = pn_encoder();
   msg->error = pn_error();
+  msg->raw = pn_buffer(0);
+  memset(msg->sections, 0, sizeof(msg->sections));
   return msg;
 }
 
@@ -368,6 +459,9 @@ void pn_message_clear(pn_message_t *msg)
   pn_data_clear(msg->annotations);
   pn_data_clear(msg->properties);
   pn_data_clear(msg->body);
+  pn_buffer_clear(msg->raw);
+  memset(msg->sections, 0, sizeof(msg->sections));
+  pn_error_clear(msg->error);
 }
 
 int pn_message_errno(pn_message_t *msg)
@@ -391,6 +485,8 @@ bool pn_message_is_inferred(pn_message_t *msg)
 int pn_message_set_inferred(pn_message_t *msg, bool inferred)
 {
   assert(msg);
+  // changes the body descriptor
+  pni_message_modify(msg, PNI_BODY);
   msg->inferred = inferred;
   return 0;
 }
@@ -398,11 +494,13 @@ int pn_message_set_inferred(pn_message_t *msg, bool inferred)
 bool pn_message_is_durable(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_HEADER);
   return msg->durable;
 }
 int pn_message_set_durable(pn_message_t *msg, bool durable)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_HEADER);
   msg->durable = durable;
   return 0;
 }
@@ -411,11 +509,13 @@ int pn_message_set_durable(pn_message_t *msg, bool durable)
 uint8_t pn_message_get_priority(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_HEADER);
   return msg->priority;
 }
 int pn_message_set_priority(pn_message_t *msg, uint8_t priority)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_HEADER);
   msg->priority = priority;
   return 0;
 }
@@ -423,11 +523,13 @@ int pn_message_set_priority(pn_message_t *msg, uint8_t priority)
 pn_millis_t pn_message_get_ttl(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_HEADER);
   return msg->ttl;
 }
 int pn_message_set_ttl(pn_message_t *msg, pn_millis_t ttl)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_HEADER);
   msg->ttl = ttl;
   return 0;
 }
@@ -435,11 +537,13 @@ int pn_message_set_ttl(pn_message_t *msg, pn_millis_t ttl)
 bool pn_message_is_first_acquirer(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_HEADER);
   return msg->first_acquirer;
 }
 int pn_message_set_first_acquirer(pn_message_t *msg, bool first)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_HEADER);
   msg->first_acquirer = first;
   return 0;
 }
@@ -447,11 +551,13 @@ int pn_message_set_first_acquirer(pn_message_t *msg, bool first)
 uint32_t pn_message_get_delivery_count(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_HEADER);
   return msg->delivery_count;
 }
 int pn_message_set_delivery_count(pn_message_t *msg, uint32_t count)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_HEADER);
   msg->delivery_count = count;
   return 0;
 }
@@ -459,16 +565,19 @@ int pn_message_set_delivery_count(pn_message_t *msg, uint32_t count)
 pn_data_t *pn_message_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return msg->id;
 }
 pn_atom_t pn_message_get_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_data_get_atom(msg->id);
 }
 int pn_message_set_id(pn_message_t *msg, pn_atom_t id)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   pn_data_rewind(msg->id);
   return pn_data_put_atom(msg->id, id);
 }
@@ -486,60 +595,71 @@ static int pn_string_set_bytes(pn_string_t *string, pn_bytes_t bytes)
 pn_bytes_t pn_message_get_user_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get_bytes(msg->user_id);
 }
 int pn_message_set_user_id(pn_message_t *msg, pn_bytes_t user_id)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set_bytes(msg->user_id, user_id);
 }
 
 const char *pn_message_get_address(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get(msg->address);
 }
 int pn_message_set_address(pn_message_t *msg, const char *address)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set(msg->address, address);
 }
 
 const char *pn_message_get_subject(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get(msg->subject);
 }
 int pn_message_set_subject(pn_message_t *msg, const char *subject)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set(msg->subject, subject);
 }
 
 const char *pn_message_get_reply_to(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get(msg->reply_to);
 }
 int pn_message_set_reply_to(pn_message_t *msg, const char *reply_to)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set(msg->reply_to, reply_to);
 }
 
 pn_data_t *pn_message_correlation_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return msg->correlation_id;
 }
 pn_atom_t pn_message_get_correlation_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_data_get_atom(msg->correlation_id);
 }
 int pn_message_set_correlation_id(pn_message_t *msg, pn_atom_t atom)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   pn_data_rewind(msg->correlation_id);
   return pn_data_put_atom(msg->correlation_id, atom);
 }
@@ -547,33 +667,39 @@ int pn_message_set_correlation_id(pn_message_t *msg, pn_atom_t atom)
 const char *pn_message_get_content_type(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get(msg->content_type);
 }
 int pn_message_set_content_type(pn_message_t *msg, const char *type)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set(msg->content_type, type);
 }
 
 const char *pn_message_get_content_encoding(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get(msg->content_encoding);
 }
 int pn_message_set_content_encoding(pn_message_t *msg, const char *encoding)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set(msg->content_encoding, encoding);
 }
 
 pn_timestamp_t pn_message_get_expiry_time(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return msg->expiry_time;
 }
 int pn_message_set_expiry_time(pn_message_t *msg, pn_timestamp_t time)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   msg->expiry_time = time;
   return 0;
 }
@@ -581,11 +707,13 @@ int pn_message_set_expiry_time(pn_message_t *msg, pn_timestamp_t time)
 pn_timestamp_t pn_message_get_creation_time(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return msg->creation_time;
 }
 int pn_message_set_creation_time(pn_message_t *msg, pn_timestamp_t time)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   msg->creation_time = time;
   return 0;
 }
@@ -593,22 +721,26 @@ int pn_message_set_creation_time(pn_message_t *msg, pn_timestamp_t time)
 const char *pn_message_get_group_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get(msg->group_id);
 }
 int pn_message_set_group_id(pn_message_t *msg, const char *group_id)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set(msg->group_id, group_id);
 }
 
 pn_sequence_t pn_message_get_group_sequence(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return msg->group_sequence;
 }
 int pn_message_set_group_sequence(pn_message_t *msg, pn_sequence_t n)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   msg->group_sequence = n;
   return 0;
 }
@@ -616,14 +748,110 @@ int pn_message_set_group_sequence(pn_message_t *msg, pn_sequence_t n)
 const char *pn_message_get_reply_to_group_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_parse(msg, PNI_PROPERTIES);
   return pn_string_get(msg->reply_to_group_id);
 }
 int pn_message_set_reply_to_group_id(pn_message_t *msg, const char *reply_to_group_id)
 {
   assert(msg);
+  pni_message_modify(msg, PNI_PROPERTIES);
   return pn_string_set(msg->reply_to_group_id, reply_to_group_id);
 }
 
+// Decode the first section in bytes into the message fields
+static ssize_t pni_message_decode_section(pn_message_t *msg, const char *bytes, size_t size)
+{
+  pn_data_clear(msg->data);
+  ssize_t used = pn_data_decode(msg->data, bytes, size);
+  if (used < 0)
+      return pn_error_format(msg->error, used, "data error: %s",
+                             pn_error_text(pn_data_error(msg->data)));
+  bool scanned;
+  uint64_t desc;
+  int err = pn_data_scan(msg->data, "D?L.", &scanned, &desc);
+  if (err) return pn_error_format(msg->error, err, "data error: %s",
+                                  pn_error_text(pn_data_error(msg->data)));
+  if (!scanned) {
+    desc = 0;
+  }
+
+  pn_data_rewind(msg->data);
+  pn_data_next(msg->data);
+  pn_data_enter(msg->data);
+  pn_data_next(msg->data);
+
+  switch (desc) {
+  case HEADER:
+    err = pn_data_scan(msg->data, "D.[oBIoI]", &msg->durable, &msg->priority,
+                 &msg->ttl, &msg->first_acquirer, &msg->delivery_count);
+    if (err) return pn_error_format(msg->error, err, "data error: %s",
+                                    pn_error_text(pn_data_error(msg->data)));
+    break;
+  case PROPERTIES:
+    {
+      pn_bytes_t user_id, address, subject, reply_to, ctype, cencoding,
+        group_id, reply_to_group_id;
+      pn_data_clear(msg->id);
+      pn_data_clear(msg->correlation_id);
+      err = pn_data_scan(msg->data, "D.[CzSSSCssttSIS]", msg->id,
+                         &user_id, &address, &subject, &reply_to,
+                         msg->correlation_id, &ctype, &cencoding,
+                         &msg->expiry_time, &msg->creation_time, &group_id,
+                         &msg->group_sequence, &reply_to_group_id);
+      if (err) return pn_error_format(msg->error, err, "data error: %s",
+                                      pn_error_text(pn_data_error(msg->data)));
+      err = pn_string_set_bytes(msg->user_id, user_id);
+      if (err) return pn_error_format(msg->error, err, "error setting user_id");
+      err = pn_string_setn(msg->address, address.start, address.size);
+      if (err) return pn_error_format(msg->error, err, "error setting address");
+      err = pn_string_setn(msg->subject, subject.start, subject.size);
+      if (err) return pn_error_format(msg->error, err, "error setting subject");
+      err = pn_string_setn(msg->reply_to, reply_to.start, reply_to.size);
+      if (err) return pn_error_format(msg->error, err, "error setting reply_to");
+      err = pn_string_setn(msg->content_type, ctype.start, ctype.size);
+      if (err) return pn_error_format(msg->error, err, "error setting content_type");
+      err = pn_string_setn(msg->content_encoding, cencoding.start,
+                           cencoding.size);
+      if (err) return pn_error_format(msg->error, err, "error setting content_encoding");
+      err = pn_string_setn(msg->group_id, group_id.start, group_id.size);
+      if (err) return pn_error_format(msg->error, err, "error setting group_id");
+      err = pn_string_setn(msg->reply_to_group_id, reply_to_group_id.start,
+                           reply_to_group_id.size);
+      if (err) return pn_error_format(msg->error, err, "error setting reply_to_group_id");
+    }
+    break;
+  case DELIVERY_ANNOTATIONS:
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->instructions, msg->data);
+    if (err) return err;
+    break;
+  case MESSAGE_ANNOTATIONS:
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->annotations, msg->data);
+    if (err) return err;
+    break;
+  case APPLICATION_PROPERTIES:
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->properties, msg->data);
+    if (err) return err;
+    break;
+  case DATA:
+  case AMQP_SEQUENCE:
+  case AMQP_VALUE:
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->body, msg->data);
+    if (err) return err;
+    break;
+  case FOOTER:
+    break;
+  default:
+    err = pn_data_copy(msg->body, msg->data);
+    if (err) return err;
+    break;
+  }
+  return used;
+}
+
 int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
 {
   assert(msg && bytes && size);
@@ -631,126 +859,266 @@ int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
   pn_message_clear(msg);
 
   while (size) {
-    pn_data_clear(msg->data);
-    ssize_t used = pn_data_decode(msg->data, bytes, size);
-    if (used < 0)
-        return pn_error_format(msg->error, used, "data error: %s",
-                               pn_error_text(pn_data_error(msg->data)));
+    ssize_t used = pni_message_decode_section(msg, bytes, size);
+    if (used < 0) return used;
     size -= used;
     bytes += used;
-    bool scanned;
+  }
+
+  pn_data_clear(msg->data);
+  return 0;
+}
+
+static void pni_message_parse(pn_message_t *msg, pni_section_t section)
+{
+  pni_raw_section_t *raw = &msg->sections[section];
+  if (!raw->size || raw->parsed) return;
+  raw->parsed = true;
+  // Errors are left in msg->error. The bytes are kept so the section is
+  // passed on unchanged if it is re-encoded.
+  pni_message_decode_section(msg, pn_buffer_memory(msg->raw).start + raw->offset, raw->size);
+  pn_data_clear(msg->data);
+}
+
+int pn_message_decode_lazy(pn_message_t *msg, const char *bytes, size_t size)
+{
+  assert(msg && bytes && size);
+
+  pn_message_clear(msg);
+  int err = pn_buffer_append(msg->raw, bytes, size);
+  if (err) return pn_error_format(msg->error, err, "error saving message");
+
+  size_t offset = 0;
+  while (offset < size) {
+    const char *start = bytes + offset;
+    ssize_t used = pni_value_size(start, size - offset);
+    if (used < 0)
+      return pn_error_format(msg->error, used, "data error: %s",
+                             used == PN_UNDERFLOW ? "not enough data to decode" : "invalid encoding");
     uint64_t desc;
-    int err = pn_data_scan(msg->data, "D?L.", &scanned, &desc);
-    if (err) return pn_error_format(msg->error, err, "data error: %s",
-                                    pn_error_text(pn_data_error(msg->data)));
-    if (!scanned) {
+    if (!pni_value_descriptor(start, used, &desc)) {
       desc = 0;
     }
 
-    pn_data_rewind(msg->data);
-    pn_data_next(msg->data);
-    pn_data_enter(msg->data);
-    pn_data_next(msg->data);
-
+    pni_section_t section;
     switch (desc) {
-    case HEADER:
-      err = pn_data_scan(msg->data, "D.[oBIoI]", &msg->durable, &msg->priority,
-                   &msg->ttl, &msg->first_acquirer, &msg->delivery_count);
-      if (err) return pn_error_format(msg->error, err, "data error: %s",
-                                      pn_error_text(pn_data_error(msg->data)));
-      break;
-    case PROPERTIES:
-      {
-        pn_bytes_t user_id, address, subject, reply_to, ctype, cencoding,
-          group_id, reply_to_group_id;
-        pn_data_clear(msg->id);
-        pn_data_clear(msg->correlation_id);
-        err = pn_data_scan(msg->data, "D.[CzSSSCssttSIS]", msg->id,
-                           &user_id, &address, &subject, &reply_to,
-                           msg->correlation_id, &ctype, &cencoding,
-                           &msg->expiry_time, &msg->creation_time, &group_id,
-                           &msg->group_sequence, &reply_to_group_id);
-        if (err) return pn_error_format(msg->error, err, "data error: %s",
-                                        pn_error_text(pn_data_error(msg->data)));
-        err = pn_string_set_bytes(msg->user_id, user_id);
-        if (err) return pn_error_format(msg->error, err, "error setting user_id");
-        err = pn_string_setn(msg->address, address.start, address.size);
-        if (err) return pn_error_format(msg->error, err, "error setting address");
-        err = pn_string_setn(msg->subject, subject.start, subject.size);
-        if (err) return pn_error_format(msg->error, err, "error setting subject");
-        err = pn_string_setn(msg->reply_to, reply_to.start, reply_to.size);
-        if (err) return pn_error_format(msg->error, err, "error setting reply_to");
-        err = pn_string_setn(msg->content_type, ctype.start, ctype.size);
-        if (err) return pn_error_format(msg->error, err, "error setting content_type");
-        err = pn_string_setn(msg->content_encoding, cencoding.start,
-                             cencoding.size);
-        if (err) return pn_error_format(msg->error, err, "error setting content_encoding");
-        err = pn_string_setn(msg->group_id, group_id.start, group_id.size);
-        if (err) return pn_error_format(msg->error, err, "error setting group_id");
-        err = pn_string_setn(msg->reply_to_group_id, reply_to_group_id.start,
-                             reply_to_group_id.size);
-        if (err) return pn_error_format(msg->error, err, "error setting reply_to_group_id");
-      }
-      break;
-    case DELIVERY_ANNOTATIONS:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->instructions, msg->data);
-      if (err) return err;
-      break;
-    case MESSAGE_ANNOTATIONS:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->annotations, msg->data);
-      if (err) return err;
-      break;
-    case APPLICATION_PROPERTIES:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->properties, msg->data);
-      if (err) return err;
-      break;
+    case HEADER: section = PNI_HEADER; break;
+    case DELIVERY_ANNOTATIONS: section = PNI_DELIVERY_ANNOTATIONS; break;
+    case MESSAGE_ANNOTATIONS: section = PNI_MESSAGE_ANNOTATIONS; break;
+    case PROPERTIES: section = PNI_PROPERTIES; break;
+    case APPLICATION_PROPERTIES: section = PNI_APPLICATION_PROPERTIES; break;
     case DATA:
     case AMQP_SEQUENCE:
-    case AMQP_VALUE:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->body, msg->data);
-      if (err) return err;
-      break;
-    case FOOTER:
-      break;
+    case AMQP_VALUE: section = PNI_BODY; break;
+    case FOOTER: section = PNI_SECTIONS; break;
     default:
-      err = pn_data_copy(msg->body, msg->data);
-      if (err) return err;
+      // Not a section, pn_message_decode puts the whole thing in the body
+      msg->sections[PNI_BODY].size = 0;
+      used = pni_message_decode_section(msg, start, used);
+      if (used < 0) return used;
+      section = PNI_SECTIONS;
       break;
     }
+    if (section != PNI_SECTIONS) {
+      msg->sections[section].offset = offset;
+      msg->sections[section].size = used;
+      msg->sections[section].parsed = false;
+    }
+    offset += used;
   }
 
   pn_data_clear(msg->data);
   return 0;
 }
 
+static int pni_message_put_data(pn_message_t *msg, pn_data_t *data)
+{
+  int err = pn_encoder_put_data(msg->encoder, data);
+  if (err)
+    return pn_error_format(msg->error, err, "data error: %s",
+                           pn_error_text(pn_data_error(data)));
+  return 0;
+}
+
+// Like pn_data_fill "C": the value held in data, or null if it is empty
+static int pni_message_put_atom(pn_message_t *msg, pn_data_t *data)
+{
+  if (pn_data_size(data)) {
+    return pni_message_put_data(msg, data);
+  } else {
+    pn_encoder_put_null(msg->encoder);
+    return 0;
+  }
+}
+
+static void pni_message_put_string(pn_message_t *msg, pn_string_t *string, bool symbol)
+{
+  if (!pn_string_get(string)) {
+    pn_encoder_put_null(msg->encoder);
+  } else if (symbol) {
+    pn_encoder_put_symbol(msg->encoder, pn_string_get_bytes(string));
+  } else {
+    pn_encoder_put_string(msg->encoder, pn_string_get_bytes(string));
+  }
+}
+
+// Copy a section that is unchanged since pn_message_decode_lazy
+static bool pni_message_put_raw(pn_message_t *msg, pni_section_t section)
+{
+  pni_raw_section_t *raw = &msg->sections[section];
+  if (!pni_message_raw_size(msg, section)) return false;
+  pn_encoder_put_raw(msg->encoder, pn_buffer_memory(msg->raw).start + raw->offset, raw->size);
+  return true;
+}
+
+static int pni_message_put_section(pn_message_t *msg, pni_section_t section, uint64_t descriptor, pn_data_t *data)
+{
+  if (pni_message_put_raw(msg, section)) return 0;
+  if (!pn_data_size(data)) return 0;
+  pn_encoder_put_described(msg->encoder);
+  pn_encoder_put_ulong(msg->encoder, descriptor);
+  return pni_message_put_data(msg, data);
+}
+
+static void pni_message_put_header(pn_message_t *msg)
+{
+  pn_encoder_t *encoder = msg->encoder;
+  if (pni_message_put_raw(msg, PNI_HEADER)) return;
+  pn_encoder_put_described(encoder);
+  pn_encoder_put_ulong(encoder, HEADER);
+  size_t list = pn_encoder_begin_list(encoder);
+  pn_encoder_put_bool(encoder, msg->durable);
+  pn_encoder_put_ubyte(encoder, msg->priority);
+  if (msg->ttl) {
+    pn_encoder_put_uint(encoder, msg->ttl);
+  } else {
+    pn_encoder_put_null(encoder);
+  }
+  pn_encoder_put_bool(encoder, msg->first_acquirer);
+  pn_encoder_put_uint(encoder, msg->delivery_count);
+  pn_encoder_end_list(encoder, list, 5);
+}
+
+static int pni_message_put_properties(pn_message_t *msg)
+{
+  pn_encoder_t *encoder = msg->encoder;
+  if (pni_message_put_raw(msg, PNI_PROPERTIES)) return 0;
+  pn_encoder_put_described(encoder);
+  pn_encoder_put_ulong(encoder, PROPERTIES);
+  size_t list = pn_encoder_begin_list(encoder);
+  int err = pni_message_put_atom(msg, msg->id);
+  if (err) return err;
+  if (pn_string_get(msg->user_id)) {
+    pn_encoder_put_binary(encoder, pn_string_get_bytes(msg->user_id));
+  } else {
+    pn_encoder_put_null(encoder);
+  }
+  pni_message_put_string(msg, msg->address, false);
+  pni_message_put_string(msg, msg->subject, false);
+  pni_message_put_string(msg, msg->reply_to, false);
+  err = pni_message_put_atom(msg, msg->correlation_id);
+  if (err) return err;
+  pni_message_put_string(msg, msg->content_type, true);
+  pni_message_put_string(msg, msg->content_encoding, true);
+  pn_encoder_put_timestamp(encoder, msg->expiry_time);
+  pn_encoder_put_timestamp(encoder, msg->creation_time);
+  pni_message_put_string(msg, msg->group_id, false);
+  pn_encoder_put_uint(encoder, msg->group_sequence);
+  pni_message_put_string(msg, msg->reply_to_group_id, false);
+  pn_encoder_end_list(encoder, list, 13);
+  return 0;
+}
+
+static int pni_message_put_body(pn_message_t *msg)
+{
+  uint64_t descriptor = AMQP_VALUE;
+  if (msg->inferred && !pni_message_raw_size(msg, PNI_BODY) && pn_data_size(msg->body)) {
+    pn_data_rewind(msg->body);
+    pn_data_next(msg->body);
+    switch (pn_data_type(msg->body)) {
+    case PN_BINARY:
+      descriptor = DATA;
+      break;
+    case PN_LIST:
+      descriptor = AMQP_SEQUENCE;
+      break;
+    default:
+      break;
+    }
+    pn_data_rewind(msg->body);
+  }
+  return pni_message_put_section(msg, PNI_BODY, descriptor, msg->body);
+}
+
+/* Write the message straight from its fields, or copy the sections that
+   are unchanged since pn_message_decode_lazy. This must produce the same
+   bytes as pn_data_encode of the tree built by pn_message_data. */
+static int pni_message_write(pn_message_t *msg)
+{
+  pni_message_put_header(msg);
+  int err = pni_message_put_section(msg, PNI_DELIVERY_ANNOTATIONS, DELIVERY_ANNOTATIONS, msg->instructions);
+  if (err) return err;
+  err = pni_message_put_section(msg, PNI_MESSAGE_ANNOTATIONS, MESSAGE_ANNOTATIONS, msg->annotations);
+  if (err) return err;
+  err = pni_message_put_properties(msg);
+  if (err) return err;
+  err = pni_message_put_section(msg, PNI_APPLICATION_PROPERTIES, APPLICATION_PROPERTIES, msg->properties);
+  if (err) return err;
+  return pni_message_put_body(msg);
+}
+
 int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
 {
   if (!msg || !bytes || !size || !*size) return PN_ARG_ERR;
-  pn_data_clear(msg->data);
-  pn_message_data(msg, msg->data);
-  size_t remaining = *size;
-  ssize_t encoded = pn_data_encode(msg->data, bytes, remaining);
+  pn_encoder_begin(msg->encoder, bytes, *size);
+  int err = pni_message_write(msg);
+  if (err) return err;
+  ssize_t encoded = pn_encoder_end(msg->encoder);
   if (encoded < 0) {
-    if (encoded == PN_OVERFLOW) {
-      return encoded;
-    } else {
-      return pn_error_format(msg->error, encoded, "data error: %s",
-                             pn_error_text(pn_data_error(msg->data)));
-    }
+    *size = pn_encoder_needed(msg->encoder);
+    return encoded;
   }
-  bytes += encoded;
-  remaining -= encoded;
-  *size -= remaining;
-  pn_data_clear(msg->data);
+  *size = encoded;
   return 0;
 }
 
+ssize_t pn_message_encoded_size(pn_message_t *msg)
+{
+  if (!msg) return PN_ARG_ERR;
+  pn_encoder_begin(msg->encoder, NULL, 0);
+  int err = pni_message_write(msg);
+  if (err) return err;
+  return pn_encoder_end(msg->encoder);
+}
+
+ssize_t pn_message_send(pn_message_t *msg, pn_link_t *sender)
+{
+  if (!msg || !sender) return PN_ARG_ERR;
+  if (!pn_link_current(sender)) return PN_EOS;
+  // Try whatever space the delivery buffer already has, it is normally
+  // enough once the delivery has been recycled a few times.
+  pn_rwbytes_t space = pni_link_send_space(sender, 0);
+  pn_encoder_begin(msg->encoder, space.start, space.size);
+  int err = pni_message_write(msg);
+  if (err) return err;
+  ssize_t encoded = pn_encoder_end(msg->encoder);
+  if (encoded < 0 || !space.start) {
+    size_t needed = pn_encoder_needed(msg->encoder);
+    space = pni_link_send_space(sender, needed);
+    if (space.size < needed) return PN_OUT_OF_MEMORY;
+    pn_encoder_begin(msg->encoder, space.start, space.size);
+    err = pni_message_write(msg);
+    if (err) return err;
+    encoded = pn_encoder_end(msg->encoder);
+    if (encoded < 0) return encoded;
+  }
+  pni_link_sent(sender, encoded);
+  return encoded;
+}
+
 int pn_message_data(pn_message_t *msg, pn_data_t *data)
 {
+  pni_message_parse_all(msg);
   pn_data_clear(data);
   int err = pn_data_fill(data, "DL[oB?IoI]", HEADER, msg->durable,
                          msg->priority, msg->ttl, msg->ttl, msg->first_acquirer,
@@ -843,20 +1211,67 @@ int pn_message_data(pn_message_t *msg, pn_data_t *data)
 
 pn_data_t *pn_message_instructions(pn_message_t *msg)
 {
-  return msg ? msg->instructions : NULL;
+  if (!msg) return NULL;
+  return pni_message_lend(msg, PNI_DELIVERY_ANNOTATIONS);
 }
 
 pn_data_t *pn_message_annotations(pn_message_t *msg)
 {
-  return msg ? msg->annotations : NULL;
+  if (!msg) return NULL;
+  return pni_message_lend(msg, PNI_MESSAGE_ANNOTATIONS);
 }
 
 pn_data_t *pn_message_properties(pn_message_t *msg)
 {
-  return msg ? msg->properties : NULL;
+  if (!msg) return NULL;
+  return pni_message_lend(msg, PNI_APPLICATION_PROPERTIES);
 }
 
 pn_data_t *pn_message_body(pn_message_t *msg)
 {
-  return msg ? msg->body : NULL;
+  if (!msg) return NULL;
+  return pni_message_lend(msg, PNI_BODY);
+}
+
+int pn_message_set_encoded_body(pn_message_t *msg, const char *bytes, size_t size)
+{
+  assert(msg);
+  if (!bytes || pni_value_size(bytes, size) != (ssize_t) size) return PN_ARG_ERR;
+
+  // Reuse the raw buffer if no other section still refers to it
+  bool shared = false;
+  for (int i = 0; i < PNI_SECTIONS; ++i) {
+    if (i != PNI_BODY && pni_message_raw_size(msg, (pni_section_t) i)) shared = true;
+  }
+  if (!shared) pn_buffer_clear(msg->raw);
+
+  static const char descriptor[] = {(char) PNE_DESCRIPTOR, (char) PNE_SMALLULONG, (char) AMQP_VALUE};
+  size_t offset = pn_buffer_size(msg->raw);
+  int err = pn_buffer_append(msg->raw, descriptor, sizeof(descriptor));
+  if (!err) err = pn_buffer_append(msg->raw, bytes, size);
+  if (err) {
+    msg->sections[PNI_BODY].size = 0;
+    return pn_error_format(msg->error, err, "error saving body");
+  }
+  pn_data_clear(msg->body);
+  msg->sections[PNI_BODY].offset = offset;
+  msg->sections[PNI_BODY].size = sizeof(descriptor) + size;
+  msg->sections[PNI_BODY].parsed = false;
+  msg->sections[PNI_BODY].lent = false;
+  return 0;
+}
+
+pn_bytes_t pn_message_get_encoded_body(pn_message_t *msg)
+{
+  assert(msg);
+  pni_raw_section_t *raw = &msg->sections[PNI_BODY];
+  const char *section = pn_buffer_memory(msg->raw).start + raw->offset;
+  uint64_t descriptor;
+  if (!pni_message_raw_size(msg, PNI_BODY) || !pni_value_descriptor(section, raw->size, &descriptor) ||
+      descriptor != AMQP_VALUE) {
+    return pn_bytes(0, NULL);
+  }
+  ssize_t dsize = pni_value_size(section + 1, raw->size - 1);
+  if (dsize < 0) return pn_bytes(0, NULL);
+  return pn_bytes(raw->size - 1 - dsize, section + 1 + dsize);
 }
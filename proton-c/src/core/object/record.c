@@ -30,14 +30,27 @@ typedef struct {
 } pni_field_t;
 
 struct pn_record_t {
+  // fields for the reserved handles, indexed by handle and undefined
+  // while clazz is NULL
+  pni_field_t reserved[PN_RESERVED_HANDLES];
   size_t size;
   size_t capacity;
   pni_field_t *fields;
 };
 
+static inline bool pni_record_reserved(pn_handle_t key)
+{
+  return (uintptr_t) key < PN_RESERVED_HANDLES;
+}
+
 static void pn_record_initialize(void *object)
 {
   pn_record_t *record = (pn_record_t *) object;
+  for (int i = 0; i < PN_RESERVED_HANDLES; i++) {
+    record->reserved[i].key = (pn_handle_t) (uintptr_t) i;
+    record->reserved[i].clazz = NULL;
+    record->reserved[i].value = NULL;
+  }
   record->size = 0;
   record->capacity = 0;
   record->fields = NULL;
@@ -46,6 +59,10 @@ static void pn_record_initialize(void *object)
 static void pn_record_finalize(void *object)
 {
   pn_record_t *record = (pn_record_t *) object;
+  for (int i = 0; i < PN_RESERVED_HANDLES; i++) {
+    pni_field_t *v = &record->reserved[i];
+    if (v->clazz) pn_class_decref(v->clazz, v->value);
+  }
   for (size_t i = 0; i < record->size; i++) {
     pni_field_t *v = &record->fields[i];
     pn_class_decref(v->clazz, v->value);
@@ -66,6 +83,10 @@ pn_record_t *pn_record(void)
 }
 
 static pni_field_t *pni_record_find(pn_record_t *record, pn_handle_t key) {
+  if (pni_record_reserved(key)) {
+    pni_field_t *field = &record->reserved[(uintptr_t) key];
+    return field->clazz ? field : NULL;
+  }
   for (size_t i = 0; i < record->size; i++) {
     pni_field_t *field = &record->fields[i];
     if (field->key == key) {
@@ -96,6 +117,8 @@ void pn_record_def(pn_record_t *record, pn_handle_t key, const pn_class_t *clazz
   pni_field_t *field = pni_record_find(record, key);
   if (field) {
     assert(field->clazz == clazz);
+  } else if (pni_record_reserved(key)) {
+    record->reserved[(uintptr_t) key].clazz = clazz;
   } else {
     field = pni_record_create(record);
     field->key = key;
@@ -141,6 +164,12 @@ void pn_record_set(pn_record_t *record, pn_handle_t key, void *value)
 void pn_record_clear(pn_record_t *record)
 {
   assert(record);
+  for (int i = 0; i < PN_RESERVED_HANDLES; i++) {
+    pni_field_t *field = &record->reserved[i];
+    if (field->clazz) pn_class_decref(field->clazz, field->value);
+    field->clazz = NULL;
+    field->value = NULL;
+  }
   for (size_t i = 0; i < record->size; i++) {
     pni_field_t *field = &record->fields[i];
     pn_class_decref(field->clazz, field->value);
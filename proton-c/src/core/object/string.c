@@ -108,8 +108,9 @@ pn_string_t *pn_stringn(const char *bytes, size_t n)
 {
   static const pn_class_t clazz = PN_CLASS(pn_string);
   pn_string_t *string = (pn_string_t *) pn_class_new(&clazz, sizeof(pn_string_t));
-  string->capacity = n ? n * sizeof(char) : 16;
-  string->bytes = (char *) malloc(string->capacity);
+  // a null string has no storage until something is written to it
+  string->capacity = 0;
+  string->bytes = NULL;
   pn_string_setn(string, bytes, n);
   return string;
 }
@@ -141,16 +142,16 @@ int pn_string_set(pn_string_t *string, const char *bytes)
 
 int pn_string_grow(pn_string_t *string, size_t capacity)
 {
-  bool grow = false;
-  while (string->capacity < (capacity*sizeof(char) + 1)) {
-    string->capacity *= 2;
-    grow = true;
+  size_t grown = string->capacity ? string->capacity : 16;
+  while (grown < (capacity*sizeof(char) + 1)) {
+    grown *= 2;
   }
 
-  if (grow) {
-    char *growed = (char *) realloc(string->bytes, string->capacity);
+  if (grown != string->capacity) {
+    char *growed = (char *) realloc(string->bytes, grown);
     if (growed) {
       string->bytes = growed;
+      string->capacity = grown;
     } else {
       return PN_ERR;
     }
@@ -161,10 +162,9 @@ int pn_string_grow(pn_string_t *string, size_t capacity)
 
 int pn_string_setn(pn_string_t *string, const char *bytes, size_t n)
 {
-  int err = pn_string_grow(string, n);
-  if (err) return err;
-
   if (bytes) {
+    int err = pn_string_grow(string, n);
+    if (err) return err;
     memcpy(string->bytes, bytes, n*sizeof(char));
     string->bytes[n] = '\0';
     string->size = n;
@@ -244,13 +244,15 @@ int pn_string_vaddf(pn_string_t *string, const char *format, va_list ap)
 char *pn_string_buffer(pn_string_t *string)
 {
   assert(string);
+  if (!string->bytes) pn_string_grow(string, 0);
   return string->bytes;
 }
 
 size_t pn_string_capacity(pn_string_t *string)
 {
   assert(string);
-  return string->capacity - 1;
+  if (!string->bytes) pn_string_grow(string, 0);
+  return string->capacity ? string->capacity - 1 : 0;
 }
 
 int pn_string_resize(pn_string_t *string, size_t size)
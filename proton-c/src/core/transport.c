@@ -73,32 +73,75 @@ static void pni_calculate_channel_max(pn_transport_t *transport) {
 
 void pn_delivery_map_init(pn_delivery_map_t *db, pn_sequence_t next)
 {
-  db->deliveries = pn_hash(PN_WEAKREF, 0, 0.75);
+  db->deliveries = NULL;
+  db->capacity = 0;
+  db->head = 0;
+  db->first = next;
   db->next = next;
 }
 
 void pn_delivery_map_free(pn_delivery_map_t *db)
 {
-  pn_free(db->deliveries);
+  free(db->deliveries);
 }
 
-static pn_delivery_t *pni_delivery_map_get(pn_delivery_map_t *db, pn_sequence_t id)
+// start numbering an empty map at next
+static void pni_delivery_map_start(pn_delivery_map_t *db, pn_sequence_t next)
 {
-  return (pn_delivery_t *) pn_hash_get(db->deliveries, id);
+  assert(db->first == db->next);
+  db->first = next;
+  db->next = next;
+}
+
+// ids wrap, so positions in the ring are unsigned offsets from first
+static inline uint32_t pni_delivery_map_offset(pn_delivery_map_t *db, pn_sequence_t id)
+{
+  return (uint32_t) id - (uint32_t) db->first;
+}
+
+static inline uint32_t pni_delivery_map_size(pn_delivery_map_t *db)
+{
+  return pni_delivery_map_offset(db, db->next);
+}
+
+// the slot offset ids after first, offset must be less than the size
+static inline pn_delivery_t **pni_delivery_map_slot(pn_delivery_map_t *db, uint32_t offset)
+{
+  return &db->deliveries[(db->head + offset) & (db->capacity - 1)];
+}
+
+static int pni_delivery_map_grow(pn_delivery_map_t *db)
+{
+  size_t capacity = db->capacity ? 2*db->capacity : 16;
+  pn_delivery_t **deliveries = (pn_delivery_t **) calloc(capacity, sizeof(pn_delivery_t *));
+  if (!deliveries) return PN_OUT_OF_MEMORY;
+  uint32_t size = pni_delivery_map_size(db);
+  for (uint32_t i = 0; i < size; i++) {
+    deliveries[i] = *pni_delivery_map_slot(db, i);
+  }
+  free(db->deliveries);
+  db->deliveries = deliveries;
+  db->capacity = capacity;
+  db->head = 0;
+  return 0;
 }
 
 static void pn_delivery_state_init(pn_delivery_state_t *ds, pn_delivery_t *delivery, pn_sequence_t id)
 {
   ds->id = id;
+  ds->disp = (size_t) -1;
   ds->sent = false;
   ds->init = true;
 }
 
 static pn_delivery_state_t *pni_delivery_map_push(pn_delivery_map_t *db, pn_delivery_t *delivery)
 {
+  if (pni_delivery_map_size(db) >= db->capacity) {
+    if (pni_delivery_map_grow(db)) return NULL;
+  }
   pn_delivery_state_t *ds = &delivery->state;
   pn_delivery_state_init(ds, delivery, db->next++);
-  pn_hash_put(db->deliveries, ds->id, delivery);
+  *pni_delivery_map_slot(db, pni_delivery_map_offset(db, ds->id)) = delivery;
   return ds;
 }
 
@@ -107,20 +150,29 @@ void pn_delivery_map_del(pn_delivery_map_t *db, pn_delivery_t *delivery)
   if (delivery->state.init) {
     delivery->state.init = false;
     delivery->state.sent = false;
-    pn_hash_del(db->deliveries, delivery->state.id);
+    *pni_delivery_map_slot(db, pni_delivery_map_offset(db, delivery->state.id)) = NULL;
+    // drop the settled deliveries at the front so the ring only spans the
+    // unsettled range
+    while (db->first != db->next && !db->deliveries[db->head]) {
+      db->head = (db->head + 1) & (db->capacity - 1);
+      db->first++;
+    }
   }
 }
 
 static void pni_delivery_map_clear(pn_delivery_map_t *dm)
 {
-  pn_hash_t *hash = dm->deliveries;
-  for (pn_handle_t entry = pn_hash_head(hash);
-       entry;
-       entry = pn_hash_next(hash, entry))
-  {
-    pn_delivery_t *dlv = (pn_delivery_t *) pn_hash_value(hash, entry);
-    pn_delivery_map_del(dm, dlv);
+  uint32_t size = pni_delivery_map_size(dm);
+  for (uint32_t i = 0; i < size; i++) {
+    pn_delivery_t **slot = pni_delivery_map_slot(dm, i);
+    if (*slot) {
+      (*slot)->state.init = false;
+      (*slot)->state.sent = false;
+      *slot = NULL;
+    }
   }
+  dm->head = 0;
+  dm->first = 0;
   dm->next = 0;
 }
 
@@ -263,7 +315,8 @@ void pn_set_error_layer(pn_transport_t *transport)
 ssize_t pn_io_layer_input_autodetect(pn_transport_t *transport, unsigned int layer, const char *bytes, size_t available)
 {
   const char* error;
-  bool eos = pn_transport_capacity(transport)==PN_EOS;
+  // Not pn_transport_capacity(), which may move the input bytes are in
+  bool eos = transport->tail_closed;
   if (eos && available==0) {
     pn_do_error(transport, "amqp:connection:framing-error", "No valid protocol header found");
     pn_set_error_layer(transport);
@@ -397,6 +450,7 @@ static void pn_transport_initialize(void *object)
 {
   pn_transport_t *transport = (pn_transport_t *)object;
   transport->freed = false;
+  transport->output = NULL;
   transport->output_buf = NULL;
   transport->output_size = PN_DEFAULT_MAX_FRAME_SIZE ? PN_DEFAULT_MAX_FRAME_SIZE : 16 * 1024;
   transport->input_buf = NULL;
@@ -404,10 +458,12 @@ static void pn_transport_initialize(void *object)
   transport->tracer = pni_default_tracer;
   transport->sasl = NULL;
   transport->ssl = NULL;
+  transport->socket = PN_INVALID_SOCKET;
 
   transport->scratch = pn_string(NULL);
   transport->args = pn_data(16);
   transport->output_args = pn_data(16);
+  transport->encoder = pn_encoder();
   transport->frame = pn_buffer(PN_TRANSPORT_INITIAL_FRAME_SIZE);
   transport->input_frames_ct = 0;
   transport->output_frames_ct = 0;
@@ -472,7 +528,9 @@ static void pn_transport_initialize(void *object)
   transport->bytes_input = 0;
   transport->bytes_output = 0;
 
+  transport->input_start = 0;
   transport->input_pending = 0;
+  transport->output_start = 0;
   transport->output_pending = 0;
 
   transport->done_processing = false;
@@ -515,6 +573,9 @@ static void pni_unmap_remote_channel(pn_session_t *ssn)
   // XXX: should really update link state also
   pni_delivery_map_clear(&ssn->state.incoming);
   pni_transport_unbind_handles(ssn->state.remote_handles, false);
+  // The peer has ended the session, it won't use the rest of its window
+  ssn->connection->incoming_window -= ssn->state.incoming_window;
+  ssn->state.incoming_window = 0;
   pn_transport_t *transport = ssn->connection->transport;
   uint16_t channel = ssn->state.remote_channel;
   ssn->state.remote_channel = -2;
@@ -570,9 +631,7 @@ pn_transport_t *pn_transport(void)
     return NULL;
   }
 
-  transport->capacity = 4*1024;
-  transport->available = 0;
-  transport->output = (char *) malloc(transport->capacity);
+  transport->output = pn_buffer(4*1024);
   if (!transport->output) {
     pn_transport_free(transport);
     return NULL;
@@ -672,9 +731,10 @@ static void pn_transport_finalize(void *object)
   pn_free(transport->scratch);
   pn_data_free(transport->args);
   pn_data_free(transport->output_args);
+  pn_free(transport->encoder);
   pn_buffer_free(transport->frame);
   pn_free(transport->context);
-  free(transport->output);
+  pn_buffer_free(transport->output);
 }
 
 static void pni_post_remote_open_events(pn_transport_t *transport, pn_connection_t *connection) {
@@ -902,6 +962,30 @@ void pn_do_trace(pn_transport_t *transport, uint16_t ch, pn_dir_t dir,
   }
 }
 
+// Append a frame to the output queue, the body (if any) follows the
+// performative in frame.payload.
+static int pni_queue_frame(pn_transport_t *transport, pn_frame_t frame, pn_bytes_t body)
+{
+  ssize_t n = pn_queue_frame(transport->output, frame, body);
+  if (n < 0) {
+    pn_transport_logf(transport, "error queueing frame: %s", pn_code(n));
+    return PN_ERR;
+  }
+  transport->output_frames_ct += 1;
+  if (transport->trace & PN_TRACE_RAW) {
+    char *raw = (char *) malloc(n);
+    if (raw) {
+      pn_buffer_get(transport->output, pn_buffer_size(transport->output) - n, n, raw);
+      pn_string_set(transport->scratch, "RAW: \"");
+      pn_quote(transport->scratch, raw, n);
+      pn_string_addf(transport->scratch, "\"");
+      pn_transport_log(transport, pn_string_get(transport->scratch));
+      free(raw);
+    }
+  }
+  return 0;
+}
+
 int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...)
 {
   pn_buffer_t *frame_buf = transport->frame;
@@ -940,22 +1024,30 @@ int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const ch
   frame.channel = ch;
   frame.payload = buf.start;
   frame.size = wr;
-  size_t n;
-  while (!(n = pn_write_frame(transport->output + transport->available,
-                              transport->capacity - transport->available, frame))) {
-    transport->capacity *= 2;
-    transport->output = (char *) realloc(transport->output, transport->capacity);
-  }
-  transport->output_frames_ct += 1;
-  if (transport->trace & PN_TRACE_RAW) {
-    pn_string_set(transport->scratch, "RAW: \"");
-    pn_quote(transport->scratch, transport->output + transport->available, n);
-    pn_string_addf(transport->scratch, "\"");
-    pn_transport_log(transport, pn_string_get(transport->scratch));
-  }
-  transport->available += n;
+  return pni_queue_frame(transport, frame, pn_bytes(0, NULL));
+}
 
-  return 0;
+// The frame buffer, cleared and with room for at least size bytes of
+// performative
+static pn_rwbytes_t pni_frame_space(pn_transport_t *transport, size_t size)
+{
+  pn_buffer_clear(transport->frame);
+  return pn_buffer_reserve(transport->frame, size);
+}
+
+// Queue an AMQP frame whose performative was written to the frame buffer
+// by one of the pni_encode_* functions
+static int pni_post_encoded(pn_transport_t *transport, uint16_t ch, pn_rwbytes_t buf, ssize_t size)
+{
+  if (size < 0) {
+    pn_transport_logf(transport, "error posting frame: %s", pn_code(size));
+    return PN_ERR;
+  }
+  pn_frame_t frame = {AMQP_FRAME_TYPE};
+  frame.channel = ch;
+  frame.payload = buf.start;
+  frame.size = size;
+  return pni_queue_frame(transport, frame, pn_bytes(0, NULL));
 }
 
 static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
@@ -973,39 +1065,70 @@ static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
   bool more_flag = more;
   int framecount = 0;
   pn_buffer_t *frame = transport->frame;
+  pn_rwbytes_t buf = {0, NULL};
+  ssize_t wr;
+  int err;
+
+  // Unless there is a delivery state to send or the frame is traced, the
+  // performative is written directly rather than through output_args
+  bool direct = !code && !(transport->trace & PN_TRACE_FRM);
+  pni_transfer_frame_t transfer;
+  transfer.handle = handle;
+  transfer.id = id;
+  transfer.id_present = true;
+  transfer.tag = *tag;
+  transfer.message_format = message_format;
+  transfer.settled = settled;
 
   // create preformatives, assuming 'more' flag need not change
 
  compute_performatives:
-  pn_data_clear(transport->output_args);
-  int err = pn_data_fill(transport->output_args, "DL[IIzIoon?DLC]", TRANSFER,
-                         handle, id, tag->size, tag->start,
-                         message_format,
-                         settled, more_flag, (bool)code, code, state);
-  if (err) {
-    pn_transport_logf(transport,
-                      "error posting transfer frame: %s: %s", pn_code(err),
-                      pn_error_text(pn_data_error(transport->output_args)));
-    return PN_ERR;
+  if (direct) {
+    transfer.more = more_flag;
+    buf = pni_frame_space(transport, 0);
+    wr = pni_encode_transfer(transport->encoder, buf.start, buf.size, &transfer);
+    if (wr == PN_OVERFLOW) {
+      buf = pni_frame_space(transport, pn_encoder_needed(transport->encoder));
+      wr = pni_encode_transfer(transport->encoder, buf.start, buf.size, &transfer);
+    }
+    if (wr < 0) {
+      pn_transport_logf(transport, "error posting frame: %s", pn_code(wr));
+      return PN_ERR;
+    }
+    buf.size = wr;
+  } else {
+    pn_data_clear(transport->output_args);
+    err = pn_data_fill(transport->output_args, "DL[IIzIoon?DLC]", TRANSFER,
+                       handle, id, tag->size, tag->start,
+                       message_format,
+                       settled, more_flag, (bool)code, code, state);
+    if (err) {
+      pn_transport_logf(transport,
+                        "error posting transfer frame: %s: %s", pn_code(err),
+                        pn_error_text(pn_data_error(transport->output_args)));
+      return PN_ERR;
+    }
   }
 
   do { // send as many frames as possible without changing the 'more' flag...
 
-  encode_performatives:
-    pn_buffer_clear( frame );
-    pn_rwbytes_t buf = pn_buffer_memory( frame );
-    buf.size = pn_buffer_available( frame );
-
-    ssize_t wr = pn_data_encode(transport->output_args, buf.start, buf.size);
-    if (wr < 0) {
-      if (wr == PN_OVERFLOW) {
-        pn_buffer_ensure( frame, pn_buffer_available( frame ) * 2 );
-        goto encode_performatives;
+    if (!direct) {
+    encode_performatives:
+      pn_buffer_clear( frame );
+      buf = pn_buffer_memory( frame );
+      buf.size = pn_buffer_available( frame );
+
+      wr = pn_data_encode(transport->output_args, buf.start, buf.size);
+      if (wr < 0) {
+        if (wr == PN_OVERFLOW) {
+          pn_buffer_ensure( frame, pn_buffer_available( frame ) * 2 );
+          goto encode_performatives;
+        }
+        pn_transport_logf(transport, "error posting frame: %s", pn_code(wr));
+        return PN_ERR;
       }
-      pn_transport_logf(transport, "error posting frame: %s", pn_code(wr));
-      return PN_ERR;
+      buf.size = wr;
     }
-    buf.size = wr;
 
     // check if we need to break up the outbound frame
     size_t available = payload->size;
@@ -1023,39 +1146,20 @@ static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
       }
     }
 
-    if (pn_buffer_available( frame ) < (available + buf.size)) {
-      // not enough room for payload - try again...
-      pn_buffer_ensure( frame, available + buf.size );
-      goto encode_performatives;
-    }
-
     pn_do_trace(transport, ch, OUT, transport->output_args, payload->start, available);
 
-    memmove( buf.start + buf.size, payload->start, available);
-    payload->start += available;
-    payload->size -= available;
-    buf.size += available;
-
+    // the performative stays in the frame buffer, the body is gathered
+    // straight from the delivery into the output queue
     pn_frame_t frame = {AMQP_FRAME_TYPE};
     frame.channel = ch;
     frame.payload = buf.start;
     frame.size = buf.size;
 
-    size_t n;
-    while (!(n = pn_write_frame(transport->output + transport->available,
-                                transport->capacity - transport->available, frame))) {
-      transport->capacity *= 2;
-      transport->output = (char *) realloc(transport->output, transport->capacity);
-    }
-    transport->output_frames_ct += 1;
+    err = pni_queue_frame(transport, frame, pn_bytes(available, payload->start));
+    if (err) return err;
+    payload->start += available;
+    payload->size -= available;
     framecount++;
-    if (transport->trace & PN_TRACE_RAW) {
-      pn_string_set(transport->scratch, "RAW: \"");
-      pn_quote(transport->scratch, transport->output + transport->available, n);
-      pn_string_addf(transport->scratch, "\"");
-      pn_transport_log(transport, pn_string_get(transport->scratch));
-    }
-    transport->available += n;
   } while (payload->size > 0 && framecount < frame_limit);
 
   return framecount;
@@ -1468,18 +1572,17 @@ static void pn_full_settle(pn_delivery_map_t *db, pn_delivery_t *delivery)
 int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
   // XXX: multi transfer
-  uint32_t handle;
-  pn_bytes_t tag;
-  bool id_present;
-  pn_sequence_t id;
-  bool settled;
-  bool more;
-  bool has_type;
-  uint64_t type;
+  pni_transfer_frame_t transfer;
   pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[I?Iz.oo.D?LC]", &handle, &id_present, &id, &tag,
-                         &settled, &more, &has_type, &type, transport->disp_data);
+  int err = pn_data_scan(args, "D.[I?Iz.oo.D?LC]", &transfer.handle, &transfer.id_present,
+                         &transfer.id, &transfer.tag, &transfer.settled, &transfer.more,
+                         &transfer.has_type, &transfer.type, transport->disp_data);
   if (err) return err;
+  return pni_do_transfer(transport, channel, &transfer, payload);
+}
+
+int pni_do_transfer(pn_transport_t *transport, uint16_t channel, const pni_transfer_frame_t *transfer, const pn_bytes_t *payload)
+{
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
     return pn_do_error(transport, "amqp:not-allowed", "no such channel: %u", channel);
@@ -1489,9 +1592,9 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
     return pn_do_error(transport, "amqp:session:window-violation", "incoming session window exceeded");
   }
 
-  pn_link_t *link = pni_handle_state(ssn, handle);
+  pn_link_t *link = pni_handle_state(ssn, transfer->handle);
   if (!link) {
-    return pn_do_error(transport, "amqp:invalid-field", "no such handle: %u", handle);
+    return pn_do_error(transport, "amqp:invalid-field", "no such handle: %u", transfer->handle);
   }
   pn_delivery_t *delivery;
   if (link->unsettled_tail && !link->unsettled_tail->done) {
@@ -1500,20 +1603,22 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
     pn_delivery_map_t *incoming = &ssn->state.incoming;
 
     if (!ssn->state.incoming_init) {
-      incoming->next = id;
+      pni_delivery_map_start(incoming, transfer->id);
       ssn->state.incoming_init = true;
       ssn->incoming_deliveries++;
     }
 
-    delivery = pn_delivery(link, pn_dtag(tag.start, tag.size));
+    delivery = pn_delivery(link, pn_dtag(transfer->tag.start, transfer->tag.size));
+    if (!delivery) return PN_OUT_OF_MEMORY;
     pn_delivery_state_t *state = pni_delivery_map_push(incoming, delivery);
-    if (id_present && id != state->id) {
+    if (!state) return PN_OUT_OF_MEMORY;
+    if (transfer->id_present && (pn_sequence_t) transfer->id != state->id) {
       return pn_do_error(transport, "amqp:session:invalid-field",
                          "sequencing error, expected delivery-id %u, got %u",
-                         state->id, id);
+                         state->id, transfer->id);
     }
-    if (has_type) {
-      delivery->remote.type = type;
+    if (transfer->has_type) {
+      delivery->remote.type = transfer->type;
       pn_data_copy(delivery->remote.data, transport->disp_data);
     }
 
@@ -1522,8 +1627,8 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
     link->queued++;
 
     // XXX: need to fill in remote state: delivery->remote.state = ...;
-    delivery->remote.settled = settled;
-    if (settled) {
+    delivery->remote.settled = transfer->settled;
+    if (transfer->settled) {
       delivery->updated = true;
       pn_work_update(transport->connection, delivery);
     }
@@ -1531,10 +1636,12 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
 
   pn_buffer_append(delivery->bytes, payload->start, payload->size);
   ssn->incoming_bytes += payload->size;
-  delivery->done = !more;
+  ssn->connection->incoming_bytes += payload->size;
+  delivery->done = !transfer->more;
 
   ssn->state.incoming_transfer_count++;
   ssn->state.incoming_window--;
+  ssn->connection->incoming_window--;
 
   // XXX: need better policy for when to refresh window
   if (!ssn->state.incoming_window && (int32_t) link->state.local_handle >= 0) {
@@ -1547,47 +1654,50 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
 
 int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
-  pn_sequence_t onext, inext, delivery_count;
-  uint32_t iwin, owin, link_credit;
-  uint32_t handle;
-  bool inext_init, handle_init, dcount_init, drain;
-  int err = pn_data_scan(args, "D.[?IIII?I?II.o]", &inext_init, &inext, &iwin,
-                         &onext, &owin, &handle_init, &handle, &dcount_init,
-                         &delivery_count, &link_credit, &drain);
+  pni_flow_frame_t flow;
+  int err = pn_data_scan(args, "D.[?IIII?I?II.o]", &flow.next_incoming_id_present,
+                         &flow.next_incoming_id, &flow.incoming_window, &flow.next_outgoing_id,
+                         &flow.outgoing_window, &flow.handle_present, &flow.handle,
+                         &flow.delivery_count_present, &flow.delivery_count,
+                         &flow.link_credit, &flow.drain);
   if (err) return err;
+  return pni_do_flow(transport, channel, &flow);
+}
 
+int pni_do_flow(pn_transport_t *transport, uint16_t channel, const pni_flow_frame_t *flow)
+{
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
     return pn_do_error(transport, "amqp:not-allowed", "no such channel: %u", channel);
   }
 
-  if (inext_init) {
-    ssn->state.remote_incoming_window = inext + iwin - ssn->state.outgoing_transfer_count;
+  if (flow->next_incoming_id_present) {
+    ssn->state.remote_incoming_window = flow->next_incoming_id + flow->incoming_window - ssn->state.outgoing_transfer_count;
   } else {
-    ssn->state.remote_incoming_window = iwin;
+    ssn->state.remote_incoming_window = flow->incoming_window;
   }
 
-  if (handle_init) {
-    pn_link_t *link = pni_handle_state(ssn, handle);
+  if (flow->handle_present) {
+    pn_link_t *link = pni_handle_state(ssn, flow->handle);
     if (!link) {
-      return pn_do_error(transport, "amqp:invalid-field", "no such handle: %u", handle);
+      return pn_do_error(transport, "amqp:invalid-field", "no such handle: %u", flow->handle);
     }
     if (link->endpoint.type == SENDER) {
       pn_sequence_t receiver_count;
-      if (dcount_init) {
-        receiver_count = delivery_count;
+      if (flow->delivery_count_present) {
+        receiver_count = flow->delivery_count;
       } else {
         // our initial delivery count
         receiver_count = 0;
       }
       pn_sequence_t old = link->state.link_credit;
-      link->state.link_credit = receiver_count + link_credit - link->state.delivery_count;
+      link->state.link_credit = receiver_count + flow->link_credit - link->state.delivery_count;
       link->credit += link->state.link_credit - old;
-      link->drain = drain;
+      link->drain = flow->drain;
       pn_delivery_t *delivery = pn_link_current(link);
       if (delivery) pn_work_update(transport->connection, delivery);
     } else {
-      pn_sequence_t delta = delivery_count - link->state.delivery_count;
+      pn_sequence_t delta = flow->delivery_count - link->state.delivery_count;
       if (delta > 0) {
         link->state.delivery_count += delta;
         link->state.link_credit -= delta;
@@ -1621,16 +1731,25 @@ static int pn_scan_error(pn_data_t *data, pn_condition_t *condition, const char
 
 int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
-  bool role;
-  pn_sequence_t first, last;
-  uint64_t type = 0;
-  bool last_init, settled, type_init;
+  pni_disposition_frame_t disposition;
+  disposition.type = 0;
   pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[oI?IoD?LC]", &role, &first, &last_init,
-                         &last, &settled, &type_init, &type,
-                         transport->disp_data);
+  int err = pn_data_scan(args, "D.[oI?IoD?LC]", &disposition.role, &disposition.first,
+                         &disposition.last_present, &disposition.last, &disposition.settled,
+                         &disposition.has_type, &disposition.type, transport->disp_data);
   if (err) return err;
-  if (!last_init) last = first;
+  pn_data_rewind(transport->disp_data);
+  bool remote_data = (pn_data_next(transport->disp_data) &&
+                      pn_data_get_list(transport->disp_data) > 0);
+  return pni_do_disposition(transport, channel, &disposition, remote_data);
+}
+
+int pni_do_disposition(pn_transport_t *transport, uint16_t channel, const pni_disposition_frame_t *disposition, bool remote_data)
+{
+  int err;
+  uint64_t type = disposition->type;
+  pn_sequence_t first = disposition->first;
+  pn_sequence_t last = disposition->last_present ? (pn_sequence_t) disposition->last : first;
 
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
@@ -1638,21 +1757,24 @@ int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t ch
   }
 
   pn_delivery_map_t *deliveries;
-  if (role) {
+  if (disposition->role) {
     deliveries = &ssn->state.outgoing;
   } else {
     deliveries = &ssn->state.incoming;
   }
 
-  pn_data_rewind(transport->disp_data);
-  bool remote_data = (pn_data_next(transport->disp_data) &&
-                      pn_data_get_list(transport->disp_data) > 0);
-
-  for (pn_sequence_t id = first; id <= last; id++) {
-    pn_delivery_t *delivery = pni_delivery_map_get(deliveries, id);
-    pn_disposition_t *remote = &delivery->remote;
+  // Only the part of first..last that is in the map can match, walk it
+  // straight through the ring
+  int64_t size = pni_delivery_map_size(deliveries);
+  int64_t lo = (int32_t) pni_delivery_map_offset(deliveries, first);
+  int64_t hi = (int32_t) pni_delivery_map_offset(deliveries, last);
+  if (lo < 0) lo = 0;
+  if (hi >= size) hi = size - 1;
+  for (int64_t i = lo; i <= hi; i++) {
+    pn_delivery_t *delivery = *pni_delivery_map_slot(deliveries, (uint32_t) i);
     if (delivery) {
-      if (type_init) remote->type = type;
+      pn_disposition_t *remote = &delivery->remote;
+      if (disposition->has_type) remote->type = type;
       if (remote_data) {
         switch (type) {
         case PN_RECEIVED:
@@ -1690,7 +1812,7 @@ int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t ch
           break;
         }
       }
-      remote->settled = settled;
+      remote->settled = disposition->settled;
       delivery->updated = true;
       pn_work_update(transport->connection, delivery);
 
@@ -1804,10 +1926,11 @@ static ssize_t transport_consume(pn_transport_t *transport)
     ssize_t n;
     n = transport->io_layers[0]->
       process_input( transport, 0,
-                     transport->input_buf + consumed,
+                     transport->input_buf + transport->input_start,
                      transport->input_pending );
     if (n > 0) {
       consumed += n;
+      transport->input_start += n;
       transport->input_pending -= n;
     } else if (n == 0) {
       break;
@@ -1816,12 +1939,15 @@ static ssize_t transport_consume(pn_transport_t *transport)
       if (transport->trace & (PN_TRACE_RAW | PN_TRACE_FRM))
         pn_transport_log(transport, "  <- EOS");
       transport->input_pending = 0;  // XXX ???
+      transport->input_start = 0;
       return n;
     }
   }
 
-  if (transport->input_pending && consumed) {
-    memmove( transport->input_buf,  &transport->input_buf[consumed], transport->input_pending );
+  // Unconsumed input stays where it is, pni_input_compact() reclaims the
+  // space in front of it when it is needed.
+  if (!transport->input_pending) {
+    transport->input_start = 0;
   }
 
   return consumed;
@@ -1879,11 +2005,39 @@ static size_t pni_session_outgoing_window(pn_session_t *ssn)
 
 static size_t pni_session_incoming_window(pn_session_t *ssn)
 {
-  uint32_t size = ssn->connection->transport->local_max_frame;
+  pn_connection_t *conn = ssn->connection;
+  uint32_t size = conn->transport->local_max_frame;
   if (!size) {
     return 2147483647; // biggest legal value
-  } else {
-    return (ssn->incoming_capacity - ssn->incoming_bytes)/size;
+  }
+  size_t window = (size_t) ssn->incoming_bytes < ssn->incoming_capacity ?
+    (ssn->incoming_capacity - ssn->incoming_bytes)/size : 0;
+  if (conn->incoming_capacity) {
+    // The frames granted to the other sessions may still arrive, so they
+    // count against the connection's capacity along with what is buffered
+    uint64_t committed = conn->incoming_bytes +
+      (conn->incoming_window - ssn->state.incoming_window) * size;
+    size_t shared = committed < conn->incoming_capacity ?
+      (size_t)((conn->incoming_capacity - committed)/size) : 0;
+    if (shared < window) window = shared;
+  }
+  return window;
+}
+
+static void pni_session_update_incoming_window(pn_session_t *ssn)
+{
+  pn_connection_t *conn = ssn->connection;
+  pn_sequence_t window = pni_session_incoming_window(ssn);
+  // The peer may already have sent the transfers the last window allowed,
+  // so a smaller capacity only takes effect as they drain
+  if (window < ssn->state.incoming_window) {
+    window = ssn->state.incoming_window;
+  }
+  conn->incoming_window -= ssn->state.incoming_window;
+  conn->incoming_window += window;
+  ssn->state.incoming_window = window;
+  if (!window && conn->incoming_capacity) {
+    conn->incoming_blocked = true;
   }
 }
 
@@ -1914,7 +2068,7 @@ static int pni_process_ssn_setup(pn_transport_t *transport, pn_endpoint_t *endpo
         pn_transport_logf(transport, "unable to find an open available channel within limit of %d", transport->channel_max );
         return PN_ERR;
       }
-      state->incoming_window = pni_session_incoming_window(ssn);
+      pni_session_update_incoming_window(ssn);
       state->outgoing_window = pni_session_outgoing_window(ssn);
       pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, "DL[?HIII]", BEGIN,
                     ((int16_t) state->remote_channel >= 0), state->remote_channel,
@@ -2029,10 +2183,31 @@ static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endp
 
 static int pni_post_flow(pn_transport_t *transport, pn_session_t *ssn, pn_link_t *link)
 {
-  ssn->state.incoming_window = pni_session_incoming_window(ssn);
+  pni_session_update_incoming_window(ssn);
   ssn->state.outgoing_window = pni_session_outgoing_window(ssn);
   bool linkq = (bool) link;
-  pn_link_state_t *state = &link->state;
+  pn_link_state_t *state = linkq ? &link->state : NULL;
+  if (!(transport->trace & PN_TRACE_FRM)) {
+    pni_flow_frame_t flow;
+    flow.next_incoming_id_present = (int16_t) ssn->state.remote_channel >= 0;
+    flow.next_incoming_id = ssn->state.incoming_transfer_count;
+    flow.incoming_window = ssn->state.incoming_window;
+    flow.next_outgoing_id = ssn->state.outgoing_transfer_count;
+    flow.outgoing_window = ssn->state.outgoing_window;
+    flow.handle_present = linkq;
+    flow.handle = linkq ? state->local_handle : 0;
+    flow.delivery_count_present = linkq;
+    flow.delivery_count = linkq ? state->delivery_count : 0;
+    flow.link_credit = linkq ? state->link_credit : 0;
+    flow.drain = linkq ? link->drain : false;
+    pn_rwbytes_t buf = pni_frame_space(transport, 0);
+    ssize_t wr = pni_encode_flow(transport->encoder, buf.start, buf.size, &flow);
+    if (wr == PN_OVERFLOW) {
+      buf = pni_frame_space(transport, pn_encoder_needed(transport->encoder));
+      wr = pni_encode_flow(transport->encoder, buf.start, buf.size, &flow);
+    }
+    return pni_post_encoded(transport, ssn->state.local_channel, buf, wr);
+  }
   return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[?IIII?I?I?In?o]", FLOW,
                        (int16_t) ssn->state.remote_channel >= 0, ssn->state.incoming_transfer_count,
                        ssn->state.incoming_window,
@@ -2062,21 +2237,63 @@ static int pni_process_flow_receiver(pn_transport_t *transport, pn_endpoint_t *e
   return 0;
 }
 
+static int pni_disp_compare(const void *a, const void *b)
+{
+  const pni_disp_t *x = (const pni_disp_t *) a;
+  const pni_disp_t *y = (const pni_disp_t *) b;
+  if (x->role != y->role) return x->role < y->role ? -1 : 1;
+  if (x->settled != y->settled) return x->settled < y->settled ? -1 : 1;
+  if (x->code != y->code) return x->code < y->code ? -1 : 1;
+  // ids wrap, so compare their serial distance; a batch spans far fewer
+  // than 2^31 of them
+  int32_t distance = (int32_t) ((uint32_t) x->id - (uint32_t) y->id);
+  return distance < 0 ? -1 : distance > 0;
+}
+
+// Send the pending dispositions as the fewest ranges: sorted by outcome
+// then id, so they need not have been settled in order. Each delivery has
+// at most one, its latest, so sorting can't reorder its changes.
 static int pni_flush_disp(pn_transport_t *transport, pn_session_t *ssn)
 {
-  uint64_t code = ssn->state.disp_code;
-  bool settled = ssn->state.disp_settled;
-  if (ssn->state.disp) {
-    int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[oIIo?DL[]]", DISPOSITION,
-                            ssn->state.disp_type, ssn->state.disp_first, ssn->state.disp_last,
-                            settled, (bool)code, code);
+  pn_session_state_t *state = &ssn->state;
+  size_t count = state->disp_count;
+  pni_disp_t *disps = state->disps;
+  if (!count) return 0;
+  if (state->disp_unsorted) {
+    qsort(disps, count, sizeof(pni_disp_t), pni_disp_compare);
+  }
+  state->disp_count = 0;
+  state->disp_unsorted = false;
+
+  for (size_t i = 0; i < count;) {
+    pni_disp_t *d = &disps[i];
+    uint32_t last = d->id;
+    for (++i; i < count && (uint32_t) disps[i].id == last + 1 && disps[i].code == d->code &&
+           disps[i].settled == d->settled && disps[i].role == d->role; ++i) {
+      last = disps[i].id;
+    }
+    int err;
+    if (!(transport->trace & PN_TRACE_FRM)) {
+      pni_disposition_frame_t disposition;
+      disposition.role = d->role;
+      disposition.first = d->id;
+      disposition.last = last;
+      disposition.last_present = true;
+      disposition.settled = d->settled;
+      disposition.has_type = d->code;
+      disposition.type = d->code;
+      pn_rwbytes_t buf = pni_frame_space(transport, 0);
+      ssize_t wr = pni_encode_disposition(transport->encoder, buf.start, buf.size, &disposition);
+      if (wr == PN_OVERFLOW) {
+        buf = pni_frame_space(transport, pn_encoder_needed(transport->encoder));
+        wr = pni_encode_disposition(transport->encoder, buf.start, buf.size, &disposition);
+      }
+      err = pni_post_encoded(transport, state->local_channel, buf, wr);
+    } else {
+      err = pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, "DL[oIIo?DL[]]", DISPOSITION,
+                          d->role, d->id, last, d->settled, (bool)d->code, d->code);
+    }
     if (err) return err;
-    ssn->state.disp_type = 0;
-    ssn->state.disp_code = 0;
-    ssn->state.disp_settled = 0;
-    ssn->state.disp_first = 0;
-    ssn->state.disp_last = 0;
-    ssn->state.disp = false;
   }
   return 0;
 }
@@ -2097,6 +2314,8 @@ static int pni_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
   }
 
   if (!pni_disposition_batchable(&delivery->local)) {
+    // after any batched change to the same delivery
+    PN_RETURN_IF_ERROR(pni_flush_disp(transport, ssn));
     pn_data_clear(transport->disp_data);
     PN_RETURN_IF_ERROR(pni_disposition_encode(&delivery->local, transport->disp_data));
     return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel,
@@ -2105,29 +2324,35 @@ static int pni_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
       (bool)code, code, transport->disp_data);
   }
 
-  if (ssn_state->disp && code == ssn_state->disp_code &&
-      delivery->local.settled == ssn_state->disp_settled &&
-      ssn_state->disp_type == role) {
-    if (state->id == ssn_state->disp_first - 1) {
-      ssn_state->disp_first = state->id;
-      return 0;
-    } else if (state->id == ssn_state->disp_last + 1) {
-      ssn_state->disp_last = state->id;
-      return 0;
+  // A later change to a delivery already in the batch replaces it
+  pni_disp_t *disp = state->disp < ssn_state->disp_count ? &ssn_state->disps[state->disp] : NULL;
+  if (disp && disp->id == state->id && disp->role == role) {
+    disp->code = code;
+    disp->settled = delivery->local.settled;
+    if ((disp > ssn_state->disps && pni_disp_compare(disp - 1, disp) > 0) ||
+        (disp + 1 < ssn_state->disps + ssn_state->disp_count && pni_disp_compare(disp, disp + 1) > 0)) {
+      ssn_state->disp_unsorted = true;
     }
+    return 0;
   }
 
-  if (ssn_state->disp) {
-    int err = pni_flush_disp(transport, ssn);
-    if (err) return err;
+  if (ssn_state->disp_count == ssn_state->disp_capacity) {
+    size_t capacity = ssn_state->disp_capacity ? 2*ssn_state->disp_capacity : 16;
+    pni_disp_t *disps = (pni_disp_t *) realloc(ssn_state->disps, capacity * sizeof(pni_disp_t));
+    if (!disps) return PN_OUT_OF_MEMORY;
+    ssn_state->disps = disps;
+    ssn_state->disp_capacity = capacity;
   }
-
-  ssn_state->disp_type = role;
-  ssn_state->disp_code = code;
-  ssn_state->disp_settled = delivery->local.settled;
-  ssn_state->disp_first = state->id;
-  ssn_state->disp_last = state->id;
-  ssn_state->disp = true;
+  state->disp = ssn_state->disp_count;
+  disp = &ssn_state->disps[state->disp];
+  disp->code = code;
+  disp->id = state->id;
+  disp->settled = delivery->local.settled;
+  disp->role = role;
+  if (ssn_state->disp_count && pni_disp_compare(disp - 1, disp) > 0) {
+    ssn_state->disp_unsorted = true;
+  }
+  ssn_state->disp_count++;
 
   return 0;
 }
@@ -2145,11 +2370,12 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
         ssn_state->remote_incoming_window > 0 && link_state->link_credit > 0) {
       if (!state->init) {
         state = pni_delivery_map_push(&ssn_state->outgoing, delivery);
+        if (!state) return PN_OUT_OF_MEMORY;
       }
 
       pn_bytes_t bytes = pn_buffer_bytes(delivery->bytes);
       size_t full_size = bytes.size;
-      pn_bytes_t tag = pn_buffer_bytes(delivery->tag);
+      pn_bytes_t tag = pni_delivery_tag(delivery);
       pn_data_clear(transport->disp_data);
       PN_RETURN_IF_ERROR(pni_disposition_encode(&delivery->local, transport->disp_data));
       int count = pni_post_amqp_transfer_frame(transport,
@@ -2169,6 +2395,7 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
       int sent = full_size - bytes.size;
       pn_buffer_trim(delivery->bytes, sent, 0);
       link->session->outgoing_bytes -= sent;
+      link->session->connection->outgoing_bytes -= sent;
       if (!pn_buffer_size(delivery->bytes) && delivery->done) {
         state->sent = true;
         link_state->delivery_count++;
@@ -2249,6 +2476,28 @@ static int pni_process_tpwork(pn_transport_t *transport, pn_endpoint_t *endpoint
   return 0;
 }
 
+// Give a window back to the sessions left without one for lack of room in
+// the connection's incoming capacity, now that some of it has been read
+static int pni_process_incoming_blocked(pn_transport_t *transport, pn_endpoint_t *endpoint)
+{
+  pn_connection_t *conn = (pn_connection_t *) endpoint;
+  if (!conn->incoming_blocked || transport->close_sent) return 0;
+
+  conn->incoming_blocked = false;
+  size_t nsessions = pn_list_size(conn->sessions);
+  for (size_t i = 0; i < nsessions; i++) {
+    pn_session_t *ssn = (pn_session_t *) pn_list_get(conn->sessions, i);
+    if ((int16_t) ssn->state.local_channel < 0 || ssn->state.incoming_window) continue;
+    if (pni_session_incoming_window(ssn)) {
+      int err = pni_post_flow(transport, ssn, NULL);
+      if (err) return err;
+    } else {
+      conn->incoming_blocked = true;
+    }
+  }
+  return 0;
+}
+
 static int pni_process_flush_disp(pn_transport_t *transport, pn_endpoint_t *endpoint)
 {
   if (endpoint->type == SESSION) {
@@ -2439,10 +2688,21 @@ static int pni_phase(pn_transport_t *transport, int (*phase)(pn_transport_t *, p
   return 0;
 }
 
+// Run a phase that only acts on the connection itself, if it is modified,
+// rather than walking every modified endpoint
+static int pni_phase_conn(pn_transport_t *transport, int (*phase)(pn_transport_t *, pn_endpoint_t *))
+{
+  pn_endpoint_t *endpoint = &transport->connection->endpoint;
+  return endpoint->modified ? phase(transport, endpoint) : 0;
+}
+
+// Only modified endpoints are on the connection's transport list, so the
+// cost of each phase depends on what changed, not on how many sessions and
+// links there are.
 static int pni_process(pn_transport_t *transport)
 {
   int err;
-  if ((err = pni_phase(transport, pni_process_conn_setup))) return err;
+  if ((err = pni_phase_conn(transport, pni_process_conn_setup))) return err;
   if ((err = pni_phase(transport, pni_process_ssn_setup))) return err;
   if ((err = pni_phase(transport, pni_process_link_setup))) return err;
   if ((err = pni_phase(transport, pni_process_flow_receiver))) return err;
@@ -2450,15 +2710,16 @@ static int pni_process(pn_transport_t *transport)
   // XXX: this has to happen two times because we might settle stuff
   // on the first pass and create space for more work to be done on the
   // second pass
-  if ((err = pni_phase(transport, pni_process_tpwork))) return err;
-  if ((err = pni_phase(transport, pni_process_tpwork))) return err;
+  if ((err = pni_phase_conn(transport, pni_process_tpwork))) return err;
+  if ((err = pni_phase_conn(transport, pni_process_tpwork))) return err;
+  if ((err = pni_phase_conn(transport, pni_process_incoming_blocked))) return err;
 
   if ((err = pni_phase(transport, pni_process_flush_disp))) return err;
 
   if ((err = pni_phase(transport, pni_process_flow_sender))) return err;
   if ((err = pni_phase(transport, pni_process_link_teardown))) return err;
   if ((err = pni_phase(transport, pni_process_ssn_teardown))) return err;
-  if ((err = pni_phase(transport, pni_process_conn_teardown))) return err;
+  if ((err = pni_phase_conn(transport, pni_process_conn_teardown))) return err;
 
   if (transport->connection->tpwork_head) {
     pn_modified(transport->connection, &transport->connection->endpoint, false);
@@ -2566,10 +2827,10 @@ static pn_timestamp_t pn_tick_amqp(pn_transport_t* transport, unsigned int layer
       transport->last_bytes_output = transport->bytes_output;
     } else if (transport->keepalive_deadline <= now) {
       transport->keepalive_deadline = now + (pn_timestamp_t)(transport->remote_idle_timeout/2.0);
-      if (transport->available == 0) {    // no outbound data pending
+      if (pn_buffer_size(transport->output) == 0) {    // no outbound data pending
         // so send empty frame (and account for it!)
         pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "");
-        transport->last_bytes_output += transport->available;
+        transport->last_bytes_output += pn_buffer_size(transport->output);
       }
     }
     timeout = pn_timestamp_min( timeout, transport->keepalive_deadline );
@@ -2611,7 +2872,7 @@ static ssize_t pn_output_write_amqp(pn_transport_t* transport, unsigned int laye
   // write out any buffered data _before_ returning PN_EOS, else we
   // could truncate an outgoing Close frame containing a useful error
   // status
-  if (!transport->available && transport->close_sent) {
+  if (!pn_buffer_size(transport->output) && transport->close_sent) {
     return PN_EOS;
   }
 
@@ -2629,12 +2890,26 @@ static void pni_close_head(pn_transport_t *transport)
   }
 }
 
+// Move staged output that has not yet been popped to the front of
+// output_buf. Only done once at least as much has been popped as is left
+// (or there is no space left) so each byte is moved at most once on average.
+static void pni_output_compact(pn_transport_t *transport)
+{
+  size_t start = transport->output_start;
+  size_t pending = transport->output_pending;
+  if (start && (start >= pending || start + pending >= transport->output_size)) {
+    memmove(transport->output_buf, &transport->output_buf[start], pending);
+    transport->output_start = 0;
+  }
+}
+
 // generate outbound data, return amount of pending output else error
 static ssize_t transport_produce(pn_transport_t *transport)
 {
   if (transport->head_closed) return PN_EOS;
 
-  ssize_t space = transport->output_size - transport->output_pending;
+  pni_output_compact(transport);
+  ssize_t space = transport->output_size - transport->output_start - transport->output_pending;
 
   if (space <= 0) {     // can we expand the buffer?
     int more = 0;
@@ -2656,7 +2931,7 @@ static ssize_t transport_produce(pn_transport_t *transport)
     ssize_t n;
     n = transport->io_layers[0]->
       process_output( transport, 0,
-                      &transport->output_buf[transport->output_pending],
+                      &transport->output_buf[transport->output_start + transport->output_pending],
                       space );
     if (n > 0) {
       space -= n;
@@ -2845,13 +3120,26 @@ uint64_t pn_transport_get_frames_input(const pn_transport_t *transport)
   return 0;
 }
 
+// Move partially consumed input to the front of input_buf, with the same
+// amortized policy as pni_output_compact()
+static void pni_input_compact(pn_transport_t *transport)
+{
+  size_t start = transport->input_start;
+  size_t pending = transport->input_pending;
+  if (start && (start >= pending || start + pending >= transport->input_size)) {
+    memmove(transport->input_buf, &transport->input_buf[start], pending);
+    transport->input_start = 0;
+  }
+}
+
 // input
 ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 {
   if (transport->tail_closed) return PN_EOS;
   //if (pn_error_code(transport->error)) return pn_error_code(transport->error);
 
-  ssize_t capacity = transport->input_size - transport->input_pending;
+  pni_input_compact(transport);
+  ssize_t capacity = transport->input_size - transport->input_start - transport->input_pending;
   if ( capacity<=0 ) {
     // can we expand the size of the input buffer?
     int more = 0;
@@ -2875,8 +3163,8 @@ ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 
 char *pn_transport_tail(pn_transport_t *transport)
 {
-  if (transport && transport->input_pending < transport->input_size) {
-    return &transport->input_buf[transport->input_pending];
+  if (transport && transport->input_start + transport->input_pending < transport->input_size) {
+    return &transport->input_buf[transport->input_start + transport->input_pending];
   }
   return NULL;
 }
@@ -2907,7 +3195,7 @@ ssize_t pn_transport_push(pn_transport_t *transport, const char *src, size_t siz
 int pn_transport_process(pn_transport_t *transport, size_t size)
 {
   assert(transport);
-  size = pn_min( size, (transport->input_size - transport->input_pending) );
+  size = pn_min( size, (transport->input_size - transport->input_start - transport->input_pending) );
   transport->input_pending += size;
   transport->bytes_input += size;
 
@@ -2939,7 +3227,7 @@ ssize_t pn_transport_pending(pn_transport_t *transport)      /* <0 == done */
 const char *pn_transport_head(pn_transport_t *transport)
 {
   if (transport && transport->output_pending) {
-    return transport->output_buf;
+    return &transport->output_buf[transport->output_start];
   }
   return NULL;
 }
@@ -2964,20 +3252,97 @@ ssize_t pn_transport_peek(pn_transport_t *transport, char *dst, size_t size)
   return size;
 }
 
+// True if frames queued by the AMQP layer can be written out as they
+// are, i.e. no SSL or SASL security layer from 'first' up needs to
+// transform them.
+static bool pni_output_direct(pn_transport_t *transport, unsigned int first, unsigned int *amqp_index)
+{
+  for (unsigned int layer = first; layer < PN_IO_LAYER_CT; ++layer) {
+    const pn_io_layer_t *io_layer = transport->io_layers[layer];
+    if (io_layer == &amqp_layer || io_layer == &amqp_read_header_layer) {
+      *amqp_index = layer;
+      return true;
+    }
+    if (io_layer != &pni_passthru_layer) return false;
+  }
+  return false;
+}
+
+bool pni_transport_amqp_output(pn_transport_t *transport, unsigned int layer, ssize_t *result, pn_bytes_t *frames)
+{
+  unsigned int amqp;
+  if (!pni_output_direct(transport, layer, &amqp)) return false;
+  char none;
+  *result = transport->io_layers[amqp]->process_output(transport, amqp, &none, 0);
+  if (*result < 0 || !pn_buffer_segments(transport->output, frames, 1)) {
+    *frames = pn_bytes(0, NULL);
+  }
+  return true;
+}
+
+void pni_transport_amqp_output_done(pn_transport_t *transport, size_t size)
+{
+  pn_buffer_trim(transport->output, size, 0);
+}
+
+size_t pni_transport_head_iov(pn_transport_t *transport, pn_bytes_t *iov, size_t iovcnt)
+{
+  size_t n = 0;
+  unsigned int layer;
+  if (!iovcnt) return 0;
+  if (!transport->head_closed && pni_output_direct(transport, 0, &layer)) {
+    // Run the AMQP layer without asking for any bytes, so that new frames
+    // are generated but left in place rather than copied into output_buf.
+    char none;
+    ssize_t r = transport->io_layers[layer]->process_output(transport, layer, &none, 0);
+    if (r == 0 && (transport->output_pending || pn_buffer_size(transport->output))) {
+      if (transport->output_pending) {
+        iov[n++] = pn_bytes(transport->output_pending, pn_transport_head(transport));
+      }
+      n += pn_buffer_segments(transport->output, iov + n, iovcnt - n);
+      return n;
+    }
+  }
+
+  ssize_t pending = pn_transport_pending(transport);
+  if (pending > 0) {
+    iov[n++] = pn_bytes(pending, pn_transport_head(transport));
+  }
+  return n;
+}
+
 void pn_transport_pop(pn_transport_t *transport, size_t size)
 {
   if (transport) {
+    size_t direct = 0;
+    if (size > transport->output_pending) {
+      // Written straight from the frame queue by pni_transport_head_iov()
+      direct = size - transport->output_pending;
+      assert( pn_buffer_size(transport->output) >= direct );
+      pn_buffer_trim(transport->output, direct, 0);
+      transport->bytes_output += direct;
+      size = transport->output_pending;
+    }
     assert( transport->output_pending >= size );
     transport->output_pending -= size;
     transport->bytes_output += size;
     if (transport->output_pending) {
-      memmove( transport->output_buf,  &transport->output_buf[size],
-               transport->output_pending );
+      transport->output_start += size;
+    } else {
+      transport->output_start = 0;
     }
 
-    if (transport->output_pending==0 && pn_transport_pending(transport) < 0) {
-      // TODO: It looks to me that this is a NOP as iff we ever get here
-      // TODO: pni_close_head() will always have been already called before leaving pn_transport_pending()
+    if (direct) {
+      // Leave the rest of the frame queue for pni_transport_head_iov(), only
+      // closing the head once it is drained and no more output will come
+      unsigned int layer;
+      char none;
+      if (!transport->head_closed && !pn_buffer_size(transport->output) &&
+          pni_output_direct(transport, 0, &layer) &&
+          transport->io_layers[layer]->process_output(transport, layer, &none, 0) < 0) {
+        pni_close_head(transport);
+      }
+    } else if (transport->output_pending==0 && pn_transport_pending(transport) < 0) {
       pni_close_head(transport);
     }
   }
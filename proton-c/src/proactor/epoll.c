@@ -0,0 +1,1103 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/* accept4(), GNU strerror_r() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <proton/condition.h>
+#include <proton/connection_driver.h>
+#include <proton/engine.h>
+#include <proton/listener.h>
+#include <proton/object.h>
+#include <proton/proactor.h>
+#include <proton/transport.h>
+
+#include "ssl/ssl-internal.h"
+
+/* All asserts are cheap and should remain in a release build for debugability */
+#undef NDEBUG
+#include <assert.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+  Linux epoll proactor.
+
+  There is no leader thread: every thread in pn_proactor_wait() calls epoll_wait() on a
+  shared epoll set and handles whatever it gets back. Sockets are registered with
+  EPOLLONESHOT so an IO event is delivered to exactly one thread, which then owns the
+  connection or listener until it is re-armed.
+
+  A psocket (connection or listener) is in one of three states, protected by its own lock:
+
+  - IDLE: waiting for IO, a tick timer or a wakeup. The first thread to get an event for
+  it becomes the owner and does the IO directly.
+
+  - QUEUED: on the proactor ready_q, waiting for a thread to pick it up. Used for wakeups,
+  new connections and listeners, and batches that are returned to pn_proactor_done() with
+  events still pending.
+
+  - WORKING: owned by a single thread, doing IO or in user code handling a batch.
+  Events that arrive while WORKING or QUEUED are recorded and picked up by the owner
+  before the psocket goes back to IDLE.
+
+  Interrupts and cross-thread wakeups use an eventfd, the proactor timeout and per
+  connection ticks use timerfds, all in the same epoll set.
+
+  An event may be returned by epoll_wait() for a psocket that another thread is about to
+  free, so epoll events carry a slot index and generation rather than a pointer. Slots are
+  looked up under proactor.lock and the psocket lock is taken before proactor.lock is
+  released, so a psocket is never freed while another thread is looking at it.
+
+  Function naming:
+  - *_lh - called with the relevant lock held
+*/
+
+static const char *AMQP_PORT = "5672";
+static const char *AMQP_PORT_NAME = "amqp";
+static const char *AMQPS_PORT = "5671";
+static const char *AMQPS_PORT_NAME = "amqps";
+
+/* Condition name for IO errors */
+static const char *COND_NAME = "proton:io";
+
+PN_HANDLE(PN_PROACTOR)
+
+/* pn_proactor_t and pn_listener_t are plain C structs with normal memory management.
+   CLASSDEF is for identification when used as a pn_event_t context.
+*/
+PN_STRUCT_CLASSDEF(pn_proactor, CID_pn_proactor)
+PN_STRUCT_CLASSDEF(pn_listener, CID_pn_listener)
+
+typedef enum {
+  IDLE,                         /* Waiting for epoll, a tick or a wakeup */
+  QUEUED,                       /* On the proactor ready_q */
+  WORKING                       /* Owned by a thread doing IO or handling a batch */
+} psocket_state_t;
+
+/* epoll_data.u64 for the proactor's own file descriptors, slot 0 is never used */
+#define KEY_EVENTFD 0
+#define KEY_TIMER 1
+
+/* common to connection and listener */
+typedef struct psocket_t {
+  /* Immutable */
+  pn_proactor_t *proactor;
+  uint64_t key;                 /* epoll key: generation << 32 | slot << 1 */
+  bool is_conn;
+
+  /* Protected by proactor.lock */
+  struct psocket_t *next;       /* Next on the ready_q */
+
+  /* Protected by lock */
+  pthread_mutex_t lock;
+  psocket_state_t state;
+  uint32_t events;              /* epoll events not yet handled by the owner */
+  bool tick;                    /* tick timer expired */
+  bool wake;                    /* wakeup or close requested */
+
+  /* Only used by the owner thread */
+  int fd;
+  bool registered;              /* fd has been added to the epoll set */
+  char host[NI_MAXHOST];
+  char port[NI_MAXSERV];
+} psocket_t;
+
+/* Holds a psocket and a pn_connection_driver  */
+typedef struct pconnection_t {
+  psocket_t psocket;
+
+  /* Only used by owner thread */
+  pn_connection_driver_t driver;
+  int timer_fd;
+  bool timer_registered;        /* timer_fd has been added to the epoll set */
+  bool timer_armed;             /* timer_fd is armed in the epoll set */
+  pn_timestamp_t deadline;      /* next tick, 0 if none */
+  struct addrinfo *addrinfo;    /* addresses to connect to */
+  struct addrinfo *ai;          /* address being connected */
+  bool connecting;
+  bool write_shutdown;
+} pconnection_t;
+
+/* pn_listener_t with a psocket_t  */
+struct pn_listener_t {
+  psocket_t psocket;
+
+  /* Only used by owner thread */
+  pn_condition_t *condition;
+  pn_collector_t *collector;
+  pn_event_batch_t batch;
+  pn_record_t *attachments;
+  void *context;
+  size_t backlog;
+};
+
+typedef struct queue { psocket_t *front, *back; } queue;
+
+/* Slot in the proactor socket table */
+typedef struct slot_t {
+  psocket_t *psocket;           /* NULL if free */
+  uint32_t generation;          /* incremented each time the slot is freed */
+  uint32_t next_free;
+} slot_t;
+
+struct pn_proactor_t {
+  /* Immutable */
+  int epollfd;
+  int eventfd;
+  int timer_fd;
+
+  /* Owner thread: proactor collector and batch can belong to any thread */
+  pn_collector_t *collector;
+  pn_event_batch_t batch;
+
+  /* Protected by lock */
+  pthread_mutex_t lock;
+  queue ready_q;                /* psockets waiting for a thread */
+  queue free_q;                 /* finished psockets waiting to be freed */
+  slot_t *slots;
+  uint32_t slots_size;
+  uint32_t free_slot;           /* head of the free slot list, 0 if none */
+  size_t count;                 /* psocket count */
+  size_t interrupt;             /* pending interrupts */
+  bool inactive;
+  bool timeout_elapsed;
+  bool batch_working;           /* batch is being processed in a worker thread */
+};
+
+/* Push ps to back of q */
+static void push_lh(queue *q, psocket_t *ps) {
+  ps->next = NULL;
+  if (!q->front) {
+    q->front = q->back = ps;
+  } else {
+    q->back->next = ps;
+    q->back =  ps;
+  }
+}
+
+/* Pop returns front of q or NULL if empty */
+static psocket_t* pop_lh(queue *q) {
+  psocket_t *ps = q->front;
+  if (ps) {
+    q->front = ps->next;
+    ps->next = NULL;
+  }
+  return ps;
+}
+
+static void psocket_init(psocket_t* ps, pn_proactor_t* p, bool is_conn, const char *host, const char *port) {
+  ps->proactor = p;
+  ps->is_conn = is_conn;
+  ps->fd = -1;
+  ps->state = QUEUED;           /* New psockets go straight to the ready_q */
+  pthread_mutex_init(&ps->lock, NULL);
+
+  /* For platforms that don't know about "amqp" and "amqps" service names. */
+  if (port && strcmp(port, AMQP_PORT_NAME) == 0)
+    port = AMQP_PORT;
+  else if (port && strcmp(port, AMQPS_PORT_NAME) == 0)
+    port = AMQPS_PORT;
+  /* Set to "\001" to indicate a NULL as opposed to an empty string "" */
+  strncpy(ps->host, host ? host : "\001", sizeof(ps->host));
+  ps->host[sizeof(ps->host)-1] = '\0';
+  strncpy(ps->port, port ? port : "\001", sizeof(ps->port));
+  ps->port[sizeof(ps->port)-1] = '\0';
+}
+
+/* Turn "\001" back to NULL */
+static inline const char* fixstr(const char* str) {
+  return str[0] == '\001' ? NULL : str;
+}
+
+static inline pconnection_t *as_pconnection(psocket_t* ps) {
+  return ps->is_conn ? (pconnection_t*)ps : NULL;
+}
+
+static inline pn_listener_t *as_listener(psocket_t* ps) {
+  return ps->is_conn ? NULL: (pn_listener_t*)ps;
+}
+
+/* Wake a thread in epoll_wait() */
+static void notify(pn_proactor_t *p) {
+  uint64_t one = 1;
+  ssize_t n = write(p->eventfd, &one, sizeof(one));
+  (void)n;                      /* Only fails if the counter is saturated, still readable */
+}
+
+/* (Re-)arm fd in the epoll set for a single event */
+static int epoll_arm(pn_proactor_t *p, int fd, bool *registered, uint64_t key, uint32_t events) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events | EPOLLONESHOT;
+  ev.data.u64 = key;
+  int op = *registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  *registered = true;
+  return epoll_ctl(p->epollfd, op, fd, &ev);
+}
+
+static pn_timestamp_t now_millis(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((pn_timestamp_t)t.tv_sec) * 1000 + t.tv_nsec / 1000000;
+}
+
+/* Set a timerfd to expire after millis, or at millis if absolute. 0 disarms it */
+static void timer_set(int fd, pn_timestamp_t millis, bool absolute) {
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = millis / 1000;
+  its.it_value.tv_nsec = (millis % 1000) * 1000000;
+  timerfd_settime(fd, absolute ? TFD_TIMER_ABSTIME : 0, &its, NULL);
+}
+
+/* Read a timerfd or eventfd, return the count or 0 if it was not readable */
+static uint64_t read_count(int fd) {
+  uint64_t n = 0;
+  return (read(fd, &n, sizeof(n)) == sizeof(n)) ? n : 0;
+}
+
+/* Add ps to the socket table, assigning its epoll key */
+static bool sockets_add(pn_proactor_t *p, psocket_t *ps) {
+  pthread_mutex_lock(&p->lock);
+  if (!p->free_slot) {
+    uint32_t old_size = p->slots_size;
+    uint32_t size = old_size ? old_size * 2 : 16;
+    slot_t *slots = (slot_t*)realloc(p->slots, size * sizeof(slot_t));
+    if (!slots) {
+      pthread_mutex_unlock(&p->lock);
+      return false;
+    }
+    memset(slots + old_size, 0, (size - old_size) * sizeof(slot_t));
+    for (uint32_t i = size - 1; i > 0 && i >= old_size; --i) { /* Slot 0 is never used */
+      slots[i].next_free = p->free_slot;
+      p->free_slot = i;
+    }
+    p->slots = slots;
+    p->slots_size = size;
+  }
+  uint32_t i = p->free_slot;
+  slot_t *s = &p->slots[i];
+  p->free_slot = s->next_free;
+  s->psocket = ps;
+  ps->key = ((uint64_t)s->generation << 32) | ((uint64_t)i << 1);
+  ++p->count;
+  pthread_mutex_unlock(&p->lock);
+  return true;
+}
+
+/* Remove a finished ps from the socket table. It is freed by the next thread to look
+   for work, not immediately: like the libuv proactor, the connection and listener
+   remain valid for a while after their final event has been handled.
+*/
+static void sockets_remove(psocket_t *ps) {
+  pn_proactor_t *p = ps->proactor;
+  pthread_mutex_lock(&p->lock);
+  /* Wait out any thread that found ps in the table before we took proactor.lock */
+  pthread_mutex_lock(&ps->lock);
+  pthread_mutex_unlock(&ps->lock);
+  uint32_t i = (uint32_t)ps->key >> 1;
+  slot_t *s = &p->slots[i];
+  s->psocket = NULL;
+  ++s->generation;
+  s->next_free = p->free_slot;
+  p->free_slot = i;
+  push_lh(&p->free_q, ps);
+  bool inactive = (--p->count == 0);
+  if (inactive) p->inactive = true;
+  pthread_mutex_unlock(&p->lock);
+  if (inactive) notify(p);
+}
+
+/* Find the psocket for an epoll key and lock it, NULL if it has been freed */
+static psocket_t *sockets_lock(pn_proactor_t *p, uint64_t key) {
+  uint32_t i = (uint32_t)key >> 1;
+  pthread_mutex_lock(&p->lock);
+  psocket_t *ps = NULL;
+  if (i < p->slots_size && p->slots[i].psocket &&
+      p->slots[i].generation == (uint32_t)(key >> 32)) {
+    ps = p->slots[i].psocket;
+    pthread_mutex_lock(&ps->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return ps;
+}
+
+/* Put a QUEUED psocket on the ready_q */
+static void ready_push(psocket_t *ps) {
+  pn_proactor_t *p = ps->proactor;
+  pthread_mutex_lock(&p->lock);
+  push_lh(&p->ready_q, ps);
+  pthread_mutex_unlock(&p->lock);
+  notify(p);
+}
+
+/* Check the caller owns ps. No lock: other threads leave a WORKING state alone */
+static void psocket_assert_working(psocket_t *ps) {
+  assert(ps->state == WORKING);
+}
+
+/* Called in any thread to set a wakeup, queue ps if nobody owns it */
+static void psocket_wake(psocket_t *ps) {
+  pthread_mutex_lock(&ps->lock);
+  ps->wake = true;
+  bool queue = (ps->state == IDLE);
+  if (queue) ps->state = QUEUED;
+  pthread_mutex_unlock(&ps->lock);
+  if (queue) ready_push(ps);
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch);
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch);
+
+static inline pn_proactor_t *batch_proactor(pn_event_batch_t *batch) {
+  return (batch->next_event == proactor_batch_next) ?
+    (pn_proactor_t*)((char*)batch - offsetof(pn_proactor_t, batch)) : NULL;
+}
+
+static inline pn_listener_t *batch_listener(pn_event_batch_t *batch) {
+  return (batch->next_event == listener_batch_next) ?
+    (pn_listener_t*)((char*)batch - offsetof(pn_listener_t, batch)) : NULL;
+}
+
+static inline pconnection_t *batch_pconnection(pn_event_batch_t *batch) {
+  pn_connection_driver_t *d = pn_event_batch_connection_driver(batch);
+  return d ? (pconnection_t*)((char*)d - offsetof(pconnection_t, driver)) : NULL;
+}
+
+static void pconnection_free(pconnection_t *pc) {
+  pn_connection_driver_destroy(&pc->driver);
+  if (pc->psocket.fd >= 0) close(pc->psocket.fd);
+  if (pc->timer_fd >= 0) close(pc->timer_fd);
+  if (pc->addrinfo) freeaddrinfo(pc->addrinfo);
+  pthread_mutex_destroy(&pc->psocket.lock);
+  free(pc);
+}
+
+static pconnection_t *pconnection(pn_proactor_t *p, pn_connection_t *c, bool server, const char *host, const char *port) {
+  pconnection_t *pc = (pconnection_t*)calloc(1, sizeof(*pc));
+  if (!pc) return NULL;
+  if (pn_connection_driver_init(&pc->driver, c, NULL) != 0) {
+    free(pc);
+    return NULL;
+  }
+  psocket_init(&pc->psocket, p, true, host, port);
+  pc->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (pc->timer_fd < 0 || !sockets_add(p, &pc->psocket)) {
+    pconnection_free(pc);
+    return NULL;
+  }
+  if (server) {
+    pn_transport_set_server(pc->driver.transport);
+  }
+  pn_record_t *r = pn_connection_attachments(pc->driver.connection);
+  pn_record_def(r, PN_PROACTOR, PN_VOID);
+  pn_record_set(r, PN_PROACTOR, pc);
+  return pc;
+}
+
+static pconnection_t *get_pconnection(pn_connection_t* c) {
+  if (!c) {
+    return NULL;
+  }
+  pn_record_t *r = pn_connection_attachments(c);
+  return (pconnection_t*) pn_record_get(r, PN_PROACTOR);
+}
+
+static void pconnection_error(pconnection_t *pc, int err, const char* what) {
+  char msg[256];
+  const char *str = strerror_r(err, msg, sizeof(msg));
+  pn_connection_driver_t *driver = &pc->driver;
+  pn_connection_driver_bind(driver); /* Bind so errors will be reported */
+  pn_connection_driver_errorf(driver, COND_NAME, "%s %s:%s: %s",
+                              what, fixstr(pc->psocket.host), fixstr(pc->psocket.port), str);
+  pn_connection_driver_close(driver);
+}
+
+/* Start a non-blocking connect to the next address that will take one */
+static void pconnection_start_connect(pconnection_t *pc, struct addrinfo *ai) {
+  int err = 0;
+  for (; ai; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      err = errno;
+      continue;
+    }
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS) {
+      pc->psocket.fd = fd;
+      pn_ssl_set_socket(pc->driver.transport, fd);
+      pc->psocket.registered = false;
+      pc->ai = ai;
+      pc->connecting = true;
+      return;
+    }
+    err = errno;
+    close(fd);
+  }
+  pc->connecting = false;
+  pconnection_error(pc, err, "connecting to");
+}
+
+/* Check a connect in progress after an epoll event */
+static void pconnection_connected(pconnection_t *pc) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(pc->psocket.fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+    err = errno;
+  }
+  if (!err) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    if (getpeername(pc->psocket.fd, (struct sockaddr*)&addr, &addrlen) == 0) {
+      pc->connecting = false;
+      freeaddrinfo(pc->addrinfo);
+      pc->addrinfo = pc->ai = NULL;
+    }
+    /* ENOTCONN: the event was for an earlier address, still connecting */
+    return;
+  }
+  close(pc->psocket.fd);
+  pc->psocket.fd = -1;
+  if (pc->ai->ai_next) {
+    pconnection_start_connect(pc, pc->ai->ai_next);
+  } else {
+    pc->connecting = false;
+    pconnection_error(pc, err, "on connect to");
+  }
+}
+
+static void pconnection_read(pconnection_t *pc) {
+  pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
+  if (rbuf.size > 0) {
+    ssize_t n = read(pc->psocket.fd, rbuf.start, rbuf.size);
+    if (n > 0) {
+      pn_connection_driver_read_done(&pc->driver, n);
+    } else if (n == 0) {
+      pn_connection_driver_read_close(&pc->driver);
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      pconnection_error(pc, errno, "on read from");
+    }
+  }
+}
+
+#define WRITE_IOV_MAX 16
+
+/* Write as much as the socket will take, gathering queued frames */
+static void pconnection_write(pconnection_t *pc) {
+  pn_bytes_t bufs[WRITE_IOV_MAX];
+  struct iovec iov[WRITE_IOV_MAX];
+  size_t n;
+  while ((n = pn_connection_driver_write_iov(&pc->driver, bufs, WRITE_IOV_MAX)) > 0) {
+    for (size_t i = 0; i < n; ++i) {
+      iov[i].iov_base = (void*)bufs[i].start;
+      iov[i].iov_len = bufs[i].size;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    ssize_t written = sendmsg(pc->psocket.fd, &msg, MSG_NOSIGNAL);
+    if (written >= 0) {
+      pn_connection_driver_write_done(&pc->driver, written);
+    } else {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        pconnection_error(pc, errno, "on write to");
+      }
+      return;
+    }
+  }
+  if (pn_connection_driver_write_closed(&pc->driver) && !pc->write_shutdown) {
+    shutdown(pc->psocket.fd, SHUT_WR);
+    pc->write_shutdown = true;
+  }
+}
+
+/* Generate tick events and set the tick timer for the next one */
+static void pconnection_tick(pconnection_t *pc) {
+  pn_timestamp_t next = pn_transport_tick(pc->driver.transport, now_millis());
+  if (next != pc->deadline) {
+    timer_set(pc->timer_fd, next, true);
+    pc->deadline = next;
+  }
+}
+
+/* IO events the connection is waiting for. This is engine processing and can generate
+   events, so it is done by the owner without the psocket lock, before going IDLE */
+static uint32_t pconnection_wanted(pconnection_t *pc) {
+  if (pc->psocket.fd < 0) return 0;
+  if (pc->connecting) return EPOLLOUT;
+  uint32_t events = 0;
+  pn_bytes_t wbuf;
+  if (pn_connection_driver_read_buffer(&pc->driver).size > 0) events |= EPOLLIN;
+  if (pn_connection_driver_write_iov(&pc->driver, &wbuf, 1) > 0) events |= EPOLLOUT;
+  return events;
+}
+
+/* Arm the epoll set for the wanted events and the tick timer, called with lock held */
+static void pconnection_arm_lh(pconnection_t *pc, uint32_t events) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  /* Nothing to wait for: don't arm, or a hung-up socket would fire forever */
+  if (events) {
+    epoll_arm(p, pc->psocket.fd, &pc->psocket.registered, pc->psocket.key, events);
+  }
+  if (pc->deadline && !pc->timer_armed) {
+    epoll_arm(p, pc->timer_fd, &pc->timer_registered, pc->psocket.key | KEY_TIMER, EPOLLIN);
+    pc->timer_armed = true;
+  }
+}
+
+/* Do IO for a WORKING connection. Return a batch if there are events for the caller to
+   handle, otherwise return the connection to IDLE (or free it) and return NULL */
+static pn_event_batch_t *pconnection_process(pconnection_t *pc) {
+  psocket_t *ps = &pc->psocket;
+  while (true) {
+    pthread_mutex_lock(&ps->lock);
+    bool wake = ps->wake;
+    ps->wake = false;
+    /* Leave IO events till the user has seen the events already pending, the first
+       batch (PN_CONNECTION_INIT) binds the transport */
+    bool busy = pn_connection_driver_has_event(&pc->driver);
+    uint32_t events = busy ? 0 : ps->events;
+    bool tick = busy ? false : ps->tick;
+    if (!busy) {
+      ps->events = 0;
+      ps->tick = false;
+    }
+    pthread_mutex_unlock(&ps->lock);
+
+    if (wake) {
+      pn_connection_t *c = pc->driver.connection;
+      pn_collector_put(pn_connection_collector(c), PN_OBJECT, c, PN_CONNECTION_WAKE);
+    }
+    if (!busy) {
+      if (tick) {
+        read_count(pc->timer_fd);
+        pc->timer_armed = false;
+      }
+      if (pc->connecting && events) {
+        pconnection_connected(pc);
+      }
+      if (!pc->connecting && ps->fd >= 0) {
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          pconnection_read(pc);
+        }
+        pconnection_write(pc);
+      }
+      pconnection_tick(pc);
+    }
+
+    uint32_t wanted = pconnection_wanted(pc);
+    if (pn_connection_driver_has_event(&pc->driver)) {
+      return &pc->driver.batch;
+    }
+    if (pn_connection_driver_finished(&pc->driver)) {
+      sockets_remove(ps);
+      return NULL;
+    }
+    pthread_mutex_lock(&ps->lock);
+    if (!ps->events && !ps->tick && !ps->wake) {
+      pconnection_arm_lh(pc, wanted);
+      ps->state = IDLE;
+      pthread_mutex_unlock(&ps->lock);
+      return NULL;
+    }
+    pthread_mutex_unlock(&ps->lock); /* More arrived while we were working */
+  }
+}
+
+static void pn_listener_free(pn_listener_t *l);
+
+static void listener_error(pn_listener_t *l, int err, const char* what) {
+  char msg[256];
+  const char *str = strerror_r(err, msg, sizeof(msg));
+  pn_condition_format(l->condition, COND_NAME, "%s %s:%s: %s",
+                      what, fixstr(l->psocket.host), fixstr(l->psocket.port), str);
+}
+
+/* Close the listening socket and tell the user */
+static void listener_close(pn_listener_t *l) {
+  if (l->psocket.fd >= 0) {
+    close(l->psocket.fd);
+    l->psocket.fd = -1;
+    pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_CLOSE);
+  }
+}
+
+/* Like pconnection_process() for a listener */
+static pn_event_batch_t *listener_process(pn_listener_t *l) {
+  psocket_t *ps = &l->psocket;
+  while (true) {
+    pthread_mutex_lock(&ps->lock);
+    uint32_t events = ps->events;
+    bool closing = ps->wake;    /* The only wakeup for a listener is pn_listener_close() */
+    ps->events = 0;
+    pthread_mutex_unlock(&ps->lock);
+
+    if (closing) {
+      listener_close(l);
+    } else if (events & (EPOLLERR | EPOLLHUP)) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(ps->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      listener_error(l, err ? err : EIO, "listening on");
+      listener_close(l);
+    } else if (events & EPOLLIN) {
+      pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_ACCEPT);
+    }
+
+    if (pn_collector_peek(l->collector)) {
+      return &l->batch;
+    }
+    if (ps->fd < 0) {           /* PN_LISTENER_CLOSE has been handled */
+      sockets_remove(ps);
+      return NULL;
+    }
+    pthread_mutex_lock(&ps->lock);
+    if (!ps->events && !ps->wake) {
+      epoll_arm(ps->proactor, ps->fd, &ps->registered, ps->key, EPOLLIN);
+      ps->state = IDLE;
+      pthread_mutex_unlock(&ps->lock);
+      return NULL;
+    }
+    pthread_mutex_unlock(&ps->lock);
+  }
+}
+
+static void psocket_free(psocket_t *ps) {
+  if (ps->is_conn) {
+    pconnection_free(as_pconnection(ps));
+  } else {
+    pn_listener_free(as_listener(ps));
+  }
+}
+
+/* Free psockets on a queue taken from proactor.free_q */
+static void psockets_free(psocket_t *ps) {
+  while (ps) {
+    psocket_t *next = ps->next;
+    psocket_free(ps);
+    ps = next;
+  }
+}
+
+static pn_event_batch_t *psocket_process(psocket_t *ps) {
+  return ps->is_conn ?
+    pconnection_process(as_pconnection(ps)) : listener_process(as_listener(ps));
+}
+
+/* Set the event in the proactor's batch  */
+static pn_event_batch_t *proactor_batch_lh(pn_proactor_t *p, pn_event_type_t t) {
+  pn_collector_put(p->collector, pn_proactor__class(), p, t);
+  p->batch_working = true;
+  return &p->batch;
+}
+
+static bool proactor_has_event_lh(pn_proactor_t *p) {
+  return p->inactive || p->interrupt || p->timeout_elapsed;
+}
+
+/* Return a proactor batch or the batch of a psocket on the ready_q, NULL if none */
+static pn_event_batch_t *proactor_next_batch(pn_proactor_t *p) {
+  while (true) {
+    pthread_mutex_lock(&p->lock);
+    psocket_t *finished = p->free_q.front;
+    p->free_q.front = p->free_q.back = NULL;
+    pn_event_batch_t *batch = NULL;
+    if (!p->batch_working) {       /* Can generate proactor events */
+      if (p->inactive) {
+        p->inactive = false;
+        batch = proactor_batch_lh(p, PN_PROACTOR_INACTIVE);
+      } else if (p->interrupt > 0) {
+        --p->interrupt;
+        batch = proactor_batch_lh(p, PN_PROACTOR_INTERRUPT);
+      } else if (p->timeout_elapsed) {
+        p->timeout_elapsed = false;
+        batch = proactor_batch_lh(p, PN_PROACTOR_TIMEOUT);
+      }
+    }
+    psocket_t *ps = batch ? NULL : pop_lh(&p->ready_q);
+    /* One eventfd read wakes one thread for the whole ready_q, pass it on */
+    bool more = ps && p->ready_q.front;
+    pthread_mutex_unlock(&p->lock);
+    if (more) notify(p);
+    psockets_free(finished);
+    if (batch || !ps) {
+      return batch;
+    }
+    pthread_mutex_lock(&ps->lock);
+    assert(ps->state == QUEUED);
+    ps->state = WORKING;
+    pthread_mutex_unlock(&ps->lock);
+    batch = psocket_process(ps);
+    if (batch) {
+      return batch;
+    }
+  }
+}
+
+/* Handle an event from epoll_wait(), return a batch if the caller now owns one */
+static pn_event_batch_t *proactor_handle(pn_proactor_t *p, struct epoll_event *ev) {
+  bool registered = true;
+  switch (ev->data.u64) {
+   case KEY_EVENTFD:
+    read_count(p->eventfd);
+    epoll_arm(p, p->eventfd, &registered, KEY_EVENTFD, EPOLLIN);
+    return NULL;                /* Caller checks for work */
+
+   case KEY_TIMER:
+    pthread_mutex_lock(&p->lock);
+    /* Don't report a timeout that was cancelled or reset after it expired */
+    if (read_count(p->timer_fd)) {
+      p->timeout_elapsed = true;
+    }
+    pthread_mutex_unlock(&p->lock);
+    epoll_arm(p, p->timer_fd, &registered, KEY_TIMER, EPOLLIN);
+    return NULL;
+
+   default: {
+     psocket_t *ps = sockets_lock(p, ev->data.u64);
+     if (!ps) {
+       return NULL;             /* Freed while the event was in flight */
+     }
+     if (ev->data.u64 & KEY_TIMER) {
+       ps->tick = true;
+     } else {
+       ps->events |= ev->events;
+     }
+     bool mine = (ps->state == IDLE);
+     if (mine) ps->state = WORKING;
+     pthread_mutex_unlock(&ps->lock);
+     return mine ? psocket_process(ps) : NULL;
+   }
+  }
+}
+
+static pn_event_batch_t *proactor_do_epoll(pn_proactor_t *p, bool can_block) {
+  while (true) {
+    pn_event_batch_t *batch = proactor_next_batch(p);
+    if (batch) {
+      return batch;
+    }
+    struct epoll_event ev;
+    int n = epoll_wait(p->epollfd, &ev, 1, can_block ? -1 : 0);
+    if (n < 0) {
+      assert(errno == EINTR);
+      continue;
+    }
+    if (n == 0) {
+      return NULL;
+    }
+    batch = proactor_handle(p, &ev);
+    if (batch) {
+      return batch;
+    }
+  }
+}
+
+pn_listener_t *pn_event_listener(pn_event_t *e) {
+  return (pn_event_class(e) == pn_listener__class()) ? (pn_listener_t*)pn_event_context(e) : NULL;
+}
+
+pn_proactor_t *pn_event_proactor(pn_event_t *e) {
+  if (pn_event_class(e) == pn_proactor__class()) {
+    return (pn_proactor_t*)pn_event_context(e);
+  }
+  pn_listener_t *l = pn_event_listener(e);
+  if (l) {
+    return l->psocket.proactor;
+  }
+  pn_connection_t *c = pn_event_connection(e);
+  if (c) {
+    return pn_connection_proactor(pn_event_connection(e));
+  }
+  return NULL;
+}
+
+/* Finished with a psocket batch, do any IO and queue it again if there are more events */
+static void psocket_done(psocket_t *ps) {
+  psocket_assert_working(ps);
+  if (psocket_process(ps)) {
+    pthread_mutex_lock(&ps->lock);
+    ps->state = QUEUED;
+    pthread_mutex_unlock(&ps->lock);
+    ready_push(ps);
+  }
+}
+
+void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc) {
+    psocket_done(&pc->psocket);
+    return;
+  }
+  pn_listener_t *l = batch_listener(batch);
+  if (l) {
+    psocket_done(&l->psocket);
+    return;
+  }
+  pn_proactor_t *bp = batch_proactor(batch);
+  if (bp == p) {
+    pthread_mutex_lock(&p->lock);
+    p->batch_working = false;
+    bool more = proactor_has_event_lh(p);
+    pthread_mutex_unlock(&p->lock);
+    if (more) notify(p);
+    return;
+  }
+}
+
+pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
+  return proactor_do_epoll(p, true);
+}
+
+pn_event_batch_t *pn_proactor_get(struct pn_proactor_t* p) {
+  return proactor_do_epoll(p, false);
+}
+
+void pn_proactor_interrupt(pn_proactor_t *p) {
+  pthread_mutex_lock(&p->lock);
+  ++p->interrupt;
+  pthread_mutex_unlock(&p->lock);
+  notify(p);
+}
+
+void pn_proactor_set_timeout(pn_proactor_t *p, pn_millis_t t) {
+  pthread_mutex_lock(&p->lock);
+  p->timeout_elapsed = false;   /* Cancel any undelivered timeout */
+  timer_set(p->timer_fd, t, false);
+  pthread_mutex_unlock(&p->lock);
+}
+
+int pn_proactor_connect(pn_proactor_t *p, pn_connection_t *c, const char *host, const char *port) {
+  pconnection_t *pc = pconnection(p, c, false, host, port);
+  if (!pc) {
+    return PN_OUT_OF_MEMORY;
+  }
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int gai = getaddrinfo(fixstr(pc->psocket.host), fixstr(pc->psocket.port), &hints, &pc->addrinfo);
+  if (gai) {
+    pc->addrinfo = NULL;
+    pn_connection_driver_bind(&pc->driver);
+    pn_connection_driver_errorf(&pc->driver, COND_NAME, "connecting to %s:%s: %s",
+                                fixstr(pc->psocket.host), fixstr(pc->psocket.port),
+                                gai_strerror(gai));
+    pn_connection_driver_close(&pc->driver);
+  } else {
+    pconnection_start_connect(pc, pc->addrinfo);
+    if (pc->connecting) {
+      /* Events for the connect are recorded until the first batch is done */
+      epoll_arm(p, pc->psocket.fd, &pc->psocket.registered, pc->psocket.key, EPOLLOUT);
+    }
+  }
+  ready_push(&pc->psocket);
+  return 0;
+}
+
+int pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *host, const char *port, int backlog)
+{
+  psocket_init(&l->psocket, p, false, host, port);
+  l->backlog = backlog;
+  if (!sockets_add(p, &l->psocket)) {
+    return PN_OUT_OF_MEMORY;
+  }
+  struct addrinfo hints, *addrinfo = NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  int gai = getaddrinfo(fixstr(l->psocket.host), fixstr(l->psocket.port), &hints, &addrinfo);
+  if (gai) {
+    pn_condition_format(l->condition, COND_NAME, "listening on %s:%s: %s",
+                        fixstr(l->psocket.host), fixstr(l->psocket.port), gai_strerror(gai));
+  } else {
+    int err = 0;
+    for (struct addrinfo *ai = addrinfo; ai && l->psocket.fd < 0; ai = ai->ai_next) {
+      int fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      int yes = 1;
+      if (fd >= 0 &&
+          setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == 0 &&
+          bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+          listen(fd, backlog) == 0) {
+        l->psocket.fd = fd;
+      } else {
+        err = errno;
+        if (fd >= 0) close(fd);
+      }
+    }
+    freeaddrinfo(addrinfo);
+    if (l->psocket.fd < 0) {
+      listener_error(l, err, "listening on");
+    }
+  }
+  pn_collector_put(l->collector, pn_listener__class(), l,
+                   l->psocket.fd >= 0 ? PN_LISTENER_OPEN : PN_LISTENER_CLOSE);
+  ready_push(&l->psocket);
+  return 0;
+}
+
+pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
+  pconnection_t *pc = get_pconnection(c);
+  return pc ? pc->psocket.proactor : NULL;
+}
+
+void pn_connection_wake(pn_connection_t* c) {
+  /* May be called from any thread */
+  pconnection_t *pc = get_pconnection(c);
+  if (pc) {
+    psocket_wake(&pc->psocket);
+  }
+}
+
+pn_proactor_t *pn_proactor() {
+  pn_proactor_t *p = (pn_proactor_t*)calloc(1, sizeof(*p));
+  if (!p) return NULL;
+  p->epollfd = epoll_create1(EPOLL_CLOEXEC);
+  p->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  p->collector = pn_collector();
+  p->batch.next_event = &proactor_batch_next;
+  pthread_mutex_init(&p->lock, NULL);
+  bool registered = false, timer_registered = false;
+  if (p->epollfd < 0 || p->eventfd < 0 || p->timer_fd < 0 || !p->collector ||
+      epoll_arm(p, p->eventfd, &registered, KEY_EVENTFD, EPOLLIN) != 0 ||
+      epoll_arm(p, p->timer_fd, &timer_registered, KEY_TIMER, EPOLLIN) != 0) {
+    pn_proactor_free(p);
+    return NULL;
+  }
+  return p;
+}
+
+void pn_proactor_free(pn_proactor_t *p) {
+  /* Abort all connections and listeners */
+  for (uint32_t i = 0; i < p->slots_size; ++i) {
+    if (p->slots[i].psocket) {
+      psocket_free(p->slots[i].psocket);
+    }
+  }
+  psockets_free(p->free_q.front);
+  free(p->slots);
+  if (p->epollfd >= 0) close(p->epollfd);
+  if (p->eventfd >= 0) close(p->eventfd);
+  if (p->timer_fd >= 0) close(p->timer_fd);
+  pthread_mutex_destroy(&p->lock);
+  if (p->collector) pn_collector_free(p->collector);
+  free(p);
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch) {
+  pn_listener_t *l = batch_listener(batch);
+  psocket_assert_working(&l->psocket);
+  return pn_collector_next(l->collector);
+}
+
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch) {
+  pn_proactor_t *p = batch_proactor(batch);
+  assert(p->batch_working);
+  return pn_collector_next(p->collector);
+}
+
+static void pn_listener_free(pn_listener_t *l) {
+  if (l) {
+    if (l->psocket.fd >= 0) close(l->psocket.fd);
+    if (l->psocket.proactor) pthread_mutex_destroy(&l->psocket.lock);
+    if (l->collector) pn_collector_free(l->collector);
+    if (l->condition) pn_condition_free(l->condition);
+    if (l->attachments) pn_free(l->attachments);
+    free(l);
+  }
+}
+
+pn_listener_t *pn_listener(void) {
+  pn_listener_t *l = (pn_listener_t*)calloc(1, sizeof(pn_listener_t));
+  if (l) {
+    l->psocket.fd = -1;
+    l->batch.next_event = listener_batch_next;
+    l->collector = pn_collector();
+    l->condition = pn_condition();
+    l->attachments = pn_record();
+    if (!l->condition || !l->collector || !l->attachments) {
+      pn_listener_free(l);
+      return NULL;
+    }
+  }
+  return l;
+}
+
+void pn_listener_close(pn_listener_t* l) {
+  /* This can be called from any thread, not just the owner of l */
+  psocket_wake(&l->psocket);
+}
+
+pn_proactor_t *pn_listener_proactor(pn_listener_t* l) {
+  return l ? l->psocket.proactor : NULL;
+}
+
+pn_condition_t* pn_listener_condition(pn_listener_t* l) {
+  return l->condition;
+}
+
+void *pn_listener_get_context(pn_listener_t *l) {
+  return l->context;
+}
+
+void pn_listener_set_context(pn_listener_t *l, void *context) {
+  l->context = context;
+}
+
+pn_record_t *pn_listener_attachments(pn_listener_t *l) {
+  return l->attachments;
+}
+
+int pn_listener_accept(pn_listener_t *l, pn_connection_t *c) {
+  psocket_assert_working(&l->psocket);
+  pconnection_t *pc = pconnection(l->psocket.proactor, c, true, l->psocket.host, l->psocket.port);
+  if (!pc) {
+    return PN_OUT_OF_MEMORY;
+  }
+  int fd = accept4(l->psocket.fd, NULL, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd >= 0) {
+    pc->psocket.fd = fd;
+    pn_ssl_set_socket(pc->driver.transport, fd);
+  } else {
+    pconnection_error(pc, errno, "accepting from");
+  }
+  ready_push(&pc->psocket);
+  return 0;
+}
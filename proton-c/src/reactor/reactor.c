@@ -236,17 +236,15 @@ static void pni_reactor_dispatch_post(pn_reactor_t *reactor, pn_event_t *event)
   }
 }
 
-PN_HANDLE(PN_HANDLER)
-
 pn_handler_t *pn_record_get_handler(pn_record_t *record) {
   assert(record);
-  return (pn_handler_t *) pn_record_get(record, PN_HANDLER);
+  return (pn_handler_t *) pn_record_get(record, PN_HANDLERCTX);
 }
 
 void pn_record_set_handler(pn_record_t *record, pn_handler_t *handler) {
   assert(record);
-  pn_record_def(record, PN_HANDLER, PN_OBJECT);
-  pn_record_set(record, PN_HANDLER, handler);
+  pn_record_def(record, PN_HANDLERCTX, PN_OBJECT);
+  pn_record_set(record, PN_HANDLERCTX, handler);
 }
 
 PN_HANDLE(PN_REACTOR)
@@ -351,6 +349,7 @@ pn_handler_t *pn_event_handler(pn_event_t *event, pn_handler_t *default_handler)
 }
 
 pn_task_t *pn_reactor_schedule(pn_reactor_t *reactor, int delay, pn_handler_t *handler) {
+  pni_timer_set_now(reactor->timer, reactor->now);
   pn_task_t *task = pn_timer_schedule(reactor->timer, reactor->now + delay);
   pn_record_t *record = pn_task_attachments(task);
   pni_record_init_reactor(record, reactor);
@@ -30,5 +30,6 @@ void pni_reactor_set_connection_peer_address(pn_connection_t *connection,
                                              const char *host,
                                              const char *port);
 pn_io_t *pni_reactor_io(pn_reactor_t *reactor);
+void pni_timer_set_now(pn_timer_t *timer, pn_timestamp_t now);
 
 #endif /* src/reactor.h */
@@ -22,12 +22,40 @@
 #include <proton/object.h>
 #include <proton/reactor.h>
 #include <assert.h>
+#include <string.h>
+
+#include "core/util.h"
+#include "io.h"
+#include "reactor.h"
+
+// Tasks are kept in a hierarchical timing wheel of millisecond ticks, so
+// scheduling and cancelling are O(1) and a cancelled task is released at
+// once. Level 0 has a slot per tick for the next PNI_WHEEL_SLOTS ticks,
+// each level above has slots PNI_WHEEL_SLOTS times as wide, and a slot's
+// tasks are moved down a level when the ticks reach it. Tasks beyond the
+// top level wait in its furthest slot and are placed again from there.
+
+#define PNI_WHEEL_BITS (6)
+#define PNI_WHEEL_SLOTS (1 << PNI_WHEEL_BITS)
+#define PNI_WHEEL_MASK (PNI_WHEEL_SLOTS - 1)
+#define PNI_WHEEL_LEVELS (6)
+
+typedef struct {
+  pn_task_t *task_head;
+  pn_task_t *task_tail;
+} pni_slot_t;
 
 struct pn_task_t {
   pn_list_t *pool;
   pn_record_t *attachments;
   pn_timestamp_t deadline;
   bool cancelled;
+  // while scheduled, the timer and slot holding the task and its level
+  pn_timer_t *timer;
+  pni_slot_t *slot;
+  int level;
+  pn_task_t *task_next;
+  pn_task_t *task_prev;
 };
 
 void pn_task_initialize(pn_task_t *task) {
@@ -35,6 +63,11 @@ void pn_task_initialize(pn_task_t *task) {
   task->attachments = pn_record();
   task->deadline = 0;
   task->cancelled = false;
+  task->timer = NULL;
+  task->slot = NULL;
+  task->level = 0;
+  task->task_next = NULL;
+  task->task_prev = NULL;
 }
 
 void pn_task_finalize(pn_task_t *task) {
@@ -70,9 +103,15 @@ pn_record_t *pn_task_attachments(pn_task_t *task) {
   return task->attachments;
 }
 
+static void pni_timer_unlink(pn_timer_t *timer, pn_task_t *task);
+
 void pn_task_cancel(pn_task_t *task) {
     assert(task);
     task->cancelled = true;
+    if (task->timer) {
+      pni_timer_unlink(task->timer, task);
+      pn_decref(task);
+    }
 }
 
 //
@@ -81,18 +120,49 @@ void pn_task_cancel(pn_task_t *task) {
 
 struct pn_timer_t {
   pn_list_t *pool;
-  pn_list_t *tasks;
   pn_collector_t *collector;
+  // every tick before current has been processed
+  pn_timestamp_t current;
+  bool started;
+  // the earliest deadline, when known
+  pn_timestamp_t earliest;
+  bool earliest_valid;
+  int tasks;
+  int level_tasks[PNI_WHEEL_LEVELS];
+  // tasks scheduled with a deadline before the current tick
+  pni_slot_t due;
+  pni_slot_t wheel[PNI_WHEEL_LEVELS][PNI_WHEEL_SLOTS];
 };
 
 static void pn_timer_initialize(pn_timer_t *timer) {
   timer->pool = pn_list(PN_OBJECT, 0);
-  timer->tasks = pn_list(PN_OBJECT, 0);
+  timer->current = 0;
+  timer->started = false;
+  timer->earliest = 0;
+  timer->earliest_valid = true;
+  timer->tasks = 0;
+  memset(timer->level_tasks, 0, sizeof(timer->level_tasks));
+  memset(&timer->due, 0, sizeof(timer->due));
+  memset(timer->wheel, 0, sizeof(timer->wheel));
 }
 
 static void pn_timer_finalize(pn_timer_t *timer) {
+  while (timer->due.task_head) {
+    pn_task_t *task = timer->due.task_head;
+    pni_timer_unlink(timer, task);
+    pn_decref(task);
+  }
+  for (int level = 0; level < PNI_WHEEL_LEVELS; ++level) {
+    for (int i = 0; i < PNI_WHEEL_SLOTS; ++i) {
+      pni_slot_t *slot = &timer->wheel[level][i];
+      while (slot->task_head) {
+        pn_task_t *task = slot->task_head;
+        pni_timer_unlink(timer, task);
+        pn_decref(task);
+      }
+    }
+  }
   pn_decref(timer->pool);
-  pn_free(timer->tasks);
 }
 
 #define pn_timer_inspect NULL
@@ -107,6 +177,61 @@ pn_timer_t *pn_timer(pn_collector_t *collector) {
   return timer;
 }
 
+static void pni_timer_unlink(pn_timer_t *timer, pn_task_t *task) {
+  pni_slot_t *slot = task->slot;
+  LL_REMOVE(slot, task, task);
+  task->task_next = NULL;
+  task->task_prev = NULL;
+  task->slot = NULL;
+  task->timer = NULL;
+  if (slot != &timer->due) {
+    timer->level_tasks[task->level]--;
+  }
+  timer->tasks--;
+  if (task->deadline == timer->earliest) {
+    timer->earliest_valid = false;
+  }
+}
+
+// Link a task into the slot for its deadline relative to the current tick
+static void pni_timer_link(pn_timer_t *timer, pn_task_t *task) {
+  pni_slot_t *slot;
+  if (task->deadline < timer->current) {
+    slot = &timer->due;
+  } else {
+    uint64_t delta = task->deadline - timer->current;
+    uint64_t when = task->deadline;
+    int level = 0;
+    while (level < PNI_WHEEL_LEVELS - 1 && delta >> (PNI_WHEEL_BITS * (level + 1))) {
+      level++;
+    }
+    if (delta >> (PNI_WHEEL_BITS * (level + 1))) {
+      // beyond the top level, wait in its furthest slot
+      when = timer->current + ((uint64_t) 1 << (PNI_WHEEL_BITS * PNI_WHEEL_LEVELS)) - 1;
+    }
+    slot = &timer->wheel[level][(when >> (PNI_WHEEL_BITS * level)) & PNI_WHEEL_MASK];
+    task->level = level;
+    timer->level_tasks[level]++;
+  }
+  LL_ADD(slot, task, task);
+  task->slot = slot;
+  task->timer = timer;
+  if (timer->earliest_valid && (!timer->tasks || task->deadline < timer->earliest)) {
+    timer->earliest = task->deadline;
+  }
+  timer->tasks++;
+}
+
+// Start the wheel at the reactor's clock rather than the first deadline,
+// so tasks scheduled later with earlier deadlines still go in the wheel,
+// and move an empty wheel up to it
+void pni_timer_set_now(pn_timer_t *timer, pn_timestamp_t now) {
+  if (!timer->started || (!timer->tasks && now > timer->current)) {
+    timer->current = now;
+    timer->started = true;
+  }
+}
+
 pn_task_t *pn_timer_schedule(pn_timer_t *timer,  pn_timestamp_t deadline) {
   pn_task_t *task = (pn_task_t *) pn_list_pop(timer->pool);
   if (!task) {
@@ -116,53 +241,138 @@ pn_task_t *pn_timer_schedule(pn_timer_t *timer,  pn_timestamp_t deadline) {
   pn_incref(task->pool);
   task->deadline = deadline;
   task->cancelled = false;
-  pn_list_minpush(timer->tasks, task);
-  pn_decref(task);
+  if (!timer->started) {
+    // no clock yet, start at the first deadline
+    timer->current = deadline;
+    timer->started = true;
+  }
+  // the wheel holds the reference from pn_task or pn_list_pop
+  pni_timer_link(timer, task);
   return task;
 }
 
-void pni_timer_flush_cancelled(pn_timer_t *timer) {
-    while (pn_list_size(timer->tasks)) {
-        pn_task_t *task = (pn_task_t *) pn_list_get(timer->tasks, 0);
-        if (task->cancelled) {
-            pn_task_t *min = (pn_task_t *) pn_list_minpop(timer->tasks);
-            assert(min == task);
-            pn_decref(min);
-        } else {
-            break;
-        }
+static void pni_timer_expire(pn_timer_t *timer, pni_slot_t *slot) {
+  while (slot->task_head) {
+    pn_task_t *task = slot->task_head;
+    pni_timer_unlink(timer, task);
+    pn_collector_put(timer->collector, PN_OBJECT, task, PN_TIMER_TASK);
+    pn_decref(task);
+  }
+}
+
+// Move the tasks in a slot of an upper level down to where they now belong
+static void pni_timer_cascade(pn_timer_t *timer, int level) {
+  pni_slot_t *slot = &timer->wheel[level][(timer->current >> (PNI_WHEEL_BITS * level)) & PNI_WHEEL_MASK];
+  pn_task_t *task = slot->task_head;
+  slot->task_head = NULL;
+  slot->task_tail = NULL;
+  while (task) {
+    pn_task_t *next = task->task_next;
+    timer->level_tasks[level]--;
+    timer->tasks--;
+    pni_timer_link(timer, task);
+    task = next;
+  }
+}
+
+// Process the ticks up to and including now
+static void pni_timer_advance(pn_timer_t *timer, pn_timestamp_t now) {
+  while (timer->current <= now) {
+    if (!timer->tasks) {
+      timer->current = now + 1;
+      return;
+    }
+    // Skip straight to the next boundary of the lowest non-empty level,
+    // there is nothing to do on the ticks in between
+    int level = 0;
+    while (level < PNI_WHEEL_LEVELS - 1 && !timer->level_tasks[level]) level++;
+    if (level) {
+      uint64_t span = (uint64_t) 1 << (PNI_WHEEL_BITS * level);
+      pn_timestamp_t next = (pn_timestamp_t) ((timer->current | (span - 1)) + 1);
+      if (next > now + 1) {
+        timer->current = now + 1;
+        return;
+      }
+      timer->current = next;
+    } else {
+      pni_timer_expire(timer, &timer->wheel[0][timer->current & PNI_WHEEL_MASK]);
+      timer->current++;
     }
+    for (int l = 1; l < PNI_WHEEL_LEVELS; ++l) {
+      if (timer->current & (((uint64_t) 1 << (PNI_WHEEL_BITS * l)) - 1)) break;
+      pni_timer_cascade(timer, l);
+    }
+  }
+}
+
+// The earliest deadline in the first occupied slot of a level
+static pn_timestamp_t pni_timer_level_deadline(pn_timer_t *timer, int level) {
+  int shift = PNI_WHEEL_BITS * level;
+  // Above level 0 the slot of the current tick was cascaded when the tick
+  // got there, anything in it is a full turn ahead and so comes last
+  uint64_t first = (timer->current >> shift) + (level ? 1 : 0);
+  for (int i = 0; i < PNI_WHEEL_SLOTS; ++i) {
+    pni_slot_t *slot = &timer->wheel[level][(first + i) & PNI_WHEEL_MASK];
+    if (slot->task_head) {
+      pn_timestamp_t deadline = slot->task_head->deadline;
+      for (pn_task_t *task = slot->task_head->task_next; task; task = task->task_next) {
+        if (task->deadline < deadline) deadline = task->deadline;
+      }
+      return deadline;
+    }
+  }
+  return 0;
+}
+
+static pn_timestamp_t pni_timer_earliest(pn_timer_t *timer) {
+  if (!timer->tasks) return 0;
+  if (timer->due.task_head) {
+    pn_timestamp_t deadline = timer->due.task_head->deadline;
+    for (pn_task_t *task = timer->due.task_head->task_next; task; task = task->task_next) {
+      if (task->deadline < deadline) deadline = task->deadline;
+    }
+    return deadline;
+  }
+  // Each level's slots are in deadline order but the levels overlap, a
+  // lower level can reach past the start of the next one's first slot
+  pn_timestamp_t deadline = 0;
+  for (int level = 0; level < PNI_WHEEL_LEVELS; ++level) {
+    if (timer->level_tasks[level]) {
+      pn_timestamp_t d = pni_timer_level_deadline(timer, level);
+      if (!deadline || d < deadline) deadline = d;
+    }
+  }
+  return deadline;
 }
 
 pn_timestamp_t pn_timer_deadline(pn_timer_t *timer) {
   assert(timer);
-  pni_timer_flush_cancelled(timer);
-  if (pn_list_size(timer->tasks)) {
-    pn_task_t *task = (pn_task_t *) pn_list_get(timer->tasks, 0);
-    return task->deadline;
-  } else {
-    return 0;
+  if (!timer->earliest_valid) {
+    timer->earliest = pni_timer_earliest(timer);
+    timer->earliest_valid = true;
   }
+  return timer->tasks ? timer->earliest : 0;
 }
 
 void pn_timer_tick(pn_timer_t *timer, pn_timestamp_t now) {
   assert(timer);
-  while (pn_list_size(timer->tasks)) {
-    pn_task_t *task = (pn_task_t *) pn_list_get(timer->tasks, 0);
+  // Tasks scheduled before the first tick can be due later than others
+  // scheduled after them, so check each one
+  pn_task_t *task = timer->due.task_head;
+  while (task) {
+    pn_task_t *next = task->task_next;
     if (now >= task->deadline) {
-      pn_task_t *min = (pn_task_t *) pn_list_minpop(timer->tasks);
-      assert(min == task);
-      if (!min->cancelled)
-          pn_collector_put(timer->collector, PN_OBJECT, min, PN_TIMER_TASK);
-      pn_decref(min);
-    } else {
-      break;
+      pni_timer_unlink(timer, task);
+      pn_collector_put(timer->collector, PN_OBJECT, task, PN_TIMER_TASK);
+      pn_decref(task);
     }
+    task = next;
   }
+  pni_timer_advance(timer, now);
+  timer->started = true;
 }
 
 int pn_timer_tasks(pn_timer_t *timer) {
   assert(timer);
-  pni_timer_flush_cancelled(timer);
-  return pn_list_size(timer->tasks);
+  return timer->tasks;
 }
@@ -22,6 +22,7 @@
 #include "platform/platform.h"
 #include "core/util.h"
 #include "core/engine-internal.h"
+#include "ssl/ssl-internal.h"
 
 #include <proton/ssl.h>
 #include <proton/engine.h>
@@ -45,11 +46,34 @@
 #include <openssl/ssl.h>
 #include <openssl/dh.h>
 #include <openssl/err.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 #include <openssl/x509v3.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <time.h>
+
+// Kernel TLS needs the TLS 1.2 key block, which OpenSSL 1.1.1 can derive
+#if defined(USE_KERNEL_TLS) && OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define PNI_KTLS
+#include <openssl/kdf.h>
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <errno.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
 
 
 /** @file
@@ -64,6 +88,26 @@ static int ssl_session_ex_data_index;
 
 typedef struct pn_ssl_session_t pn_ssl_session_t;
 
+// a key for encrypting session tickets
+typedef struct {
+  unsigned char name[16];
+  unsigned char aes_key[32];
+  unsigned char hmac_key[32];
+  time_t created;
+  bool valid;
+} pni_ticket_key_t;
+
+// Connections on different threads share a domain: its ticket keys are
+// guarded by a lock.  Before 1.1 OpenSSL locks through the application's
+// locking callbacks, which are needed to share the SSL_CTX anyway.
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define TICKET_LOCK(domain) CRYPTO_THREAD_write_lock((domain)->ticket_lock)
+#define TICKET_UNLOCK(domain) CRYPTO_THREAD_unlock((domain)->ticket_lock)
+#else
+#define TICKET_LOCK(domain) CRYPTO_w_lock(CRYPTO_LOCK_SSL_CTX)
+#define TICKET_UNLOCK(domain) CRYPTO_w_unlock(CRYPTO_LOCK_SSL_CTX)
+#endif
+
 struct pn_ssl_domain_t {
 
   SSL_CTX       *ctx;
@@ -80,6 +124,17 @@ struct pn_ssl_domain_t {
   bool has_ca_db;       // true when CA database configured
   bool has_certificate; // true when certificate configured
   bool allow_unsecured;
+  bool kernel_tls;      // hand output encryption to the kernel after the handshake
+
+  // session ticket keys when they change, see pn_ssl_domain_set_session_tickets()
+  pni_ticket_key_t ticket_keys[2];  // current, previous
+  uint32_t ticket_lifetime;         // seconds
+  uint64_t tickets_issued;
+  uint64_t tickets_accepted;
+  uint64_t tickets_rejected;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  CRYPTO_RWLOCK *ticket_lock;
+#endif
 };
 
 
@@ -89,11 +144,14 @@ struct pni_ssl_t {
   const char *peer_hostname;
   SSL *ssl;
 
-  BIO *bio_ssl;         // i/o from/to SSL socket layer
-  BIO *bio_ssl_io;      // SSL "half" of network-facing BIO
-  BIO *bio_net_io;      // socket-side "half" of network-facing BIO
-  // buffers for holding I/O from "applications" above SSL
-#define APP_BUF_SIZE    (4*1024)
+  BIO *bio_net_in;      // memory BIO: network data waiting to be read by SSL
+  BIO *bio_net_out;     // memory BIO: records written by SSL for the network
+  // buffers for holding I/O from "applications" above SSL, one full TLS
+  // record each.  outbuf is only allocated when a layer other than AMQP
+  // (e.g. SASL) produces the output, AMQP frames are encrypted in place.
+#define APP_BUF_SIZE    SSL3_RT_MAX_PLAIN_LENGTH
+  // network data accepted but not yet read by SSL, about one record
+#define NET_BUF_SIZE    SSL3_RT_MAX_PACKET_SIZE
   char *outbuf;
   char *inbuf;
 
@@ -103,12 +161,15 @@ struct pni_ssl_t {
   size_t out_size;
   size_t out_count;
   size_t in_size;
+  size_t in_start;      // inbuf[in_start .. in_start+in_count) awaits the app
   size_t in_count;
 
-  bool ssl_shutdown;    // BIO_ssl_shutdown() called on socket.
+  bool ssl_shutdown;    // SSL_shutdown() called on socket.
   bool ssl_closed;      // shutdown complete, or SSL error
   bool read_blocked;    // SSL blocked until more network data is read
   bool write_blocked;   // SSL blocked until data is written to network
+  bool ktls_pending;    // kernel TLS wanted, handshake output not yet all sent
+  bool ktls;            // the kernel encrypts what is written to the socket
 
   char *subject;
   X509 *peer_certificate;
@@ -131,6 +192,9 @@ static inline pni_ssl_t *get_ssl_internal(pn_ssl_t *ssl)
 #define CIPHERS_AUTHENTICATE    "ALL:!aNULL:!eNULL:@STRENGTH"
 #define CIPHERS_ANONYMOUS       "ALL:aNULL:!eNULL:@STRENGTH"
 
+// names the sessions of server domains
+#define SESSION_ID_CONTEXT      "org.apache.qpid.proton"
+
 /* */
 static int keyfile_pw_cb(char *buf, int size, int rwflag, void *userdata);
 static void handle_error_ssl( pn_transport_t *transport, unsigned int layer);
@@ -138,6 +202,10 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
 static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer, char *input_data, size_t len);
 static ssize_t process_input_done(pn_transport_t *transport, unsigned int layer, const char *input_data, size_t len);
 static ssize_t process_output_done(pn_transport_t *transport, unsigned int layer, char *input_data, size_t len);
+#ifdef PNI_KTLS
+static ssize_t process_output_ktls(pn_transport_t *transport, unsigned int layer, char *buffer, size_t max_len);
+static bool ktls_start(pn_transport_t *transport);
+#endif
 static int init_ssl_socket(pn_transport_t *, pni_ssl_t *);
 static void release_ssl_socket( pni_ssl_t * );
 static size_t buffered_output( pn_transport_t *transport );
@@ -357,6 +425,7 @@ static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
 }
 
 
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
 // this code was generated using the command:
 // "openssl dhparam -C -2 2048"
 static DH *get_dh2048(void)
@@ -391,12 +460,20 @@ static DH *get_dh2048(void)
   DH *dh;
 
   if ((dh=DH_new()) == NULL) return(NULL);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  BIGNUM *p = BN_bin2bn(dh2048_p,sizeof(dh2048_p),NULL);
+  BIGNUM *g = BN_bin2bn(dh2048_g,sizeof(dh2048_g),NULL);
+  if (!p || !g || !DH_set0_pqg(dh, p, NULL, g))
+    { BN_free(p); BN_free(g); DH_free(dh); return(NULL); }
+#else
   dh->p=BN_bin2bn(dh2048_p,sizeof(dh2048_p),NULL);
   dh->g=BN_bin2bn(dh2048_g,sizeof(dh2048_g),NULL);
   if ((dh->p == NULL) || (dh->g == NULL))
     { DH_free(dh); return(NULL); }
+#endif
   return(dh);
 }
+#endif
 
 typedef struct {
   const char *id;
@@ -422,15 +499,15 @@ static SSL_SESSION *ssn_cache_find( pn_ssl_domain_t *domain, const char *id )
   if (!id) return NULL;
 
   ssl_cache_visit_data visitor = {id, NULL};
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  OPENSSL_LH_doall_arg((OPENSSL_LHASH *)SSL_CTX_sessions(domain->ctx), &SSL_SESSION_visit_caster, &visitor);
+#else
   lh_SSL_SESSION_doall_arg(SSL_CTX_sessions(domain->ctx), &SSL_SESSION_visit_caster, ssl_cache_visit_data, &visitor);
+#endif
   return visitor.session;
 }
 
-// Set up/tear down ssl session ex data
-int ssl_session_ex_data_init(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp) {
-  return CRYPTO_set_ex_data(ad, idx, NULL);
-}
-
+// Tear down ssl session ex data, it starts out NULL
 void ssl_session_ex_data_fini(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp) {
   free(CRYPTO_get_ex_data(ad, idx));
 }
@@ -452,7 +529,7 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
     ssl_ex_data_index = SSL_get_ex_new_index( 0, (void *) "org.apache.qpid.proton.ssl",
                                               NULL, NULL, NULL);
     ssl_session_ex_data_index = SSL_SESSION_get_ex_new_index(0, (void *)"ssl session data",
-                                                             &ssl_session_ex_data_init, NULL, &ssl_session_ex_data_fini);
+                                                             NULL, NULL, &ssl_session_ex_data_fini);
   }
 
   pn_ssl_domain_t *domain = (pn_ssl_domain_t *) calloc(1, sizeof(pn_ssl_domain_t));
@@ -460,6 +537,13 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
 
   domain->ref_count = 1;
   domain->mode = mode;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  domain->ticket_lock = CRYPTO_THREAD_lock_new();
+  if (!domain->ticket_lock) {
+    free(domain);
+    return NULL;
+  }
+#endif
 
   // enable all supported protocol versions, then explicitly disable the
   // known vulnerable ones.  This should allow us to use the latest version
@@ -467,28 +551,36 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
   switch(mode) {
   case PN_SSL_MODE_CLIENT:
     domain->ctx = SSL_CTX_new(SSLv23_client_method()); // and TLSv1+
-    SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_CLIENT);
     if (!domain->ctx) {
       ssl_log_error("Unable to initialize OpenSSL context.");
-      free(domain);
+      pn_ssl_domain_free(domain);
       return NULL;
     }
+    SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_CLIENT);
     break;
 
   case PN_SSL_MODE_SERVER:
     domain->ctx = SSL_CTX_new(SSLv23_server_method()); // and TLSv1+
     if (!domain->ctx) {
       ssl_log_error("Unable to initialize OpenSSL context.");
-      free(domain);
+      pn_ssl_domain_free(domain);
       return NULL;
     }
+    // sessions are only resumed by servers that name their context, else
+    // clients that have been verified fail to resume
+    SSL_CTX_set_session_id_context(domain->ctx, (const unsigned char *) SESSION_ID_CONTEXT,
+                                   sizeof(SESSION_ID_CONTEXT) - 1);
     break;
 
   default:
     pn_transport_logf(NULL, "Invalid value for pn_ssl_mode_t: %d", mode);
-    free(domain);
+    pn_ssl_domain_free(domain);
     return NULL;
   }
+  // let SSL take as much as it can from the network BIO at a time, rather
+  // than reading each record header and body separately
+  SSL_CTX_set_read_ahead(domain->ctx, 1);
+
   const long reject_insecure = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3;
   SSL_CTX_set_options(domain->ctx, reject_insecure);
 #ifdef SSL_OP_NO_COMPRESSION
@@ -509,12 +601,17 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
     return NULL;
   }
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  // OpenSSL 3 has built in groups matching the strength of the certificate
+  SSL_CTX_set_dh_auto(domain->ctx, 1);
+#else
   DH *dh = get_dh2048();
   if (dh) {
     SSL_CTX_set_tmp_dh(domain->ctx, dh);
     DH_free(dh);
     SSL_CTX_set_options(domain->ctx, SSL_OP_SINGLE_DH_USE);
   }
+#endif
 
   return domain;
 }
@@ -526,6 +623,10 @@ void pn_ssl_domain_free( pn_ssl_domain_t *domain )
     if (domain->ctx) SSL_CTX_free(domain->ctx);
     if (domain->keyfile_pw) free(domain->keyfile_pw);
     if (domain->trusted_CAs) free(domain->trusted_CAs);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (domain->ticket_lock) CRYPTO_THREAD_lock_free(domain->ticket_lock);
+#endif
+    OPENSSL_cleanse(domain->ticket_keys, sizeof(domain->ticket_keys));
     free(domain);
   }
 }
@@ -730,6 +831,201 @@ int pn_ssl_domain_allow_unsecured_client(pn_ssl_domain_t *domain)
   return 0;
 }
 
+int pn_ssl_domain_enable_kernel_tls(pn_ssl_domain_t *domain)
+{
+  if (!domain) return -1;
+#ifdef PNI_KTLS
+  // only TLS 1.2 keys are installed, and OpenSSL can no longer write
+  // handshake records once the kernel has the output
+  if (!SSL_CTX_set_max_proto_version(domain->ctx, TLS1_2_VERSION)) return -1;
+#ifdef SSL_OP_NO_RENEGOTIATION
+  SSL_CTX_set_options(domain->ctx, SSL_OP_NO_RENEGOTIATION);
+#endif
+  domain->kernel_tls = true;
+  return 0;
+#else
+  pn_transport_logf(NULL, "Kernel TLS is not supported by this build.");
+  return -1;
+#endif
+}
+
+int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, uint32_t timeout)
+{
+  if (!domain) return -1;
+  if (domain->mode != PN_SSL_MODE_SERVER) {
+    pn_transport_logf(NULL, "Cannot configure the session cache - not a server.");
+    return -1;
+  }
+  if (size) {
+    SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(domain->ctx, (long) size);
+  } else {
+    SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_OFF);
+  }
+  if (timeout) SSL_CTX_set_timeout(domain->ctx, (long) timeout);
+  return 0;
+}
+
+// Start a new current ticket key, keeping the last one.  Called with the
+// ticket lock held.
+static void ticket_key_rotate(pn_ssl_domain_t *domain, time_t now)
+{
+  pni_ticket_key_t *keys = domain->ticket_keys;
+  keys[1] = keys[0];
+  keys[0].created = now;
+  keys[0].valid = RAND_bytes(keys[0].name, sizeof(keys[0].name)) == 1 &&
+    RAND_bytes(keys[0].aes_key, sizeof(keys[0].aes_key)) == 1 &&
+    RAND_bytes(keys[0].hmac_key, sizeof(keys[0].hmac_key)) == 1;
+}
+
+// Find the key to encrypt (enc == 1) or decrypt a session ticket with and
+// set up ectx, the MAC is left to the caller.  A ticket made with the
+// previous key is accepted, and replaced by one made with the current key.
+static int ticket_key_init(SSL *s, unsigned char key_name[16], unsigned char *iv,
+                           EVP_CIPHER_CTX *ectx, int enc, pni_ticket_key_t *found)
+{
+  pn_transport_t *transport = (pn_transport_t *) SSL_get_ex_data(s, ssl_ex_data_index);
+  pn_ssl_domain_t *domain = transport->ssl->domain;
+  time_t now = time(NULL);
+  pni_ticket_key_t key;
+  int result = 0;
+
+  TICKET_LOCK(domain);
+  pni_ticket_key_t *keys = domain->ticket_keys;
+  time_t lifetime = domain->ticket_lifetime;
+  if (!keys[0].valid || now - keys[0].created >= lifetime) {
+    ticket_key_rotate(domain, now);
+    // tickets made with a key retired for a whole lifetime are refused
+    if (keys[1].valid && now - keys[1].created >= 2 * lifetime) keys[1].valid = false;
+  }
+  if (enc) {
+    if (keys[0].valid) {
+      key = keys[0];
+      result = 1;
+      domain->tickets_issued++;
+    } else {
+      result = -1;
+    }
+  } else {
+    for (int i = 0; i < 2 && !result; ++i) {
+      if (keys[i].valid && memcmp(key_name, keys[i].name, sizeof(keys[i].name)) == 0) {
+        key = keys[i];
+        result = i ? 2 : 1;
+      }
+    }
+    if (result) {
+      domain->tickets_accepted++;
+    } else {
+      domain->tickets_rejected++;
+    }
+  }
+  TICKET_UNLOCK(domain);
+  if (result <= 0) return result;
+
+  if (enc) {
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1 ||
+        !EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv)) {
+      result = -1;
+    }
+    memcpy(key_name, key.name, sizeof(key.name));
+  } else if (!EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv)) {
+    result = -1;
+  }
+  *found = key;
+  OPENSSL_cleanse(&key, sizeof(key));
+  return result;
+}
+
+// Called by OpenSSL for session tickets, see ticket_key_init()
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int ticket_key_cb(SSL *s, unsigned char key_name[16], unsigned char *iv,
+                         EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *mctx, int enc)
+{
+  pni_ticket_key_t key;
+  int result = ticket_key_init(s, key_name, iv, ectx, enc, &key);
+  if (result > 0) {
+    OSSL_PARAM params[2];
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0);
+    params[1] = OSSL_PARAM_construct_end();
+    if (!EVP_MAC_init(mctx, key.hmac_key, sizeof(key.hmac_key), params)) result = -1;
+  }
+  OPENSSL_cleanse(&key, sizeof(key));
+  return result;
+}
+#else
+static int ticket_key_cb(SSL *s, unsigned char key_name[16], unsigned char *iv,
+                         EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc)
+{
+  pni_ticket_key_t key;
+  int result = ticket_key_init(s, key_name, iv, ectx, enc, &key);
+  if (result > 0 && !HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL)) {
+    result = -1;
+  }
+  OPENSSL_cleanse(&key, sizeof(key));
+  return result;
+}
+#endif
+
+int pn_ssl_domain_set_session_tickets(pn_ssl_domain_t *domain, bool enable, uint32_t key_lifetime)
+{
+  if (!domain) return -1;
+  if (domain->mode != PN_SSL_MODE_SERVER) {
+    pn_transport_logf(NULL, "Cannot configure session tickets - not a server.");
+    return -1;
+  }
+  if (!enable) {
+    SSL_CTX_set_options(domain->ctx, SSL_OP_NO_TICKET);
+    return 0;
+  }
+  SSL_CTX_clear_options(domain->ctx, SSL_OP_NO_TICKET);
+  TICKET_LOCK(domain);
+  domain->ticket_lifetime = key_lifetime;
+  TICKET_UNLOCK(domain);
+  if (key_lifetime) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(domain->ctx, &ticket_key_cb);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(domain->ctx, &ticket_key_cb);
+#endif
+  } else {
+    // OpenSSL's own key
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(domain->ctx, NULL);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(domain->ctx, NULL);
+#endif
+  }
+  return 0;
+}
+
+int pn_ssl_domain_get_resume_stats(pn_ssl_domain_t *domain, pn_ssl_resume_stats_t *stats)
+{
+  if (!domain || !stats || domain->mode != PN_SSL_MODE_SERVER) return -1;
+  stats->handshakes = SSL_CTX_sess_accept_good(domain->ctx);
+  stats->resumed = SSL_CTX_sess_hits(domain->ctx);
+  stats->misses = SSL_CTX_sess_misses(domain->ctx);
+  stats->timeouts = SSL_CTX_sess_timeouts(domain->ctx);
+  stats->cache_full = SSL_CTX_sess_cache_full(domain->ctx);
+  stats->cached = SSL_CTX_sess_number(domain->ctx);
+  TICKET_LOCK(domain);
+  stats->tickets_issued = domain->tickets_issued;
+  stats->tickets_accepted = domain->tickets_accepted;
+  stats->tickets_rejected = domain->tickets_rejected;
+  TICKET_UNLOCK(domain);
+  return 0;
+}
+
+void pn_ssl_set_socket(pn_transport_t *transport, pn_socket_t socket)
+{
+  if (transport) transport->socket = socket;
+}
+
+bool pn_ssl_get_kernel_tls(pn_ssl_t *ssl0)
+{
+  pni_ssl_t *ssl = get_ssl_internal(ssl0);
+  return ssl && ssl->ktls;
+}
+
 int pn_ssl_get_ssf(pn_ssl_t *ssl0)
 {
   const SSL_CIPHER *c;
@@ -799,15 +1095,10 @@ pn_ssl_t *pn_ssl(pn_transport_t *transport)
   if (!ssl) return NULL;
   ssl->out_size = APP_BUF_SIZE;
   uint32_t max_frame = pn_transport_get_max_frame(transport);
-  ssl->in_size =  max_frame ? max_frame : APP_BUF_SIZE;
-  ssl->outbuf = (char *)malloc(ssl->out_size);
-  if (!ssl->outbuf) {
-    free(ssl);
-    return NULL;
-  }
+  // never less than a record, so SSL can always decrypt straight into inbuf
+  ssl->in_size = pn_max(max_frame, APP_BUF_SIZE);
   ssl->inbuf =  (char *)malloc(ssl->in_size);
   if (!ssl->inbuf) {
-    free(ssl->outbuf);
     free(ssl);
     return NULL;
   }
@@ -851,7 +1142,8 @@ static int start_ssl_shutdown(pn_transport_t *transport)
       }
     }
     ssl->ssl_shutdown = true;
-    BIO_ssl_shutdown( ssl->bio_ssl );
+    // with kernel TLS the close_notify is sent once the output is flushed
+    if (!ssl->ktls) SSL_shutdown( ssl->ssl );
   }
   return 0;
 }
@@ -860,6 +1152,34 @@ static int start_ssl_shutdown(pn_transport_t *transport)
 //////// SSL Connections
 
 
+// After an SSL_read() or SSL_write() returned ret <= 0, note what SSL is waiting
+// for.  Returns PN_EOS if SSL has failed, else 0.
+static ssize_t ssl_io_blocked(pn_transport_t *transport, int ret)
+{
+  pni_ssl_t *ssl = transport->ssl;
+  switch (SSL_get_error( ssl->ssl, ret )) {
+  case SSL_ERROR_ZERO_RETURN:
+    // SSL closed cleanly
+    ssl_log(transport, "SSL connection has closed");
+    start_ssl_shutdown(transport);  // KAG: not sure - this may not be necessary
+    ssl->ssl_closed = true;
+    return 0;
+  case SSL_ERROR_WANT_READ:
+    ssl->read_blocked = true;
+    ssl_log(transport, "Detected read-blocked");
+    return 0;
+  case SSL_ERROR_WANT_WRITE:
+    ssl->write_blocked = true;
+    ssl_log(transport, "Detected write-blocked");
+    return 0;
+  case SSL_ERROR_WANT_X509_LOOKUP:
+    return 0;
+  default:
+    // unexpected error
+    return (ssize_t)ssl_failed(transport);
+  }
+}
+
 // take data from the network, and pass it into SSL.  Attempt to read decrypted data from
 // SSL socket and pass it to the application.
 static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer, const char *input_data, size_t available)
@@ -876,10 +1196,12 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
   do {
     work_pending = false;
 
-    // Write to network bio as much as possible, consuming bytes/available
+    // Write to network bio as much as SSL can use, consuming bytes/available
 
     if (available > 0) {
-      int written = BIO_write( ssl->bio_net_io, input_data, available );
+      size_t pending = BIO_ctrl_pending( ssl->bio_net_in );
+      size_t room = pending < NET_BUF_SIZE ? NET_BUF_SIZE - pending : 0;
+      int written = room ? BIO_write( ssl->bio_net_in, input_data, pn_min(available, room) ) : 0;
       if (written > 0) {
         input_data += written;
         available -= written;
@@ -889,45 +1211,32 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
         ssl_log( transport, "Wrote %d bytes to BIO Layer, %d left over", written, available );
       }
     } else if (shutdown_input) {
-      // lower layer (caller) has closed.  Close the WRITE side of the BIO.  This will cause
+      // lower layer (caller) has closed.  Make the network BIO report EOF. This will cause
       // an EOF to be passed to SSL once all pending inbound data has been consumed.
       ssl_log( transport, "Lower layer closed - shutting down BIO write side");
-      (void)BIO_shutdown_wr( ssl->bio_net_io );
+      BIO_set_mem_eof_return( ssl->bio_net_in, 0 );
       shutdown_input = false;
     }
 
-    // Read all available data from the SSL socket
-
-    if (!ssl->ssl_closed && ssl->in_count < ssl->in_size) {
-      int read = BIO_read( ssl->bio_ssl, &ssl->inbuf[ssl->in_count], ssl->in_size - ssl->in_count );
-      if (read > 0) {
-        ssl_log( transport, "Read %d bytes from SSL socket for app", read );
-        ssl_log_clear_data(transport, &ssl->inbuf[ssl->in_count], read );
-        ssl->in_count += read;
-        work_pending = true;
-      } else {
-        if (!BIO_should_retry(ssl->bio_ssl)) {
-          int reason = SSL_get_error( ssl->ssl, read );
-          switch (reason) {
-          case SSL_ERROR_ZERO_RETURN:
-            // SSL closed cleanly
-            ssl_log(transport, "SSL connection has closed");
-            start_ssl_shutdown(transport);  // KAG: not sure - this may not be necessary
-            ssl->ssl_closed = true;
-            break;
-          default:
-            // unexpected error
-            return (ssize_t)ssl_failed(transport);
-          }
-        } else {
-          if (BIO_should_write( ssl->bio_ssl )) {
-            ssl->write_blocked = true;
-            ssl_log(transport, "Detected write-blocked");
-          }
-          if (BIO_should_read( ssl->bio_ssl )) {
-            ssl->read_blocked = true;
-            ssl_log(transport, "Detected read-blocked");
-          }
+    // Read all available data from the SSL socket, a whole record at a time
+
+    if (!ssl->ssl_closed) {
+      if (ssl->in_start && ssl->in_size - ssl->in_start - ssl->in_count < APP_BUF_SIZE) {
+        // not enough room left for a record: move the unconsumed input back
+        memmove( ssl->inbuf, ssl->inbuf + ssl->in_start, ssl->in_count );
+        ssl->in_start = 0;
+      }
+      size_t room = ssl->in_size - ssl->in_start - ssl->in_count;
+      if (room > 0) {
+        char *end = &ssl->inbuf[ssl->in_start + ssl->in_count];
+        int read = SSL_read( ssl->ssl, end, room );
+        if (read > 0) {
+          ssl_log( transport, "Read %d bytes from SSL socket for app", read );
+          ssl_log_clear_data(transport, end, read );
+          ssl->in_count += read;
+          work_pending = true;
+        } else if (ssl_io_blocked(transport, read)) {
+          return PN_EOS;
         }
       }
     }
@@ -936,17 +1245,17 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
 
     if (!ssl->app_input_closed) {
       if (ssl->in_count > 0 || ssl->ssl_closed) {  /* if ssl_closed, send 0 count */
-        ssize_t consumed = transport->io_layers[layer+1]->process_input(transport, layer+1, ssl->inbuf, ssl->in_count);
+        ssize_t consumed = transport->io_layers[layer+1]->process_input(transport, layer+1, ssl->inbuf + ssl->in_start, ssl->in_count);
         if (consumed > 0) {
           ssl->in_count -= consumed;
-          if (ssl->in_count)
-            memmove( ssl->inbuf, ssl->inbuf + consumed, ssl->in_count );
+          ssl->in_start = ssl->in_count ? ssl->in_start + consumed : 0;
           work_pending = true;
           ssl_log( transport, "Application consumed %d bytes from peer", (int) consumed );
         } else if (consumed < 0) {
           ssl_log(transport, "Application layer closed its input, error=%d (discarding %d bytes)",
                (int) consumed, (int)ssl->in_count);
           ssl->in_count = 0;    // discard any pending input
+          ssl->in_start = 0;
           ssl->app_input_closed = consumed;
           if (ssl->app_output_closed && ssl->out_count == 0) {
             // both sides of app closed, and no more app output pending:
@@ -954,27 +1263,34 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
           }
         } else {
           // app did not consume any bytes, must be waiting for a full frame
-          if (ssl->in_count == ssl->in_size) {
-            // but the buffer is full, not enough room for a full frame.
-            // can we grow the buffer?
-            uint32_t max_frame = pn_transport_get_max_frame(transport);
-            if (!max_frame) max_frame = ssl->in_size * 2;  // no limit
-            if (ssl->in_size < max_frame) {
-              // no max frame limit - grow it.
-              size_t newsize = pn_min(max_frame, ssl->in_size * 2);
-              char *newbuf = (char *)realloc( ssl->inbuf, newsize );
-              if (newbuf) {
-                ssl->in_size = newsize;
-                ssl->inbuf = newbuf;
-                work_pending = true;  // can we get more input?
-              }
+          if (ssl->in_start + ssl->in_count == ssl->in_size) {
+            if (ssl->in_start) {
+              // make room by moving the partial frame to the front
+              memmove( ssl->inbuf, ssl->inbuf + ssl->in_start, ssl->in_count );
+              ssl->in_start = 0;
+              work_pending = true;
             } else {
-              // can't gather any more input, but app needs more?
-              // This is a bug - since SSL can buffer up to max-frame,
-              // the application _must_ have enough data to process.  If
-              // this is an oversized frame, the app _must_ handle it
-              // by returning an error code to SSL.
-              pn_transport_log(transport, "Error: application unable to consume input.");
+              // but the buffer is full, not enough room for a full frame.
+              // can we grow the buffer?
+              uint32_t max_frame = pn_transport_get_max_frame(transport);
+              if (!max_frame) max_frame = ssl->in_size * 2;  // no limit
+              if (ssl->in_size < max_frame) {
+                // no max frame limit - grow it.
+                size_t newsize = pn_min(max_frame, ssl->in_size * 2);
+                char *newbuf = (char *)realloc( ssl->inbuf, newsize );
+                if (newbuf) {
+                  ssl->in_size = newsize;
+                  ssl->inbuf = newbuf;
+                  work_pending = true;  // can we get more input?
+                }
+              } else {
+                // can't gather any more input, but app needs more?
+                // This is a bug - since SSL can buffer up to max-frame,
+                // the application _must_ have enough data to process.  If
+                // this is an oversized frame, the app _must_ handle it
+                // by returning an error code to SSL.
+                pn_transport_log(transport, "Error: application unable to consume input.");
+              }
             }
           }
         }
@@ -1019,81 +1335,101 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
   if (!ssl) return PN_EOS;
   if (ssl->ssl == NULL && init_ssl_socket(transport, ssl)) return PN_EOS;
 
+#ifdef PNI_KTLS
+  if (ssl->ktls) return process_output_ktls(transport, layer, buffer, max_len);
+  if (ssl->ktls_pending && !ssl->ssl_closed) {
+    // application output waits for the handshake, the kernel may encrypt it
+    if (!SSL_is_init_finished(ssl->ssl)) {
+      int ret = SSL_do_handshake(ssl->ssl);
+      if (ret <= 0 && ssl_io_blocked(transport, ret)) return PN_EOS;
+    }
+    if (SSL_is_init_finished(ssl->ssl) && BIO_ctrl_pending(ssl->bio_net_out) == 0 &&
+        transport->output_pending == 0) {
+      // the whole handshake has been written to the socket
+      ssl->ktls_pending = false;
+      ssl->ktls = ktls_start(transport);
+      if (ssl->ktls) return process_output_ktls(transport, layer, buffer, max_len);
+    }
+  }
+#endif
+
   ssize_t written = 0;
   bool work_pending;
 
   do {
     work_pending = false;
-    // first, get any pending application output, if possible
-
-    if (!ssl->app_output_closed && ssl->out_count < ssl->out_size) {
-      ssize_t app_bytes = transport->io_layers[layer+1]->process_output(transport, layer+1, &ssl->outbuf[ssl->out_count], ssl->out_size - ssl->out_count);
-      if (app_bytes > 0) {
-        ssl->out_count += app_bytes;
-        work_pending = true;
-        ssl_log(transport, "Gathered %d bytes from app to send to peer", app_bytes );
-      } else {
-        if (app_bytes < 0) {
-          ssl_log(transport, "Application layer closed its output, error=%d (%d bytes pending send)",
-               (int) app_bytes, (int) ssl->out_count);
-          ssl->app_output_closed = app_bytes;
-        }
-      }
-    }
-
-    // now push any pending app data into the socket
 
-    if (!ssl->ssl_closed) {
-      char *data = ssl->outbuf;
-      if (ssl->out_count > 0) {
-        int wrote = BIO_write( ssl->bio_ssl, data, ssl->out_count );
+    // only encrypt more application output while the network side can take
+    // what is already waiting, so at most about a record is held back here
+    bool room = !ssl->ktls_pending && BIO_ctrl_pending( ssl->bio_net_out ) < max_len;
+    ssize_t app_bytes;
+    pn_bytes_t frames;
+
+    if (room && !ssl->ssl_closed && !ssl->app_output_closed && ssl->out_count == 0 &&
+        pni_transport_amqp_output(transport, layer+1, &app_bytes, &frames)) {
+      // AMQP frames go straight from the transport's output queue into SSL,
+      // a record at a time
+      if (app_bytes < 0) {
+        ssl_log(transport, "Application layer closed its output, error=%d", (int) app_bytes);
+        ssl->app_output_closed = app_bytes;
+      } else if (frames.size > 0) {
+        int wrote = SSL_write( ssl->ssl, frames.start, pn_min(frames.size, APP_BUF_SIZE) );
         if (wrote > 0) {
-          data += wrote;
-          ssl->out_count -= wrote;
+          pni_transport_amqp_output_done(transport, wrote);
           work_pending = true;
           ssl_log( transport, "Wrote %d bytes from app to socket", wrote );
+        } else if (ssl_io_blocked(transport, wrote)) {
+          return PN_EOS;
+        }
+      }
+    } else if (room) {
+      // otherwise gather any pending application output, if possible
+
+      if (!ssl->app_output_closed && ssl->out_count < ssl->out_size) {
+        if (!ssl->outbuf) {
+          ssl->outbuf = (char *)malloc(ssl->out_size);
+          if (!ssl->outbuf) return PN_EOS;
+        }
+        app_bytes = transport->io_layers[layer+1]->process_output(transport, layer+1, &ssl->outbuf[ssl->out_count], ssl->out_size - ssl->out_count);
+        if (app_bytes > 0) {
+          ssl->out_count += app_bytes;
+          work_pending = true;
+          ssl_log(transport, "Gathered %d bytes from app to send to peer", app_bytes );
         } else {
-          if (!BIO_should_retry(ssl->bio_ssl)) {
-            int reason = SSL_get_error( ssl->ssl, wrote );
-            switch (reason) {
-            case SSL_ERROR_ZERO_RETURN:
-              // SSL closed cleanly
-              ssl_log(transport, "SSL connection has closed");
-              start_ssl_shutdown(transport); // KAG: not sure - this may not be necessary
-              ssl->out_count = 0;      // can no longer write to socket, so erase app output data
-              ssl->ssl_closed = true;
-              break;
-            default:
-              // unexpected error
-              return (ssize_t)ssl_failed(transport);
-            }
-          } else {
-            if (BIO_should_read( ssl->bio_ssl )) {
-              ssl->read_blocked = true;
-              ssl_log(transport, "Detected read-blocked");
-            }
-            if (BIO_should_write( ssl->bio_ssl )) {
-              ssl->write_blocked = true;
-              ssl_log(transport, "Detected write-blocked");
-            }
+          if (app_bytes < 0) {
+            ssl_log(transport, "Application layer closed its output, error=%d (%d bytes pending send)",
+                 (int) app_bytes, (int) ssl->out_count);
+            ssl->app_output_closed = app_bytes;
           }
         }
       }
 
-      if (ssl->out_count == 0) {
-        if (ssl->app_input_closed && ssl->app_output_closed) {
-          // application is done sending/receiving data, and all buffered output data has
-          // been written to the SSL socket
-          start_ssl_shutdown(transport);
+      // now push any pending app data into the socket
+
+      if (!ssl->ssl_closed && ssl->out_count > 0) {
+        int wrote = SSL_write( ssl->ssl, ssl->outbuf, ssl->out_count );
+        if (wrote > 0) {
+          ssl->out_count -= wrote;
+          if (ssl->out_count) memmove( ssl->outbuf, ssl->outbuf + wrote, ssl->out_count );
+          work_pending = true;
+          ssl_log( transport, "Wrote %d bytes from app to socket", wrote );
+        } else if (ssl_io_blocked(transport, wrote)) {
+          return PN_EOS;
+        } else if (ssl->ssl_closed) {
+          ssl->out_count = 0;      // can no longer write to socket, so erase app output data
         }
-      } else if (data != ssl->outbuf) {
-        memmove( ssl->outbuf, data, ssl->out_count );
       }
     }
 
+    if (!ssl->ssl_closed && ssl->out_count == 0 && ssl->app_input_closed && ssl->app_output_closed) {
+      // application is done sending/receiving data, and all buffered output data has
+      // been written to the SSL socket
+      start_ssl_shutdown(transport);
+    }
+
     // read from the network bio as much as possible, filling the buffer
     if (max_len) {
-      int available = BIO_read( ssl->bio_net_io, buffer, max_len );
+      int available = BIO_read( ssl->bio_net_out, buffer, max_len );
       if (available > 0) {
         max_len -= available;
         buffer += available;
@@ -1107,17 +1443,17 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
   } while (work_pending);
 
   //_log(ssl, "written=%d ssl_closed=%d in_count=%d app_input_closed=%d app_output_closed=%d bio_pend=%d",
-  //     written, ssl->ssl_closed, ssl->in_count, ssl->app_input_closed, ssl->app_output_closed, BIO_pending(ssl->bio_net_io) );
+  //     written, ssl->ssl_closed, ssl->in_count, ssl->app_input_closed, ssl->app_output_closed, BIO_pending(ssl->bio_net_out) );
 
   // PROTON-82: close the output side as soon as we've sent the SSL close_notify.
   // We're not requiring the response, as some implementations never reply.
   // ----
   // Once no more data is available "below" the SSL socket, tell the transport we are
   // done.
-  //if (written == 0 && ssl->ssl_closed && BIO_pending(ssl->bio_net_io) == 0) {
+  //if (written == 0 && ssl->ssl_closed && BIO_pending(ssl->bio_net_out) == 0) {
   //  written = ssl->app_output_closed ? ssl->app_output_closed : PN_EOS;
   //}
-  if (written == 0 && (SSL_get_shutdown(ssl->ssl) & SSL_SENT_SHUTDOWN) && BIO_pending(ssl->bio_net_io) == 0) {
+  if (written == 0 && (SSL_get_shutdown(ssl->ssl) & SSL_SENT_SHUTDOWN) && BIO_pending(ssl->bio_net_out) == 0) {
     written = ssl->app_output_closed ? ssl->app_output_closed : PN_EOS;
     if (transport->io_layers[layer]==&ssl_input_closed_layer) {
       transport->io_layers[layer] = &ssl_closed_layer;
@@ -1129,6 +1465,168 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
   return written;
 }
 
+#ifdef PNI_KTLS
+
+// Install the write keys of a finished TLS 1.2 handshake in the socket.
+// OpenSSL 1.1 does not expose them, so the key block is derived again from
+// the master secret (RFC 5246 section 6.3).  Returns false if the socket,
+// the kernel or the cipher does not allow it.
+static bool ktls_start(pn_transport_t *transport)
+{
+  pni_ssl_t *ssl = transport->ssl;
+  const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl->ssl);
+  SSL_SESSION *session = SSL_get_session(ssl->ssl);
+  if (transport->socket == PN_INVALID_SOCKET) {
+    ssl_log(transport, "Kernel TLS not used: no socket");
+    return false;
+  }
+  if (!cipher || !session || SSL_version(ssl->ssl) != TLS1_2_VERSION) {
+    ssl_log(transport, "Kernel TLS not used: not TLS 1.2");
+    return false;
+  }
+  size_t key_len;
+  switch (SSL_CIPHER_get_cipher_nid(cipher)) {
+  case NID_aes_128_gcm: key_len = TLS_CIPHER_AES_GCM_128_KEY_SIZE; break;
+  case NID_aes_256_gcm: key_len = TLS_CIPHER_AES_GCM_256_KEY_SIZE; break;
+  default:
+    ssl_log(transport, "Kernel TLS not used: cipher %s", SSL_CIPHER_get_name(cipher));
+    return false;
+  }
+
+  // key block: client key, server key, client salt, server salt
+  unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+  unsigned char seed[2 * SSL3_RANDOM_SIZE];
+  unsigned char block[2 * TLS_CIPHER_AES_GCM_256_KEY_SIZE + 2 * TLS_CIPHER_AES_GCM_256_SALT_SIZE];
+  size_t salt_len = TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+  size_t block_len = 2 * key_len + 2 * salt_len;
+  size_t master_len = SSL_SESSION_get_master_key(session, master, sizeof(master));
+  SSL_get_server_random(ssl->ssl, seed, SSL3_RANDOM_SIZE);
+  SSL_get_client_random(ssl->ssl, seed + SSL3_RANDOM_SIZE, SSL3_RANDOM_SIZE);
+
+  bool ok = false;
+  EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, NULL);
+  if (pctx && EVP_PKEY_derive_init(pctx) > 0 &&
+      EVP_PKEY_CTX_set_tls1_prf_md(pctx, SSL_CIPHER_get_handshake_digest(cipher)) > 0 &&
+      EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, master, master_len) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, (const unsigned char *) "key expansion", 13) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, seed, sizeof(seed)) > 0 &&
+      EVP_PKEY_derive(pctx, block, &block_len) > 0) {
+    bool server = ssl->domain->mode == PN_SSL_MODE_SERVER;
+    const unsigned char *key = block + (server ? key_len : 0);
+    const unsigned char *salt = block + 2 * key_len + (server ? salt_len : 0);
+    // the Finished message was record 0, and GCM nonces follow the record number
+    const unsigned char seq[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    union {
+      struct tls12_crypto_info_aes_gcm_128 gcm_128;
+      struct tls12_crypto_info_aes_gcm_256 gcm_256;
+    } info;
+    socklen_t info_len;
+    memset(&info, 0, sizeof(info));
+    if (key_len == TLS_CIPHER_AES_GCM_128_KEY_SIZE) {
+      info.gcm_128.info.version = TLS_1_2_VERSION;
+      info.gcm_128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+      memcpy(info.gcm_128.key, key, key_len);
+      memcpy(info.gcm_128.salt, salt, salt_len);
+      memcpy(info.gcm_128.iv, seq, sizeof(seq));
+      memcpy(info.gcm_128.rec_seq, seq, sizeof(seq));
+      info_len = sizeof(info.gcm_128);
+    } else {
+      info.gcm_256.info.version = TLS_1_2_VERSION;
+      info.gcm_256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+      memcpy(info.gcm_256.key, key, key_len);
+      memcpy(info.gcm_256.salt, salt, salt_len);
+      memcpy(info.gcm_256.iv, seq, sizeof(seq));
+      memcpy(info.gcm_256.rec_seq, seq, sizeof(seq));
+      info_len = sizeof(info.gcm_256);
+    }
+    ok = setsockopt(transport->socket, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 &&
+      setsockopt(transport->socket, SOL_TLS, TLS_TX, &info, info_len) == 0;
+    if (!ok) {
+      ssl_log(transport, "Kernel TLS not used: %s", strerror(errno));
+    }
+    OPENSSL_cleanse(&info, sizeof(info));
+  } else {
+    ssl_log_flush(transport);
+  }
+  EVP_PKEY_CTX_free(pctx);
+  OPENSSL_cleanse(master, sizeof(master));
+  OPENSSL_cleanse(block, sizeof(block));
+  if (ok) ssl_log(transport, "Kernel TLS enabled, cipher %s", SSL_CIPHER_get_name(cipher));
+  return ok;
+}
+
+// Send close_notify as a TLS alert record encrypted by the kernel.
+static void ktls_close_notify(pn_transport_t *transport)
+{
+  unsigned char alert[2] = { SSL3_AL_WARNING, SSL3_AD_CLOSE_NOTIFY };
+  char control[CMSG_SPACE(sizeof(unsigned char))];
+  struct iovec iov = { alert, sizeof(alert) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_TLS;
+  cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+  *CMSG_DATA(cmsg) = SSL3_RT_ALERT;
+  if (sendmsg(transport->socket, &msg, MSG_NOSIGNAL) != (ssize_t) sizeof(alert)) {
+    ssl_log(transport, "Unable to send close_notify: %s", strerror(errno));
+  }
+  SSL *s = transport->ssl->ssl;
+  SSL_set_shutdown(s, SSL_get_shutdown(s) | SSL_SENT_SHUTDOWN);
+}
+
+// Once the kernel encrypts, the application's output is passed through as
+// it is.  SSL still decrypts the input and keeps the shutdown state.
+static ssize_t process_output_ktls(pn_transport_t *transport, unsigned int layer, char *buffer, size_t max_len)
+{
+  pni_ssl_t *ssl = transport->ssl;
+  size_t stale = BIO_ctrl_pending(ssl->bio_net_out);
+  if (stale) {
+    // e.g. an alert from SSL_read(). OpenSSL encrypted it with the write
+    // state the kernel took over, so sending it would repeat record numbers
+    // and nonces: it can't be sent and the connection can't go on.
+    (void) BIO_reset(ssl->bio_net_out);
+    if (!ssl->ssl_closed) {
+      ssl_log(transport, "%d bytes of SSL output after the kernel took over", (int) stale);
+      ssl_failed(transport);
+    }
+  }
+
+  ssize_t written = 0;
+  if (!ssl->app_output_closed && !ssl->ssl_shutdown) {
+    written = transport->io_layers[layer+1]->process_output(transport, layer+1, buffer, max_len);
+    if (written < 0) {
+      ssl_log(transport, "Application layer closed its output, error=%d", (int) written);
+      ssl->app_output_closed = written;
+      written = 0;
+    }
+  }
+  if (!ssl->ssl_closed && ssl->app_input_closed && ssl->app_output_closed) {
+    start_ssl_shutdown(transport);
+  }
+
+  if (written == 0 && (ssl->ssl_shutdown || ssl->ssl_closed) && transport->output_pending == 0) {
+    // everything before it has been written to the socket
+    if (!(SSL_get_shutdown(ssl->ssl) & SSL_SENT_SHUTDOWN)) {
+      ktls_close_notify(transport);
+    }
+    written = ssl->app_output_closed ? ssl->app_output_closed : PN_EOS;
+    if (transport->io_layers[layer]==&ssl_input_closed_layer) {
+      transport->io_layers[layer] = &ssl_closed_layer;
+    } else {
+      transport->io_layers[layer] = &ssl_output_closed_layer;
+    }
+  }
+  return written;
+}
+
+#endif
+
 static int init_ssl_socket(pn_transport_t* transport, pni_ssl_t *ssl)
 {
   if (ssl->ssl) return 0;
@@ -1140,9 +1638,15 @@ static int init_ssl_socket(pn_transport_t* transport, pni_ssl_t *ssl)
     return -1;
   }
 
+  ssl->ktls_pending = ssl->domain->kernel_tls;
+
   // store backpointer to pn_transport_t in SSL object:
   SSL_set_ex_data(ssl->ssl, ssl_ex_data_index, transport);
 
+  // AMQP frames are encrypted where they are queued, which may move
+  // between an incomplete SSL_write() and its retry.
+  SSL_set_mode(ssl->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
   if (ssl->peer_hostname && ssl->domain->mode == PN_SSL_MODE_CLIENT) {
     SSL_set_tlsext_host_name(ssl->ssl, ssl->peer_hostname);
@@ -1161,28 +1665,26 @@ static int init_ssl_socket(pn_transport_t* transport, pni_ssl_t *ssl)
     }
   }
 
-  // now layer a BIO over the SSL socket
-  ssl->bio_ssl = BIO_new(BIO_f_ssl());
-  if (!ssl->bio_ssl) {
-    pn_transport_log(transport, "BIO setup failure." );
-    return -1;
-  }
-  (void)BIO_set_ssl(ssl->bio_ssl, ssl->ssl, BIO_NOCLOSE);
-
-  // create the "lower" BIO "pipe", and attach it below the SSL layer
-  if (!BIO_new_bio_pair(&ssl->bio_ssl_io, 0, &ssl->bio_net_io, 0)) {
+  // SSL reads from and writes to memory BIOs, which the transport fills
+  // and drains directly: no BIO pair or SSL BIO sits in between.
+  ssl->bio_net_in = BIO_new(BIO_s_mem());
+  ssl->bio_net_out = BIO_new(BIO_s_mem());
+  if (!ssl->bio_net_in || !ssl->bio_net_out) {
     pn_transport_log(transport, "BIO setup failure." );
+    if (ssl->bio_net_in) BIO_free(ssl->bio_net_in);
+    if (ssl->bio_net_out) BIO_free(ssl->bio_net_out);
+    ssl->bio_net_in = ssl->bio_net_out = NULL;
     return -1;
   }
-  SSL_set_bio(ssl->ssl, ssl->bio_ssl_io, ssl->bio_ssl_io);
+  // an empty input BIO means "more to come" until the network closes
+  BIO_set_mem_eof_return(ssl->bio_net_in, -1);
+  SSL_set_bio(ssl->ssl, ssl->bio_net_in, ssl->bio_net_out);
 
   if (ssl->domain->mode == PN_SSL_MODE_SERVER) {
     SSL_set_accept_state(ssl->ssl);
-    BIO_set_ssl_mode(ssl->bio_ssl, 0);  // server mode
     ssl_log( transport, "Server SSL socket created." );
   } else {      // client mode
     SSL_set_connect_state(ssl->ssl);
-    BIO_set_ssl_mode(ssl->bio_ssl, 1);  // client mode
     ssl_log( transport, "Client SSL socket created." );
   }
   ssl->subject = NULL;
@@ -1192,16 +1694,14 @@ static int init_ssl_socket(pn_transport_t* transport, pni_ssl_t *ssl)
 
 static void release_ssl_socket(pni_ssl_t *ssl)
 {
-  if (ssl->bio_ssl) BIO_free(ssl->bio_ssl);
   if (ssl->ssl) {
-      SSL_free(ssl->ssl);       // will free bio_ssl_io
+    SSL_free(ssl->ssl);       // will free the BIOs once they are set
   } else {
-    if (ssl->bio_ssl_io) BIO_free(ssl->bio_ssl_io);
+    if (ssl->bio_net_in) BIO_free(ssl->bio_net_in);
+    if (ssl->bio_net_out) BIO_free(ssl->bio_net_out);
   }
-  if (ssl->bio_net_io) BIO_free(ssl->bio_net_io);
-  ssl->bio_ssl = NULL;
-  ssl->bio_ssl_io = NULL;
-  ssl->bio_net_io = NULL;
+  ssl->bio_net_in = NULL;
+  ssl->bio_net_out = NULL;
   ssl->ssl = NULL;
 }
 
@@ -1426,8 +1926,8 @@ static size_t buffered_output(pn_transport_t *transport)
   pni_ssl_t *ssl = transport->ssl;
   if (ssl) {
     count += ssl->out_count;
-    if (ssl->bio_net_io) { // pick up any bytes waiting for network io
-      count += BIO_ctrl_pending(ssl->bio_net_io);
+    if (ssl->bio_net_out && !ssl->ktls) { // pick up any bytes waiting for network io
+      count += BIO_ctrl_pending(ssl->bio_net_out);
     }
   }
   return count;
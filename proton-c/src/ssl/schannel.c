@@ -38,6 +38,7 @@
 #include "platform/platform.h"
 #include "core/util.h"
 #include "core/autodetect.h"
+#include "ssl/ssl-internal.h"
 
 #include <assert.h>
 
@@ -649,6 +650,31 @@ int pn_ssl_domain_allow_unsecured_client(pn_ssl_domain_t *domain)
   return 0;
 }
 
+int pn_ssl_domain_enable_kernel_tls(pn_ssl_domain_t *domain)
+{
+  // kernel TLS is Linux only
+  return -1;
+}
+
+void pn_ssl_set_socket(pn_transport_t *transport, pn_socket_t socket)
+{
+}
+
+int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, uint32_t timeout)
+{
+  return -1;
+}
+
+int pn_ssl_domain_set_session_tickets(pn_ssl_domain_t *domain, bool enable, uint32_t key_lifetime)
+{
+  return -1;
+}
+
+int pn_ssl_domain_get_resume_stats(pn_ssl_domain_t *domain, pn_ssl_resume_stats_t *stats)
+{
+  return -1;
+}
+
 
 // TODO: This is just an untested guess
 int pn_ssl_get_ssf(pn_ssl_t *ssl0)
@@ -789,6 +815,11 @@ pn_ssl_resume_status_t pn_ssl_resume_status( pn_ssl_t *ssl )
   return PN_SSL_RESUME_UNKNOWN;
 }
 
+bool pn_ssl_get_kernel_tls(pn_ssl_t *ssl)
+{
+  return false;
+}
+
 
 int pn_ssl_set_peer_hostname( pn_ssl_t *ssl0, const char *hostname )
 {
@@ -21,6 +21,7 @@
  *
  */
 
+#include "proton/selectable.h"
 #include "proton/ssl.h"
 
 /** @file
@@ -33,4 +34,8 @@
 // release the SSL context
 void pn_ssl_free(pn_transport_t *transport);
 
+// Tell a transport which socket its output is written to, for kernel TLS.
+// The transport never does I/O on it otherwise. Exported for the proactor.
+PN_EXTERN void pn_ssl_set_socket(pn_transport_t *transport, pn_socket_t socket);
+
 #endif /* ssl-internal.h */
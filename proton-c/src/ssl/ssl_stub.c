@@ -23,6 +23,7 @@
 #include <proton/error.h>
 #include <proton/transport.h>
 #include "core/engine-internal.h"
+#include "ssl/ssl-internal.h"
 
 
 /** @file
@@ -48,7 +49,7 @@ int pn_ssl_init(pn_ssl_t *ssl, pn_ssl_domain_t *domain,
   return -1;
 }
 
-void pn_ssl_free( pn_ssl_t *ssl)
+void pn_ssl_free(pn_transport_t *transport)
 {
 }
 
@@ -118,6 +119,35 @@ int pn_ssl_domain_allow_unsecured_client(pn_ssl_domain_t *domain)
   return -1;
 }
 
+int pn_ssl_domain_enable_kernel_tls(pn_ssl_domain_t *domain)
+{
+  return -1;
+}
+
+void pn_ssl_set_socket(pn_transport_t *transport, pn_socket_t socket)
+{
+}
+
+int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, uint32_t timeout)
+{
+  return -1;
+}
+
+int pn_ssl_domain_set_session_tickets(pn_ssl_domain_t *domain, bool enable, uint32_t key_lifetime)
+{
+  return -1;
+}
+
+int pn_ssl_domain_get_resume_stats(pn_ssl_domain_t *domain, pn_ssl_resume_stats_t *stats)
+{
+  return -1;
+}
+
+bool pn_ssl_get_kernel_tls(pn_ssl_t *ssl)
+{
+  return false;
+}
+
 bool pn_ssl_allow_unsecured(pn_ssl_t *ssl)
 {
   return true;
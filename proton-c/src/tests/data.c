@@ -25,25 +25,188 @@
 #include "core/data.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-// Make sure we can grow the capacity of a pn_data_t all the way to the max and we stop there.
+// Make sure we can grow a pn_data_t well past the old 16 bit node limit.
 static void test_grow(void)
 {
+  const unsigned count = 100000;
   pn_data_t* data = pn_data(0);
-  while (pn_data_size(data) < PNI_NID_MAX) {
-    int code = pn_data_put_int(data, 1);
+  for (unsigned i = 0; i < count; ++i) {
+    int code = pn_data_put_int(data, i);
     if (code) fprintf(stderr, "%d: %s", code, pn_error_text(pn_data_error(data)));
     assert(code == 0);
   }
-  assert(pn_data_size(data) == PNI_NID_MAX);
-  int code = pn_data_put_int(data, 1);
-  if (code != PN_OUT_OF_MEMORY)
-    fprintf(stderr, "expected PN_OUT_OF_MEMORY, got  %s\n", pn_code(code));
-  assert(code == PN_OUT_OF_MEMORY);
-  assert(pn_data_size(data) == PNI_NID_MAX);
+  assert(pn_data_size(data) == count);
+  pn_data_rewind(data);
+  for (unsigned i = 0; i < count; ++i) {
+    assert(pn_data_next(data));
+    assert(pn_data_get_int(data) == (int32_t) i);
+  }
+  assert(!pn_data_next(data));
   pn_data_free(data);
 }
 
+// Round trip a list with more elements than a 16 bit node id can count,
+// with values stored in the node and values stored in the data buffer.
+static void test_big_list(void)
+{
+  const unsigned count = 70000;
+  pn_data_t* src = pn_data(0);
+  pn_data_put_list(src);
+  pn_data_enter(src);
+  for (unsigned i = 0; i < count; ++i) {
+    char str[16];
+    int len = snprintf(str, sizeof(str), "%u", i);
+    if (i % 2) {
+      pn_data_put_string(src, pn_bytes(len, str));
+    } else {
+      pn_data_put_ulong(src, i);
+    }
+  }
+  pn_uuid_t uuid = {{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16}};
+  pn_data_put_uuid(src, uuid);
+  pn_data_exit(src);
+
+  ssize_t size = pn_data_encoded_size(src);
+  assert(size > 0);
+  char *bytes = (char *) malloc(size);
+  assert(pn_data_encode(src, bytes, size) == size);
+
+  pn_data_t* dst = pn_data(0);
+  assert(pn_data_decode(dst, bytes, size) == size);
+  pn_data_rewind(dst);
+  assert(pn_data_next(dst));
+  assert(pn_data_get_list(dst) == count + 1);
+  pn_data_enter(dst);
+  for (unsigned i = 0; i < count; ++i) {
+    char str[16];
+    int len = snprintf(str, sizeof(str), "%u", i);
+    assert(pn_data_next(dst));
+    if (i % 2) {
+      pn_bytes_t s = pn_data_get_string(dst);
+      assert(s.size == (size_t) len && memcmp(s.start, str, len) == 0);
+    } else {
+      assert(pn_data_get_ulong(dst) == i);
+    }
+  }
+  assert(pn_data_next(dst));
+  assert(memcmp(pn_data_get_uuid(dst).bytes, uuid.bytes, 16) == 0);
+  assert(!pn_data_next(dst));
+
+  free(bytes);
+  pn_data_free(dst);
+  pn_data_free(src);
+}
+
+// Encode data into bytes, which must be big enough
+static ssize_t encode_array(pn_data_t *data, char *bytes, size_t size)
+{
+  ssize_t n = pn_data_encode(data, bytes, size);
+  assert(n > 0);
+  return n;
+}
+
+// An array put in one step encodes like one put element by element, and
+// decodes, copies, prints and can be entered like one.
+static void test_packed_array(void)
+{
+  const int32_t ints[] = {1, -2, 300000, INT32_MIN};
+  const size_t count = sizeof(ints) / sizeof(ints[0]);
+  char packed[64], nodes[64];
+
+  pn_data_t *src = pn_data(0);
+  assert(pn_data_put_array_elements(src, PN_INT, ints, count) == 0);
+  ssize_t size = encode_array(src, packed, sizeof(packed));
+
+  pn_data_t *ref = pn_data(0);
+  pn_data_put_array(ref, false, PN_INT);
+  pn_data_enter(ref);
+  for (size_t i = 0; i < count; ++i) pn_data_put_int(ref, ints[i]);
+  pn_data_exit(ref);
+  assert(encode_array(ref, nodes, sizeof(nodes)) == size);
+  assert(memcmp(packed, nodes, size) == 0);
+  assert(pn_data_encoded_size(src) == size);
+
+  // the node by node array reads out in one step too
+  int32_t out[8];
+  pn_data_rewind(ref);
+  assert(pn_data_next(ref));
+  assert(pn_data_get_array_elements(ref, out, 8) == (ssize_t) count);
+  assert(memcmp(out, ints, sizeof(ints)) == 0);
+
+  // decoding keeps it packed: no node per element
+  pn_data_t *dst = pn_data(0);
+  assert(pn_data_decode(dst, packed, size) == size);
+  assert(pn_data_size(dst) == 1);
+  pn_data_rewind(dst);
+  assert(pn_data_next(dst));
+  assert(pn_data_get_array(dst) == count);
+  assert(pn_data_get_array_type(dst) == PN_INT);
+  assert(pn_data_get_array_elements(dst, out, 2) == PN_OVERFLOW);
+  memset(out, 0, sizeof(out));
+  assert(pn_data_get_array_elements(dst, out, 8) == (ssize_t) count);
+  assert(memcmp(out, ints, sizeof(ints)) == 0);
+
+  char str[128];
+  size_t len = sizeof(str);
+  assert(pn_data_format(dst, str, &len) == 0);
+  assert(strcmp(str, "@PN_INT[1, -2, 300000, -2147483648]") == 0);
+
+  pn_data_t *copy = pn_data(0);
+  assert(pn_data_copy(copy, dst) == 0);
+  assert(pn_data_size(copy) == 1);
+  assert(encode_array(copy, nodes, sizeof(nodes)) == size);
+  assert(memcmp(packed, nodes, size) == 0);
+
+  // entering unpacks
+  pn_data_rewind(dst);
+  assert(pn_data_next(dst));
+  assert(pn_data_enter(dst));
+  for (size_t i = 0; i < count; ++i) {
+    assert(pn_data_next(dst));
+    assert(pn_data_get_int(dst) == ints[i]);
+  }
+  assert(!pn_data_next(dst));
+  assert(pn_data_exit(dst));
+  assert(pn_data_get_array(dst) == count);
+  assert(encode_array(dst, nodes, sizeof(nodes)) == size);
+  assert(memcmp(packed, nodes, size) == 0);
+
+  // wider and narrower elements, nested in a list
+  const double doubles[] = {0.5, -1e300};
+  const uint8_t ubytes[] = {0, 255};
+  pn_data_clear(src);
+  pn_data_put_list(src);
+  pn_data_enter(src);
+  assert(pn_data_put_array_elements(src, PN_DOUBLE, doubles, 2) == 0);
+  assert(pn_data_put_array_elements(src, PN_UBYTE, ubytes, 2) == 0);
+  assert(pn_data_put_array_elements(src, PN_LONG, NULL, 0) == 0);
+  pn_data_exit(src);
+  assert(pn_data_put_array_elements(src, PN_STRING, NULL, 0) == PN_ARG_ERR);
+  size = encode_array(src, packed, sizeof(packed));
+  pn_data_clear(dst);
+  assert(pn_data_decode(dst, packed, size) == size);
+  len = sizeof(str);
+  assert(pn_data_format(dst, str, &len) == 0);
+  assert(strcmp(str, "[@PN_DOUBLE[0.5, -1e+300], @PN_UBYTE[0, 255], @PN_LONG[]]") == 0);
+  pn_data_rewind(dst);
+  assert(pn_data_next(dst));
+  pn_data_enter(dst);
+  assert(pn_data_next(dst));
+  double d[2];
+  assert(pn_data_get_array_elements(dst, d, 2) == 2);
+  assert(d[0] == doubles[0] && d[1] == doubles[1]);
+
+  pn_data_free(copy);
+  pn_data_free(dst);
+  pn_data_free(ref);
+  pn_data_free(src);
+}
+
 int main(int argc, char **argv) {
   test_grow();
+  test_big_list();
+  test_packed_array();
 }
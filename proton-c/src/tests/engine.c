@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <proton/engine.h>
+#include <proton/connection_driver.h>
 
 // never remove 'assert()'
 #undef NDEBUG
@@ -294,12 +295,462 @@ int test_free_link(int argc, char **argv)
     return 0;
 }
 
+// push data from a driver to a transport using the gathering write API
+static int xfer_iov(pn_connection_driver_t *src, pn_transport_t *dest)
+{
+    pn_bytes_t iov[4];
+    size_t n = pn_connection_driver_write_iov(src, iov, 4);
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        ssize_t in = pn_transport_push(dest, iov[i].start, iov[i].size);
+        assert(in >= 0);
+        total += in;
+        if ((size_t)in < iov[i].size) break;
+    }
+    pn_connection_driver_write_done(src, total);
+    return (int)total;
+}
+
+// two connection drivers talking to each other, the second as the server
+typedef struct {
+    pn_connection_driver_t d1, d2;
+    pn_link_t *tx, *rx;
+} driver_pair_t;
+
+// max_frame limits the frames the server accepts, if not 0
+static void driver_pair_init(driver_pair_t *p, uint32_t max_frame)
+{
+    assert(pn_connection_driver_init(&p->d1, NULL, NULL) == 0);
+    assert(pn_connection_driver_init(&p->d2, NULL, NULL) == 0);
+    pn_transport_set_server(p->d2.transport);
+    if (max_frame) {
+        pn_transport_set_max_frame(p->d2.transport, max_frame);
+    }
+    pn_connection_driver_bind(&p->d1);
+    pn_connection_driver_bind(&p->d2);
+    p->tx = p->rx = NULL;
+}
+
+// open a sender on the first driver and its receiver on the second
+static void driver_pair_link(driver_pair_t *p)
+{
+    test_setup(p->d1.connection, p->d1.transport,
+               p->d2.connection, p->d2.transport);
+    p->tx = pn_link_head(p->d1.connection, (PN_LOCAL_ACTIVE | PN_REMOTE_ACTIVE));
+    p->rx = pn_link_head(p->d2.connection, (PN_LOCAL_ACTIVE | PN_REMOTE_ACTIVE));
+    assert(p->tx && p->rx);
+}
+
+static void driver_pair_destroy(driver_pair_t *p)
+{
+    pn_connection_driver_destroy(&p->d1);
+    pn_connection_driver_destroy(&p->d2);
+}
+
+// send a multi-frame delivery using pn_connection_driver_write_iov()
+int test_write_iov(int argc, char **argv)
+{
+    fprintf(stdout, "test_write_iov\n");
+    driver_pair_t p;
+    driver_pair_init(&p, 4096);
+    driver_pair_link(&p);
+    pn_link_t *tx = p.tx, *rx = p.rx;
+
+    pn_link_flow(rx, 1);
+    while (pump(p.d1.transport, p.d2.transport));
+
+    const size_t size = 100000;
+    char *sent = (char *) malloc(size);
+    char *recvd = (char *) malloc(size);
+    for (size_t i = 0; i < size; ++i) sent[i] = (char)i;
+
+    pn_delivery(tx, pn_dtag("tag-1", 6));
+    assert(pn_link_send(tx, sent, size) == (ssize_t)size);
+    pn_link_advance(tx);
+
+    // short writes keep being served from the frame queue, not copied
+    pn_bytes_t iov[4];
+    const char *start = NULL;
+    for (int i = 0; i < 2; ++i) {
+        assert(pn_connection_driver_write_iov(&p.d1, iov, 4) > 0);
+        assert(!pn_transport_head(p.d1.transport));
+        assert(!start || iov[0].start == start + 100);
+        assert(iov[0].size > 100);
+        start = iov[0].start;
+        assert(pn_transport_push(p.d2.transport, start, 100) == 100);
+        pn_connection_driver_write_done(&p.d1, 100);
+    }
+    assert(!pn_transport_head(p.d1.transport));
+
+    while (xfer_iov(&p.d1, p.d2.transport) + xfer(p.d2.transport, p.d1.transport));
+
+    pn_delivery_t *d = pn_link_current(rx);
+    assert(d && !pn_delivery_partial(d));
+    assert(pn_link_recv(rx, recvd, size) == (ssize_t)size);
+    assert(memcmp(sent, recvd, size) == 0);
+    assert(pn_transport_get_frames_output(p.d1.transport) > size/4096);
+
+    // writing the last frame directly closes the head
+    pn_connection_close(p.d2.connection);
+    while (pump(p.d1.transport, p.d2.transport));
+    pn_connection_close(p.d1.connection);
+    while (pn_connection_driver_next_event(&p.d1));
+    assert(pn_connection_driver_write_iov(&p.d1, iov, 4) == 1);
+    pn_connection_driver_write_done(&p.d1, iov[0].size);
+    bool head_closed = false;
+    pn_event_t *e;
+    while ((e = pn_connection_driver_next_event(&p.d1))) {
+        head_closed |= pn_event_type(e) == PN_TRANSPORT_HEAD_CLOSED;
+    }
+    assert(head_closed);
+
+    free(sent);
+    free(recvd);
+    driver_pair_destroy(&p);
+    return 0;
+}
+
+// tags of every size arrive intact, including on recycled deliveries
+int test_delivery_tags(int argc, char **argv)
+{
+    fprintf(stdout, "test_delivery_tags\n");
+    driver_pair_t p;
+    driver_pair_init(&p, 0);
+    driver_pair_link(&p);
+    pn_link_t *tx = p.tx, *rx = p.rx;
+
+    const char *tags[] = {"", "1", "12345678", "123456789", "a-longer-tag-of-32-bytes-maximum",
+                          "12", "a-long-tag-again", NULL};
+    pn_link_flow(rx, 100);
+    for (const char **tag = tags; *tag; ++tag) {
+        pn_delivery_t *out = pn_delivery(tx, pn_dtag(*tag, strlen(*tag)));
+        pn_delivery_tag_t t = pn_delivery_tag(out);
+        assert(t.size == strlen(*tag) && memcmp(t.start, *tag, t.size) == 0);
+        assert(pn_link_send(tx, "x", 1) == 1);
+        pn_link_advance(tx);
+        pn_delivery_settle(out);  // back to the pool for the next one
+        while (pump(p.d1.transport, p.d2.transport));
+
+        pn_delivery_t *in = pn_link_current(rx);
+        assert(in);
+        t = pn_delivery_tag(in);
+        assert(t.size == strlen(*tag) && memcmp(t.start, *tag, t.size) == 0);
+        pn_link_advance(rx);
+        pn_delivery_settle(in);
+    }
+
+    driver_pair_destroy(&p);
+    return 0;
+}
+
+// dispositions find their deliveries when settled out of order across many
+// unsettled deliveries
+int test_unsettled_deliveries(int argc, char **argv)
+{
+    fprintf(stdout, "test_unsettled_deliveries\n");
+    driver_pair_t p;
+    driver_pair_init(&p, 0);
+    driver_pair_link(&p);
+    pn_link_t *tx = p.tx, *rx = p.rx;
+
+    enum { N = 1000 };
+    pn_delivery_t *out[N], *in[N];
+    for (int round = 0; round < 3; ++round) {
+        pn_link_flow(rx, N);
+        while (pump(p.d1.transport, p.d2.transport));
+        for (int i = 0; i < N; ++i) {
+            out[i] = pn_delivery(tx, pn_dtag((const char *)&i, sizeof(i)));
+            pn_link_send(tx, "x", 1);
+            pn_link_advance(tx);
+        }
+        while (pump(p.d1.transport, p.d2.transport));
+        for (int i = 0; i < N; ++i) {
+            in[i] = pn_link_current(rx);
+            assert(in[i] && *(const int *)pn_delivery_tag(in[i]).start == i);
+            pn_link_advance(rx);
+        }
+
+        // settle every third delivery first, leaving gaps, then the rest
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int i = N - 1; i >= 0; --i) {
+                if ((i % 3 == 0) == (pass == 0)) {
+                    pn_delivery_update(in[i], PN_ACCEPTED);
+                    pn_delivery_settle(in[i]);
+                }
+            }
+            while (pump(p.d1.transport, p.d2.transport));
+            for (int i = 0; i < N; ++i) {
+                if ((i % 3 == 0) == (pass == 0) || pass == 1) {
+                    assert(pn_delivery_remote_state(out[i]) == PN_ACCEPTED);
+                    assert(pn_delivery_settled(out[i]));
+                } else {
+                    assert(pn_delivery_remote_state(out[i]) == 0);
+                }
+            }
+        }
+        for (int i = 0; i < N; ++i) pn_delivery_settle(out[i]);
+        while (pump(p.d1.transport, p.d2.transport));
+    }
+
+    // settling a block in any order sends a single range
+    pn_link_flow(rx, N);
+    while (pump(p.d1.transport, p.d2.transport));
+    for (int i = 0; i < N; ++i) {
+        pn_delivery(tx, pn_dtag((const char *)&i, sizeof(i)));
+        pn_link_send(tx, "x", 1);
+        pn_link_advance(tx);
+    }
+    while (pump(p.d1.transport, p.d2.transport));
+    for (int i = 0; i < N; ++i) {
+        in[i] = pn_link_current(rx);
+        pn_link_advance(rx);
+    }
+    uint64_t frames = pn_transport_get_frames_output(p.d2.transport);
+    for (int i = 0; i < N; ++i) {
+        pn_delivery_t *d = in[(i * 7) % N];  // 7 and N are coprime
+        pn_delivery_update(d, PN_ACCEPTED);
+        pn_delivery_settle(d);
+    }
+    while (pump(p.d1.transport, p.d2.transport));
+    assert(pn_transport_get_frames_output(p.d2.transport) == frames + 1);
+
+    driver_pair_destroy(&p);
+    return 0;
+}
+
+// the incoming capacity of a connection bounds the bytes buffered by all
+// of its sessions together, and windows reopen as the data is read
+int test_connection_capacity(int argc, char **argv)
+{
+    fprintf(stdout, "test_connection_capacity\n");
+    driver_pair_t p;
+    driver_pair_init(&p, 1024);
+    pn_connection_set_incoming_capacity(p.d2.connection, 8 * 1024);
+    assert(pn_connection_get_incoming_capacity(p.d2.connection) == 8 * 1024);
+
+    pn_connection_open(p.d1.connection);
+    pn_connection_open(p.d2.connection);
+    enum { SESSIONS = 2, MESSAGES = 20, SIZE = 900 };
+    pn_link_t *tx[SESSIONS];
+    for (int i = 0; i < SESSIONS; ++i) {
+        pn_session_t *ssn = pn_session(p.d1.connection);
+        pn_session_open(ssn);
+        tx[i] = pn_sender(ssn, i ? "b" : "a");
+        pn_link_open(tx[i]);
+    }
+    while (pump(p.d1.transport, p.d2.transport)) {
+        process_endpoints(p.d1.connection);
+        process_endpoints(p.d2.connection);
+    }
+    for (pn_link_t *rx = pn_link_head(p.d2.connection, 0); rx; rx = pn_link_next(rx, 0)) {
+        pn_link_flow(rx, MESSAGES);
+    }
+    while (pump(p.d1.transport, p.d2.transport));
+
+    char body[SIZE];
+    memset(body, 'x', SIZE);
+    for (int i = 0; i < SESSIONS; ++i) {
+        for (int j = 0; j < MESSAGES; ++j) {
+            pn_delivery(tx[i], pn_dtag((const char *)&j, sizeof(j)));
+            pn_link_send(tx[i], body, SIZE);
+            pn_link_advance(tx[i]);
+        }
+    }
+    assert(pn_connection_outgoing_bytes(p.d1.connection) == SESSIONS * MESSAGES * SIZE);
+
+    int received = 0;
+    while (received < SESSIONS * MESSAGES) {
+        while (pump(p.d1.transport, p.d2.transport));
+        size_t buffered = pn_connection_incoming_bytes(p.d2.connection);
+        assert(buffered > 0 && buffered <= 8 * 1024);
+        size_t sum = 0;
+        for (pn_session_t *ssn = pn_session_head(p.d2.connection, 0); ssn; ssn = pn_session_next(ssn, 0)) {
+            sum += pn_session_incoming_bytes(ssn);
+        }
+        assert(sum == buffered);
+
+        // read one message from each link, leaving the rest buffered
+        for (pn_link_t *rx = pn_link_head(p.d2.connection, 0); rx; rx = pn_link_next(rx, 0)) {
+            pn_delivery_t *d = pn_link_current(rx);
+            if (d && !pn_delivery_partial(d)) {
+                char buf[SIZE];
+                assert(pn_link_recv(rx, buf, SIZE) == SIZE);
+                pn_link_advance(rx);
+                pn_delivery_settle(d);
+                ++received;
+            }
+        }
+    }
+    assert(pn_connection_incoming_bytes(p.d2.connection) == 0);
+    assert(pn_connection_outgoing_bytes(p.d1.connection) == 0);
+
+    driver_pair_destroy(&p);
+    return 0;
+}
+
+// Lowering the capacity must not take back a window the peer has already
+// used, and bytes freed without being read must leave the connection.
+int test_connection_capacity_shrink(int argc, char **argv)
+{
+    fprintf(stdout, "test_connection_capacity_shrink\n");
+    driver_pair_t p;
+    driver_pair_init(&p, 1024);
+    pn_connection_set_incoming_capacity(p.d2.connection, 8 * 1024);
+    driver_pair_link(&p);
+    pn_link_t *tx = p.tx, *rx = p.rx;
+    pn_link_flow(rx, 20);
+    while (pump(p.d1.transport, p.d2.transport));
+
+    enum { MESSAGES = 20, SIZE = 900 };
+    char body[SIZE];
+    memset(body, 'x', SIZE);
+    for (int j = 0; j < MESSAGES; ++j) {
+        pn_delivery(tx, pn_dtag((const char *)&j, sizeof(j)));
+        pn_link_send(tx, body, SIZE);
+        pn_link_advance(tx);
+    }
+
+    // hold the transfers the window allows while the receiver shrinks it
+    ssize_t pending = pn_transport_pending(p.d1.transport);
+    assert(pending > 8 * SIZE);
+    char *in_flight = (char *) malloc(pending);
+    memcpy(in_flight, pn_transport_head(p.d1.transport), pending);
+    pn_transport_pop(p.d1.transport, pending);
+
+    pn_connection_set_incoming_capacity(p.d2.connection, 2 * 1024);
+    pn_link_flow(rx, 1);
+    assert(pn_transport_pending(p.d2.transport) > 0);
+    assert(pn_transport_push(p.d2.transport, in_flight, pending) == pending);
+    free(in_flight);
+    assert(!pn_condition_is_set(pn_transport_condition(p.d2.transport)));
+    assert(pn_connection_incoming_bytes(p.d2.connection) == 8 * SIZE);
+
+    // free the link without reading what arrived
+    pn_link_close(rx);
+    pn_link_free(rx);
+    while (pump(p.d1.transport, p.d2.transport)) {
+        process_endpoints(p.d1.connection);
+        while (pn_connection_driver_next_event(&p.d2));
+    }
+    assert(pn_connection_incoming_bytes(p.d2.connection) == 0);
+
+    driver_pair_destroy(&p);
+    return 0;
+}
+
+static void quiet_tracer(pn_transport_t *transport, const char *message) {}
+
+// Exchange flows, transfers and dispositions. An end encodes and decodes
+// them directly unless it is traced, when it uses the generic codec.
+static void frame_decoding(bool trace1, bool trace2)
+{
+    driver_pair_t p;
+    driver_pair_init(&p, 1024);
+    if (trace1) {
+        pn_transport_set_tracer(p.d1.transport, quiet_tracer);
+        pn_transport_trace(p.d1.transport, PN_TRACE_FRM);
+    }
+    if (trace2) {
+        pn_transport_set_tracer(p.d2.transport, quiet_tracer);
+        pn_transport_trace(p.d2.transport, PN_TRACE_FRM);
+    }
+    driver_pair_link(&p);
+    pn_link_t *tx = p.tx, *rx = p.rx;
+
+    pn_link_flow(rx, 300);
+    while (pump(p.d1.transport, p.d2.transport));
+    assert(pn_link_credit(tx) == 300);
+
+    // a large delivery id and tag use the wider encodings
+    enum { N = 260 };
+    pn_delivery_t *out[N], *in[N];
+    char tag[300];
+    memset(tag, 't', sizeof(tag));
+    for (int i = 0; i < N; ++i) {
+        out[i] = pn_delivery(tx, pn_dtag(tag, i == N - 1 ? sizeof(tag) : 1));
+        pn_link_send(tx, (const char *)&i, sizeof(i));
+        if (i == 1) pn_delivery_settle(out[i]);
+        else pn_link_advance(tx);
+    }
+    while (pump(p.d1.transport, p.d2.transport));
+    for (int i = 0; i < N; ++i) {
+        in[i] = pn_link_current(rx);
+        assert(in[i]);
+        assert(pn_delivery_tag(in[i]).size == (i == N - 1 ? sizeof(tag) : 1));
+        assert(pn_delivery_settled(in[i]) == (i == 1));
+        int body = -1;
+        assert(pn_link_recv(rx, (char *)&body, sizeof(body)) == sizeof(body));
+        assert(body == i);
+        pn_link_advance(rx);
+    }
+
+    // a delivery split over several frames
+    char big[5000], got[5000];
+    for (size_t i = 0; i < sizeof(big); ++i) big[i] = (char)i;
+    pn_delivery(tx, pn_dtag("big", 3));
+    pn_link_send(tx, big, sizeof(big));
+    pn_link_advance(tx);
+    uint64_t frames = pn_transport_get_frames_input(p.d2.transport);
+    while (pump(p.d1.transport, p.d2.transport));
+    assert(pn_transport_get_frames_input(p.d2.transport) - frames >= 5);
+    pn_delivery_t *d = pn_link_current(rx);
+    assert(d && !pn_delivery_partial(d) && pn_delivery_pending(d) == sizeof(big));
+    assert(pn_link_recv(rx, got, sizeof(got)) == sizeof(got));
+    assert(!memcmp(big, got, sizeof(big)));
+    pn_link_advance(rx);
+
+    // dispositions with and without fields in their state
+    pn_delivery_update(in[0], PN_ACCEPTED);
+    pn_delivery_settle(in[0]);
+    pn_condition_set_name(pn_disposition_condition(pn_delivery_local(in[2])), "test:rejected");
+    pn_delivery_update(in[2], PN_REJECTED);
+    pn_delivery_settle(in[2]);
+    pn_disposition_set_failed(pn_delivery_local(in[3]), true);
+    pn_delivery_update(in[3], PN_MODIFIED);
+    pn_delivery_update(in[N - 1], PN_RELEASED);
+    while (pump(p.d1.transport, p.d2.transport));
+    assert(pn_delivery_remote_state(out[0]) == PN_ACCEPTED && pn_delivery_settled(out[0]));
+    assert(pn_delivery_remote_state(out[2]) == PN_REJECTED && pn_delivery_settled(out[2]));
+    assert(!strcmp(pn_condition_get_name(pn_disposition_condition(pn_delivery_remote(out[2]))),
+                   "test:rejected"));
+    assert(pn_delivery_remote_state(out[3]) == PN_MODIFIED && !pn_delivery_settled(out[3]));
+    assert(pn_disposition_is_failed(pn_delivery_remote(out[3])));
+    assert(pn_delivery_remote_state(out[N - 1]) == PN_RELEASED);
+    assert(pn_delivery_remote_state(out[4]) == 0);
+
+    // draining the remaining credit
+    assert(pn_link_credit(tx) == 300 - N - 1);
+    pn_link_drain(rx, 0);
+    while (pump(p.d1.transport, p.d2.transport));
+    assert(pn_link_get_drain(tx));
+    pn_link_drained(tx);
+    while (pump(p.d1.transport, p.d2.transport));
+    assert(pn_link_credit(tx) == 0 && pn_link_credit(rx) == 0);
+
+    driver_pair_destroy(&p);
+}
+
+int test_frame_decoding(int argc, char **argv)
+{
+    fprintf(stdout, "test_frame_decoding\n");
+    frame_decoding(false, false);
+    frame_decoding(true, false);
+    frame_decoding(false, true);
+    frame_decoding(true, true);
+    return 0;
+}
 
 typedef int (*test_ptr_t)(int argc, char **argv);
 
 test_ptr_t tests[] = {test_free_connection,
                       test_free_session,
                       test_free_link,
+                      test_write_iov,
+                      test_delivery_tags,
+                      test_unsettled_deliveries,
+                      test_connection_capacity,
+                      test_connection_capacity_shrink,
+                      test_frame_decoding,
                       NULL};
 
 int main(int argc, char **argv)
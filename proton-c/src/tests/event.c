@@ -96,6 +96,45 @@ static void test_event_incref(bool eventfirst) {
   }
 }
 
+static int drain(pn_collector_t *collector) {
+  int count = 0;
+  while (pn_collector_next(collector)) count++;
+  return count;
+}
+
+static void test_collector_coalesce(void) {
+  pn_collector_t *collector = pn_collector();
+  void *link = pn_class_new(PN_OBJECT, 0);
+  void *d1 = pn_class_new(PN_OBJECT, 0);
+  void *d2 = pn_class_new(PN_OBJECT, 0);
+  // the head is not coalesced with, it may be being handled
+  assert(pn_collector_put(collector, PN_OBJECT, d1, PN_DELIVERY));
+  assert(pn_collector_put(collector, PN_OBJECT, link, PN_LINK_FLOW));
+  assert(pn_collector_put(collector, PN_OBJECT, d2, PN_DELIVERY));
+  assert(pn_collector_put(collector, PN_OBJECT, d1, PN_DELIVERY));
+  assert(!pn_collector_put(collector, PN_OBJECT, link, PN_LINK_FLOW));
+  assert(!pn_collector_put(collector, PN_OBJECT, d2, PN_DELIVERY));
+  assert(!pn_collector_put(collector, PN_OBJECT, d1, PN_DELIVERY));
+  // other kinds of event are only folded into the tail
+  assert(pn_collector_put(collector, PN_OBJECT, link, PN_LINK_REMOTE_OPEN));
+  assert(pn_collector_put(collector, PN_OBJECT, d1, PN_DELIVERY) == NULL);
+  assert(pn_collector_put(collector, PN_OBJECT, link, PN_LINK_REMOTE_DETACH));
+  assert(!pn_collector_put(collector, PN_OBJECT, link, PN_LINK_REMOTE_DETACH));
+  assert(pn_collector_put(collector, PN_OBJECT, link, PN_LINK_REMOTE_OPEN));
+  assert(drain(collector) == 7);
+  // once an event is handed out a new one is queued
+  assert(pn_collector_put(collector, PN_OBJECT, d1, PN_DELIVERY));
+  assert(pn_collector_put(collector, PN_OBJECT, d2, PN_DELIVERY));
+  assert(pn_collector_next(collector));
+  assert(pn_collector_put(collector, PN_OBJECT, d1, PN_DELIVERY));
+  assert(!pn_collector_put(collector, PN_OBJECT, d1, PN_DELIVERY));
+  assert(drain(collector) == 2);
+  pn_decref(d1);
+  pn_decref(d2);
+  pn_decref(link);
+  pn_free(collector);
+}
+
 int main(int argc, char **argv)
 {
   test_collector();
@@ -105,5 +144,6 @@ int main(int argc, char **argv)
   test_collector_pool();
   test_event_incref(true);
   test_event_incref(false);
+  test_collector_coalesce();
   return 0;
 }
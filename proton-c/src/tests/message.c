@@ -23,8 +23,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <proton/connection.h>
+#include <proton/delivery.h>
 #include <proton/error.h>
+#include <proton/link.h>
 #include <proton/message.h>
+#include <proton/session.h>
 
 #define assert(E) ((E) ? 0 : (abort(), 0))
 
@@ -37,11 +41,238 @@ static void test_overflow_error(void)
   int err = pn_message_encode(message, buf, &size);
   assert(err == PN_OVERFLOW);
   assert(pn_message_errno(message) == 0);
+  assert(size == (size_t) pn_message_encoded_size(message));
+  pn_message_free(message);
+}
+
+// Encoding directly must give the same bytes as encoding pn_message_data
+static void check_encode(pn_message_t *message)
+{
+  pn_data_t *data = pn_data(0);
+  assert(pn_message_data(message, data) == 0);
+  size_t expect_size = pn_data_encoded_size(data);
+  char *expect = (char *) malloc(expect_size);
+  assert(pn_data_encode(data, expect, expect_size) == (ssize_t) expect_size);
+
+  assert(pn_message_encoded_size(message) == (ssize_t) expect_size);
+  size_t size = expect_size;
+  char *bytes = (char *) malloc(size);
+  assert(pn_message_encode(message, bytes, &size) == 0);
+  assert(size == expect_size);
+  assert(memcmp(bytes, expect, size) == 0);
+
+  free(bytes);
+  free(expect);
+  pn_data_free(data);
+}
+
+static char big[300];
+
+static void fill_message(pn_message_t *message)
+{
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = 0;
+
+  pn_message_set_durable(message, true);
+  pn_message_set_priority(message, 9);
+  pn_message_set_ttl(message, 60000);
+  pn_message_set_delivery_count(message, 1000);
+  pn_atom_t id = {PN_ULONG, {0}};
+  id.u.as_ulong = 12345;
+  pn_message_set_id(message, id);
+  pn_message_set_user_id(message, pn_bytes(4, "user"));
+  pn_message_set_address(message, "queue://address");
+  pn_message_set_subject(message, big);
+  pn_message_set_reply_to(message, "queue://reply");
+  pn_atom_t cid = {PN_STRING, {0}};
+  cid.u.as_bytes = pn_bytes(3, "cid");
+  pn_message_set_correlation_id(message, cid);
+  pn_message_set_content_type(message, "text/plain");
+  pn_message_set_content_encoding(message, big);
+  pn_message_set_expiry_time(message, 1000000);
+  pn_message_set_creation_time(message, 2000000);
+  pn_message_set_group_id(message, "group");
+  pn_message_set_group_sequence(message, 300);
+  pn_message_set_reply_to_group_id(message, "reply-group");
+  pn_data_fill(pn_message_instructions(message), "{sS}", "key", "instruction");
+  pn_data_fill(pn_message_annotations(message), "{sl}", "x-opt-key", (int64_t) -1);
+  pn_data_fill(pn_message_properties(message), "{SISS}", "a", 1, "b", big);
+  pn_data_put_string(pn_message_body(message), pn_bytes(sizeof(big) - 1, big));
+}
+
+static void test_encode(void)
+{
+  pn_message_t *message = pn_message();
+  check_encode(message);
+
+  fill_message(message);
+  check_encode(message);
+
+  pn_data_clear(pn_message_body(message));
+  pn_data_put_binary(pn_message_body(message), pn_bytes(4, "body"));
+  pn_message_set_inferred(message, true);
+  check_encode(message);
+
+  pn_message_free(message);
+}
+
+static size_t encode(pn_message_t *message, char *bytes, size_t size)
+{
+  assert(pn_message_encode(message, bytes, &size) == 0);
+  return size;
+}
+
+static void test_decode_lazy(void)
+{
+  char bytes[4096], again[4096];
+  pn_message_t *message = pn_message();
+  fill_message(message);
+  size_t size = encode(message, bytes, sizeof(bytes));
+
+  // Nothing used: the same bytes come back
+  pn_message_t *lazy = pn_message();
+  assert(pn_message_decode_lazy(lazy, bytes, size) == 0);
+  assert(encode(lazy, again, sizeof(again)) == size);
+  assert(memcmp(bytes, again, size) == 0);
+
+  // Reading fields decodes their sections but they are still copied
+  assert(strcmp(pn_message_get_address(lazy), "queue://address") == 0);
+  assert(pn_message_get_priority(lazy) == 9);
+  assert(pn_data_size(pn_message_body(lazy)) == 1);
+  assert(encode(lazy, again, sizeof(again)) == size);
+  assert(memcmp(bytes, again, size) == 0);
+
+  // A change is re-encoded, the rest of the message is kept
+  pn_message_set_address(lazy, "queue://elsewhere");
+  pn_message_set_address(message, "queue://elsewhere");
+  size = encode(message, bytes, sizeof(bytes));
+  assert(encode(lazy, again, sizeof(again)) == size);
+  assert(memcmp(bytes, again, size) == 0);
+
+  pn_message_t *eager = pn_message();
+  assert(pn_message_decode(eager, again, size) == 0);
+  assert(strcmp(pn_message_get_address(eager), "queue://elsewhere") == 0);
+  assert(strcmp(pn_message_get_reply_to(eager), "queue://reply") == 0);
+  assert(pn_message_get_delivery_count(eager) == 1000);
+
+  // Truncated sections are found without decoding them
+  assert(pn_message_decode_lazy(lazy, bytes, size - 1) == PN_UNDERFLOW);
+
+  pn_message_free(eager);
+  pn_message_free(lazy);
+  pn_message_free(message);
+}
+
+static void test_encoded_body(void)
+{
+  char bytes[4096], again[4096], value[64];
+  pn_message_t *message = pn_message();
+  fill_message(message);
+  assert(pn_message_get_encoded_body(message).size == 0);
+
+  // The same bytes as the body set through pn_message_body
+  pn_data_t *body = pn_data(0);
+  pn_data_fill(body, "DL[iS]", (uint64_t) 0x1234, 42, "field");
+  ssize_t vsize = pn_data_encode(body, value, sizeof(value));
+  assert(vsize > 0);
+  pn_data_clear(pn_message_body(message));
+  pn_data_fill(pn_message_body(message), "DL[iS]", (uint64_t) 0x1234, 42, "field");
+  size_t size = encode(message, bytes, sizeof(bytes));
+
+  assert(pn_message_set_encoded_body(message, value, vsize - 1) == PN_ARG_ERR);
+  assert(pn_message_set_encoded_body(message, value, vsize) == 0);
+  pn_bytes_t got = pn_message_get_encoded_body(message);
+  assert(got.size == (size_t) vsize && memcmp(got.start, value, vsize) == 0);
+  assert(encode(message, again, sizeof(again)) == size);
+  assert(memcmp(bytes, again, size) == 0);
+  check_encode(message);
+
+  // Still encoded after a lazy decode and reading the body, until the
+  // body is changed
+  pn_message_t *lazy = pn_message();
+  assert(pn_message_decode_lazy(lazy, bytes, size) == 0);
+  got = pn_message_get_encoded_body(lazy);
+  assert(got.size == (size_t) vsize && memcmp(got.start, value, vsize) == 0);
+  assert(pn_data_size(pn_message_body(lazy)) > 0);
+  got = pn_message_get_encoded_body(lazy);
+  assert(got.size == (size_t) vsize && memcmp(got.start, value, vsize) == 0);
+  assert(encode(lazy, again, sizeof(again)) == size);
+  assert(memcmp(bytes, again, size) == 0);
+  pn_data_clear(pn_message_body(lazy));
+  assert(pn_message_get_encoded_body(lazy).size == 0);
+  assert(encode(lazy, again, sizeof(again)) < size);
+
+  // Setting it again reuses the saved bytes
+  assert(pn_message_set_encoded_body(message, value, vsize) == 0);
+  assert(pn_data_size(pn_message_body(message)) > 0);
+  pn_data_rewind(pn_message_body(message));
+  assert(pn_data_next(pn_message_body(message)));
+  assert(pn_data_type(pn_message_body(message)) == PN_DESCRIBED);
+
+  pn_data_free(body);
+  pn_message_free(lazy);
+  pn_message_free(message);
+}
+
+static void test_decode_lazy_error(void)
+{
+  // A properties section holding a bad type code
+  static const char bytes[] = {0x00, 0x53, 0x73, (char) 0xc0, 0x02, 0x01, (char) 0xff};
+  pn_message_t *message = pn_message();
+  assert(pn_message_decode_lazy(message, bytes, sizeof(bytes)) == 0);
+  assert(pn_message_errno(message) == 0);
+
+  // Found when the section is used
+  assert(pn_message_get_address(message) == NULL);
+  assert(pn_message_errno(message) != 0);
+
+  // and forgotten by the next decode
+  assert(pn_message_decode_lazy(message, bytes, 3) != 0);
+  fill_message(message);
+  char encoded[4096];
+  size_t size = encode(message, encoded, sizeof(encoded));
+  assert(pn_message_decode_lazy(message, encoded, size) == 0);
+  assert(pn_message_get_address(message) != NULL);
+  assert(pn_message_errno(message) == 0);
+  pn_message_free(message);
+}
+
+static void test_send(void)
+{
+  pn_message_t *message = pn_message();
+  pn_connection_t *connection = pn_connection();
+  pn_link_t *sender = pn_sender(pn_session(connection), "sender");
+  assert(pn_message_send(message, sender) == PN_EOS);
+
+  // Larger than the initial delivery buffer
+  fill_message(message);
+  ssize_t size = pn_message_encoded_size(message);
+  pn_delivery_t *delivery = pn_delivery(sender, pn_dtag("1", 1));
+  assert(pn_message_send(message, sender) == size);
+  assert(pn_delivery_pending(delivery) == (size_t) size);
+
+  // Appended after data already sent on the delivery
+  assert(pn_message_send(message, sender) == size);
+  assert(pn_delivery_pending(delivery) == 2 * (size_t) size);
+  assert(pn_link_advance(sender));
+
+  pn_message_clear(message);
+  size = pn_message_encoded_size(message);
+  delivery = pn_delivery(sender, pn_dtag("2", 1));
+  assert(pn_message_send(message, sender) == size);
+  assert(pn_delivery_pending(delivery) == (size_t) size);
+
+  pn_connection_free(connection);
   pn_message_free(message);
 }
 
 int main(int argc, char **argv)
 {
   test_overflow_error();
+  test_encode();
+  test_send();
+  test_decode_lazy();
+  test_decode_lazy_error();
+  test_encoded_body();
   return 0;
 }
@@ -689,6 +689,32 @@ static void test_string_addf(void)
   pn_free(str);
 }
 
+static void test_string_null_storage(void)
+{
+  // a null string has no storage until written, but its buffer can
+  // still be filled directly
+  pn_string_t *str = pn_string(NULL);
+  assert(!pn_string_get(str));
+  assert(pn_string_size(str) == 0);
+  assert(pn_string_capacity(str) >= 1);
+  char *buf = pn_string_buffer(str);
+  assert(buf);
+  buf[0] = 'x';
+  assert(pn_string_resize(str, 1) == 0);
+  assert(!strcmp(pn_string_get(str), "x"));
+  pn_string_set(str, NULL);
+  assert(!pn_string_get(str));
+  assert(pn_string_addf(str, "x") != 0);
+  pn_free(str);
+
+  str = pn_string(NULL);
+  assert(pn_string_set(str, "") == 0);
+  assert(!strcmp(pn_string_get(str), ""));
+  assert(pn_string_addf(str, "%d", 42) == 0);
+  assert(!strcmp(pn_string_get(str), "42"));
+  pn_free(str);
+}
+
 static void test_map_iteration(int n)
 {
   pn_list_t *pairs = pn_list(PN_OBJECT, 2*n);
@@ -1041,6 +1067,55 @@ void test_heap(int seed, int size)
   pn_free(list);
 }
 
+PN_HANDLE(TEST_HANDLE)
+
+static void test_record(void)
+{
+  pn_record_t *record = pn_record();
+  void *a = pn_class_new(PN_OBJECT, 0);
+  void *b = pn_class_new(PN_OBJECT, 0);
+
+  // PN_LEGCTX is always defined, the other reserved handles are not
+  assert(pn_record_has(record, PN_LEGCTX));
+  assert(!pn_record_has(record, PN_HANDLERCTX));
+  assert(!pn_record_has(record, PN_BINDINGCTX));
+  assert(!pn_record_has(record, TEST_HANDLE));
+
+  // setting an undefined handle does nothing
+  pn_record_set(record, PN_BINDINGCTX, a);
+  assert(!pn_record_get(record, PN_BINDINGCTX));
+  assert(pn_refcount(a) == 1);
+
+  pn_record_def(record, PN_BINDINGCTX, PN_OBJECT);
+  pn_record_def(record, TEST_HANDLE, PN_OBJECT);
+  pn_record_set(record, PN_BINDINGCTX, a);
+  pn_record_set(record, TEST_HANDLE, b);
+  assert(pn_record_get(record, PN_BINDINGCTX) == a);
+  assert(pn_record_get(record, TEST_HANDLE) == b);
+  assert(!pn_record_get(record, PN_HANDLERCTX));
+  assert(pn_refcount(a) == 2);
+  assert(pn_refcount(b) == 2);
+
+  pn_record_set(record, PN_BINDINGCTX, b);
+  assert(pn_record_get(record, PN_BINDINGCTX) == b);
+  assert(pn_refcount(a) == 1);
+  assert(pn_refcount(b) == 3);
+
+  pn_record_clear(record);
+  assert(pn_record_has(record, PN_LEGCTX));
+  assert(!pn_record_has(record, PN_BINDINGCTX));
+  assert(!pn_record_has(record, TEST_HANDLE));
+  assert(pn_refcount(b) == 1);
+
+  pn_record_def(record, PN_BINDINGCTX, PN_OBJECT);
+  pn_record_set(record, PN_BINDINGCTX, a);
+  pn_decref(record);
+  assert(pn_refcount(a) == 1);
+
+  pn_decref(a);
+  pn_decref(b);
+}
+
 int main(int argc, char **argv)
 {
   for (size_t i = 0; i < 128; i++) {
@@ -1088,6 +1163,7 @@ int main(int argc, char **argv)
 
   test_string_format();
   test_string_addf();
+  test_string_null_storage();
 
   test_build_list();
   test_build_map();
@@ -1111,5 +1187,7 @@ int main(int argc, char **argv)
   test_map_coalesced_chain();
   test_map_coalesced_chain2();
 
+  test_record();
+
   return 0;
 }
@@ -23,11 +23,19 @@
 #include <proton/event.h>
 #include <proton/listener.h>
 #include <proton/proactor.h>
+#include <proton/ssl.h>
 #include <proton/transport.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <netinet/tcp.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
 static pn_millis_t timeout = 5*1000; /* timeout for hanging tests */
 
 static const char *localhost = "127.0.0.1"; /* host for connect/listen */
@@ -226,11 +234,238 @@ static void test_inactive(test_t *t) {
   pn_proactor_free(server);
 }
 
+/* SSL domains for the SSL tests */
+static pn_ssl_domain_t *client_domain, *server_domain;
+static const char *client_session_id;        /* Session the client resumes */
+static pn_ssl_resume_status_t client_resumed; /* Resume status seen by the client */
+static bool client_kernel_tls;               /* Kernel TLS used by the client */
+static bool server_kernel_tls;               /* Kernel TLS used by the server */
+static char client_cipher[64];               /* Cipher seen by the client */
+
+/* Set up SSL on a new connection, checking it closes cleanly */
+static handler_state_t ssl_common_handler(test_t *t, pn_event_t *e, pn_ssl_domain_t *domain,
+                                          const char *session_id) {
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_BOUND: {
+     pn_transport_t *tp = pn_event_transport(e);
+     TEST_CHECK(t, pn_ssl_init(pn_ssl(tp), domain, session_id) == 0, "pn_ssl_init failed");
+     return H_CONTINUE;
+   }
+   case PN_TRANSPORT_CLOSED: {
+     pn_condition_t *cond = pn_transport_condition(pn_event_transport(e));
+     if (!TEST_CHECK(t, !pn_condition_is_set(cond), "%s: %s", pn_condition_get_name(cond),
+                     pn_condition_get_description(cond)))
+       return H_FAILED;
+     return H_FINISHED;
+   }
+   default:
+    return H_CONTINUE;
+  }
+}
+
+/* Server side of test_ssl_kernel_tls: return the open and the close */
+static handler_state_t ssl_server_handler(test_t *t, pn_event_t *e) {
+  pn_connection_t *c = pn_event_connection(e);
+  switch (pn_event_type(e)) {
+   case PN_LISTENER_ACCEPT:
+    pn_listener_accept(pn_event_listener(e), pn_connection());
+    return H_CONTINUE;
+   case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_open(c);
+    return H_CONTINUE;
+   case PN_CONNECTION_REMOTE_CLOSE:
+    server_kernel_tls = pn_ssl_get_kernel_tls(pn_ssl(pn_event_transport(e)));
+    pn_connection_close(c);
+    return H_CONTINUE;
+   default:
+    return ssl_common_handler(t, e, server_domain, NULL);
+  }
+}
+
+/* Client side of test_ssl_kernel_tls: open, check the SSL state, close */
+static handler_state_t ssl_client_handler(test_t *t, pn_event_t *e) {
+  pn_connection_t *c = pn_event_connection(e);
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN: {
+     pn_ssl_t *ssl = pn_ssl(pn_event_transport(e));
+     TEST_CHECK(t, pn_ssl_get_cipher_name(ssl, client_cipher, sizeof(client_cipher)), "no cipher");
+     client_kernel_tls = pn_ssl_get_kernel_tls(ssl);
+     client_resumed = pn_ssl_resume_status(ssl);
+     pn_connection_close(c);
+     return H_CONTINUE;
+   }
+   default:
+    return ssl_common_handler(t, e, client_domain, client_session_id);
+  }
+}
+
+/* Create the SSL domains, return false if there is no SSL */
+static bool ssl_domains_init(test_t *t) {
+  client_domain = pn_ssl_domain(PN_SSL_MODE_CLIENT);
+  server_domain = pn_ssl_domain(PN_SSL_MODE_SERVER);
+  if (!client_domain || !server_domain) {
+    TEST_LOG(t, "skipped, no SSL");
+    return false;
+  }
+  TEST_CHECK(t, pn_ssl_domain_set_credentials(server_domain, SSL_DB "/server-certificate.pem",
+                                              SSL_DB "/server-private-key.pem", "server-password") == 0,
+             "cannot load server certificate");
+  client_session_id = NULL;
+  return true;
+}
+
+static void ssl_domains_free(void) {
+  pn_ssl_domain_free(client_domain);
+  pn_ssl_domain_free(server_domain);
+}
+
+/* Run one SSL connection between the client and server domains */
+static void ssl_connect(test_t *t) {
+  proactor_test_t pts[] =  { { t, ssl_client_handler }, { t, ssl_server_handler } };
+  proactor_test_init(pts, 2);
+  pn_proactor_t *client = pts[0].proactor, *server = pts[1].proactor;
+  test_port_t port = test_port();          /* Hold a port */
+
+  pn_proactor_listen(server, pn_listener(), localhost, port.str, 4);
+  pn_event_type_t etype = wait_for(server, PN_LISTENER_OPEN);
+  if (TEST_CHECK(t, PN_LISTENER_OPEN == etype, pn_event_type_name(etype))) {
+    sock_close(port.sock);
+    pn_connection_t *c = pn_connection();
+    pn_connection_open(c);
+    pn_proactor_connect(client, c, localhost, port.str);
+    proactor_test_run(pts, 2);
+  }
+  pn_proactor_free(client);
+  pn_proactor_free(server);
+}
+
+/* True if the kernel lets TLS be put on a TCP connection */
+static bool kernel_tls_available(void) {
+#ifdef __linux__
+  sock_t l = sock_bind0();
+  sock_t c = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  bool ok = listen(l, 1) == 0 && getsockname(l, (struct sockaddr*)&addr, &len) == 0 &&
+    connect(c, (struct sockaddr*)&addr, len) == 0 &&
+    setsockopt(c, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == 0;
+  sock_close(c);
+  sock_close(l);
+  return ok;
+#else
+  return false;
+#endif
+}
+
+/* SSL connection with kernel TLS requested at both ends.  Both ends use it
+   where the build and the kernel allow, otherwise the connection must carry
+   on in user space.
+*/
+static void test_ssl_kernel_tls(test_t *t) {
+  if (!ssl_domains_init(t)) return;
+  bool enabled = pn_ssl_domain_enable_kernel_tls(client_domain) == 0 &&
+    pn_ssl_domain_enable_kernel_tls(server_domain) == 0;
+  client_kernel_tls = server_kernel_tls = false;
+  ssl_connect(t);
+  if (enabled && kernel_tls_available() && strstr(client_cipher, "GCM")) {
+    TEST_CHECK(t, client_kernel_tls, "client did not use kernel TLS");
+    TEST_CHECK(t, server_kernel_tls, "server did not use kernel TLS");
+  } else {
+    TEST_CHECK(t, !client_kernel_tls && !server_kernel_tls, "kernel TLS used where it is not available");
+    TEST_LOG(t, "kernel TLS %s, only the fallback was checked",
+             !enabled ? "not supported by this build" :
+             strstr(client_cipher, "GCM") ? "not available from the kernel" : "not offered for this cipher");
+  }
+  ssl_domains_free();
+}
+
+/* A reconnecting client resumes its session from the server's cache, or
+   from a session ticket.
+*/
+static void test_ssl_session_resume(test_t *t) {
+  for (int tickets = 0; tickets < 2; ++tickets) {
+    if (!ssl_domains_init(t)) return;
+    TEST_CHECK(t, pn_ssl_domain_set_session_cache(server_domain, 16, 60) == 0, "");
+    TEST_CHECK(t, pn_ssl_domain_set_session_tickets(server_domain, tickets, tickets ? 60 : 0) == 0, "");
+    TEST_CHECK(t, pn_ssl_domain_set_session_cache(client_domain, 16, 60) != 0, "client cache");
+
+    client_session_id = "resume-me";
+    ssl_connect(t);
+    TEST_CHECK(t, client_resumed == PN_SSL_RESUME_NEW, "first connection resumed");
+    ssl_connect(t);
+    TEST_CHECK(t, client_resumed == PN_SSL_RESUME_REUSED, "second connection not resumed");
+
+    pn_ssl_resume_stats_t stats;
+    TEST_CHECK(t, pn_ssl_domain_get_resume_stats(server_domain, &stats) == 0, "");
+    TEST_CHECK(t, stats.handshakes == 2, "%d handshakes", (int) stats.handshakes);
+    TEST_CHECK(t, stats.resumed == 1, "%d resumed", (int) stats.resumed);
+    if (tickets) {
+      TEST_CHECK(t, stats.tickets_issued >= 1, "no tickets issued");
+      TEST_CHECK(t, stats.tickets_accepted == 1, "%d tickets accepted", (int) stats.tickets_accepted);
+    } else {
+      TEST_CHECK(t, stats.cached >= 1, "no sessions cached");
+    }
+    ssl_domains_free();
+  }
+}
+
+/* Let ms milliseconds go by */
+static void proactor_sleep(pn_millis_t ms) {
+  pn_proactor_t *p = pn_proactor();
+  pn_proactor_set_timeout(p, ms);
+  wait_for(p, PN_PROACTOR_TIMEOUT);
+  pn_proactor_free(p);
+}
+
+/* Session ticket keys change every lifetime.  A ticket made with the
+   previous key is accepted and replaced, one made with a key retired for
+   two lifetimes is refused.  Key ages are counted in whole seconds, so the
+   lifetime is 2s to leave room for the connections themselves.
+*/
+static void test_ssl_ticket_rotation(test_t *t) {
+  if (!ssl_domains_init(t)) return;
+  /* No server cache to resume from once the ticket is refused */
+  TEST_CHECK(t, pn_ssl_domain_set_session_cache(server_domain, 0, 0) == 0, "");
+  TEST_CHECK(t, pn_ssl_domain_set_session_tickets(server_domain, true, 2) == 0, "");
+  client_session_id = "rotate-me";
+  pn_ssl_resume_stats_t stats;
+
+  ssl_connect(t);
+  TEST_CHECK(t, client_resumed == PN_SSL_RESUME_NEW, "first connection resumed");
+  TEST_CHECK(t, pn_ssl_domain_get_resume_stats(server_domain, &stats) == 0, "");
+  uint64_t issued = stats.tickets_issued;
+  TEST_CHECK(t, issued >= 1, "no tickets issued");
+
+  proactor_sleep(2500);         /* The first key becomes the previous one */
+  ssl_connect(t);
+  TEST_CHECK(t, client_resumed == PN_SSL_RESUME_REUSED, "ticket from the previous key refused");
+  TEST_CHECK(t, pn_ssl_domain_get_resume_stats(server_domain, &stats) == 0, "");
+  TEST_CHECK(t, stats.tickets_accepted == 1, "%d tickets accepted", (int) stats.tickets_accepted);
+  TEST_CHECK(t, stats.tickets_issued > issued, "ticket not replaced");
+  TEST_CHECK(t, stats.tickets_rejected == 0, "%d tickets rejected", (int) stats.tickets_rejected);
+
+  /* A new session, with a ticket made with the second key */
+  client_session_id = "rotate-me-too";
+  ssl_connect(t);
+  TEST_CHECK(t, client_resumed == PN_SSL_RESUME_NEW, "new session resumed");
+
+  proactor_sleep(4500);         /* The second key is retired for two lifetimes */
+  ssl_connect(t);
+  TEST_CHECK(t, client_resumed == PN_SSL_RESUME_NEW, "ticket from a retired key accepted");
+  TEST_CHECK(t, pn_ssl_domain_get_resume_stats(server_domain, &stats) == 0, "");
+  TEST_CHECK(t, stats.tickets_accepted == 1, "%d tickets accepted", (int) stats.tickets_accepted);
+  TEST_CHECK(t, stats.tickets_rejected == 1, "%d tickets rejected", (int) stats.tickets_rejected);
+  ssl_domains_free();
+}
+
 int main(int argv, char** argc) {
   int failed = 0;
   RUN_TEST(failed, t, test_inactive(&t));
   RUN_TEST(failed, t, test_interrupt_timeout(&t));
   RUN_TEST(failed, t, test_early_error(&t));
   RUN_TEST(failed, t, test_listen_connect(&t));
+  RUN_TEST(failed, t, test_ssl_kernel_tls(&t));
+  RUN_TEST(failed, t, test_ssl_session_resume(&t));
+  RUN_TEST(failed, t, test_ssl_ticket_rotation(&t));
   return failed;
 }
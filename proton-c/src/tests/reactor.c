@@ -549,6 +549,74 @@ static void test_reactor_schedule_cancel(void) {
   pn_free(events);
 }
 
+static void test_timer_cancel(void) {
+  pn_collector_t *collector = pn_collector();
+  pn_timer_t *timer = pn_timer(collector);
+  pn_timestamp_t deadlines[] = {1000, 1001, 1063, 1064, 5000, 300000, 1000000000};
+  const int n = sizeof(deadlines)/sizeof(deadlines[0]);
+  pn_task_t *tasks[sizeof(deadlines)/sizeof(deadlines[0])];
+  // start the clock before the first deadline so every task is in the wheel
+  pn_timer_tick(timer, 999);
+  for (int i = n - 1; i >= 0; i--) {
+    tasks[i] = pn_timer_schedule(timer, deadlines[i]);
+  }
+  assert(pn_timer_tasks(timer) == n);
+  assert(pn_timer_deadline(timer) == 1000);
+  // cancelled tasks are dropped at once, not when they fall due
+  pn_task_cancel(tasks[0]);
+  pn_task_cancel(tasks[4]);
+  assert(pn_timer_tasks(timer) == n - 2);
+  assert(pn_timer_deadline(timer) == 1001);
+  for (int i = 1; i < n; i++) {
+    if (i == 4) continue;
+    pn_timer_tick(timer, deadlines[i] - 1);
+    assert(!pn_collector_peek(collector));
+    pn_timer_tick(timer, deadlines[i]);
+    pn_event_t *event = pn_collector_peek(collector);
+    assert(event && pn_event_type(event) == PN_TIMER_TASK);
+    assert(pn_event_context(event) == tasks[i]);
+    pn_collector_pop(collector);
+    assert(!pn_collector_peek(collector));
+  }
+  assert(pn_timer_tasks(timer) == 0);
+  assert(pn_timer_deadline(timer) == 0);
+  pn_free(timer);
+  pn_free(collector);
+}
+
+// Tasks scheduled in deadline order are spread over the levels of the
+// wheel and fire on time as the ticks cross the level boundaries
+static void test_timer_levels(void) {
+  pn_collector_t *collector = pn_collector();
+  pn_timer_t *timer = pn_timer(collector);
+  const pn_timestamp_t start = 1000000;
+  pn_timestamp_t offsets[] = {0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145,
+                              16777216, 1073741824, ((pn_timestamp_t) 1 << 36) + 5};
+  const int n = sizeof(offsets)/sizeof(offsets[0]);
+  pn_task_t *tasks[sizeof(offsets)/sizeof(offsets[0])];
+  pn_timer_tick(timer, start - 1);
+  for (int i = 0; i < n; i++) {
+    tasks[i] = pn_timer_schedule(timer, start + offsets[i]);
+  }
+  assert(pn_timer_tasks(timer) == n);
+  for (int i = 0; i < n; i++) {
+    pn_timestamp_t deadline = start + offsets[i];
+    assert(pn_timer_deadline(timer) == deadline);
+    pn_timer_tick(timer, deadline - 1);
+    assert(!pn_collector_peek(collector));
+    pn_timer_tick(timer, deadline);
+    pn_event_t *event = pn_collector_peek(collector);
+    assert(event && pn_event_type(event) == PN_TIMER_TASK);
+    assert(pn_event_context(event) == tasks[i]);
+    pn_collector_pop(collector);
+    assert(!pn_collector_peek(collector));
+    assert(pn_timer_tasks(timer) == n - i - 1);
+  }
+  assert(pn_timer_deadline(timer) == 0);
+  pn_free(timer);
+  pn_free(collector);
+}
+
 int main(int argc, char **argv)
 {
   test_reactor_event_root();
@@ -574,5 +642,7 @@ int main(int argc, char **argv)
   test_reactor_schedule();
   test_reactor_schedule_handler();
   test_reactor_schedule_cancel();
+  test_timer_cancel();
+  test_timer_levels();
   return 0;
 }
@@ -90,6 +90,19 @@ static inline bool test_check_(test_t *t, bool expr, const char *sexpr, const ch
 
 #define TEST_CHECK(TEST, EXPR, ...) test_check_((TEST), (EXPR), #EXPR, __FILE__, __LINE__, __VA_ARGS__)
 
+/* Print a printf-style note about the test, e.g. what it could not check on this system. Use via TEST_LOG. */
+static inline void test_log_(test_t *t, const char *file, int line, const char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  printf("%s:%d:[%s] note: ", file, line, t->name);
+  vprintf(fmt, ap);
+  printf("\n");
+  fflush(stdout);
+  va_end(ap);
+}
+
+#define TEST_LOG(TEST, ...) test_log_((TEST), __FILE__, __LINE__, __VA_ARGS__)
+
 /* T is name of a test_t variable, EXPR is the test expression (which should update T)
    FAILED is incremented if the test has errors
 */
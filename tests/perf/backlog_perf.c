@@ -0,0 +1,95 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure the cost of draining an outgoing transport backlog.
+ *
+ * A sender queues a backlog of 64KB deliveries, which the transport
+ * frames all at once, then the output is taken 64KB at a time as a
+ * socket would. The cost per byte should not depend on the backlog size.
+ */
+
+#include "perf_util.h"
+
+#include <proton/engine.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHUNK (64*1024)
+
+static double drain(size_t backlog)
+{
+  transport_pair_t p;
+  transport_pair_init(&p);
+  pn_connection_t *c1 = p.c1, *c2 = p.c2;
+  pn_transport_t *t1 = p.t1, *t2 = p.t2;
+
+  pn_connection_open(c1);
+  pn_session_t *ssn = pn_session(c1);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "backlog");
+  pn_link_open(snd);
+  pump(t1, t2);
+
+  pn_connection_open(c2);
+  pn_session_t *rssn = pn_session_head(c2, 0);
+  pn_session_set_incoming_capacity(rssn, 2*backlog);
+  pn_session_open(rssn);
+  pn_link_t *rcv = pn_link_head(c2, 0);
+  pn_link_open(rcv);
+  pn_link_flow(rcv, backlog/CHUNK + 1);
+  pump(t1, t2);
+
+  char *body = (char *) calloc(CHUNK, 1);
+  for (size_t i = 0; i < backlog/CHUNK; ++i) {
+    char tag[16];
+    snprintf(tag, sizeof(tag), "%lu", (unsigned long) i);
+    pn_delivery(snd, pn_dtag(tag, strlen(tag)));
+    pn_link_send(snd, body, CHUNK);
+    pn_link_advance(snd);
+  }
+
+  clock_t start = clock();
+  size_t total = 0;
+  ssize_t pending;
+  while ((pending = pn_transport_pending(t1)) > 0) {
+    size_t n = pending < CHUNK ? (size_t) pending : CHUNK;
+    pn_transport_pop(t1, n);
+    total += n;
+  }
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  free(body);
+  transport_pair_free(&p);
+  return total ? secs * 1e9 / total : 0;
+}
+
+int main(int argc, char **argv)
+{
+  size_t max = (argc > 1) ? (size_t) atol(argv[1]) : 64;
+  printf("backlog_mb\tns_per_byte\n");
+  for (size_t mb = 1; mb <= max; mb *= 2) {
+    printf("%lu\t%.3f\n", (unsigned long) mb, drain(mb*1024*1024));
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Count the heap allocations made by short lived connections.
+ *
+ * Each cycle connects a client and server transport in memory, opens a
+ * session and a link, sends one message and settles it, then closes
+ * everything and frees both ends, as an RPC client making a connection
+ * per request would. Reports the allocations (malloc, calloc and
+ * realloc calls, counted with a malloc hook on glibc) and the time per
+ * cycle.
+ */
+
+#include "perf_util.h"
+
+#include <proton/connection.h>
+#include <proton/delivery.h>
+#include <proton/link.h>
+#include <proton/session.h>
+#include <proton/transport.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static unsigned long allocations = 0;
+
+#ifdef __GLIBC__
+// The hooks must be visible to the libraries despite -fvisibility=hidden
+#define HOOK __attribute__((visibility("default")))
+
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+
+HOOK void *malloc(size_t size) {
+  ++allocations;
+  return __libc_malloc(size);
+}
+
+HOOK void *calloc(size_t n, size_t size) {
+  ++allocations;
+  return __libc_calloc(n, size);
+}
+
+HOOK void *realloc(void *p, size_t size) {
+  ++allocations;
+  return __libc_realloc(p, size);
+}
+#endif
+
+static void cycle(void)
+{
+  transport_pair_t p;
+  transport_pair_init(&p);
+  pn_connection_t *c1 = p.c1, *c2 = p.c2;
+  pn_transport_t *t1 = p.t1, *t2 = p.t2;
+
+  pn_connection_open(c1);
+  pn_session_t *ssn = pn_session(c1);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "request");
+  pn_link_open(snd);
+  pump(t1, t2);
+
+  pn_connection_open(c2);
+  pn_session_t *rssn = pn_session_head(c2, 0);
+  pn_session_open(rssn);
+  pn_link_t *rcv = pn_link_head(c2, 0);
+  pn_link_open(rcv);
+  pn_link_flow(rcv, 1);
+  pump(t1, t2);
+
+  pn_delivery(snd, pn_dtag("t", 1));
+  pn_link_send(snd, "request body", 12);
+  pn_link_advance(snd);
+  pump(t1, t2);
+
+  pn_delivery_t *d = pn_link_current(rcv);
+  if (!d) {
+    fprintf(stderr, "no delivery\n");
+    exit(1);
+  }
+  pn_link_advance(rcv);
+  pn_delivery_update(d, PN_ACCEPTED);
+  pn_delivery_settle(d);
+  pump(t1, t2);
+  pn_delivery_settle(pn_unsettled_head(snd));
+
+  pn_link_close(snd);
+  pn_session_close(ssn);
+  pn_connection_close(c1);
+  pump(t1, t2);
+  pn_link_close(rcv);
+  pn_session_close(rssn);
+  pn_connection_close(c2);
+  pump(t1, t2);
+
+  transport_pair_free(&p);
+}
+
+int main(int argc, char **argv)
+{
+  int n = (argc > 1) ? atoi(argv[1]) : 20000;
+  cycle();
+  allocations = 0;
+  clock_t start = clock();
+  for (int i = 0; i < n; ++i) {
+    cycle();
+  }
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("cycles\tallocs_per_cycle\tus_per_cycle\n");
+  printf("%d\t%.1f\t%.1f\n", n, (double) allocations / n, secs * 1e6 / n);
+  return 0;
+}
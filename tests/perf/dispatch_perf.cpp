@@ -0,0 +1,128 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure the time proton::io::connection_driver::dispatch takes to
+ * hand events to a messaging_handler, at each end of a pair of in-memory
+ * connection_drivers sending small messages. The handlers do as little
+ * as possible, so the time is mostly the binding's own per event work.
+ */
+
+#include "perf_util.h"
+
+#include <proton/connection.hpp>
+#include <proton/connection_options.hpp>
+#include <proton/container.hpp>
+#include <proton/delivery.hpp>
+#include <proton/io/connection_driver.hpp>
+#include <proton/message.hpp>
+#include <proton/messaging_handler.hpp>
+#include <proton/receiver.hpp>
+#include <proton/receiver_options.hpp>
+#include <proton/sender.hpp>
+#include <proton/tracker.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+namespace {
+
+using proton::io::connection_driver;
+using proton::io::const_buffer;
+using proton::io::mutable_buffer;
+
+class sender_handler : public proton::messaging_handler {
+  public:
+    proton::message message;
+    int total, sent, accepted;
+
+    sender_handler(int n) : total(n), sent(0), accepted(0) {}
+
+    void on_connection_open(proton::connection &c) PN_CPP_OVERRIDE {
+        c.open_sender("perf");
+    }
+
+    void on_sendable(proton::sender &s) PN_CPP_OVERRIDE {
+        while (s.credit() > 0 && sent < total) {
+            s.send(message);
+            ++sent;
+        }
+    }
+
+    void on_tracker_accept(proton::tracker &) PN_CPP_OVERRIDE {
+        ++accepted;
+    }
+};
+
+class receiver_handler : public proton::messaging_handler {
+  public:
+    int received;
+
+    receiver_handler() : received(0) {}
+
+    void on_receiver_open(proton::receiver &r) PN_CPP_OVERRIDE {
+        r.open(proton::receiver_options().credit_window(1000));
+    }
+
+    void on_message(proton::delivery &, proton::message &) PN_CPP_OVERRIDE {
+        ++received;
+    }
+};
+
+std::clock_t timed_dispatch(connection_driver &d) {
+    std::clock_t start = std::clock();
+    d.dispatch();
+    return std::clock() - start;
+}
+
+double ns_per(std::clock_t t, int n) {
+    return double(t) * 1e9 / CLOCKS_PER_SEC / n;
+}
+
+}
+
+int main(int argc, char **argv) {
+    int n = (argc > 1) ? std::atoi(argv[1]) : 500000;
+    sender_handler sh(n);
+    receiver_handler rh;
+    sh.message.body("x");
+
+    // The container is never run, the server side needs one for its defaults
+    proton::container container;
+    connection_driver a(container), b(container);
+    a.connect(proton::connection_options().handler(sh));
+    b.accept(proton::connection_options().handler(rh));
+
+    std::clock_t sender_time = 0, receiver_time = 0;
+    while (sh.accepted < n) {
+        sender_time += timed_dispatch(a);
+        receiver_time += timed_dispatch(b);
+        if (!pump_drivers(a, b) && !pump_drivers(b, a) && sh.accepted < n) {
+            std::fprintf(stderr, "stalled after %d messages\n", sh.accepted);
+            return 1;
+        }
+    }
+
+    std::printf("end\tmessages\tdispatch_ns_per_message\n");
+    std::printf("sender\t%d\t%.0f\n", n, ns_per(sender_time, n));
+    std::printf("receiver\t%d\t%.0f\n", n, ns_per(receiver_time, n));
+    return 0;
+}
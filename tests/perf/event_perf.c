@@ -0,0 +1,106 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure putting events on a collector and taking them off.
+ *
+ * cycle: puts one event and pops it again.
+ *
+ * burst: each batch puts a PN_DELIVERY event for each of BATCH
+ * deliveries with a PN_LINK_FLOW event for the link after each one,
+ * as incoming transfers do, then updates every delivery again before
+ * the batch is drained with pn_collector_next.
+ *
+ * Reports the time per event put and the number of events delivered.
+ */
+
+#include <proton/event.h>
+#include <proton/object.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BATCH 100
+
+static void report(const char *name, uint64_t puts, clock_t start, uint64_t events)
+{
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%s\t%lu\t%.1f\t%lu\n", name, (unsigned long) puts, secs * 1e9 / puts,
+         (unsigned long) events);
+}
+
+static void cycle(size_t n)
+{
+  pn_collector_t *collector = pn_collector();
+  void *obj = pn_class_new(PN_OBJECT, 0);
+  uint64_t events = 0;
+
+  clock_t start = clock();
+  for (size_t i = 0; i < n; ++i) {
+    pn_collector_put(collector, PN_OBJECT, obj, PN_DELIVERY);
+    if (pn_collector_peek(collector)) events++;
+    pn_collector_pop(collector);
+  }
+  report("cycle", n, start, events);
+
+  pn_decref(obj);
+  pn_free(collector);
+}
+
+static void burst(size_t n)
+{
+  pn_collector_t *collector = pn_collector();
+  void *link = pn_class_new(PN_OBJECT, 0);
+  void *deliveries[BATCH];
+  for (int i = 0; i < BATCH; ++i) {
+    deliveries[i] = pn_class_new(PN_OBJECT, 0);
+  }
+  uint64_t puts = 0, events = 0;
+
+  clock_t start = clock();
+  for (size_t b = 0; b < n / (3 * BATCH); ++b) {
+    for (int i = 0; i < BATCH; ++i) {
+      pn_collector_put(collector, PN_OBJECT, deliveries[i], PN_DELIVERY);
+      pn_collector_put(collector, PN_OBJECT, link, PN_LINK_FLOW);
+    }
+    for (int i = 0; i < BATCH; ++i) {
+      pn_collector_put(collector, PN_OBJECT, deliveries[i], PN_DELIVERY);
+    }
+    puts += 3 * BATCH;
+    while (pn_collector_next(collector)) events++;
+  }
+  report("burst", puts, start, events);
+
+  for (int i = 0; i < BATCH; ++i) {
+    pn_decref(deliveries[i]);
+  }
+  pn_decref(link);
+  pn_free(collector);
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = (argc > 1) ? (size_t) atol(argv[1]) : 10000000;
+  printf("test\tputs\tns_per_put\tevents\n");
+  cycle(n);
+  burst(n);
+  return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure the rate at which a transport processes frames.
+ *
+ * A sender and receiver exchange small messages in rounds: the receiver
+ * grants credit with a flow, the sender sends transfers and the receiver
+ * settles every other delivery then the rest, so each round is one flow,
+ * ROUND transfers and ROUND dispositions. The time spent in
+ * pn_transport_push, where incoming frames are decoded and dispatched,
+ * and in pn_transport_pending, where outgoing frames are generated, is
+ * counted separately for each end.
+ */
+
+#include "perf_util.h"
+
+#include <proton/delivery.h>
+#include <proton/engine.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUND 10
+
+static clock_t push_time[2];
+static clock_t pending_time[2];
+
+// pump() from perf_util.h, timing the calls that hand frames over
+static void timed_pump(pn_transport_t *t1, pn_transport_t *t2)
+{
+  int work;
+  do {
+    work = 0;
+    pn_transport_t *from = t1, *to = t2;
+    for (int i = 0; i < 2; ++i) {
+      clock_t start = clock();
+      ssize_t out = pn_transport_pending(from);
+      pending_time[i] += clock() - start;
+      ssize_t in = pn_transport_capacity(to);
+      if (out > 0 && in > 0) {
+        size_t n = (size_t)(out < in ? out : in);
+        start = clock();
+        pn_transport_push(to, pn_transport_head(from), n);
+        push_time[i] += clock() - start;
+        pn_transport_pop(from, n);
+        work = 1;
+      }
+      from = t2; to = t1;
+    }
+  } while (work);
+}
+
+static double rate(uint64_t frames, clock_t time)
+{
+  double secs = (double) time / CLOCKS_PER_SEC;
+  return secs ? frames / secs : 0;
+}
+
+static void report(const char *name, uint64_t in, clock_t in_time, uint64_t out, clock_t out_time)
+{
+  printf("%s\t%lu\t%.0f\t%lu\t%.0f\n", name, (unsigned long) in, rate(in, in_time),
+         (unsigned long) out, rate(out, out_time));
+}
+
+int main(int argc, char **argv)
+{
+  size_t rounds = (argc > 1) ? (size_t) atol(argv[1]) : 20000;
+
+  transport_pair_t p;
+  transport_pair_init(&p);
+  pn_connection_t *c1 = p.c1, *c2 = p.c2;
+  pn_transport_t *t1 = p.t1, *t2 = p.t2;
+
+  pn_connection_open(c1);
+  pn_session_t *ssn = pn_session(c1);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "frames");
+  pn_link_open(snd);
+  pump(t1, t2);
+
+  pn_connection_open(c2);
+  pn_session_t *rssn = pn_session_head(c2, 0);
+  pn_session_open(rssn);
+  pn_link_t *rcv = pn_link_head(c2, 0);
+  pn_link_open(rcv);
+  pump(t1, t2);
+
+  push_time[0] = push_time[1] = 0;
+  pending_time[0] = pending_time[1] = 0;
+  uint64_t in1 = pn_transport_get_frames_input(t1);
+  uint64_t in2 = pn_transport_get_frames_input(t2);
+  uint64_t out1 = pn_transport_get_frames_output(t1);
+  uint64_t out2 = pn_transport_get_frames_output(t2);
+  char body[64];
+  memset(body, 'x', sizeof(body));
+  pn_delivery_t *dlvs[ROUND];
+  for (size_t r = 0; r < rounds; ++r) {
+    pn_link_flow(rcv, ROUND);
+    timed_pump(t1, t2);
+    for (int i = 0; i < ROUND; ++i) {
+      pn_delivery(snd, pn_dtag((const char *) &i, sizeof(i)));
+      pn_link_send(snd, body, sizeof(body));
+      pn_link_advance(snd);
+    }
+    timed_pump(t1, t2);
+    for (int i = 0; i < ROUND; ++i) {
+      dlvs[i] = pn_link_current(rcv);
+      if (!dlvs[i]) {
+        fprintf(stderr, "missing delivery in round %lu\n", (unsigned long) r);
+        return 1;
+      }
+      pn_link_advance(rcv);
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+      for (int i = pass; i < ROUND; i += 2) {
+        pn_delivery_update(dlvs[i], PN_ACCEPTED);
+        pn_delivery_settle(dlvs[i]);
+      }
+      timed_pump(t1, t2);
+    }
+    for (pn_delivery_t *d = pn_unsettled_head(snd); d; d = pn_unsettled_head(snd)) {
+      pn_delivery_settle(d);
+    }
+  }
+  in1 = pn_transport_get_frames_input(t1) - in1;
+  in2 = pn_transport_get_frames_input(t2) - in2;
+  out1 = pn_transport_get_frames_output(t1) - out1;
+  out2 = pn_transport_get_frames_output(t2) - out2;
+
+  printf("end\tframes_in\tin_per_sec\tframes_out\tout_per_sec\n");
+  report("sender", in1, push_time[1], out1, pending_time[0]);
+  report("receiver", in2, push_time[0], out2, pending_time[1]);
+
+  transport_pair_free(&p);
+  return 0;
+}
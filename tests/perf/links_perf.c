@@ -0,0 +1,111 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure the cost of transport processing on a connection with many
+ * idle links.
+ *
+ * A connection has a given number of attached links but only one of them
+ * carries traffic: each message is sent, received, accepted and settled
+ * on its own. Reports the time per message, which should not depend on
+ * the number of idle links.
+ */
+
+#include "perf_util.h"
+
+#include <proton/delivery.h>
+#include <proton/engine.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void run(size_t links, size_t messages)
+{
+  transport_pair_t p;
+  transport_pair_init(&p);
+  pn_connection_t *c1 = p.c1, *c2 = p.c2;
+  pn_transport_t *t1 = p.t1, *t2 = p.t2;
+
+  pn_connection_open(c1);
+  pn_session_t *ssn = pn_session(c1);
+  pn_session_open(ssn);
+  pn_link_t *snd = NULL;
+  for (size_t i = 0; i < links; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "link-%lu", (unsigned long) i);
+    pn_link_t *link = pn_sender(ssn, name);
+    pn_link_open(link);
+    if (!snd) snd = link;
+  }
+  pump(t1, t2);
+
+  pn_connection_open(c2);
+  pn_session_open(pn_session_head(c2, 0));
+  pn_link_t *rcv = NULL;
+  for (pn_link_t *link = pn_link_head(c2, 0); link; link = pn_link_next(link, 0)) {
+    pn_link_open(link);
+    if (!strcmp(pn_link_name(link), "link-0")) rcv = link;
+  }
+  pn_link_flow(rcv, 1000);
+  pump(t1, t2);
+
+  clock_t start = clock();
+  for (size_t i = 0; i < messages; ++i) {
+    pn_delivery(snd, pn_dtag((const char *) &i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+    pump(t1, t2);
+    pn_delivery_t *d = pn_link_current(rcv);
+    if (!d) {
+      fprintf(stderr, "message %lu not received\n", (unsigned long) i);
+      exit(1);
+    }
+    pn_link_advance(rcv);
+    pn_link_flow(rcv, 1);
+    pn_delivery_update(d, PN_ACCEPTED);
+    pn_delivery_settle(d);
+    pump(t1, t2);
+    d = pn_unsettled_head(snd);
+    if (!d || !pn_delivery_remote_state(d)) {
+      fprintf(stderr, "message %lu not settled\n", (unsigned long) i);
+      exit(1);
+    }
+    pn_delivery_settle(d);
+  }
+  pump(t1, t2);
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("%lu\t%lu\t%.0f\n", (unsigned long) links, (unsigned long) messages,
+         secs * 1e9 / messages);
+
+  transport_pair_free(&p);
+}
+
+int main(int argc, char **argv)
+{
+  size_t messages = (argc > 1) ? (size_t) atol(argv[1]) : 100000;
+  printf("links\tmessages\tns_per_message\n");
+  run(1, messages);
+  run(100, messages);
+  run(10000, messages);
+  return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure engine throughput and latency between two pn_connection_driver_t
+ * connected back to back in memory, with no sockets, threads or second
+ * process involved.
+ *
+ * A sender spreads messages over one or more links of a session as the
+ * receiver grants credit, and the receiver tops each link's credit back
+ * up to the window once half of it is used. Messages are either sent
+ * presettled or accepted and settled by the receiver, and the run ends
+ * when the sender has seen every message settled.
+ *
+ * Each configuration of message size, link count, settle mode and credit
+ * window prints one tab separated line: the message and byte rates, and
+ * percentiles of the latency from the sender's pn_link_send to the
+ * receiver seeing the complete message. The latency includes the time a
+ * message waits behind the others already sent on the connection.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "perf_util.h"
+
+#include <proton/connection.h>
+#include <proton/connection_driver.h>
+#include <proton/delivery.h>
+#include <proton/link.h>
+#include <proton/session.h>
+#include <proton/transport.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+static uint64_t now_ns(void)
+{
+  LARGE_INTEGER count, frequency;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)((double) count.QuadPart * 1e9 / (double) frequency.QuadPart);
+}
+#else
+#include <time.h>
+
+static uint64_t now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+#endif
+
+typedef struct {
+  size_t size;
+  size_t links;
+  bool settled;
+  int credit;
+} config_t;
+
+typedef struct {
+  config_t config;
+  size_t messages;
+  size_t sent;
+  size_t received;
+  size_t settled;
+  char *body;
+  char *scratch;
+  uint64_t *sent_at;
+  uint64_t *latency;
+  uint64_t start;
+} run_t;
+
+static void fail(const char *msg)
+{
+  fprintf(stderr, "%s\n", msg);
+  exit(1);
+}
+
+static void send_messages(run_t *r, pn_link_t *link)
+{
+  while (pn_link_credit(link) > 0 && r->sent < r->messages) {
+    uint64_t seq = r->sent++;
+    if (seq == 0) r->start = now_ns();
+    memcpy(r->body, &seq, sizeof(seq));
+    pn_delivery_t *d = pn_delivery(link, pn_dtag((const char *) &seq, sizeof(seq)));
+    r->sent_at[seq] = now_ns();
+    pn_link_send(link, r->body, r->config.size);
+    pn_link_advance(link);
+    if (r->config.settled) {
+      pn_delivery_settle(d);
+      r->settled++;
+    }
+  }
+}
+
+static void sender_event(run_t *r, pn_event_t *e)
+{
+  switch (pn_event_type(e)) {
+   case PN_LINK_FLOW:
+    send_messages(r, pn_event_link(e));
+    break;
+
+   case PN_DELIVERY: {
+     pn_delivery_t *d = pn_event_delivery(e);
+     if (!pn_delivery_remote_state(d)) break;
+     if (pn_delivery_remote_state(d) != PN_ACCEPTED) fail("message not accepted");
+     pn_delivery_settle(d);
+     r->settled++;
+     break;
+   }
+
+   case PN_TRANSPORT_ERROR:
+    fail("sender transport error");
+    break;
+
+   default:
+    break;
+  }
+}
+
+static void receiver_event(run_t *r, pn_event_t *e)
+{
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_open(pn_event_connection(e));
+    break;
+
+   case PN_SESSION_REMOTE_OPEN:
+    pn_session_open(pn_event_session(e));
+    break;
+
+   case PN_LINK_REMOTE_OPEN: {
+     pn_link_t *link = pn_event_link(e);
+     pn_link_open(link);
+     pn_link_flow(link, r->config.credit);
+     break;
+   }
+
+   case PN_DELIVERY: {
+     pn_delivery_t *d = pn_event_delivery(e);
+     if (!pn_delivery_readable(d) || pn_delivery_partial(d)) break;
+     pn_link_t *link = pn_delivery_link(d);
+     if (pn_link_recv(link, r->scratch, r->config.size) != (ssize_t) r->config.size) {
+       fail("short message");
+     }
+     uint64_t seq;
+     memcpy(&seq, r->scratch, sizeof(seq));
+     r->latency[r->received++] = now_ns() - r->sent_at[seq];
+     pn_link_advance(link);
+     if (!pn_delivery_settled(d)) pn_delivery_update(d, PN_ACCEPTED);
+     pn_delivery_settle(d);
+     int credit = pn_link_credit(link);
+     if (credit <= r->config.credit / 2) pn_link_flow(link, r->config.credit - credit);
+     break;
+   }
+
+   case PN_TRANSPORT_ERROR:
+    fail("receiver transport error");
+    break;
+
+   default:
+    break;
+  }
+}
+
+static int compare(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(run_t *r, double p)
+{
+  size_t i = (size_t)(p * (double)(r->messages - 1));
+  return (double) r->latency[i] / 1e3;
+}
+
+static void run(config_t config, size_t messages)
+{
+  run_t r;
+  memset(&r, 0, sizeof(r));
+  r.config = config;
+  r.messages = messages;
+  r.body = (char *) calloc(config.size, 1);
+  r.scratch = (char *) malloc(config.size);
+  r.sent_at = (uint64_t *) malloc(messages * sizeof(uint64_t));
+  r.latency = (uint64_t *) malloc(messages * sizeof(uint64_t));
+
+  pn_connection_driver_t a, b;
+  pn_connection_driver_init(&a, NULL, NULL);
+  pn_connection_driver_init(&b, NULL, NULL);
+  pn_transport_set_server(b.transport);
+
+  pn_connection_open(a.connection);
+  pn_session_t *ssn = pn_session(a.connection);
+  pn_session_open(ssn);
+  for (size_t i = 0; i < config.links; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "link-%lu", (unsigned long) i);
+    pn_link_t *link = pn_sender(ssn, name);
+    if (config.settled) pn_link_set_snd_settle_mode(link, PN_SND_SETTLED);
+    pn_link_open(link);
+  }
+
+  while (r.received < messages || r.settled < messages) {
+    bool work = false;
+    pn_event_t *e;
+    while ((e = pn_connection_driver_next_event(&a))) {
+      sender_event(&r, e);
+      work = true;
+    }
+    while ((e = pn_connection_driver_next_event(&b))) {
+      receiver_event(&r, e);
+      work = true;
+    }
+    if (pump_drivers(&a, &b)) work = true;
+    if (pump_drivers(&b, &a)) work = true;
+    if (!work) fail("stalled");
+  }
+  double secs = (double)(now_ns() - r.start) / 1e9;
+
+  qsort(r.latency, messages, sizeof(uint64_t), compare);
+  printf("%lu\t%lu\t%s\t%d\t%lu\t%.0f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n",
+         (unsigned long) config.size, (unsigned long) config.links,
+         config.settled ? "settled" : "unsettled", config.credit,
+         (unsigned long) messages, messages / secs,
+         (double) messages * config.size / secs / 1e6,
+         percentile_us(&r, 0.5), percentile_us(&r, 0.9), percentile_us(&r, 0.99),
+         percentile_us(&r, 0.999), percentile_us(&r, 1));
+  fflush(stdout);
+
+  pn_connection_driver_destroy(&a);
+  pn_connection_driver_destroy(&b);
+  free(r.body);
+  free(r.scratch);
+  free(r.sent_at);
+  free(r.latency);
+}
+
+int main(int argc, char **argv)
+{
+  static const size_t sizes[] = { 16, 1024, 65536 };
+  static const size_t links[] = { 1, 16 };
+  static const int credits[] = { 1, 100, 1000 };
+  size_t messages = (argc > 1) ? (size_t) atol(argv[1]) : 20000;
+
+  printf("size\tlinks\tsettle\tcredit\tmessages\tmsgs_per_sec\tmbytes_per_sec"
+         "\tlatency_p50_us\tlatency_p90_us\tlatency_p99_us\tlatency_p999_us\tlatency_max_us\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    for (size_t l = 0; l < sizeof(links) / sizeof(links[0]); ++l) {
+      for (int settled = 1; settled >= 0; --settled) {
+        for (size_t c = 0; c < sizeof(credits) / sizeof(credits[0]); ++c) {
+          config_t config = { sizes[s], links[l], settled != 0, credits[c] };
+          run(config, messages);
+        }
+      }
+    }
+  }
+  return 0;
+}
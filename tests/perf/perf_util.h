@@ -0,0 +1,120 @@
+#ifndef TESTS_PERF_PERF_UTIL_H
+#define TESTS_PERF_PERF_UTIL_H
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+  Helpers shared by the benchmarks, usable from C and C++. The C++ helpers
+  are templates so that C benchmarks built as C++ need no C++ binding headers.
+  */
+
+#include <proton/type_compat.h>
+#include <proton/connection_driver.h>
+#include <proton/engine.h>
+
+#include <string.h>
+
+/* A client and a server connection, each bound to its own transport */
+typedef struct transport_pair_t {
+  pn_connection_t *c1, *c2;
+  pn_transport_t *t1, *t2;
+} transport_pair_t;
+
+static inline void transport_pair_init(transport_pair_t *p) {
+  p->c1 = pn_connection();
+  p->t1 = pn_transport();
+  pn_transport_bind(p->t1, p->c1);
+  p->c2 = pn_connection();
+  p->t2 = pn_transport();
+  pn_transport_set_server(p->t2);
+  pn_transport_bind(p->t2, p->c2);
+}
+
+static inline void transport_pair_free(transport_pair_t *p) {
+  pn_transport_unbind(p->t1);
+  pn_transport_free(p->t1);
+  pn_connection_free(p->c1);
+  pn_transport_unbind(p->t2);
+  pn_transport_free(p->t2);
+  pn_connection_free(p->c2);
+}
+
+/* Move bytes both ways between two transports until neither has any to send */
+static inline void pump(pn_transport_t *t1, pn_transport_t *t2) {
+  int work;
+  do {
+    work = 0;
+    pn_transport_t *from = t1, *to = t2;
+    for (int i = 0; i < 2; ++i) {
+      ssize_t out = pn_transport_pending(from);
+      ssize_t in = pn_transport_capacity(to);
+      if (out > 0 && in > 0) {
+        size_t n = (size_t)(out < in ? out : in);
+        pn_transport_push(to, pn_transport_head(from), n);
+        pn_transport_pop(from, n);
+        work = 1;
+      }
+      from = t2; to = t1;
+    }
+  } while (work);
+}
+
+/* Move the bytes written by one driver into the other */
+static inline bool pump_drivers(pn_connection_driver_t *from, pn_connection_driver_t *to) {
+  bool moved = false;
+  for (;;) {
+    pn_bytes_t wbuf = pn_connection_driver_write_buffer(from);
+    pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(to);
+    size_t n = wbuf.size < rbuf.size ? wbuf.size : rbuf.size;
+    if (!n) return moved;
+    memcpy(rbuf.start, wbuf.start, n);
+    pn_connection_driver_read_done(to, n);
+    pn_connection_driver_write_done(from, n);
+    moved = true;
+  }
+}
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <cstring>
+
+/* Copy what fits of a write buffer into a read buffer, returns the bytes copied */
+template <class wbuf_t, class rbuf_t> size_t copy_buffer(wbuf_t wbuf, rbuf_t rbuf) {
+  size_t n = std::min(wbuf.size, rbuf.size);
+  std::memcpy(rbuf.data, wbuf.data, n);
+  return n;
+}
+
+/* Move the bytes written by one proton::io::connection_driver into the other */
+template <class driver> bool pump_drivers(driver &from, driver &to) {
+  bool moved = false;
+  for (;;) {
+    size_t n = copy_buffer(from.write_buffer(), to.read_buffer());
+    if (!n) return moved;
+    to.read_done(n);
+    from.write_done(n);
+    moved = true;
+  }
+}
+
+#endif
+
+#endif // TESTS_PERF_PERF_UTIL_H
@@ -0,0 +1,166 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Count the heap allocations made by proton::sender::send, sending
+ * messages of a few sizes between two in-memory connection_drivers.
+ */
+
+#include "perf_util.h"
+
+#include <proton/connection.hpp>
+#include <proton/connection_options.hpp>
+#include <proton/container.hpp>
+#include <proton/io/connection_driver.hpp>
+#include <proton/message.hpp>
+#include <proton/messaging_handler.hpp>
+#include <proton/receiver.hpp>
+#include <proton/receiver_options.hpp>
+#include <proton/sender.hpp>
+#include <proton/tracker.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <string>
+
+namespace {
+bool counting = false;
+unsigned long allocations = 0;
+}
+
+#ifdef __GLIBC__
+// Hook the malloc family, which also covers operator new and the C library.
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t size) __THROW {
+    if (counting) ++allocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) __THROW {
+    if (counting) ++allocations;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) __THROW {
+    if (counting) ++allocations;
+    return __libc_realloc(p, size);
+}
+}
+#else
+// Only C++ allocations are visible without a malloc hook.
+void *operator new(size_t size) throw(std::bad_alloc) {
+    if (counting) ++allocations;
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) throw() { std::free(p); }
+#endif
+
+namespace {
+
+using proton::io::connection_driver;
+using proton::io::const_buffer;
+using proton::io::mutable_buffer;
+
+// Sends total messages, counting allocations once the first half has filled
+// the delivery pool
+class sender_handler : public proton::messaging_handler {
+  public:
+    proton::message message;
+    int total, warmup, sent;
+
+    sender_handler(int n) : total(n), warmup(n / 2), sent(0) {}
+
+    void on_connection_open(proton::connection &c) PN_CPP_OVERRIDE {
+        c.open_sender("perf");
+    }
+
+    void on_sendable(proton::sender &s) PN_CPP_OVERRIDE {
+        while (s.credit() > 0 && sent < total) {
+            counting = sent++ >= warmup;
+            s.send(message);
+            counting = false;
+        }
+    }
+};
+
+class receiver_handler : public proton::messaging_handler {
+  public:
+    int received;
+
+    receiver_handler() : received(0) {}
+
+    void on_receiver_open(proton::receiver &r) PN_CPP_OVERRIDE {
+        r.open(proton::receiver_options().credit_window(1000));
+    }
+
+    void on_message(proton::delivery &, proton::message &) PN_CPP_OVERRIDE {
+        ++received;
+    }
+};
+
+void run(size_t body_size, int n) {
+    sender_handler sh(n);
+    receiver_handler rh;
+    sh.message.body(std::string(body_size, 'x'));
+    sh.message.address("perf");
+    sh.message.subject("subject");
+    sh.message.properties().put("property", 1);
+
+    // The container is never run, the server side needs one for its defaults
+    proton::container container;
+    connection_driver a(container), b(container);
+    a.connect(proton::connection_options().handler(sh));
+    b.accept(proton::connection_options().handler(rh));
+
+    std::clock_t start = std::clock();
+    while (rh.received < n) {
+        a.dispatch();
+        b.dispatch();
+        if (!pump_drivers(a, b) && !pump_drivers(b, a) && rh.received < n) {
+            std::fprintf(stderr, "stalled after %d messages\n", rh.received);
+            std::exit(1);
+        }
+    }
+    double ns = double(std::clock() - start) * 1e9 / CLOCKS_PER_SEC / n;
+
+    std::printf("%lu\t%d\t%.2f\t%.0f\n", (unsigned long) body_size, n,
+                double(allocations) / (n - sh.warmup), ns);
+    allocations = 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    int scale = (argc > 1) ? std::atoi(argv[1]) : 1;
+    std::printf("body_bytes\tmessages\tallocs_per_send\tns_per_message\n");
+    run(0, 100000 * scale);
+    run(100, 100000 * scale);
+    run(10000, 10000 * scale);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure bulk settlement.
+ *
+ * A receiver holds a large number of unsettled deliveries and accepts
+ * and settles them all at once, in a given order. Reports the number of
+ * disposition frames sent and the time per delivery for the receiver to
+ * produce them and the sender to process them.
+ */
+
+#include "perf_util.h"
+
+#include <proton/delivery.h>
+#include <proton/engine.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum { IN_ORDER, REVERSE, ODD_EVEN, SHUFFLED } order_t;
+static const char *order_names[] = { "in-order", "reverse", "odd-even", "shuffled" };
+
+static void arrange(pn_delivery_t **dlvs, size_t n, order_t order)
+{
+  size_t i;
+  pn_delivery_t **tmp;
+  switch (order) {
+   case IN_ORDER:
+    break;
+   case REVERSE:
+    for (i = 0; i < n/2; ++i) {
+      pn_delivery_t *d = dlvs[i];
+      dlvs[i] = dlvs[n - 1 - i];
+      dlvs[n - 1 - i] = d;
+    }
+    break;
+   case ODD_EVEN:
+    tmp = (pn_delivery_t **) malloc(n * sizeof(pn_delivery_t *));
+    for (i = 0; i < n; ++i) {
+      tmp[(i % 2) ? (n + 1)/2 + i/2 : i/2] = dlvs[i];
+    }
+    memcpy(dlvs, tmp, n * sizeof(pn_delivery_t *));
+    free(tmp);
+    break;
+   case SHUFFLED:
+    srand(1);
+    for (i = n - 1; i > 0; --i) {
+      size_t j = (size_t) rand() % (i + 1);
+      pn_delivery_t *d = dlvs[i];
+      dlvs[i] = dlvs[j];
+      dlvs[j] = d;
+    }
+    break;
+  }
+}
+
+static void settle(size_t n, order_t order)
+{
+  transport_pair_t p;
+  transport_pair_init(&p);
+  pn_connection_t *c1 = p.c1, *c2 = p.c2;
+  pn_transport_t *t1 = p.t1, *t2 = p.t2;
+
+  pn_connection_open(c1);
+  pn_session_t *ssn = pn_session(c1);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "settle");
+  pn_link_open(snd);
+  pump(t1, t2);
+
+  pn_connection_open(c2);
+  pn_session_t *rssn = pn_session_head(c2, 0);
+  pn_session_open(rssn);
+  pn_link_t *rcv = pn_link_head(c2, 0);
+  pn_link_open(rcv);
+  pn_link_flow(rcv, n);
+  pump(t1, t2);
+
+  for (size_t i = 0; i < n; ++i) {
+    pn_delivery(snd, pn_dtag((const char *) &i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+  }
+  pump(t1, t2);
+
+  pn_delivery_t **dlvs = (pn_delivery_t **) malloc(n * sizeof(pn_delivery_t *));
+  size_t received = 0;
+  for (pn_delivery_t *d = pn_link_current(rcv); d; d = pn_link_current(rcv)) {
+    dlvs[received++] = d;
+    pn_link_advance(rcv);
+  }
+  if (received != n) {
+    fprintf(stderr, "received %lu of %lu deliveries\n", (unsigned long) received, (unsigned long) n);
+    exit(1);
+  }
+  arrange(dlvs, n, order);
+
+  uint64_t frames = pn_transport_get_frames_output(t2);
+  clock_t start = clock();
+  for (size_t i = 0; i < n; ++i) {
+    pn_delivery_update(dlvs[i], PN_ACCEPTED);
+    pn_delivery_settle(dlvs[i]);
+  }
+  pump(t1, t2);
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  frames = pn_transport_get_frames_output(t2) - frames;
+
+  size_t settled = 0;
+  for (pn_delivery_t *d = pn_unsettled_head(snd); d; d = pn_unsettled_next(d)) {
+    if (pn_delivery_remote_state(d) == PN_ACCEPTED && pn_delivery_settled(d)) ++settled;
+  }
+  if (settled != n) {
+    fprintf(stderr, "%lu of %lu deliveries settled\n", (unsigned long) settled, (unsigned long) n);
+    exit(1);
+  }
+
+  printf("%s\t%lu\t%lu\t%.0f\n", order_names[order], (unsigned long) n,
+         (unsigned long) frames, secs * 1e9 / n);
+
+  free(dlvs);
+  transport_pair_free(&p);
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = (argc > 1) ? (size_t) atol(argv[1]) : 100000;
+  printf("order\tdeliveries\tframes\tns_per_delivery\n");
+  settle(n, IN_ORDER);
+  settle(n, REVERSE);
+  settle(n, ODD_EVEN);
+  settle(n, SHUFFLED);
+  return 0;
+}
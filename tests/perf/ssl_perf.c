@@ -0,0 +1,250 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure TLS throughput between two pn_connection_driver_t connected
+ * back to back in memory, next to the same run in plain text.
+ *
+ * A sender sends presettled messages on one link as the receiver grants
+ * credit. For each message size the run is made once without and once
+ * with SSL layers on both transports, and each prints one tab separated
+ * line with the message and byte rates, so the cost of the SSL layer is
+ * the difference between the two.
+ *
+ * The server uses the test certificate in the ssl_db directory of the
+ * python tests; the client does not verify it.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "perf_util.h"
+
+#include <proton/connection.h>
+#include <proton/connection_driver.h>
+#include <proton/delivery.h>
+#include <proton/link.h>
+#include <proton/session.h>
+#include <proton/ssl.h>
+#include <proton/transport.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+static uint64_t now_ns(void)
+{
+  LARGE_INTEGER count, frequency;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)((double) count.QuadPart * 1e9 / (double) frequency.QuadPart);
+}
+#else
+#include <time.h>
+
+static uint64_t now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+#endif
+
+#define CREDIT 100
+
+typedef struct {
+  size_t size;
+  size_t messages;
+  size_t sent;
+  size_t received;
+  char *body;
+  char *scratch;
+} run_t;
+
+static void fail(const char *msg)
+{
+  fprintf(stderr, "%s\n", msg);
+  exit(1);
+}
+
+static void check_error(pn_event_t *e, const char *msg)
+{
+  pn_condition_t *cond = pn_transport_condition(pn_event_transport(e));
+  fprintf(stderr, "%s: %s: %s\n", msg,
+          pn_condition_get_name(cond), pn_condition_get_description(cond));
+  exit(1);
+}
+
+static void sender_event(run_t *r, pn_event_t *e)
+{
+  switch (pn_event_type(e)) {
+   case PN_LINK_FLOW: {
+     pn_link_t *link = pn_event_link(e);
+     while (pn_link_credit(link) > 0 && r->sent < r->messages) {
+       uint64_t seq = r->sent++;
+       pn_delivery_t *d = pn_delivery(link, pn_dtag((const char *) &seq, sizeof(seq)));
+       pn_link_send(link, r->body, r->size);
+       pn_link_advance(link);
+       pn_delivery_settle(d);
+     }
+     break;
+   }
+
+   case PN_TRANSPORT_ERROR:
+    check_error(e, "sender transport error");
+    break;
+
+   default:
+    break;
+  }
+}
+
+static void receiver_event(run_t *r, pn_event_t *e)
+{
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_open(pn_event_connection(e));
+    break;
+
+   case PN_SESSION_REMOTE_OPEN:
+    pn_session_open(pn_event_session(e));
+    break;
+
+   case PN_LINK_REMOTE_OPEN: {
+     pn_link_t *link = pn_event_link(e);
+     pn_link_open(link);
+     pn_link_flow(link, CREDIT);
+     break;
+   }
+
+   case PN_DELIVERY: {
+     pn_delivery_t *d = pn_event_delivery(e);
+     if (!pn_delivery_readable(d) || pn_delivery_partial(d)) break;
+     pn_link_t *link = pn_delivery_link(d);
+     if (pn_link_recv(link, r->scratch, r->size) != (ssize_t) r->size) {
+       fail("short message");
+     }
+     r->received++;
+     pn_link_advance(link);
+     pn_delivery_settle(d);
+     int credit = pn_link_credit(link);
+     if (credit <= CREDIT / 2) pn_link_flow(link, CREDIT - credit);
+     break;
+   }
+
+   case PN_TRANSPORT_ERROR:
+    check_error(e, "receiver transport error");
+    break;
+
+   default:
+    break;
+  }
+}
+
+static void run(size_t size, size_t messages, pn_ssl_domain_t *client, pn_ssl_domain_t *server)
+{
+  run_t r;
+  memset(&r, 0, sizeof(r));
+  r.size = size;
+  r.messages = messages;
+  r.body = (char *) calloc(size, 1);
+  r.scratch = (char *) malloc(size);
+
+  pn_connection_driver_t a, b;
+  pn_connection_driver_init(&a, NULL, NULL);
+  pn_connection_driver_init(&b, NULL, NULL);
+  pn_transport_set_server(b.transport);
+  if (client && server) {
+    if (pn_ssl_init(pn_ssl(a.transport), client, NULL) ||
+        pn_ssl_init(pn_ssl(b.transport), server, NULL)) {
+      fail("cannot set up SSL");
+    }
+  }
+
+  pn_connection_open(a.connection);
+  pn_session_t *ssn = pn_session(a.connection);
+  pn_session_open(ssn);
+  pn_link_t *link = pn_sender(ssn, "link");
+  pn_link_set_snd_settle_mode(link, PN_SND_SETTLED);
+  pn_link_open(link);
+
+  uint64_t start = now_ns();
+  while (r.received < messages) {
+    bool work = false;
+    pn_event_t *e;
+    while ((e = pn_connection_driver_next_event(&a))) {
+      sender_event(&r, e);
+      work = true;
+    }
+    while ((e = pn_connection_driver_next_event(&b))) {
+      receiver_event(&r, e);
+      work = true;
+    }
+    if (pump_drivers(&a, &b)) work = true;
+    if (pump_drivers(&b, &a)) work = true;
+    if (!work) fail("stalled");
+  }
+  double secs = (double)(now_ns() - start) / 1e9;
+
+  printf("%lu\t%s\t%lu\t%.0f\t%.1f\n",
+         (unsigned long) size, client ? "tls" : "plain", (unsigned long) messages,
+         messages / secs, (double) messages * size / secs / 1e6);
+  fflush(stdout);
+
+  pn_connection_driver_destroy(&a);
+  pn_connection_driver_destroy(&b);
+  free(r.body);
+  free(r.scratch);
+}
+
+int main(int argc, char **argv)
+{
+  static const size_t sizes[] = { 16, 1024, 16384, 65536, 1048576 };
+  size_t messages = (argc > 1) ? (size_t) atol(argv[1]) : 20000;
+  const char *ssl_db = (argc > 2) ? argv[2] : SSL_DB;
+
+  char certificate[1024], key[1024];
+  snprintf(certificate, sizeof(certificate), "%s/server-certificate.pem", ssl_db);
+  snprintf(key, sizeof(key), "%s/server-private-key.pem", ssl_db);
+  pn_ssl_domain_t *client = pn_ssl_domain(PN_SSL_MODE_CLIENT);
+  pn_ssl_domain_t *server = pn_ssl_domain(PN_SSL_MODE_SERVER);
+  if (!client || !server) fail("SSL is not available");
+  if (pn_ssl_domain_set_credentials(server, certificate, key, "server-password")) {
+    fail("cannot load the server certificate");
+  }
+
+  printf("size\ttransport\tmessages\tmsgs_per_sec\tmbytes_per_sec\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    // keep each run to roughly the same number of bytes for large messages
+    size_t n = messages;
+    if (sizes[s] > 16384) n = messages * 16384 / sizes[s];
+    if (!n) n = 1;
+    run(sizes[s], n, NULL, NULL);
+    run(sizes[s], n, client, server);
+  }
+  pn_ssl_domain_free(client);
+  pn_ssl_domain_free(server);
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Measure scheduling and cancelling timer tasks.
+ *
+ * bulk: schedules n tasks with deadlines up to a minute away, then
+ * cancels them all.
+ *
+ * rolling: simulates idle timers that are mostly reset before they
+ * expire. Each millisecond one task is scheduled between 5 and 60
+ * seconds ahead and the one scheduled 10 seconds earlier is cancelled,
+ * then the timer is ticked and its next deadline read, as the reactor
+ * does. Tasks that expire are delivered as events and discarded.
+ *
+ * Reports the time per task, and the tasks left in the timer and the
+ * events delivered at the end.
+ */
+
+#include <proton/event.h>
+#include <proton/object.h>
+#include <proton/reactor.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint64_t drain(pn_collector_t *collector)
+{
+  uint64_t events = 0;
+  while (pn_collector_peek(collector)) {
+    pn_collector_pop(collector);
+    events++;
+  }
+  return events;
+}
+
+// The count of tasks left is part of the time, it may have to discard
+// cancelled tasks
+static void report(const char *name, size_t n, clock_t start, pn_timer_t *timer, uint64_t events)
+{
+  int left = pn_timer_tasks(timer);
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%s\t%lu\t%.0f\t%d\t%lu\n", name, (unsigned long) n, secs * 1e9 / n,
+         left, (unsigned long) events);
+}
+
+static void bulk(size_t n)
+{
+  pn_collector_t *collector = pn_collector();
+  pn_timer_t *timer = pn_timer(collector);
+  pn_task_t **tasks = (pn_task_t **) malloc(n * sizeof(pn_task_t *));
+  pn_timestamp_t now = 1000000;
+  srand(1);
+
+  clock_t start = clock();
+  for (size_t i = 0; i < n; ++i) {
+    tasks[i] = pn_timer_schedule(timer, now + rand() % 60000);
+    pn_incref(tasks[i]);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    pn_task_cancel(tasks[i]);
+    pn_decref(tasks[i]);
+  }
+  pn_timer_tick(timer, now);
+  report("bulk", n, start, timer, drain(collector));
+
+  free(tasks);
+  pn_free(timer);
+  pn_free(collector);
+}
+
+#define WINDOW 10000
+
+static void rolling(size_t n)
+{
+  pn_collector_t *collector = pn_collector();
+  pn_timer_t *timer = pn_timer(collector);
+  pn_task_t *tasks[WINDOW] = {NULL};
+  pn_timestamp_t now = 1000000;
+  uint64_t events = 0;
+  srand(1);
+
+  clock_t start = clock();
+  for (size_t i = 0; i < n; ++i, ++now) {
+    pn_task_t **slot = &tasks[i % WINDOW];
+    if (*slot) {
+      pn_task_cancel(*slot);
+      pn_decref(*slot);
+    }
+    *slot = pn_timer_schedule(timer, now + 5000 + rand() % 55000);
+    pn_incref(*slot);
+    pn_timer_tick(timer, now);
+    pn_timer_deadline(timer);
+    events += drain(collector);
+  }
+  report("rolling", n, start, timer, events);
+
+  for (size_t i = 0; i < WINDOW; ++i) pn_decref(tasks[i]);
+  pn_free(timer);
+  pn_free(collector);
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = (argc > 1) ? (size_t) atol(argv[1]) : 1000000;
+  printf("test\ttasks\tns_per_task\ttasks_left\tevents\n");
+  bulk(n);
+  rolling(n);
+  return 0;
+}